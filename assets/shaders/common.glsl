@@ -0,0 +1,10 @@
+#pragma once
+
+// transform = (x offset, y offset, rotation in radians, uniform scale)
+vec2 ApplyTransform2D(vec2 p, vec4 transform)
+{
+    float s = sin(transform.z);
+    float c = cos(transform.z);
+    p *= transform.w;
+    return vec2(p.x * c - p.y * s, p.x * s + p.y * c) + transform.xy;
+}
@@ -0,0 +1,21 @@
+#version 430 core
+#include "objects.glsl"
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in vec2 aTexCoord;
+// per instance, from the draw command's base instance
+layout (location = 3) in uint aObject;
+
+// shader.vs with the model matrix read from the objects buffer
+uniform mat4 viewProjection;
+
+out vec3 ourColor;
+out vec2 TexCoord;
+
+void main()
+{
+    gl_Position = viewProjection * objects[aObject].model * vec4(aPos, 1.0);
+    ourColor = aColor;
+    TexCoord = aTexCoord;
+}
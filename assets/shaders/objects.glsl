@@ -0,0 +1,18 @@
+#pragma once
+
+// one object as IndirectRenderer stores it, see MeshObject
+struct Object
+{
+    mat4 model;
+    // world space bounding sphere: center and radius
+    vec4 sphere;
+    uint mesh;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+layout (std430, binding = 0) readonly buffer Objects
+{
+    Object objects[];
+};
@@ -8,5 +8,12 @@ uniform sampler2D ourTexture;
 
 void main()
 {
-    FragColor = texture(ourTexture, TexCoord);
-}
\ No newline at end of file
+    vec4 color = vec4(1.0);
+#ifdef USE_TEXTURE
+    color *= texture(ourTexture, TexCoord);
+#endif
+#ifdef USE_VERTEX_COLOR
+    color.rgb *= ourColor;
+#endif
+    FragColor = color;
+}
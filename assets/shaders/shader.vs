@@ -4,12 +4,16 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord;
 
+// world matrix from the transform hierarchy, camera from the render queue
+uniform mat4 model;
+uniform mat4 viewProjection;
+
 out vec3 ourColor;
 out vec2 TexCoord;
 
 void main()
 {
-    gl_Position = vec4(aPos, 1.0);
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
     ourColor = aColor;
     TexCoord = aTexCoord;
-}
\ No newline at end of file
+}
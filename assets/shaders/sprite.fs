@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 TexCoord;
+in vec4 Tint;
+
+uniform sampler2DArray sprites;
+
+void main()
+{
+    FragColor = texture(sprites, TexCoord) * Tint;
+}
@@ -0,0 +1,23 @@
+#version 330 core
+#include "common.glsl"
+
+layout (location = 0) in vec2 aCorner;
+// per instance
+layout (location = 1) in vec4 aRect;
+layout (location = 2) in vec4 aUvRect;
+layout (location = 3) in vec2 aRotationLayer;
+layout (location = 4) in vec4 aTint;
+
+// pixels to clip space: xy scale, zw offset
+uniform vec4 view;
+
+out vec3 TexCoord;
+out vec4 Tint;
+
+void main()
+{
+    vec2 p = ApplyTransform2D(aCorner * aRect.zw, vec4(aRect.xy, aRotationLayer.x, 1.0));
+    gl_Position = vec4(p * view.xy + view.zw, 0.0, 1.0);
+    TexCoord = vec3(mix(aUvRect.xy, aUvRect.zw, aCorner + 0.5), aRotationLayer.y);
+    Tint = aTint;
+}
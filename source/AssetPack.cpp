@@ -0,0 +1,520 @@
+#include "AssetPack.h"
+#include "Hash.h"
+#include "JobSystem.h"
+#include "LZCodec.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const char MAGIC[4] = { 'S', 'P', 'A', 'K' };
+	const uint32_t VERSION = 2;
+	// set in a chunk's size when it didn't compress and is stored as it is
+	const uint32_t RAW_CHUNK = 0x80000000u;
+
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t alignment;
+		uint64_t tocOffset;
+		uint64_t namesOffset;
+		uint64_t namesSize;
+	};
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	bool NeedsNormalizing(std::string_view name)
+	{
+		return name.find("./") != std::string_view::npos || name.find('\\') != std::string_view::npos;
+	}
+}
+
+struct AssetPack::Entry
+{
+	uint64_t hash;
+	uint64_t offset;
+	// bytes in the pack, then bytes once decompressed. the same when chunkBytes is 0
+	uint64_t storedSize;
+	uint64_t size;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	// compressed files start with chunkCount uint32 chunk sizes, followed by the chunks
+	uint32_t chunkBytes;
+	uint32_t chunkCount;
+};
+
+AssetPack::AssetPack()
+	: base(nullptr), mappedSize(0), table(nullptr), names(nullptr), entryCount(0)
+#ifdef _WIN32
+	, fileHandle(nullptr), mappingHandle(nullptr)
+#endif
+{
+}
+
+AssetPack::~AssetPack()
+{
+	close();
+}
+
+bool AssetPack::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(Header))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	mappingHandle = mapping;
+	base = static_cast<const std::byte*>(view);
+	mappedSize = (size_t)size.QuadPart;
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size < (off_t)sizeof(Header))
+	{
+		::close(file);
+		return false;
+	}
+	void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	// the mapping keeps its own reference to the file
+	::close(file);
+	if (view == MAP_FAILED)
+		return false;
+	base = static_cast<const std::byte*>(view);
+	mappedSize = (size_t)status.st_size;
+#endif
+
+	Header header;
+	std::memcpy(&header, base, sizeof(header));
+	// every range is checked as offset, then size against what is left after it, so
+	// corrupt values can't wrap around. entries are read as uint32 chunk size tables in
+	// place, which needs them aligned
+	bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+		header.alignment != 0 && header.alignment % alignof(uint32_t) == 0 && header.tocOffset % alignof(Entry) == 0 &&
+		header.tocOffset <= mappedSize && (uint64_t)header.entryCount * sizeof(Entry) <= mappedSize - header.tocOffset &&
+		header.namesOffset <= mappedSize && header.namesSize <= mappedSize - header.namesOffset;
+
+	entryCount = valid ? header.entryCount : 0;
+	table = valid ? reinterpret_cast<const Entry*>(base + header.tocOffset) : nullptr;
+	names = valid ? reinterpret_cast<const char*>(base + header.namesOffset) : nullptr;
+	for (size_t i = 0; valid && i < entryCount; ++i)
+	{
+		const Entry& entry = table[i];
+		valid = entry.offset % header.alignment == 0 &&
+			entry.offset <= mappedSize && entry.storedSize <= mappedSize - entry.offset &&
+			(uint64_t)entry.nameOffset + entry.nameLength <= header.namesSize &&
+			(i == 0 || table[i - 1].hash <= entry.hash);
+		if (entry.chunkBytes == 0)
+			valid = valid && entry.storedSize == entry.size;
+		else
+			valid = valid && entry.chunkBytes < RAW_CHUNK &&
+				entry.chunkCount == entry.size / entry.chunkBytes + (entry.size % entry.chunkBytes != 0) &&
+				(uint64_t)entry.chunkCount * sizeof(uint32_t) <= entry.storedSize;
+	}
+	if (!valid)
+	{
+		std::cout << "ERROR::ASSET_PACK::MALFORMED " << path << std::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void AssetPack::close()
+{
+	if (base)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(base);
+		CloseHandle((HANDLE)mappingHandle);
+		CloseHandle((HANDLE)fileHandle);
+		mappingHandle = nullptr;
+		fileHandle = nullptr;
+#else
+		munmap(const_cast<std::byte*>(base), mappedSize);
+#endif
+	}
+	base = nullptr;
+	mappedSize = 0;
+	table = nullptr;
+	names = nullptr;
+	entryCount = 0;
+}
+
+std::string_view AssetPack::name(size_t index) const
+{
+	const Entry& entry = table[index];
+	return std::string_view(names + entry.nameOffset, entry.nameLength);
+}
+
+std::span<const std::byte> AssetPack::file(size_t index) const
+{
+	const Entry& entry = table[index];
+	return std::span<const std::byte>(base + entry.offset, (size_t)entry.storedSize);
+}
+
+size_t AssetPack::size(size_t index) const
+{
+	return (size_t)table[index].size;
+}
+
+bool AssetPack::compressed(size_t index) const
+{
+	return table[index].chunkBytes != 0;
+}
+
+size_t AssetPack::lookup(std::string_view name) const
+{
+	if (!base)
+		return NOT_FOUND;
+
+	std::string normalized;
+	if (NeedsNormalizing(name))
+	{
+		normalized = NormalizeName(name);
+		name = normalized;
+	}
+
+	// binary search to the first entry with the hash, then compare names past collisions
+	uint64_t hash = HashBytes64(name.data(), name.size());
+	const Entry* first = std::lower_bound(table, table + entryCount, hash,
+		[](const Entry& entry, uint64_t value) { return entry.hash < value; });
+	for (const Entry* entry = first; entry != table + entryCount && entry->hash == hash; ++entry)
+	{
+		if (this->name((size_t)(entry - table)) == name)
+			return (size_t)(entry - table);
+	}
+	return NOT_FOUND;
+}
+
+std::span<const std::byte> AssetPack::find(std::string_view name) const
+{
+	size_t index = lookup(name);
+	if (index == NOT_FOUND || compressed(index))
+		return {};
+	return file(index);
+}
+
+bool AssetPack::contains(std::string_view name) const
+{
+	return lookup(name) != NOT_FOUND;
+}
+
+// starts holds where each chunk begins relative to the end of the size table, plus one
+// past the last
+bool AssetPack::decodeChunks(const Entry& entry, size_t begin, size_t end, const uint64_t* starts, std::byte* destination) const
+{
+	const uint32_t* sizes = reinterpret_cast<const uint32_t*>(base + entry.offset);
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(sizes + entry.chunkCount);
+	for (size_t chunk = begin; chunk < end; ++chunk)
+	{
+		uint64_t first = (uint64_t)chunk * entry.chunkBytes;
+		size_t bytes = (size_t)std::min<uint64_t>(entry.chunkBytes, entry.size - first);
+		size_t stored = (size_t)(starts[chunk + 1] - starts[chunk]);
+		uint8_t* output = reinterpret_cast<uint8_t*>(destination + first);
+		if (sizes[chunk] & RAW_CHUNK)
+		{
+			if (stored != bytes)
+				return false;
+			std::memcpy(output, data + starts[chunk], bytes);
+		}
+		else if (!LZ::Decompress(data + starts[chunk], stored, output, bytes))
+			return false;
+	}
+	return true;
+}
+
+bool AssetPack::read(size_t index, std::byte* destination, JobSystem* jobs) const
+{
+	const Entry& entry = table[index];
+	if (entry.chunkBytes == 0)
+	{
+		if (entry.size)
+			std::memcpy(destination, base + entry.offset, (size_t)entry.size);
+		return true;
+	}
+
+	// chunks only record their own size, so sum them up front to let each decode alone
+	const uint32_t* sizes = reinterpret_cast<const uint32_t*>(base + entry.offset);
+	std::vector<uint64_t> starts(entry.chunkCount + 1, 0);
+	for (uint32_t i = 0; i < entry.chunkCount; ++i)
+		starts[i + 1] = starts[i] + (sizes[i] & ~RAW_CHUNK);
+	if (starts.back() + entry.chunkCount * sizeof(uint32_t) > entry.storedSize)
+	{
+		std::cout << "ERROR::ASSET_PACK::CORRUPT_CHUNKS " << name(index) << std::endl;
+		return false;
+	}
+
+	bool valid = true;
+	if (jobs && entry.chunkCount > 1)
+	{
+		std::atomic<bool> failed{ false };
+		jobs->parallelFor(entry.chunkCount, 1, [&](unsigned int begin, unsigned int end)
+		{
+			if (!decodeChunks(entry, begin, end, starts.data(), destination))
+				failed.store(true, std::memory_order_relaxed);
+		});
+		valid = !failed.load();
+	}
+	else
+		valid = decodeChunks(entry, 0, entry.chunkCount, starts.data(), destination);
+
+	if (!valid)
+		std::cout << "ERROR::ASSET_PACK::CORRUPT_CHUNKS " << name(index) << std::endl;
+	return valid;
+}
+
+size_t AssetPack::headSize(size_t index) const
+{
+	const Entry& entry = table[index];
+	return (size_t)(entry.chunkBytes ? std::min<uint64_t>(entry.chunkBytes, entry.size) : entry.size);
+}
+
+bool AssetPack::readHead(size_t index, std::byte* destination) const
+{
+	const Entry& entry = table[index];
+	if (entry.chunkBytes == 0 || entry.chunkCount == 0)
+		return read(index, destination);
+
+	const uint32_t* sizes = reinterpret_cast<const uint32_t*>(base + entry.offset);
+	uint64_t starts[2] = { 0, sizes[0] & ~RAW_CHUNK };
+	if (starts[1] + entry.chunkCount * sizeof(uint32_t) > entry.storedSize)
+		return false;
+	return decodeChunks(entry, 0, 1, starts, destination);
+}
+
+std::string AssetPack::NormalizeName(std::string_view path)
+{
+	// shader includes come out as "dir/../common.glsl", so fold those too
+	std::string name(path);
+	std::replace(name.begin(), name.end(), '\\', '/');
+	return std::filesystem::path(name).lexically_normal().generic_string();
+}
+
+bool AssetPack::Write(const std::string& path, const std::vector<std::string>& files, uint32_t chunkBytes, JobSystem* jobs)
+{
+	struct Source
+	{
+		std::string name;
+		std::string path;
+		Entry entry;
+	};
+
+	std::vector<Source> sources;
+	sources.reserve(files.size());
+	for (const std::string& file : files)
+	{
+		std::error_code error;
+		uint64_t size = std::filesystem::file_size(file, error);
+		if (error)
+		{
+			std::cout << "ERROR::ASSET_PACK::FILE_NOT_FOUND " << file << std::endl;
+			return false;
+		}
+		Source source;
+		source.name = NormalizeName(file);
+		source.path = file;
+		source.entry = {};
+		source.entry.hash = HashBytes64(source.name.data(), source.name.size());
+		source.entry.size = size;
+		source.entry.storedSize = size;
+		sources.push_back(std::move(source));
+	}
+
+	std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b)
+	{
+		return a.entry.hash != b.entry.hash ? a.entry.hash < b.entry.hash : a.name < b.name;
+	});
+	for (size_t i = 1; i < sources.size(); ++i)
+	{
+		if (sources[i].name == sources[i - 1].name)
+		{
+			std::cout << "ERROR::ASSET_PACK::DUPLICATE_NAME " << sources[i].name << std::endl;
+			return false;
+		}
+	}
+
+	Header header = {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.entryCount = (uint32_t)sources.size();
+	header.alignment = ALIGNMENT;
+	header.tocOffset = AlignUp(sizeof(Header), alignof(Entry));
+	header.namesOffset = header.tocOffset + sources.size() * sizeof(Entry);
+
+	std::string nameBlock;
+	for (Source& source : sources)
+	{
+		source.entry.nameOffset = (uint32_t)nameBlock.size();
+		source.entry.nameLength = (uint32_t)source.name.size();
+		nameBlock += source.name;
+	}
+	header.namesSize = nameBlock.size();
+	if (chunkBytes >= RAW_CHUNK)
+		return false;
+
+	std::filesystem::path target(path);
+	std::error_code error;
+	if (target.has_parent_path())
+		std::filesystem::create_directories(target.parent_path(), error);
+
+	// written next to the target and renamed, so a running engine never maps half a pack
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+		if (!output)
+			return false;
+
+		// compressed sizes aren't known up front: leave room for the table, write the data,
+		// then come back and fill the table in
+		const char zeros[ALIGNMENT] = {};
+		uint64_t written = 0;
+		uint64_t dataOffset = AlignUp(header.namesOffset + header.namesSize, ALIGNMENT);
+		while (written < dataOffset)
+		{
+			uint64_t padding = std::min<uint64_t>(dataOffset - written, sizeof(zeros));
+			output.write(zeros, (std::streamsize)padding);
+			written += padding;
+		}
+
+		std::vector<char> buffer(chunkBytes ? 0 : 1 << 20);
+		std::vector<unsigned char> contents;
+		std::vector<unsigned char> packed;
+		std::vector<uint32_t> chunkSizes;
+		for (Source& source : sources)
+		{
+			Entry& entry = source.entry;
+			entry.offset = AlignUp(written, ALIGNMENT);
+			output.write(zeros, (std::streamsize)(entry.offset - written));
+			written = entry.offset;
+
+			std::ifstream input(source.path, std::ios::binary);
+			bool complete = (bool)input;
+			if (chunkBytes == 0)
+			{
+				uint64_t remaining = entry.size;
+				while (input && remaining > 0)
+				{
+					std::streamsize chunk = (std::streamsize)std::min<uint64_t>(remaining, buffer.size());
+					input.read(buffer.data(), chunk);
+					output.write(buffer.data(), input.gcount());
+					remaining -= (uint64_t)input.gcount();
+				}
+				complete = remaining == 0;
+			}
+			else
+			{
+				contents.resize((size_t)entry.size);
+				if (entry.size > 0)
+					complete = complete && input.read((char*)contents.data(), (std::streamsize)entry.size);
+
+				// every chunk gets a worst case slot so they can all compress at once
+				uint32_t chunkCount = (uint32_t)((entry.size + chunkBytes - 1) / chunkBytes);
+				size_t slot = LZ::Bound(chunkBytes);
+				packed.resize(chunkCount * slot);
+				chunkSizes.assign(chunkCount, 0);
+				auto compress = [&](unsigned int begin, unsigned int end)
+				{
+					for (unsigned int i = begin; i < end; ++i)
+					{
+						size_t first = (size_t)i * chunkBytes;
+						size_t bytes = std::min<size_t>(chunkBytes, contents.size() - first);
+						size_t packedBytes = LZ::Compress(contents.data() + first, bytes, packed.data() + i * slot, slot);
+						if (packedBytes == 0 || packedBytes >= bytes)
+						{
+							std::memcpy(packed.data() + i * slot, contents.data() + first, bytes);
+							chunkSizes[i] = (uint32_t)bytes | RAW_CHUNK;
+						}
+						else
+							chunkSizes[i] = (uint32_t)packedBytes;
+					}
+				};
+				if (jobs)
+					jobs->parallelFor(chunkCount, 1, compress);
+				else
+					compress(0, chunkCount);
+
+				uint64_t stored = chunkCount * sizeof(uint32_t);
+				for (uint32_t size : chunkSizes)
+					stored += size & ~RAW_CHUNK;
+
+				// not worth a decode pass for less than a sixteenth saved
+				if (complete && chunkCount > 0 && stored < entry.size - entry.size / 16)
+				{
+					entry.chunkBytes = chunkBytes;
+					entry.chunkCount = chunkCount;
+					entry.storedSize = stored;
+					output.write((const char*)chunkSizes.data(), (std::streamsize)(chunkCount * sizeof(uint32_t)));
+					for (uint32_t i = 0; i < chunkCount; ++i)
+						output.write((const char*)packed.data() + i * slot, (std::streamsize)(chunkSizes[i] & ~RAW_CHUNK));
+				}
+				else
+					output.write((const char*)contents.data(), (std::streamsize)contents.size());
+			}
+			if (!complete)
+			{
+				std::cout << "ERROR::ASSET_PACK::READ_FAILED " << source.path << std::endl;
+				output.close();
+				std::remove(temporary.c_str());
+				return false;
+			}
+			written = entry.offset + entry.storedSize;
+		}
+
+		output.seekp(0);
+		output.write((const char*)&header, sizeof(header));
+		output.write(zeros, (std::streamsize)(header.tocOffset - sizeof(header)));
+		for (const Source& source : sources)
+			output.write((const char*)&source.entry, sizeof(Entry));
+		output.write(nameBlock.data(), (std::streamsize)nameBlock.size());
+		if (!output)
+			return false;
+	}
+
+	std::filesystem::rename(temporary, target, error);
+	if (error)
+	{
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class JobSystem;
+
+// read-only archive of asset files, mapped into memory once and never copied out of.
+// the file is a header, a table of contents sorted by name hash, the names, and then
+// every blob on its own ALIGNMENT boundary, so views can be handed straight to parsers
+// and GL uploads. names are relative paths with forward slashes ("assets/shaders/shader.vs");
+// lookups accept "./", "..", and backslashes and normalize them the same way.
+// files may also be stored compressed (see LZCodec.h) in independent chunks behind a table
+// of their compressed sizes. those have no view; read() decodes the chunks in parallel
+// straight into the caller's memory, which can be a mapped staging buffer
+// ---------------------------------------------------------------------------------------
+class AssetPack
+{
+public:
+	static const uint32_t ALIGNMENT = 64;
+	static const size_t NOT_FOUND = ~(size_t)0;
+	// small enough that even one texture spreads over every worker, big enough that
+	// matches find their way back across most of a chunk
+	static const uint32_t DEFAULT_CHUNK_BYTES = 128 * 1024;
+
+	AssetPack();
+	~AssetPack();
+
+	AssetPack(const AssetPack&) = delete;
+	AssetPack& operator=(const AssetPack&) = delete;
+
+	// map the pack, false (and nothing mapped) if it is missing or malformed
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return base != nullptr; }
+
+	// index of the file, NOT_FOUND if the pack doesn't hold it
+	size_t lookup(std::string_view name) const;
+
+	// empty span when the pack doesn't hold that file or holds it compressed.
+	// views stay valid until close()
+	std::span<const std::byte> find(std::string_view name) const;
+
+	bool contains(std::string_view name) const;
+
+	size_t fileCount() const { return entryCount; }
+
+	size_t mappedBytes() const { return mappedSize; }
+
+	// name of the i-th entry in table order
+	std::string_view name(size_t index) const;
+
+	// the file as stored, compressed or not
+	std::span<const std::byte> file(size_t index) const;
+
+	// bytes of the file once decompressed
+	size_t size(size_t index) const;
+
+	bool compressed(size_t index) const;
+
+	// decompress (or copy) the whole file into destination, which must hold size(index) bytes.
+	// with a job system the chunks are spread over its workers. false if the data is corrupt
+	bool read(size_t index, std::byte* destination, JobSystem* jobs = nullptr) const;
+
+	// bytes readHead() produces: the first chunk, or the whole file when stored raw
+	size_t headSize(size_t index) const;
+
+	// decode just the start of the file, enough to parse a header without paying for the
+	// rest. destination holds headSize(index) bytes
+	bool readHead(size_t index, std::byte* destination) const;
+
+	// write a pack holding the given files under their normalized names, false on any
+	// read or write failure. files are read in one at a time, never all held at once.
+	// chunkBytes 0 stores everything raw, otherwise each file is compressed in chunks of
+	// that size (on the job system's workers if given) and kept raw if that barely helps
+	static bool Write(const std::string& path, const std::vector<std::string>& files,
+		uint32_t chunkBytes = 0, JobSystem* jobs = nullptr);
+
+	static std::string NormalizeName(std::string_view path);
+private:
+	struct Entry;
+
+	bool decodeChunks(const Entry& entry, size_t begin, size_t end, const uint64_t* starts, std::byte* destination) const;
+
+	const std::byte* base;
+	size_t mappedSize;
+	// both point into the mapping
+	const Entry* table;
+	const char* names;
+	size_t entryCount;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
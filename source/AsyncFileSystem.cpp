@@ -0,0 +1,677 @@
+#include "AsyncFileSystem.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace
+{
+	// blocking reads go in pieces so a cancel doesn't wait for the whole file
+	const size_t READ_PIECE_BYTES = 1 << 20;
+
+	// user_data of completions that aren't reads
+	const uint64_t WAKE_TAG = ~0ull;
+	const uint64_t CANCEL_TAG = 1ull << 62;
+	// descriptors the I/O thread keeps open between requests, streaming reads the same few
+	// files over and over
+	const size_t MAX_OPEN_FILES = 64;
+
+	// read until size bytes, the end of the file, an error or cancellation
+	AsyncFileSystem::Result ReadAt(const std::string& path, uint64_t offset, unsigned char* destination, size_t size,
+		const std::atomic<bool>& cancelled, size_t& bytes)
+	{
+		bytes = 0;
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return AsyncFileSystem::Result::Failed;
+#else
+		int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file < 0)
+			return AsyncFileSystem::Result::Failed;
+#endif
+
+		AsyncFileSystem::Result result = AsyncFileSystem::Result::Done;
+		while (bytes < size)
+		{
+			if (cancelled.load(std::memory_order_relaxed))
+			{
+				result = AsyncFileSystem::Result::Cancelled;
+				break;
+			}
+			size_t piece = std::min(size - bytes, READ_PIECE_BYTES);
+			uint64_t position = offset + bytes;
+#ifdef _WIN32
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = (DWORD)position;
+			overlapped.OffsetHigh = (DWORD)(position >> 32);
+			DWORD count = 0;
+			if (!ReadFile(file, destination + bytes, (DWORD)piece, &count, &overlapped))
+			{
+				if (GetLastError() != ERROR_HANDLE_EOF)
+					result = AsyncFileSystem::Result::Failed;
+				break;
+			}
+#else
+			ssize_t count = pread(file, destination + bytes, piece, (off_t)position);
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count < 0)
+			{
+				result = AsyncFileSystem::Result::Failed;
+				break;
+			}
+#endif
+			if (count == 0)
+				break;
+			bytes += (size_t)count;
+		}
+
+#ifdef _WIN32
+		CloseHandle(file);
+#else
+		::close(file);
+#endif
+		return result;
+	}
+}
+
+#ifdef __linux__
+// the submission and completion queues shared with the kernel, mapped the way
+// io_uring_setup(2) lays them out. only the I/O thread touches them
+// ---------------------------------------------------------------------------------------
+struct AsyncFileSystem::Ring
+{
+	int fd = -1;
+	// an eventfd with a read always pending in the ring, so wake() ends a wait for completions
+	int wakeFile = -1;
+	uint64_t wakeValue = 0;
+	iovec wakeVector = {};
+	// one per slot, the kernel reads them when the request is submitted
+	std::vector<iovec> vectors;
+
+	void* sqMap = nullptr;
+	size_t sqMapBytes = 0;
+	void* cqMap = nullptr;
+	size_t cqMapBytes = 0;
+	io_uring_sqe* sqes = nullptr;
+	size_t sqeBytes = 0;
+
+	unsigned* sqHead = nullptr;
+	unsigned* sqTail = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned sqMask = 0;
+	unsigned sqEntries = 0;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	io_uring_cqe* cqes = nullptr;
+	unsigned cqMask = 0;
+
+	// entries filled in since the last submit
+	unsigned tail = 0;
+	unsigned toSubmit = 0;
+
+	bool create(unsigned int entries)
+	{
+		io_uring_params params = {};
+		fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+		if (fd < 0)
+			return false;
+
+		sqMapBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cqMapBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single)
+			sqMapBytes = cqMapBytes = std::max(sqMapBytes, cqMapBytes);
+
+		sqMap = mmap(nullptr, sqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sqMap == MAP_FAILED)
+		{
+			sqMap = nullptr;
+			return false;
+		}
+		cqMap = single ? sqMap : mmap(nullptr, cqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cqMap == MAP_FAILED)
+		{
+			cqMap = nullptr;
+			return false;
+		}
+		sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+		void* sqeMap = mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		if (sqeMap == MAP_FAILED)
+			return false;
+		sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+		char* sq = static_cast<char*>(sqMap);
+		sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sqEntries = params.sq_entries;
+		char* cq = static_cast<char*>(cqMap);
+		cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		tail = *sqTail;
+
+		wakeFile = eventfd(0, EFD_CLOEXEC);
+		return wakeFile >= 0;
+	}
+
+	void destroy()
+	{
+		if (sqes)
+			munmap(sqes, sqeBytes);
+		if (cqMap && cqMap != sqMap)
+			munmap(cqMap, cqMapBytes);
+		if (sqMap)
+			munmap(sqMap, sqMapBytes);
+		if (wakeFile >= 0)
+			::close(wakeFile);
+		if (fd >= 0)
+			::close(fd);
+		*this = Ring();
+	}
+
+	// a cleared entry, or nullptr when the queue is full until the next submit
+	io_uring_sqe* next()
+	{
+		unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+		if (tail - head >= sqEntries)
+			return nullptr;
+		unsigned index = tail & sqMask;
+		io_uring_sqe* sqe = &sqes[index];
+		std::memset(sqe, 0, sizeof(*sqe));
+		sqArray[index] = index;
+		++tail;
+		++toSubmit;
+		return sqe;
+	}
+
+	// hand the new entries to the kernel, optionally waiting for completions.
+	// interrupted waits just return; the caller loops anyway
+	void submit(unsigned int waitFor)
+	{
+		__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+		int consumed = (int)syscall(__NR_io_uring_enter, fd, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+		if (consumed > 0)
+			toSubmit -= (unsigned)consumed;
+	}
+
+	// the ring has room for a read and a cancel per request in flight plus the wake read,
+	// and completions never outnumber those, so once the kernel has taken what is queued
+	// there is always an entry. an interrupted or out of memory submit is simply retried
+	io_uring_sqe* nextOrSubmit()
+	{
+		io_uring_sqe* sqe = next();
+		while (!sqe && toSubmit > 0)
+		{
+			__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+			int consumed = (int)syscall(__NR_io_uring_enter, fd, toSubmit, 0u, 0u, nullptr, 0);
+			if (consumed > 0)
+				toSubmit -= (unsigned)consumed;
+			else if (consumed == 0 || (errno != EINTR && errno != EAGAIN))
+				break;
+			sqe = next();
+		}
+		if (!sqe)
+			throw std::runtime_error("AsyncFileSystem: io_uring submission queue is full");
+		return sqe;
+	}
+
+	void armWake()
+	{
+		io_uring_sqe* sqe = nextOrSubmit();
+		wakeVector.iov_base = &wakeValue;
+		wakeVector.iov_len = sizeof(wakeValue);
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = wakeFile;
+		sqe->addr = (uint64_t)(uintptr_t)&wakeVector;
+		sqe->len = 1;
+		sqe->user_data = WAKE_TAG;
+	}
+};
+#else
+struct AsyncFileSystem::Ring
+{
+};
+#endif
+
+AsyncFileSystem::AsyncFileSystem(unsigned int maxRequests, unsigned int queueDepth, unsigned int threadCount, bool forceThreads)
+	: slots(new Slot[maxRequests]), maxRequests(maxRequests), queueDepth(queueDepth ? queueDepth : 1), active(0), stopping(false)
+{
+	freeSlots.reserve(maxRequests);
+	for (size_t i = maxRequests; i > 0; --i)
+		freeSlots.push_back((uint32_t)(i - 1));
+
+#ifdef __linux__
+	if (!forceThreads)
+	{
+		// room for a read and a cancel per request in flight, plus the wake read
+		ring.reset(new Ring());
+		if (ring->create(this->queueDepth * 2 + 1))
+		{
+			ring->vectors.resize(maxRequests);
+			threads.emplace_back(&AsyncFileSystem::ringMain, this);
+			return;
+		}
+		// old kernels and seccomp filters refuse it, threads work everywhere
+		ring->destroy();
+		ring.reset();
+	}
+#else
+	(void)forceThreads;
+#endif
+
+	if (threadCount == 0)
+		threadCount = 1;
+	for (unsigned int i = 0; i < threadCount; ++i)
+		threads.emplace_back(&AsyncFileSystem::threadMain, this);
+}
+
+AsyncFileSystem::~AsyncFileSystem()
+{
+	std::vector<uint32_t> dropped;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+		for (std::deque<uint32_t>& queue : queues)
+		{
+			for (uint32_t index : queue)
+			{
+				slots[index].state = State::InFlight;
+				dropped.push_back(index);
+			}
+			queue.clear();
+		}
+	}
+	for (uint32_t index : dropped)
+		complete(index, Result::Cancelled, 0);
+
+	queued.notify_all();
+	wake();
+	for (std::thread& thread : threads)
+		thread.join();
+
+#ifdef __linux__
+	if (ring)
+		ring->destroy();
+#endif
+}
+
+AsyncFileSystem::Request AsyncFileSystem::read(const std::string& path, uint64_t offset, size_t size, void* destination,
+	Priority priority, Callback callback, void* data)
+{
+	Request request;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (stopping || freeSlots.empty())
+			return request;
+
+		request.index = freeSlots.back();
+		freeSlots.pop_back();
+		Slot& slot = slots[request.index];
+		slot.path = path;
+		slot.offset = offset;
+		slot.size = size;
+		slot.destination = static_cast<unsigned char*>(destination);
+		slot.callback = callback;
+		slot.data = data;
+		slot.state = State::Queued;
+		slot.cancelled.store(false, std::memory_order_relaxed);
+		request.generation = slot.generation;
+
+		queues[(int)priority].push_back(request.index);
+		++active;
+	}
+
+	if (ring)
+		wake();
+	else
+		queued.notify_one();
+	return request;
+}
+
+bool AsyncFileSystem::cancel(Request request)
+{
+	if (!request.valid() || request.index >= maxRequests)
+		return false;
+
+	bool wasQueued = false;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		Slot& slot = slots[request.index];
+		if (slot.generation != request.generation || slot.state == State::Free)
+			return false;
+
+		// blocking reads notice the flag between pieces, io_uring has to be told
+		slot.cancelled.store(true, std::memory_order_relaxed);
+		if (slot.state == State::InFlight)
+		{
+			if (ring)
+				cancels.push_back(request);
+		}
+		else
+		{
+			for (std::deque<uint32_t>& queue : queues)
+				queue.erase(std::remove(queue.begin(), queue.end(), request.index), queue.end());
+			// nobody else can pick it up now
+			slot.state = State::InFlight;
+			wasQueued = true;
+		}
+	}
+
+	if (wasQueued)
+		complete(request.index, Result::Cancelled, 0);
+	else
+		wake();
+	return true;
+}
+
+bool AsyncFileSystem::pending(Request request) const
+{
+	if (!request.valid() || request.index >= maxRequests)
+		return false;
+	std::lock_guard<std::mutex> guard(lock);
+	const Slot& slot = slots[request.index];
+	return slot.generation == request.generation && slot.state != State::Free;
+}
+
+void AsyncFileSystem::wait(Request request)
+{
+	if (!request.valid() || request.index >= maxRequests)
+		return;
+	std::unique_lock<std::mutex> guard(lock);
+	const Slot& slot = slots[request.index];
+	finished.wait(guard, [&]() { return slot.generation != request.generation || slot.state == State::Free; });
+}
+
+void AsyncFileSystem::waitAll()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	finished.wait(guard, [this]() { return active == 0; });
+}
+
+size_t AsyncFileSystem::outstanding() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return active;
+}
+
+const char* AsyncFileSystem::backend() const
+{
+	return ring ? "io_uring" : "threads";
+}
+
+bool AsyncFileSystem::takeQueued(uint32_t& index)
+{
+	for (std::deque<uint32_t>& queue : queues)
+	{
+		if (!queue.empty())
+		{
+			index = queue.front();
+			queue.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+// the callback runs before the slot is freed, so wait() also covers it
+void AsyncFileSystem::complete(uint32_t index, Result result, size_t bytes)
+{
+	Slot& slot = slots[index];
+	Completion completion;
+	completion.request.index = index;
+	completion.request.generation = slot.generation;
+	completion.result = result;
+	completion.bytes = bytes;
+	completion.destination = slot.destination;
+	completion.data = slot.data;
+	if (slot.callback)
+		slot.callback(completion);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		slot.state = State::Free;
+		slot.callback = nullptr;
+		slot.data = nullptr;
+		slot.path.clear();
+		++slot.generation;
+		freeSlots.push_back(index);
+		--active;
+	}
+	finished.notify_all();
+}
+
+void AsyncFileSystem::wake()
+{
+#ifdef __linux__
+	if (ring)
+	{
+		uint64_t one = 1;
+		ssize_t written = ::write(ring->wakeFile, &one, sizeof(one));
+		(void)written;
+	}
+#endif
+}
+
+// fallback: one blocking read at a time per thread
+void AsyncFileSystem::threadMain()
+{
+	while (true)
+	{
+		uint32_t index;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			queued.wait(guard, [this]()
+			{
+				return stopping || !queues[0].empty() || !queues[1].empty() || !queues[2].empty();
+			});
+			if (!takeQueued(index))
+				return;
+			slots[index].state = State::InFlight;
+		}
+
+		Slot& slot = slots[index];
+		size_t bytes = 0;
+		Result result = ReadAt(slot.path, slot.offset, slot.destination, slot.size, slot.cancelled, bytes);
+		complete(index, result, bytes);
+	}
+}
+
+// io_uring: take as much of the queue as fits in flight, submit it in one go, then
+// sleep in the kernel until something completes or wake() is called
+void AsyncFileSystem::ringMain()
+{
+#ifdef __linux__
+	Ring& uring = *ring;
+	unsigned int inFlight = 0;
+	std::vector<uint32_t> starting;
+	std::vector<Request> cancelling;
+
+	struct OpenFile
+	{
+		int file;
+		unsigned int users;
+	};
+	std::unordered_map<std::string, OpenFile> openFiles;
+	auto acquire = [&](const std::string& path)
+	{
+		auto found = openFiles.find(path);
+		if (found == openFiles.end())
+		{
+			// drop idle descriptors before the table grows past the limit
+			if (openFiles.size() >= MAX_OPEN_FILES)
+			{
+				for (auto it = openFiles.begin(); it != openFiles.end();)
+				{
+					if (it->second.users == 0)
+					{
+						::close(it->second.file);
+						it = openFiles.erase(it);
+					}
+					else
+						++it;
+				}
+			}
+			int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (file < 0)
+				return -1;
+			found = openFiles.emplace(path, OpenFile{ file, 0 }).first;
+		}
+		++found->second.users;
+		return found->second.file;
+	};
+
+	auto submitRead = [&](uint32_t index)
+	{
+		Slot& slot = slots[index];
+		iovec& vector = uring.vectors[index];
+		vector.iov_base = slot.destination + slot.done;
+		vector.iov_len = slot.size - slot.done;
+		io_uring_sqe* sqe = uring.nextOrSubmit();
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = slot.file;
+		sqe->addr = (uint64_t)(uintptr_t)&vector;
+		sqe->len = 1;
+		sqe->off = slot.offset + slot.done;
+		sqe->user_data = index;
+	};
+
+	auto finish = [&](uint32_t index, Result result)
+	{
+		Slot& slot = slots[index];
+		if (slot.file >= 0)
+			--openFiles[slot.path].users;
+		slot.file = -1;
+		complete(index, result, slot.done);
+	};
+
+	uring.armWake();
+	while (true)
+	{
+		starting.clear();
+		cancelling.clear();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (stopping && inFlight == 0 && queues[0].empty() && queues[1].empty() && queues[2].empty())
+				break;
+
+			uint32_t index;
+			while (inFlight + starting.size() < queueDepth && takeQueued(index))
+			{
+				slots[index].state = State::InFlight;
+				starting.push_back(index);
+			}
+			cancelling.swap(cancels);
+		}
+
+		// opening is synchronous, but rare with descriptors kept around
+		for (uint32_t index : starting)
+		{
+			Slot& slot = slots[index];
+			slot.done = 0;
+			slot.cancelSubmitted = false;
+			if (slot.cancelled.load(std::memory_order_relaxed))
+			{
+				finish(index, Result::Cancelled);
+				continue;
+			}
+			slot.file = acquire(slot.path);
+			if (slot.file < 0)
+			{
+				finish(index, Result::Failed);
+				continue;
+			}
+			if (slot.size == 0)
+			{
+				finish(index, Result::Done);
+				continue;
+			}
+			submitRead(index);
+			++inFlight;
+		}
+
+		for (const Request& request : cancelling)
+		{
+			// the read may have completed since cancel() asked, and the slot moved on
+			Slot& slot = slots[request.index];
+			if (slot.generation != request.generation || slot.file < 0 || slot.cancelSubmitted)
+				continue;
+			io_uring_sqe* sqe = uring.nextOrSubmit();
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = request.index;
+			sqe->user_data = CANCEL_TAG | request.index;
+			slot.cancelSubmitted = true;
+		}
+
+		// the wake read is always pending, so this returns once anything happens
+		uring.submit(1);
+
+		unsigned head = *uring.cqHead;
+		unsigned tail = __atomic_load_n(uring.cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head)
+		{
+			io_uring_cqe cqe = uring.cqes[head & uring.cqMask];
+			if (cqe.user_data == WAKE_TAG)
+			{
+				uring.armWake();
+				continue;
+			}
+			if (cqe.user_data & CANCEL_TAG)
+				continue;
+
+			uint32_t index = (uint32_t)cqe.user_data;
+			Slot& slot = slots[index];
+			bool cancelled = slot.cancelled.load(std::memory_order_relaxed);
+			if (cqe.res == -EAGAIN || cqe.res == -EINTR)
+			{
+				submitRead(index);
+				continue;
+			}
+			if (cqe.res > 0)
+			{
+				// short reads happen on big requests; carry on from where it stopped
+				slot.done += (size_t)cqe.res;
+				if (slot.done < slot.size && !cancelled)
+				{
+					submitRead(index);
+					continue;
+				}
+			}
+
+			--inFlight;
+			if (cqe.res == -ECANCELED || (cancelled && slot.done < slot.size))
+				finish(index, Result::Cancelled);
+			else if (cqe.res < 0)
+				finish(index, Result::Failed);
+			else
+				finish(index, Result::Done);
+		}
+		__atomic_store_n(uring.cqHead, head, __ATOMIC_RELEASE);
+	}
+
+	for (auto& open : openFiles)
+		::close(open.second.file);
+#endif
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// asynchronous file reads into caller memory. on Linux requests go through an io_uring:
+// one I/O thread turns everything queued into a single submission and reaps completions,
+// so hundreds of reads can be in flight without a thread each. elsewhere, or when the
+// kernel refuses io_uring, a few threads do blocking positional reads instead.
+// queued reads start highest priority first and can be cancelled until they complete.
+// callbacks run on the I/O thread, so they should hand the data on (JobSystem::run)
+// rather than work on it
+// ---------------------------------------------------------------------------------------
+class AsyncFileSystem
+{
+public:
+	enum class Priority
+	{
+		High,    // needed this frame
+		Normal,
+		Low      // prefetching
+	};
+
+	enum class Result
+	{
+		Done,
+		Failed,
+		Cancelled
+	};
+
+	struct Request
+	{
+		uint32_t index = 0xFFFFFFFFu;
+		uint32_t generation = 0;
+
+		bool valid() const { return index != 0xFFFFFFFFu; }
+	};
+
+	struct Completion
+	{
+		Request request;
+		Result result;
+		// less than asked for when the file ended first
+		size_t bytes;
+		void* destination;
+		void* data;
+	};
+
+	typedef void (*Callback)(const Completion& completion);
+
+	// up to maxRequests reads outstanding, queueDepth of them submitted to the kernel at once.
+	// threads is the size of the fallback pool; forceThreads skips io_uring altogether
+	explicit AsyncFileSystem(unsigned int maxRequests = 1024, unsigned int queueDepth = 256,
+		unsigned int threads = 4, bool forceThreads = false);
+	// cancels whatever hasn't started and waits for the rest
+	~AsyncFileSystem();
+
+	AsyncFileSystem(const AsyncFileSystem&) = delete;
+	AsyncFileSystem& operator=(const AsyncFileSystem&) = delete;
+
+	// any thread: read size bytes at offset into destination, which has to stay valid until
+	// the callback returned. an invalid request, and no callback, when too many are outstanding
+	Request read(const std::string& path, uint64_t offset, size_t size, void* destination,
+		Priority priority = Priority::Normal, Callback callback = nullptr, void* data = nullptr);
+
+	// false if the request already completed. a read the kernel already started may still
+	// complete as Done, anything else completes as Cancelled
+	bool cancel(Request request);
+
+	// whether the request has yet to complete
+	bool pending(Request request) const;
+
+	// block until the request (or every request) completed and its callback returned
+	void wait(Request request);
+	void waitAll();
+
+	size_t outstanding() const;
+
+	// "io_uring" or "threads"
+	const char* backend() const;
+private:
+	enum class State
+	{
+		Free,
+		Queued,
+		InFlight
+	};
+
+	struct Slot
+	{
+		std::string path;
+		uint64_t offset = 0;
+		size_t size = 0;
+		unsigned char* destination = nullptr;
+		Callback callback = nullptr;
+		void* data = nullptr;
+		uint32_t generation = 0;
+		State state = State::Free;
+		std::atomic<bool> cancelled{ false };
+		// io_uring only: open descriptor, bytes read so far and whether a cancel went out
+		int file = -1;
+		size_t done = 0;
+		bool cancelSubmitted = false;
+	};
+
+	struct Ring;
+
+	// with lock held: next queued slot, highest priority first
+	bool takeQueued(uint32_t& index);
+	void complete(uint32_t index, Result result, size_t bytes);
+	void wake();
+	void threadMain();
+	void ringMain();
+
+	std::unique_ptr<Slot[]> slots;
+	size_t maxRequests;
+	unsigned int queueDepth;
+
+	// guards slot states, the queues and the free list
+	mutable std::mutex lock;
+	std::condition_variable queued;
+	std::condition_variable finished;
+	std::vector<uint32_t> freeSlots;
+	std::deque<uint32_t> queues[3];
+	// in-flight reads the I/O thread should ask the kernel to cancel
+	std::vector<Request> cancels;
+	size_t active;
+	bool stopping;
+
+	std::unique_ptr<Ring> ring;
+	std::vector<std::thread> threads;
+};
@@ -0,0 +1,618 @@
+#include "BVH.h"
+#include "FrustumCulling.h"
+#include <algorithm>
+
+namespace
+{
+	// centroid bins per axis for the static build
+	const int SAH_BINS = 16;
+	// cost of visiting a node relative to testing one item against a query
+	const float TRAVERSAL_COST = 1.0f;
+	// nodes with this few items aren't split any further
+	const uint32_t MIN_SPLIT_ITEMS = 2;
+
+	// planes a box still straddles, one bit each; OUTSIDE once it is behind any of them
+	const uint32_t ALL_PLANES = (1u << Frustum::SIDES) - 1;
+	const uint32_t OUTSIDE = 1u << 31;
+
+	struct PlaneSet
+	{
+		Vec3 normals[Frustum::SIDES];
+		// for the extents: the corner furthest along each normal
+		Vec3 absolute[Frustum::SIDES];
+		float offsets[Frustum::SIDES];
+
+		explicit PlaneSet(const Frustum& frustum)
+		{
+			for (int side = 0; side < Frustum::SIDES; ++side)
+			{
+				const Vec4& plane = frustum.planes[side];
+				normals[side] = plane.xyz();
+				absolute[side] = Vec3(std::fabs(plane.x), std::fabs(plane.y), std::fabs(plane.z));
+				offsets[side] = plane.w;
+			}
+		}
+	};
+
+	// planes in mask that box is neither entirely behind nor entirely in front of
+	uint32_t Classify(const PlaneSet& planes, const Bounds& box, uint32_t mask)
+	{
+		Vec3 center = (box.min + box.max) * 0.5f;
+		Vec3 extent = (box.max - box.min) * 0.5f;
+		for (int side = 0; side < Frustum::SIDES; ++side)
+		{
+			uint32_t bit = 1u << side;
+			if (!(mask & bit))
+				continue;
+			float distance = Dot(planes.normals[side], center) + planes.offsets[side];
+			float reach = Dot(planes.absolute[side], extent);
+			if (distance + reach < 0.0f)
+				return OUTSIDE;
+			if (distance - reach >= 0.0f)
+				mask &= ~bit;
+		}
+		return mask;
+	}
+
+	// a node still to visit and the planes its parent straddled
+	struct CullStep
+	{
+		uint32_t node;
+		uint32_t planes;
+	};
+
+	int BinOf(float center, float low, float scale)
+	{
+		int bin = (int)((center - low) * scale);
+		return bin < SAH_BINS - 1 ? bin : SAH_BINS - 1;
+	}
+}
+
+// ----- StaticBVH -----
+
+StaticBVH::StaticBVH()
+	: depth(0)
+{
+}
+
+void StaticBVH::build(const Bounds* boxes, size_t count)
+{
+	nodes.clear();
+	items.resize(count);
+	itemBounds.assign(boxes, boxes + count);
+	depth = 0;
+	if (count == 0)
+		return;
+
+	// items, their boxes and their centers are reordered together while splitting, so
+	// every node reads its own stretch of each front to back
+	std::vector<Vec3> centers(count);
+	Node root = { Bounds(), 0, (uint32_t)count };
+	for (size_t i = 0; i < count; ++i)
+	{
+		items[i] = (uint32_t)i;
+		centers[i] = boxes[i].center();
+		root.bounds = Union(root.bounds, boxes[i]);
+	}
+	// a binary tree with at most one leaf per item
+	nodes.reserve(count * 2);
+	nodes.push_back(root);
+
+	struct Pending
+	{
+		uint32_t node;
+		uint32_t level;
+	};
+	std::vector<Pending> pending = { { 0, 0 } };
+	while (!pending.empty())
+	{
+		Pending next = pending.back();
+		pending.pop_back();
+		if (!split(next.node, centers))
+			continue;
+		depth = std::max(depth, next.level + 1);
+		pending.push_back({ nodes[next.node].first, next.level + 1 });
+		pending.push_back({ nodes[next.node].first + 1, next.level + 1 });
+	}
+}
+
+bool StaticBVH::split(uint32_t index, std::vector<Vec3>& centers)
+{
+	uint32_t first = nodes[index].first;
+	uint32_t count = nodes[index].count;
+	uint32_t end = first + count;
+	if (count <= MIN_SPLIT_ITEMS)
+		return false;
+
+	Bounds centroids;
+	for (uint32_t i = first; i < end; ++i)
+	{
+		centroids.min = Min(centroids.min, centers[i]);
+		centroids.max = Max(centroids.max, centers[i]);
+	}
+
+	// every item into a bin on each axis in one pass, then sweep the bins from both ends
+	// for the cheapest plane
+	struct Bin
+	{
+		Bounds bounds;
+		uint32_t count = 0;
+	};
+	Bin bins[3][SAH_BINS];
+	Vec3 low = centroids.min;
+	Vec3 extent = centroids.max - centroids.min;
+	Vec3 scale(extent.x > 0.0f ? SAH_BINS / extent.x : 0.0f, extent.y > 0.0f ? SAH_BINS / extent.y : 0.0f,
+		extent.z > 0.0f ? SAH_BINS / extent.z : 0.0f);
+	for (uint32_t i = first; i < end; ++i)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			Bin& bin = bins[axis][BinOf(centers[i][axis], low[axis], scale[axis])];
+			bin.bounds = Union(bin.bounds, itemBounds[i]);
+			++bin.count;
+		}
+	}
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestPlane = 0;
+	Bounds bestLeft, bestRight;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (extent[axis] <= 0.0f)
+			continue;
+		float leftCosts[SAH_BINS - 1];
+		Bounds leftBounds[SAH_BINS - 1];
+		Bounds running;
+		uint32_t runningCount = 0;
+		for (int plane = 0; plane < SAH_BINS - 1; ++plane)
+		{
+			running = Union(running, bins[axis][plane].bounds);
+			runningCount += bins[axis][plane].count;
+			leftBounds[plane] = running;
+			leftCosts[plane] = runningCount > 0 ? running.halfArea() * runningCount : 0.0f;
+		}
+		running = Bounds();
+		runningCount = 0;
+		for (int plane = SAH_BINS - 2; plane >= 0; --plane)
+		{
+			running = Union(running, bins[axis][plane + 1].bounds);
+			runningCount += bins[axis][plane + 1].count;
+			if (runningCount == 0 || runningCount == count)
+				continue;
+			float cost = leftCosts[plane] + running.halfArea() * runningCount;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestPlane = plane;
+				bestLeft = leftBounds[plane];
+				bestRight = running;
+			}
+		}
+	}
+
+	// splitting has to beat testing every item in one leaf
+	float leafCost = nodes[index].bounds.halfArea() * count;
+	if (bestAxis < 0 || TRAVERSAL_COST * nodes[index].bounds.halfArea() + bestCost >= leafCost)
+		return false;
+
+	uint32_t middle = first;
+	uint32_t last = end;
+	while (middle < last)
+	{
+		if (BinOf(centers[middle][bestAxis], low[bestAxis], scale[bestAxis]) <= bestPlane)
+		{
+			++middle;
+			continue;
+		}
+		--last;
+		std::swap(items[middle], items[last]);
+		std::swap(itemBounds[middle], itemBounds[last]);
+		std::swap(centers[middle], centers[last]);
+	}
+
+	uint32_t children = (uint32_t)nodes.size();
+	nodes.push_back({ bestLeft, first, middle - first });
+	nodes.push_back({ bestRight, middle, end - middle });
+	nodes[index].first = children;
+	nodes[index].count = 0;
+	return true;
+}
+
+void StaticBVH::appendSubtree(uint32_t index, std::vector<uint32_t>& out) const
+{
+	// the subtree's items are contiguous, from its leftmost leaf to its rightmost
+	uint32_t left = index;
+	while (nodes[left].count == 0)
+		left = nodes[left].first;
+	uint32_t right = index;
+	while (nodes[right].count == 0)
+		right = nodes[right].first + 1;
+	out.insert(out.end(), items.begin() + nodes[left].first, items.begin() + nodes[right].first + nodes[right].count);
+}
+
+void StaticBVH::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	if (nodes.empty())
+		return;
+	PlaneSet planes(frustum);
+	TraversalStack<CullStep> stack(depth + 2);
+	stack.push({ 0, ALL_PLANES });
+	while (!stack.empty())
+	{
+		CullStep step = stack.pop();
+		const Node& node = nodes[step.node];
+		uint32_t mask = Classify(planes, node.bounds, step.planes);
+		if (mask == OUTSIDE)
+			continue;
+		if (mask == 0)
+		{
+			appendSubtree(step.node, visible);
+			continue;
+		}
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				if (Classify(planes, itemBounds[i], mask) != OUTSIDE)
+					visible.push_back(items[i]);
+			}
+			continue;
+		}
+		stack.push({ node.first + 1, mask });
+		stack.push({ node.first, mask });
+	}
+}
+
+void StaticBVH::overlap(const Bounds& box, std::vector<uint32_t>& found) const
+{
+	if (nodes.empty())
+		return;
+	TraversalStack<uint32_t> stack(depth + 2);
+	stack.push(0);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.pop()];
+		if (!node.bounds.overlaps(box))
+			continue;
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				if (itemBounds[i].overlaps(box))
+					found.push_back(items[i]);
+			}
+			continue;
+		}
+		stack.push(node.first + 1);
+		stack.push(node.first);
+	}
+}
+
+// ----- DynamicBVH -----
+
+DynamicBVH::DynamicBVH(float margin)
+	: root(NONE), freeList(NONE), leaves(0), margin(margin)
+{
+}
+
+uint32_t DynamicBVH::allocateNode()
+{
+	uint32_t index = freeList;
+	if (index == NONE)
+	{
+		index = (uint32_t)nodes.size();
+		nodes.emplace_back();
+	}
+	else
+	{
+		freeList = nodes[index].parent;
+	}
+	Node& node = nodes[index];
+	node.bounds = Bounds();
+	node.parent = NONE;
+	node.child1 = NONE;
+	node.child2 = NONE;
+	node.item = NONE;
+	node.height = 0;
+	return index;
+}
+
+void DynamicBVH::freeNode(uint32_t index)
+{
+	nodes[index].parent = freeList;
+	nodes[index].height = -1;
+	freeList = index;
+}
+
+Bounds DynamicBVH::fatten(const Bounds& box) const
+{
+	Vec3 grow(margin);
+	return Bounds(box.min - grow, box.max + grow);
+}
+
+uint32_t DynamicBVH::insert(const Bounds& box, uint32_t item)
+{
+	uint32_t leaf = allocateNode();
+	nodes[leaf].bounds = fatten(box);
+	nodes[leaf].item = item;
+	insertLeaf(leaf);
+	++leaves;
+	return leaf;
+}
+
+void DynamicBVH::remove(uint32_t proxy)
+{
+	removeLeaf(proxy);
+	freeNode(proxy);
+	--leaves;
+}
+
+bool DynamicBVH::update(uint32_t proxy, const Bounds& box)
+{
+	if (nodes[proxy].bounds.contains(box))
+		return false;
+	removeLeaf(proxy);
+	nodes[proxy].bounds = fatten(box);
+	insertLeaf(proxy);
+	return true;
+}
+
+void DynamicBVH::setBounds(uint32_t proxy, const Bounds& box)
+{
+	nodes[proxy].bounds = fatten(box);
+}
+
+void DynamicBVH::insertLeaf(uint32_t leaf)
+{
+	if (root == NONE)
+	{
+		root = leaf;
+		nodes[leaf].parent = NONE;
+		return;
+	}
+
+	// walk down to the best sibling: pairing with the current node costs its grown area,
+	// going further down costs what every node on the way grows plus the child's own share
+	Bounds box = nodes[leaf].bounds;
+	uint32_t index = root;
+	while (!nodes[index].leaf())
+	{
+		const Node& node = nodes[index];
+		float combined = Union(node.bounds, box).halfArea();
+		float cost = 2.0f * combined;
+		float inheritance = 2.0f * (combined - node.bounds.halfArea());
+		auto descendCost = [&](uint32_t child)
+		{
+			const Bounds& bounds = nodes[child].bounds;
+			float grown = Union(bounds, box).halfArea();
+			return nodes[child].leaf() ? grown + inheritance : grown - bounds.halfArea() + inheritance;
+		};
+		float cost1 = descendCost(node.child1);
+		float cost2 = descendCost(node.child2);
+		if (cost < cost1 && cost < cost2)
+			break;
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	uint32_t sibling = index;
+	uint32_t oldParent = nodes[sibling].parent;
+	uint32_t newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	if (oldParent == NONE)
+		root = newParent;
+	else if (nodes[oldParent].child1 == sibling)
+		nodes[oldParent].child1 = newParent;
+	else
+		nodes[oldParent].child2 = newParent;
+
+	refitUpwards(newParent);
+}
+
+void DynamicBVH::removeLeaf(uint32_t leaf)
+{
+	if (leaf == root)
+	{
+		root = NONE;
+		return;
+	}
+
+	// the parent goes and the sibling takes its place
+	uint32_t parent = nodes[leaf].parent;
+	uint32_t grandParent = nodes[parent].parent;
+	uint32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+	nodes[sibling].parent = grandParent;
+	freeNode(parent);
+	if (grandParent == NONE)
+	{
+		root = sibling;
+		return;
+	}
+	if (nodes[grandParent].child1 == parent)
+		nodes[grandParent].child1 = sibling;
+	else
+		nodes[grandParent].child2 = sibling;
+	refitUpwards(grandParent);
+}
+
+void DynamicBVH::refitUpwards(uint32_t index)
+{
+	while (index != NONE)
+	{
+		Node& node = nodes[index];
+		node.bounds = Union(nodes[node.child1].bounds, nodes[node.child2].bounds);
+		node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+		rotate(index);
+		index = nodes[index].parent;
+	}
+}
+
+void DynamicBVH::rotate(uint32_t index)
+{
+	if (nodes[index].height < 2)
+		return;
+
+	// swapping a child with one of its sibling's children leaves this node's bounds as
+	// they are and changes the sibling's; take the swap that shrinks it most
+	uint32_t b = nodes[index].child1;
+	uint32_t c = nodes[index].child2;
+	float bestSaving = 0.0f;
+	uint32_t bestChild = NONE;
+	uint32_t bestGrandchild = NONE;
+	auto consider = [&](uint32_t child, uint32_t sibling)
+	{
+		if (nodes[sibling].leaf())
+			return;
+		uint32_t f = nodes[sibling].child1;
+		uint32_t g = nodes[sibling].child2;
+		float area = nodes[sibling].bounds.halfArea();
+		// child swapped for f leaves the sibling holding child and g, and so on
+		float savingF = area - Union(nodes[child].bounds, nodes[g].bounds).halfArea();
+		float savingG = area - Union(nodes[child].bounds, nodes[f].bounds).halfArea();
+		if (savingF > bestSaving)
+		{
+			bestSaving = savingF;
+			bestChild = child;
+			bestGrandchild = f;
+		}
+		if (savingG > bestSaving)
+		{
+			bestSaving = savingG;
+			bestChild = child;
+			bestGrandchild = g;
+		}
+	};
+	consider(b, c);
+	consider(c, b);
+	if (bestChild != NONE)
+		swapWithGrandchild(index, bestChild, bestGrandchild);
+}
+
+void DynamicBVH::swapWithGrandchild(uint32_t index, uint32_t child, uint32_t grandchild)
+{
+	Node& node = nodes[index];
+	uint32_t sibling = node.child1 == child ? node.child2 : node.child1;
+	if (node.child1 == child)
+		node.child1 = grandchild;
+	else
+		node.child2 = grandchild;
+
+	Node& middle = nodes[sibling];
+	if (middle.child1 == grandchild)
+		middle.child1 = child;
+	else
+		middle.child2 = child;
+	nodes[child].parent = sibling;
+	nodes[grandchild].parent = index;
+
+	middle.bounds = Union(nodes[middle.child1].bounds, nodes[middle.child2].bounds);
+	middle.height = 1 + std::max(nodes[middle.child1].height, nodes[middle.child2].height);
+	node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+}
+
+void DynamicBVH::refit()
+{
+	if (root == NONE)
+		return;
+
+	// breadth first puts every parent before its children, so going through it backwards
+	// refits each node after everything below it
+	refitOrder.clear();
+	if (!nodes[root].leaf())
+		refitOrder.push_back(root);
+	for (size_t i = 0; i < refitOrder.size(); ++i)
+	{
+		const Node& node = nodes[refitOrder[i]];
+		if (!nodes[node.child1].leaf())
+			refitOrder.push_back(node.child1);
+		if (!nodes[node.child2].leaf())
+			refitOrder.push_back(node.child2);
+	}
+	for (size_t i = refitOrder.size(); i-- > 0;)
+	{
+		Node& node = nodes[refitOrder[i]];
+		node.bounds = Union(nodes[node.child1].bounds, nodes[node.child2].bounds);
+		node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+		rotate(refitOrder[i]);
+	}
+}
+
+float DynamicBVH::cost() const
+{
+	if (root == NONE)
+		return 0.0f;
+	double area = 0.0;
+	for (const Node& node : nodes)
+	{
+		if (node.height > 0)
+			area += node.bounds.halfArea();
+	}
+	return (float)(area / nodes[root].bounds.halfArea());
+}
+
+void DynamicBVH::appendSubtree(uint32_t index, std::vector<uint32_t>& out) const
+{
+	TraversalStack<uint32_t> stack(nodes[index].height + 2);
+	stack.push(index);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.pop()];
+		if (node.leaf())
+		{
+			out.push_back(node.item);
+			continue;
+		}
+		stack.push(node.child2);
+		stack.push(node.child1);
+	}
+}
+
+void DynamicBVH::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	if (root == NONE)
+		return;
+	PlaneSet planes(frustum);
+	TraversalStack<CullStep> stack(height() + 2);
+	stack.push({ root, ALL_PLANES });
+	while (!stack.empty())
+	{
+		CullStep step = stack.pop();
+		const Node& node = nodes[step.node];
+		uint32_t mask = Classify(planes, node.bounds, step.planes);
+		if (mask == OUTSIDE)
+			continue;
+		if (mask == 0 || node.leaf())
+		{
+			appendSubtree(step.node, visible);
+			continue;
+		}
+		stack.push({ node.child2, mask });
+		stack.push({ node.child1, mask });
+	}
+}
+
+void DynamicBVH::overlap(const Bounds& box, std::vector<uint32_t>& found) const
+{
+	if (root == NONE)
+		return;
+	TraversalStack<uint32_t> stack(height() + 2);
+	stack.push(root);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.pop()];
+		if (!node.bounds.overlaps(box))
+			continue;
+		if (node.leaf())
+		{
+			found.push_back(node.item);
+			continue;
+		}
+		stack.push(node.child2);
+		stack.push(node.child1);
+	}
+}
@@ -0,0 +1,338 @@
+#pragma once
+#include "VectorMath.h"
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct Frustum;
+
+// axis-aligned box. the default one is empty: it contains nothing and grows to whatever
+// it is joined with
+struct Bounds
+{
+	Vec3 min;
+	Vec3 max;
+
+	Bounds() : min(FLT_MAX), max(-FLT_MAX) {}
+	Bounds(const Vec3& min, const Vec3& max) : min(min), max(max) {}
+
+	Vec3 center() const { return (min + max) * 0.5f; }
+
+	// half the surface area, which is all the surface area heuristic needs
+	float halfArea() const
+	{
+		Vec3 size = max - min;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	bool contains(const Bounds& other) const
+	{
+		return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+			&& max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+	}
+
+	bool overlaps(const Bounds& other) const
+	{
+		return min.x <= other.max.x && min.y <= other.max.y && min.z <= other.max.z
+			&& max.x >= other.min.x && max.y >= other.min.y && max.z >= other.min.z;
+	}
+};
+
+inline Bounds Union(const Bounds& a, const Bounds& b)
+{
+	return Bounds(Min(a.min, b.min), Max(a.max, b.max));
+}
+
+struct Ray
+{
+	Vec3 origin;
+	// doesn't have to be unit length, distances are in multiples of it
+	Vec3 direction;
+	float maxDistance = FLT_MAX;
+};
+
+struct RayHit
+{
+	uint32_t item = 0xFFFFFFFFu;
+	float distance = FLT_MAX;
+};
+
+// the distance along the ray to where it enters the box, FLT_MAX if it misses or only gets
+// there past limit. inverse is 1 / direction per axis
+inline float RayEntry(const Ray& ray, const Vec3& inverse, const Bounds& box, float limit)
+{
+	Vec3 toMin = (box.min - ray.origin) * inverse;
+	Vec3 toMax = (box.max - ray.origin) * inverse;
+	Vec3 nearSide = Min(toMin, toMax);
+	Vec3 farSide = Max(toMin, toMax);
+	float enter = std::fmax(std::fmax(nearSide.x, nearSide.y), std::fmax(nearSide.z, 0.0f));
+	float exit = std::fmin(std::fmin(farSide.x, farSide.y), std::fmin(farSide.z, limit));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+// depth-first traversal stack, on the call stack unless the tree is unusually deep.
+// capacity is the tree's depth plus two
+template<typename T>
+class TraversalStack
+{
+public:
+	explicit TraversalStack(size_t capacity) : data(local), size(0)
+	{
+		if (capacity > LOCAL_CAPACITY)
+		{
+			heap.resize(capacity);
+			data = heap.data();
+		}
+	}
+
+	void push(const T& value) { data[size++] = value; }
+	T pop() { return data[--size]; }
+	bool empty() const { return size == 0; }
+private:
+	static const size_t LOCAL_CAPACITY = 64;
+	T local[LOCAL_CAPACITY];
+	std::vector<T> heap;
+	T* data;
+	size_t size;
+};
+
+// a node still to visit and where the ray enters it
+struct RayStep
+{
+	uint32_t node;
+	float entry;
+};
+
+// both trees take the same exact hit test for raycasts: test(item, ray, distance) returns
+// whether the item itself is hit and sets distance if so. the plain overloads stop at the
+// items' boxes (fattened ones, for the dynamic tree)
+struct BoxHitTest
+{
+	bool operator()(uint32_t, const Ray&, float&) const { return true; }
+};
+
+// bounding volume hierarchy over a fixed set of boxes, built once with the surface area
+// heuristic (binned, Wald 2007) for level geometry and anything else that never moves.
+// nodes are one flat array with siblings next to each other and the items of every subtree
+// contiguous, so a subtree found entirely inside the frustum is taken without going
+// further down. items are the indices of the boxes given to build
+// ---------------------------------------------------------------------------------------
+class StaticBVH
+{
+public:
+	StaticBVH();
+
+	void build(const Bounds* boxes, size_t count);
+
+	size_t nodeCount() const { return nodes.size(); }
+	size_t itemCount() const { return items.size(); }
+
+	// appends the items whose boxes aren't entirely outside one of the planes. as with
+	// FrustumCuller the test is conservative near the frustum's corners
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+	// appends the items whose boxes overlap box
+	void overlap(const Bounds& box, std::vector<uint32_t>& found) const;
+
+	// nearest item along the ray; false and hit untouched if nothing is hit
+	template<typename HitTest>
+	bool raycast(const Ray& ray, RayHit& hit, const HitTest& test) const;
+	bool raycast(const Ray& ray, RayHit& hit) const { return raycast(ray, hit, BoxHitTest()); }
+private:
+	// leaves have count items from first in items; inner nodes have count 0 and their
+	// children at first and first + 1
+	struct Node
+	{
+		Bounds bounds;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// splits a node's items in two where the surface area heuristic says it pays,
+	// false if the node stays a leaf
+	bool split(uint32_t node, std::vector<Vec3>& centers);
+	void appendSubtree(uint32_t node, std::vector<uint32_t>& out) const;
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> items;
+	// the items' boxes in the same order as items
+	std::vector<Bounds> itemBounds;
+	// levels below the root
+	uint32_t depth;
+};
+
+// bounding volume hierarchy for things that move, kept up to date one change at a time
+// (Catto, "Dynamic Bounding Volume Hierarchies", GDC 2019): leaves are inserted next to the
+// sibling that grows the tree's surface area least, and every node on the way back up is
+// refitted and, where swapping a child with a grandchild makes it smaller, rotated.
+// leaves hold boxes fattened by a margin so small moves don't touch the tree at all.
+// objects that move every frame can instead set their boxes and have the whole tree
+// refitted (and rotated) once
+// ---------------------------------------------------------------------------------------
+class DynamicBVH
+{
+public:
+	static const uint32_t NONE = 0xFFFFFFFFu;
+
+	explicit DynamicBVH(float margin = 0.1f);
+
+	// returns a proxy for the leaf, item is what queries report for it
+	uint32_t insert(const Bounds& box, uint32_t item);
+
+	void remove(uint32_t proxy);
+
+	// reinserts the leaf if box has left its fattened box, and returns whether it did
+	bool update(uint32_t proxy, const Bounds& box);
+
+	// replaces the leaf's box without touching the rest of the tree, which is wrong until
+	// the next refit
+	void setBounds(uint32_t proxy, const Bounds& box);
+
+	// recomputes every inner node from its children, bottom up, rotating as it goes
+	void refit();
+
+	uint32_t item(uint32_t proxy) const { return nodes[proxy].item; }
+	const Bounds& fatBounds(uint32_t proxy) const { return nodes[proxy].bounds; }
+
+	size_t leafCount() const { return leaves; }
+	int height() const { return root == NONE ? 0 : nodes[root].height; }
+
+	// surface area of the inner nodes relative to the root's; lower traverses faster
+	float cost() const;
+
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+	void overlap(const Bounds& box, std::vector<uint32_t>& found) const;
+
+	template<typename HitTest>
+	bool raycast(const Ray& ray, RayHit& hit, const HitTest& test) const;
+	bool raycast(const Ray& ray, RayHit& hit) const { return raycast(ray, hit, BoxHitTest()); }
+private:
+	// leaves have no children. free nodes are chained through parent
+	struct Node
+	{
+		Bounds bounds;
+		uint32_t parent;
+		uint32_t child1;
+		uint32_t child2;
+		uint32_t item;
+		// leaves are 0, free nodes -1
+		int32_t height;
+
+		bool leaf() const { return child1 == NONE; }
+	};
+
+	uint32_t allocateNode();
+	void freeNode(uint32_t node);
+	void insertLeaf(uint32_t leaf);
+	void removeLeaf(uint32_t leaf);
+	// refits and rotates node and everything above it
+	void refitUpwards(uint32_t node);
+	void rotate(uint32_t node);
+	// puts grandchild where child is and the other way round; child is one of node's
+	// children and grandchild one of its sibling's
+	void swapWithGrandchild(uint32_t node, uint32_t child, uint32_t grandchild);
+	void appendSubtree(uint32_t node, std::vector<uint32_t>& out) const;
+	Bounds fatten(const Bounds& box) const;
+
+	std::vector<Node> nodes;
+	uint32_t root;
+	uint32_t freeList;
+	size_t leaves;
+	float margin;
+	// refit's inner nodes, parents before children
+	std::vector<uint32_t> refitOrder;
+};
+
+template<typename HitTest>
+bool StaticBVH::raycast(const Ray& ray, RayHit& hit, const HitTest& test) const
+{
+	if (nodes.empty())
+		return false;
+	Vec3 inverse(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+	float nearest = ray.maxDistance;
+	uint32_t found = 0xFFFFFFFFu;
+
+	// nearer child on top, and nothing that starts beyond the nearest hit so far
+	TraversalStack<RayStep> stack(depth + 2);
+	float entry = RayEntry(ray, inverse, nodes[0].bounds, nearest);
+	if (entry != FLT_MAX)
+		stack.push({ 0, entry });
+	while (!stack.empty())
+	{
+		RayStep step = stack.pop();
+		if (step.entry > nearest)
+			continue;
+		const Node& node = nodes[step.node];
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				float distance = RayEntry(ray, inverse, itemBounds[i], nearest);
+				if (distance == FLT_MAX || !test(items[i], ray, distance) || distance > nearest)
+					continue;
+				nearest = distance;
+				found = items[i];
+			}
+			continue;
+		}
+		RayStep left = { node.first, RayEntry(ray, inverse, nodes[node.first].bounds, nearest) };
+		RayStep right = { node.first + 1, RayEntry(ray, inverse, nodes[node.first + 1].bounds, nearest) };
+		if (right.entry < left.entry)
+			std::swap(left, right);
+		if (right.entry != FLT_MAX)
+			stack.push(right);
+		if (left.entry != FLT_MAX)
+			stack.push(left);
+	}
+	if (found == 0xFFFFFFFFu)
+		return false;
+	hit.item = found;
+	hit.distance = nearest;
+	return true;
+}
+
+template<typename HitTest>
+bool DynamicBVH::raycast(const Ray& ray, RayHit& hit, const HitTest& test) const
+{
+	if (root == NONE)
+		return false;
+	Vec3 inverse(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+	float nearest = ray.maxDistance;
+	uint32_t found = NONE;
+
+	TraversalStack<RayStep> stack(height() + 2);
+	float entry = RayEntry(ray, inverse, nodes[root].bounds, nearest);
+	if (entry != FLT_MAX)
+		stack.push({ root, entry });
+	while (!stack.empty())
+	{
+		RayStep step = stack.pop();
+		if (step.entry > nearest)
+			continue;
+		const Node& node = nodes[step.node];
+		if (node.leaf())
+		{
+			float distance = step.entry;
+			if (!test(node.item, ray, distance) || distance > nearest)
+				continue;
+			nearest = distance;
+			found = node.item;
+			continue;
+		}
+		RayStep first = { node.child1, RayEntry(ray, inverse, nodes[node.child1].bounds, nearest) };
+		RayStep second = { node.child2, RayEntry(ray, inverse, nodes[node.child2].bounds, nearest) };
+		if (second.entry < first.entry)
+			std::swap(first, second);
+		if (second.entry != FLT_MAX)
+			stack.push(second);
+		if (first.entry != FLT_MAX)
+			stack.push(first);
+	}
+	if (found == NONE)
+		return false;
+	hit.item = found;
+	hit.distance = nearest;
+	return true;
+}
@@ -0,0 +1,1349 @@
+#include "Benchmarks.h"
+#include "JobSystem.h"
+#include "BlockCompression.h"
+#include "AssetPack.h"
+#include "AsyncFileSystem.h"
+#include "EntityWorld.h"
+#include "TransformHierarchy.h"
+#include "VectorMath.h"
+#include "FrustumCulling.h"
+#include "BVH.h"
+#include "OcclusionCulling.h"
+#include "../libraries/glfw-3.4/deps/linmath.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace
+{
+	double NowMs()
+	{
+		return std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// enough arithmetic per element that the benchmark measures scheduling and compute, not memory
+	float BusyWork(unsigned int index)
+	{
+		float x = (float)(index & 1023) * 0.001f;
+		for (int i = 0; i < 64; ++i)
+			x = std::sqrt(x * x + 1.0f) * 0.5f + std::sin(x) * 0.25f;
+		return x;
+	}
+
+	struct SourceImage
+	{
+		std::string name;
+		int width;
+		int height;
+		std::vector<uint8_t> pixels;
+	};
+
+	// peak signal to noise over the first channels of each texel, capped for exact matches
+	double Psnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, int channels)
+	{
+		double error = 0.0;
+		size_t samples = 0;
+		for (size_t i = 0; i < a.size(); i += 4)
+		{
+			for (int c = 0; c < channels; ++c)
+			{
+				double d = (double)a[i + c] - (double)b[i + c];
+				error += d * d;
+			}
+			samples += (size_t)channels;
+		}
+		if (samples == 0 || error == 0.0)
+			return 99.0;
+		return 10.0 * std::log10(255.0 * 255.0 * (double)samples / error);
+	}
+
+	struct Position
+	{
+		float x, y, z;
+	};
+
+	struct Velocity
+	{
+		float x, y, z;
+	};
+
+	struct Health
+	{
+		float current, maximum;
+	};
+
+	// what the update would walk over with one object per entity: everything the entity
+	// has, touched or not
+	struct GameObject
+	{
+		Position position;
+		Velocity velocity;
+		Health health;
+		float transform[16];
+		uint32_t flags;
+		char name[28];
+	};
+
+	// the textbook scene graph node the hierarchy is measured against
+	struct SceneNode
+	{
+		Transform local;
+		float world[16];
+		std::vector<SceneNode*> children;
+	};
+
+	void LocalMatrix(const Transform& t, float* m)
+	{
+		float x = t.rotation[0], y = t.rotation[1], z = t.rotation[2], w = t.rotation[3];
+		float rotation[3][3] =
+		{
+			{ 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y) },
+			{ 2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x) },
+			{ 2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y) }
+		};
+		for (int column = 0; column < 3; ++column)
+		{
+			for (int row = 0; row < 3; ++row)
+				m[column * 4 + row] = rotation[column][row] * t.scale[column];
+			m[column * 4 + 3] = 0.0f;
+		}
+		m[12] = t.position[0];
+		m[13] = t.position[1];
+		m[14] = t.position[2];
+		m[15] = 1.0f;
+	}
+
+	void UpdateSceneNode(SceneNode& node, const float* parent)
+	{
+		float local[16];
+		LocalMatrix(node.local, local);
+		for (int column = 0; column < 4; ++column)
+		{
+			for (int row = 0; row < 4; ++row)
+			{
+				float sum = 0.0f;
+				for (int k = 0; k < 4; ++k)
+					sum += parent[k * 4 + row] * local[column * 4 + k];
+				node.world[column * 4 + row] = sum;
+			}
+		}
+		for (SceneNode* child : node.children)
+			UpdateSceneNode(*child, node.world);
+	}
+
+	// what a typical game object keeps its bounds in, culled one at a time
+	struct CullObject
+	{
+		float center[3];
+		float radius;
+		float min[3];
+		float max[3];
+		bool visible;
+	};
+
+	Transform RandomTransform(uint32_t& state)
+	{
+		auto next = [&state]()
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return (float)(state & 0xFFFF) / 65535.0f * 2.0f - 1.0f;
+		};
+		Transform t;
+		for (int i = 0; i < 3; ++i)
+			t.position[i] = next();
+		float angle = next() * 3.14159265f;
+		t.rotation[2] = std::sin(angle * 0.5f);
+		t.rotation[3] = std::cos(angle * 0.5f);
+		return t;
+	}
+}
+
+void Benchmarks::JobSystemScaling(unsigned int maxWorkers)
+{
+	const unsigned int ELEMENT_COUNT = 1u << 18;
+	const unsigned int GRAIN = 1024;
+	const int RUNS = 5;
+
+	if (maxWorkers == 0)
+		maxWorkers = std::thread::hardware_concurrency();
+	if (maxWorkers == 0)
+		maxWorkers = 1;
+
+	std::vector<float> output(ELEMENT_COUNT);
+	double baseline = 0.0;
+
+	std::cout << "== job system scaling: " << ELEMENT_COUNT << " elements, grain " << GRAIN << " ==" << std::endl;
+	for (unsigned int workers = 1; workers <= maxWorkers; ++workers)
+	{
+		JobSystem jobs(workers);
+
+		// best of several runs, the first one also warms up the workers
+		double best = 1e30;
+		for (int run = 0; run < RUNS; ++run)
+		{
+			double start = NowMs();
+			jobs.parallelFor(ELEMENT_COUNT, GRAIN, [&output](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int i = begin; i < end; ++i)
+					output[i] = BusyWork(i);
+			});
+			double elapsed = NowMs() - start;
+			if (elapsed < best)
+				best = elapsed;
+		}
+		if (workers == 1)
+			baseline = best;
+
+		double speedup = baseline / best;
+		char line[128];
+		std::snprintf(line, sizeof(line), "workers %3u  %9.3f ms  speedup %6.2fx  efficiency %5.1f%%",
+			workers, best, speedup, 100.0 * speedup / (double)workers);
+		std::cout << line << std::endl;
+	}
+
+	// keep the optimizer from dropping the work
+	double checksum = 0.0;
+	for (unsigned int i = 0; i < ELEMENT_COUNT; i += 4096)
+		checksum += output[i];
+	std::cout << "checksum " << checksum << std::endl;
+}
+
+void Benchmarks::BlockCompression(const std::vector<std::string>& images)
+{
+	std::vector<std::string> paths = images;
+	if (paths.empty())
+	{
+		std::error_code error;
+		for (const auto& file : std::filesystem::directory_iterator("./assets/textures", error))
+		{
+			if (file.is_regular_file())
+				paths.push_back(file.path().string());
+		}
+	}
+
+	std::vector<SourceImage> sources;
+	for (const std::string& path : paths)
+	{
+		int width = 0, height = 0, channels = 0;
+		unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+		if (!pixels)
+		{
+			std::cout << "ERROR::BENCHMARK::IMAGE_NOT_LOADED " << path << std::endl;
+			continue;
+		}
+		SourceImage source;
+		source.name = std::filesystem::path(path).filename().string();
+		source.width = width;
+		source.height = height;
+		source.pixels.assign(pixels, pixels + (size_t)width * height * 4);
+		stbi_image_free(pixels);
+		sources.push_back(std::move(source));
+	}
+	if (sources.empty())
+	{
+		std::cout << "ERROR::BENCHMARK::NO_IMAGES" << std::endl;
+		return;
+	}
+
+	struct FormatCase
+	{
+		const char* name;
+		TextureFormat format;
+		// channels compared: BC1 drops alpha to one bit, BC4/BC5 only keep R / RG
+		int channels;
+	};
+	const FormatCase FORMATS[] = {
+		{ "BC1", TextureFormat::BC1, 3 },
+		{ "BC3", TextureFormat::BC3, 4 },
+		{ "BC4", TextureFormat::BC4, 1 },
+		{ "BC5", TextureFormat::BC5, 2 },
+		{ "BC7", TextureFormat::BC7, 4 },
+	};
+	const char* QUALITY_NAMES[] = { "fast", "normal", "high" };
+	const CompressionQuality QUALITIES[] = { CompressionQuality::Fast, CompressionQuality::Normal, CompressionQuality::High };
+
+	JobSystem jobs;
+	std::cout << "== block compression: " << sources.size() << " images, " << jobs.workerCount() << " workers ==" << std::endl;
+	std::vector<uint8_t> blocks;
+	std::vector<uint8_t> decoded;
+	for (const SourceImage& source : sources)
+	{
+		std::cout << source.name << " (" << source.width << "x" << source.height << ")" << std::endl;
+		double megapixels = (double)source.width * source.height / 1e6;
+		for (const FormatCase& format : FORMATS)
+		{
+			for (int q = 0; q < 3; ++q)
+			{
+				double start = NowMs();
+				CompressImage(&jobs, format.format, QUALITIES[q], source.pixels.data(), source.width, source.height, blocks);
+				double encodeMs = NowMs() - start;
+
+				DecompressImage(format.format, blocks.data(), source.width, source.height, decoded);
+				double psnr = Psnr(source.pixels, decoded, format.channels);
+
+				char line[128];
+				std::snprintf(line, sizeof(line), "  %s %-6s  %9.3f ms  %8.2f MPix/s  PSNR %6.2f dB",
+					format.name, QUALITY_NAMES[q], encodeMs, megapixels / (encodeMs / 1000.0), psnr);
+				std::cout << line << std::endl;
+			}
+		}
+	}
+}
+
+void Benchmarks::PackStreaming(const std::string& path)
+{
+	const int RUNS = 3;
+
+	AssetPack pack;
+	if (!pack.open(path))
+	{
+		std::cout << "ERROR::BENCHMARK::PACK_NOT_OPENED " << path << std::endl;
+		return;
+	}
+
+	// every file gets its own spot in one destination, the way a level load would fill staging
+	std::vector<size_t> offsets(pack.fileCount() + 1, 0);
+	size_t storedBytes = 0;
+	size_t compressedFiles = 0;
+	for (size_t i = 0; i < pack.fileCount(); ++i)
+	{
+		offsets[i + 1] = offsets[i] + pack.size(i);
+		storedBytes += pack.file(i).size();
+		compressedFiles += pack.compressed(i) ? 1 : 0;
+	}
+	size_t totalBytes = offsets.back();
+	std::vector<std::byte> destination(totalBytes);
+
+	unsigned int maxWorkers = std::thread::hardware_concurrency();
+	if (maxWorkers == 0)
+		maxWorkers = 1;
+
+	char line[160];
+	std::snprintf(line, sizeof(line), "== pack streaming: %zu files (%zu compressed), %.1f MiB -> %.1f MiB, ratio %.2f ==",
+		pack.fileCount(), compressedFiles, (double)storedBytes / (1024.0 * 1024.0), (double)totalBytes / (1024.0 * 1024.0),
+		storedBytes ? (double)totalBytes / (double)storedBytes : 0.0);
+	std::cout << line << std::endl;
+
+	double baseline = 0.0;
+	for (unsigned int workers = 1; workers <= maxWorkers; ++workers)
+	{
+		JobSystem jobs(workers);
+
+		// best of several runs, the first one also pulls the pack into the page cache
+		double best = 1e30;
+		bool valid = true;
+		for (int run = 0; run < RUNS; ++run)
+		{
+			std::atomic<bool> failed{ false };
+			double start = NowMs();
+			jobs.parallelFor((unsigned int)pack.fileCount(), 1, [&](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int i = begin; i < end; ++i)
+				{
+					if (!pack.read(i, destination.data() + offsets[i], &jobs))
+						failed.store(true, std::memory_order_relaxed);
+				}
+			});
+			double elapsed = NowMs() - start;
+			valid = valid && !failed.load();
+			if (elapsed < best)
+				best = elapsed;
+		}
+		if (workers == 1)
+			baseline = best;
+
+		std::snprintf(line, sizeof(line), "workers %3u  %9.3f ms  %7.2f GB/s  speedup %6.2fx%s", workers, best,
+			(double)totalBytes / (best * 1e6), baseline / best, valid ? "" : "  CORRUPT");
+		std::cout << line << std::endl;
+	}
+}
+
+void Benchmarks::AsyncReads(const std::string& path)
+{
+	const size_t READ_COUNT = 4096;
+	const size_t READ_BYTES = 64 * 1024;
+	const unsigned int MAX_REQUESTS = 1024;
+	const unsigned int QUEUE_DEPTH = 256;
+
+	std::error_code error;
+	uint64_t fileSize = std::filesystem::file_size(path, error);
+	if (error || fileSize < READ_BYTES)
+	{
+		std::cout << "ERROR::BENCHMARK::FILE_TOO_SMALL " << path << std::endl;
+		return;
+	}
+
+	// the same offsets for every run so all of them see the same page cache
+	std::vector<uint64_t> offsets(READ_COUNT);
+	uint32_t state = 0x9E3779B9u;
+	for (uint64_t& offset : offsets)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		offset = (uint64_t)state % (fileSize - READ_BYTES + 1);
+	}
+	std::vector<unsigned char> destination(MAX_REQUESTS * READ_BYTES);
+
+	char line[160];
+	auto report = [&](const char* name, double ms)
+	{
+		std::snprintf(line, sizeof(line), "%-10s %9.3f ms  %9.0f reads/s  %8.1f MB/s", name, ms,
+			(double)READ_COUNT * 1000.0 / ms, (double)(READ_COUNT * READ_BYTES) / (ms * 1000.0));
+		std::cout << line << std::endl;
+	};
+
+	std::cout << "== async reads: " << READ_COUNT << " x " << READ_BYTES / 1024 << " KiB from " << path
+		<< ", queue depth " << QUEUE_DEPTH << " ==" << std::endl;
+
+	double start = NowMs();
+	std::ifstream file(path, std::ios::binary);
+	for (size_t i = 0; i < READ_COUNT; ++i)
+	{
+		file.seekg((std::streamoff)offsets[i]);
+		file.read((char*)destination.data() + (i % MAX_REQUESTS) * READ_BYTES, READ_BYTES);
+	}
+	report("blocking", NowMs() - start);
+
+	for (int forceThreads = 0; forceThreads < 2; ++forceThreads)
+	{
+		AsyncFileSystem files(MAX_REQUESTS, QUEUE_DEPTH, 4, forceThreads != 0);
+		// io_uring isn't there to compare against
+		if (!forceThreads && std::string(files.backend()) != "io_uring")
+			continue;
+
+		std::vector<AsyncFileSystem::Request> requests(MAX_REQUESTS);
+		start = NowMs();
+		for (size_t i = 0; i < READ_COUNT; ++i)
+		{
+			// each buffer is reused once its previous read is done
+			size_t slot = i % MAX_REQUESTS;
+			files.wait(requests[slot]);
+			requests[slot] = files.read(path, offsets[i], READ_BYTES, destination.data() + slot * READ_BYTES);
+		}
+		files.waitAll();
+		report(files.backend(), NowMs() - start);
+	}
+}
+
+void Benchmarks::EntityIteration(unsigned int count)
+{
+	const int RUNS = 10;
+	const float DT = 1.0f / 60.0f;
+
+	std::cout << "== entity iteration: " << count << " entities ==" << std::endl;
+	char line[128];
+	auto report = [&](const char* name, double ms)
+	{
+		std::snprintf(line, sizeof(line), "%-16s %9.3f ms  %8.2f ns/entity", name, ms, ms * 1e6 / (double)count);
+		std::cout << line << std::endl;
+	};
+	// best of several runs
+	auto time = [&](const auto& update)
+	{
+		double best = 1e30;
+		for (int run = 0; run < RUNS; ++run)
+		{
+			double start = NowMs();
+			update();
+			double elapsed = NowMs() - start;
+			if (elapsed < best)
+				best = elapsed;
+		}
+		return best;
+	};
+
+	std::vector<GameObject> objects(count);
+	for (unsigned int i = 0; i < count; ++i)
+		objects[i].velocity = { (float)(i & 15), 1.0f, -1.0f };
+	report("objects", time([&]()
+	{
+		for (GameObject& object : objects)
+		{
+			object.position.x += object.velocity.x * DT;
+			object.position.y += object.velocity.y * DT;
+			object.position.z += object.velocity.z * DT;
+		}
+	}));
+
+	// a quarter of the entities have health too, so the query spans two archetypes
+	EntityWorld world;
+	double start = NowMs();
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		Velocity velocity = { (float)(i & 15), 1.0f, -1.0f };
+		if ((i & 3) == 0)
+			world.create(Position{}, velocity, Health{ 100.0f, 100.0f });
+		else
+			world.create(Position{}, velocity);
+	}
+	report("create", NowMs() - start);
+
+	EntityWorld::Query& moving = world.query<Position, Velocity>();
+	auto integrate = [DT](Entity, Position& position, const Velocity& velocity)
+	{
+		position.x += velocity.x * DT;
+		position.y += velocity.y * DT;
+		position.z += velocity.z * DT;
+	};
+	report("each", time([&]() { world.each<Position, Velocity>(moving, integrate); }));
+
+	unsigned int workers = std::thread::hardware_concurrency();
+	JobSystem jobs(workers > 0 ? workers : 1);
+	char name[32];
+	std::snprintf(name, sizeof(name), "parallel x%u", jobs.workerCount());
+	report(name, time([&]() { world.parallelEach<Position, Velocity>(jobs, moving, integrate); }));
+
+	// keep the optimizer from dropping the work
+	double checksum = 0.0;
+	world.each<Position>(moving, [&checksum](Entity, const Position& position) { checksum += position.x; });
+	for (unsigned int i = 0; i < count; i += 4096)
+		checksum += objects[i].position.x;
+	std::cout << world.archetypeCount() << " archetypes, " << world.chunkCount() << " chunks, checksum " << checksum << std::endl;
+}
+
+void Benchmarks::TransformUpdate(unsigned int count)
+{
+	const unsigned int ROOTS = 256;
+	const int RUNS = 10;
+	// the share of nodes that move every frame
+	const unsigned int MOVING_PERCENT = 2;
+
+	if (count < ROOTS)
+		count = ROOTS;
+
+	// random recursive tree: each node hangs off a random earlier one
+	uint32_t state = 0x2545F491u;
+	std::vector<unsigned int> parents(count);
+	std::vector<Transform> locals(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		parents[i] = i < ROOTS ? ~0u : state % i;
+		locals[i] = RandomTransform(state);
+	}
+
+	std::cout << "== transform update: " << count << " nodes, " << MOVING_PERCENT << "% moving ==" << std::endl;
+	char line[128];
+	auto report = [&](const char* name, double ms, size_t updated)
+	{
+		std::snprintf(line, sizeof(line), "%-18s %9.3f ms  %8zu matrices", name, ms, updated);
+		std::cout << line << std::endl;
+	};
+	auto best = [&](const auto& run)
+	{
+		double fastest = 1e30;
+		for (int i = 0; i < RUNS; ++i)
+		{
+			double elapsed = run();
+			if (elapsed < fastest)
+				fastest = elapsed;
+		}
+		return fastest;
+	};
+
+	std::vector<std::unique_ptr<SceneNode>> sceneNodes(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		sceneNodes[i].reset(new SceneNode());
+		sceneNodes[i]->local = locals[i];
+		if (parents[i] != ~0u)
+			sceneNodes[parents[i]]->children.push_back(sceneNodes[i].get());
+	}
+	const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	report("naive recursive", best([&]()
+	{
+		double start = NowMs();
+		for (unsigned int i = 0; i < ROOTS; ++i)
+			UpdateSceneNode(*sceneNodes[i], identity);
+		return NowMs() - start;
+	}), count);
+
+	TransformHierarchy hierarchy;
+	std::vector<TransformNode> nodes(count);
+	for (unsigned int i = 0; i < count; ++i)
+		nodes[i] = hierarchy.create(parents[i] == ~0u ? TransformNode() : nodes[parents[i]], locals[i]);
+	double start = NowMs();
+	hierarchy.update();
+	report("first update", NowMs() - start, hierarchy.updatedNodes());
+
+	unsigned int workers = std::thread::hardware_concurrency();
+	JobSystem jobs(workers > 0 ? workers : 1);
+	for (JobSystem* pool : { (JobSystem*)nullptr, &jobs })
+	{
+		double ms = best([&]()
+		{
+			for (unsigned int i = 0; i < ROOTS; ++i)
+				hierarchy.setLocal(nodes[i], locals[i]);
+			double start = NowMs();
+			hierarchy.update(pool);
+			return NowMs() - start;
+		});
+		report(pool ? "all, parallel" : "all", ms, hierarchy.updatedNodes());
+
+		ms = best([&]()
+		{
+			for (unsigned int i = 0; i < count * MOVING_PERCENT / 100; ++i)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				unsigned int node = state % count;
+				hierarchy.setLocal(nodes[node], locals[node]);
+			}
+			double start = NowMs();
+			hierarchy.update(pool);
+			return NowMs() - start;
+		});
+		report(pool ? "moving, parallel" : "moving", ms, hierarchy.updatedNodes());
+	}
+
+	// both sides computed the same matrices
+	double difference = 0.0;
+	for (unsigned int i = 0; i < count; i += 97)
+	{
+		const float* world = hierarchy.world(nodes[i]);
+		for (int k = 0; k < 16; ++k)
+			difference = std::max(difference, (double)std::fabs(world[k] - sceneNodes[i]->world[k]));
+	}
+	std::cout << "workers " << jobs.workerCount() << ", largest difference " << difference << std::endl;
+}
+
+void Benchmarks::VectorMathSpeed()
+{
+	const size_t MATRICES = 1024;
+	const size_t POINTS = 1 << 16;
+	const int REPEATS = 200;
+
+	// the same random inputs for both libraries
+	uint32_t state = 0x6C8E9CF5u;
+	auto random = [&state]()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (float)(state & 0xFFFF) / 65535.0f * 2.0f - 1.0f;
+	};
+	std::vector<Mat4> a(MATRICES), b(MATRICES), result(MATRICES);
+	std::vector<mat4x4> linA(MATRICES), linB(MATRICES), linResult(MATRICES);
+	for (size_t i = 0; i < MATRICES; ++i)
+	{
+		for (int column = 0; column < 4; ++column)
+		{
+			for (int row = 0; row < 4; ++row)
+			{
+				a[i][column][row] = linA[i][column][row] = random();
+				b[i][column][row] = linB[i][column][row] = random();
+			}
+		}
+	}
+
+	std::cout << "== vector math: " << MATRICES << " matrices x " << REPEATS << ", " << POINTS << " points ==" << std::endl;
+	char line[160];
+	// every result is checked against linmath's, relative to the largest element of the
+	// matrix so nearly singular inverses don't blow the tolerance up
+	const float TOLERANCE = 1e-3f;
+	bool allMatch = true;
+	auto matrixError = [&]()
+	{
+		float worst = 0.0f;
+		for (size_t i = 0; i < MATRICES; ++i)
+		{
+			float scale = 1.0f;
+			for (int column = 0; column < 4; ++column)
+			{
+				for (int row = 0; row < 4; ++row)
+					scale = std::max(scale, std::fabs(linResult[i][column][row]));
+			}
+			for (int column = 0; column < 4; ++column)
+			{
+				for (int row = 0; row < 4; ++row)
+					worst = std::max(worst, std::fabs(result[i][column][row] - linResult[i][column][row]) / scale);
+			}
+		}
+		return worst;
+	};
+	// best of several rounds, in ns per call
+	auto time = [&](const auto& run, size_t calls)
+	{
+		double best = 1e30;
+		for (int round = 0; round < 5; ++round)
+		{
+			double start = NowMs();
+			for (int repeat = 0; repeat < REPEATS; ++repeat)
+				run();
+			double elapsed = NowMs() - start;
+			if (elapsed < best)
+				best = elapsed;
+		}
+		return best * 1e6 / (double)(calls * REPEATS);
+	};
+	auto report = [&](const char* name, double linmath, double simd, float error)
+	{
+		bool matches = error <= TOLERANCE;
+		allMatch = allMatch && matches;
+		std::snprintf(line, sizeof(line), "%-12s linmath %7.2f ns  VectorMath %7.2f ns  %5.2fx  %s (max error %.2g)",
+			name, linmath, simd, linmath / simd, matches ? "match" : "DIFFER", error);
+		std::cout << line << std::endl;
+	};
+
+	// both timed before the results are compared, which reads whatever the last round left
+	double linmath = 0.0, simd = 0.0;
+	linmath = time([&]()
+	{
+		for (size_t i = 0; i < MATRICES; ++i)
+			mat4x4_mul(linResult[i], linA[i], linB[i]);
+	}, MATRICES);
+	simd = time([&]()
+	{
+		for (size_t i = 0; i < MATRICES; ++i)
+			result[i] = a[i] * b[i];
+	}, MATRICES);
+	report("multiply", linmath, simd, matrixError());
+
+	linmath = time([&]()
+	{
+		for (size_t i = 0; i < MATRICES; ++i)
+			mat4x4_invert(linResult[i], linA[i]);
+	}, MATRICES);
+	simd = time([&]()
+	{
+		for (size_t i = 0; i < MATRICES; ++i)
+			result[i] = Inverse(a[i]);
+	}, MATRICES);
+	report("invert", linmath, simd, matrixError());
+
+	// eyes and targets out of the random matrices' columns
+	linmath = time([&]()
+	{
+		vec3 up = { 0.0f, 1.0f, 0.0f };
+		for (size_t i = 0; i < MATRICES; ++i)
+			mat4x4_look_at(linResult[i], linA[i][0], linB[i][0], up);
+	}, MATRICES);
+	simd = time([&]()
+	{
+		Vec3 up(0.0f, 1.0f, 0.0f);
+		for (size_t i = 0; i < MATRICES; ++i)
+			result[i] = Mat4::LookAt(a[i][0].xyz(), b[i][0].xyz(), up);
+	}, MATRICES);
+	report("look at", linmath, simd, matrixError());
+
+	linmath = time([&]()
+	{
+		for (size_t i = 0; i < MATRICES; ++i)
+			mat4x4_perspective(linResult[i], 1.0f + 0.1f * a[i][0].x, 1.5f, 0.1f, 100.0f);
+	}, MATRICES);
+	simd = time([&]()
+	{
+		for (size_t i = 0; i < MATRICES; ++i)
+			result[i] = Mat4::Perspective(1.0f + 0.1f * a[i][0].x, 1.5f, 0.1f, 100.0f);
+	}, MATRICES);
+	report("perspective", linmath, simd, matrixError());
+
+	// points one vec4 at a time against the structure of arrays batch
+	std::vector<vec4> linPoints(POINTS), linOut(POINTS);
+	std::vector<float> x(POINTS), y(POINTS), z(POINTS), outX(POINTS), outY(POINTS), outZ(POINTS);
+	for (size_t i = 0; i < POINTS; ++i)
+	{
+		linPoints[i][0] = x[i] = random();
+		linPoints[i][1] = y[i] = random();
+		linPoints[i][2] = z[i] = random();
+		linPoints[i][3] = 1.0f;
+	}
+	linmath = time([&]()
+	{
+		for (size_t i = 0; i < POINTS; ++i)
+			mat4x4_mul_vec4(linOut[i], linA[0], linPoints[i]);
+	}, POINTS);
+	simd = time([&]()
+	{
+		TransformPoints(a[0], { x.data(), y.data(), z.data() }, { outX.data(), outY.data(), outZ.data() }, POINTS);
+	}, POINTS);
+	float pointError = 0.0f;
+	const float* out[3] = { outX.data(), outY.data(), outZ.data() };
+	for (size_t i = 0; i < POINTS; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+			pointError = std::max(pointError, std::fabs(out[k][i] - linOut[i][k]) / std::max(1.0f, std::fabs(linOut[i][k])));
+	}
+	report("points", linmath, simd, pointError);
+
+	std::cout << "results " << (allMatch ? "match" : "DIFFER from") << " linmath's" << std::endl;
+}
+
+void Benchmarks::FrustumCulling(unsigned int count)
+{
+	const int RUNS = 20;
+	// objects are scattered through a cube this wide around the camera
+	const float WORLD_SIZE = 2000.0f;
+
+	uint32_t state = 0x3C6EF372u;
+	auto random = [&state]()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (float)(state & 0xFFFF) / 65535.0f;
+	};
+	std::vector<CullObject> objects(count);
+	std::vector<float> x(count), y(count), z(count), radius(count);
+	std::vector<float> minX(count), minY(count), minZ(count), maxX(count), maxY(count), maxZ(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		CullObject& object = objects[i];
+		for (int k = 0; k < 3; ++k)
+			object.center[k] = (random() - 0.5f) * WORLD_SIZE;
+		object.radius = 0.5f + random() * 4.5f;
+		for (int k = 0; k < 3; ++k)
+		{
+			// boxes inside the spheres, so both tests keep about as much
+			float extent = object.radius * (0.3f + random() * 0.4f);
+			object.min[k] = object.center[k] - extent;
+			object.max[k] = object.center[k] + extent;
+		}
+		x[i] = object.center[0];
+		y[i] = object.center[1];
+		z[i] = object.center[2];
+		radius[i] = object.radius;
+		minX[i] = object.min[0];
+		minY[i] = object.min[1];
+		minZ[i] = object.min[2];
+		maxX[i] = object.max[0];
+		maxY[i] = object.max[1];
+		maxZ[i] = object.max[2];
+	}
+
+	Mat4 viewProjection = Mat4::Perspective(1.0472f, 16.0f / 9.0f, 0.1f, WORLD_SIZE * 0.5f)
+		* Mat4::LookAt(Vec3(0.0f, 0.0f, 0.0f), Vec3(0.3f, 0.1f, -1.0f), Vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::FromMatrix(viewProjection);
+
+#if VECTORMATH_AVX2
+	const char* width = "8 per iteration, AVX2";
+#else
+	const char* width = "4 per iteration, SSE";
+#endif
+	std::cout << "== frustum culling: " << count << " objects, " << width << " ==" << std::endl;
+	char line[128];
+	auto report = [&](const char* name, double ms, size_t visible)
+	{
+		std::snprintf(line, sizeof(line), "%-18s %8.3f ms  %8zu visible", name, ms, visible);
+		std::cout << line << std::endl;
+	};
+	auto best = [&](const auto& run)
+	{
+		double fastest = 1e30;
+		for (int i = 0; i < RUNS; ++i)
+		{
+			double start = NowMs();
+			run();
+			double elapsed = NowMs() - start;
+			if (elapsed < fastest)
+				fastest = elapsed;
+		}
+		return fastest;
+	};
+
+	// one object at a time, leaving at the first plane it is behind
+	std::vector<uint32_t> naive;
+	naive.reserve(count);
+	double ms = best([&]()
+	{
+		naive.clear();
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			CullObject& object = objects[i];
+			object.visible = true;
+			for (const Vec4& plane : frustum.planes)
+			{
+				if (plane.x * object.center[0] + plane.y * object.center[1] + plane.z * object.center[2] + plane.w < -object.radius)
+				{
+					object.visible = false;
+					break;
+				}
+			}
+			if (object.visible)
+				naive.push_back(i);
+		}
+	});
+	report("naive spheres", ms, naive.size());
+
+	unsigned int workers = std::thread::hardware_concurrency();
+	JobSystem jobs(workers > 0 ? workers : 1);
+	FrustumCuller culler;
+	SphereArrays spheres = { x.data(), y.data(), z.data(), radius.data() };
+	BoxArrays boxes = { minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data() };
+	bool matches = true;
+	for (JobSystem* pool : { (JobSystem*)nullptr, &jobs })
+	{
+		ms = best([&]() { culler.cullSpheres(frustum, spheres, count, pool); });
+		report(pool ? "spheres, parallel" : "spheres", ms, culler.visibleCount());
+		matches = matches && culler.visibleCount() == naive.size()
+			&& std::equal(naive.begin(), naive.end(), culler.visible());
+
+		ms = best([&]() { culler.cullBoxes(frustum, boxes, count, pool); });
+		report(pool ? "boxes, parallel" : "boxes", ms, culler.visibleCount());
+	}
+	std::cout << "workers " << jobs.workerCount() << ", sphere lists " << (matches ? "match" : "DIFFER") << std::endl;
+}
+
+void Benchmarks::BoundingVolumes(unsigned int count)
+{
+	const int RUNS = 10;
+	const float WORLD_SIZE = 2000.0f;
+	const unsigned int RAYS = 10000;
+	// rays checked against testing every box
+	const unsigned int CHECKED_RAYS = 20;
+	const unsigned int OVERLAPS = 10000;
+	const float OVERLAP_SIZE = 20.0f;
+	const unsigned int MOVING_PERCENT = 10;
+
+	uint32_t state = 0x3C6EF372u;
+	auto random = [&state]()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (float)(state & 0xFFFF) / 65535.0f;
+	};
+	auto randomBox = [&](const Vec3& center)
+	{
+		Vec3 extent(0.5f + random() * 2.0f, 0.5f + random() * 2.0f, 0.5f + random() * 2.0f);
+		return Bounds(center - extent, center + extent);
+	};
+	std::vector<Bounds> boxes(count);
+	std::vector<float> minX(count), minY(count), minZ(count), maxX(count), maxY(count), maxZ(count);
+	for (unsigned int i = 0; i < count; ++i)
+		boxes[i] = randomBox(Vec3((random() - 0.5f) * WORLD_SIZE, (random() - 0.5f) * WORLD_SIZE, (random() - 0.5f) * WORLD_SIZE));
+	auto copyBoxes = [&]()
+	{
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			minX[i] = boxes[i].min.x;
+			minY[i] = boxes[i].min.y;
+			minZ[i] = boxes[i].min.z;
+			maxX[i] = boxes[i].max.x;
+			maxY[i] = boxes[i].max.y;
+			maxZ[i] = boxes[i].max.z;
+		}
+	};
+	copyBoxes();
+
+	Frustum frustum = Frustum::FromMatrix(Mat4::Perspective(1.0472f, 16.0f / 9.0f, 0.1f, WORLD_SIZE * 0.25f)
+		* Mat4::LookAt(Vec3(0.0f, 0.0f, 0.0f), Vec3(0.3f, 0.1f, -1.0f), Vec3(0.0f, 1.0f, 0.0f)));
+
+	std::cout << "== bounding volume hierarchy: " << count << " boxes ==" << std::endl;
+	char line[128];
+	auto report = [&](const char* name, double ms, size_t found)
+	{
+		std::snprintf(line, sizeof(line), "%-18s %9.3f ms  %8zu", name, ms, found);
+		std::cout << line << std::endl;
+	};
+	auto best = [&](const auto& run)
+	{
+		double fastest = 1e30;
+		for (int i = 0; i < RUNS; ++i)
+		{
+			double start = NowMs();
+			run();
+			double elapsed = NowMs() - start;
+			if (elapsed < fastest)
+				fastest = elapsed;
+		}
+		return fastest;
+	};
+	double ms = 0.0;
+	bool matches = true;
+	auto sameItems = [&](std::vector<uint32_t> found, const uint32_t* expected, size_t expectedCount)
+	{
+		std::sort(found.begin(), found.end());
+		matches = matches && found.size() == expectedCount && std::equal(found.begin(), found.end(), expected);
+	};
+
+	// culling: every box through FrustumCuller against the trees
+	FrustumCuller culler;
+	BoxArrays arrays = { minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data() };
+	ms = best([&]() { culler.cullBoxes(frustum, arrays, count); });
+	report("linear cull", ms, culler.visibleCount());
+
+	StaticBVH staticTree;
+	double start = NowMs();
+	staticTree.build(boxes.data(), count);
+	report("static build", NowMs() - start, staticTree.nodeCount());
+
+	std::vector<uint32_t> found;
+	found.reserve(count);
+	ms = best([&]()
+	{
+		found.clear();
+		staticTree.cull(frustum, found);
+	});
+	report("static cull", ms, found.size());
+	sameItems(found, culler.visible(), culler.visibleCount());
+
+	// dynamic tree margins are left at zero so its cull keeps the same boxes
+	DynamicBVH dynamicTree(0.0f);
+	std::vector<uint32_t> proxies(count);
+	start = NowMs();
+	for (unsigned int i = 0; i < count; ++i)
+		proxies[i] = dynamicTree.insert(boxes[i], i);
+	report("dynamic insert", NowMs() - start, dynamicTree.leafCount());
+	std::snprintf(line, sizeof(line), "dynamic tree: height %d, cost %.1f", dynamicTree.height(), dynamicTree.cost());
+	std::cout << line << std::endl;
+
+	ms = best([&]()
+	{
+		found.clear();
+		dynamicTree.cull(frustum, found);
+	});
+	report("dynamic cull", ms, found.size());
+	sameItems(found, culler.visible(), culler.visibleCount());
+
+	// a few percent of the objects move, those leaving their fattened boxes are reinserted...
+	size_t moved = 0;
+	ms = best([&]()
+	{
+		moved = 0;
+		for (unsigned int i = 0; i < count * MOVING_PERCENT / 100; ++i)
+		{
+			unsigned int object = (unsigned int)(random() * (count - 1));
+			Vec3 step((random() - 0.5f) * 20.0f, (random() - 0.5f) * 20.0f, (random() - 0.5f) * 20.0f);
+			boxes[object] = Bounds(boxes[object].min + step, boxes[object].max + step);
+			moved += dynamicTree.update(proxies[object], boxes[object]) ? 1 : 0;
+		}
+	});
+	report("dynamic update", ms, moved);
+
+	// ...or everything moves a little and the tree is refitted once
+	ms = best([&]()
+	{
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			Vec3 step((float)(i % 3) - 1.0f, 0.0f, 0.0f);
+			boxes[i] = Bounds(boxes[i].min + step, boxes[i].max + step);
+			dynamicTree.setBounds(proxies[i], boxes[i]);
+		}
+		dynamicTree.refit();
+	});
+	report("dynamic refit", ms, count);
+	std::snprintf(line, sizeof(line), "dynamic tree: height %d, cost %.1f", dynamicTree.height(), dynamicTree.cost());
+	std::cout << line << std::endl;
+
+	copyBoxes();
+	culler.cullBoxes(frustum, arrays, count);
+	found.clear();
+	dynamicTree.cull(frustum, found);
+	sameItems(found, culler.visible(), culler.visibleCount());
+	staticTree.build(boxes.data(), count);
+
+	// picking rays from the middle of the world, nearest box
+	std::vector<Ray> rays(RAYS);
+	for (Ray& ray : rays)
+		ray.direction = Normalize(Vec3(random() - 0.5f, random() - 0.5f, random() - 0.5f));
+	size_t hits = 0;
+	std::vector<RayHit> staticHits(RAYS), dynamicHits(RAYS);
+	ms = best([&]()
+	{
+		hits = 0;
+		for (unsigned int i = 0; i < RAYS; ++i)
+			hits += staticTree.raycast(rays[i], staticHits[i]) ? 1 : 0;
+	});
+	report("static rays", ms, hits);
+	ms = best([&]()
+	{
+		hits = 0;
+		for (unsigned int i = 0; i < RAYS; ++i)
+			hits += dynamicTree.raycast(rays[i], dynamicHits[i]) ? 1 : 0;
+	});
+	report("dynamic rays", ms, hits);
+	for (unsigned int i = 0; i < CHECKED_RAYS; ++i)
+	{
+		Vec3 inverse(1.0f / rays[i].direction.x, 1.0f / rays[i].direction.y, 1.0f / rays[i].direction.z);
+		float nearest = FLT_MAX;
+		for (const Bounds& box : boxes)
+			nearest = std::min(nearest, RayEntry(rays[i], inverse, box, FLT_MAX));
+		matches = matches && staticHits[i].distance == nearest && dynamicHits[i].distance == nearest;
+	}
+
+	std::vector<Bounds> queries(OVERLAPS);
+	for (Bounds& query : queries)
+	{
+		Vec3 center((random() - 0.5f) * WORLD_SIZE, (random() - 0.5f) * WORLD_SIZE, (random() - 0.5f) * WORLD_SIZE);
+		query = Bounds(center - Vec3(OVERLAP_SIZE), center + Vec3(OVERLAP_SIZE));
+	}
+	ms = best([&]()
+	{
+		found.clear();
+		for (const Bounds& query : queries)
+			staticTree.overlap(query, found);
+	});
+	report("static overlaps", ms, found.size());
+	ms = best([&]()
+	{
+		found.clear();
+		for (const Bounds& query : queries)
+			dynamicTree.overlap(query, found);
+	});
+	report("dynamic overlaps", ms, found.size());
+
+	std::cout << "results " << (matches ? "match" : "DIFFER") << " the brute force ones" << std::endl;
+}
+
+void Benchmarks::OcclusionCulling(unsigned int count)
+{
+	const int RUNS = 10;
+	const int WIDTH = 320;
+	const int HEIGHT = 192;
+	// a grid of rooms with a doorway in the middle of every wall
+	const int ROOMS = 12;
+	const float ROOM_SIZE = 8.0f;
+	const float WALL_HEIGHT = 3.0f;
+	const float WALL_THICKNESS = 0.2f;
+	const float DOOR_WIDTH = 1.2f;
+
+	uint32_t state = 0x9E3779B9u;
+	auto random = [&state]()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (float)(state & 0xFFFF) / 65535.0f;
+	};
+
+	// walls are boxes. the cube's triangles are wound counter-clockwise from outside by
+	// flipping any whose normal points at the center
+	auto corner = [](const Bounds& box, uint32_t c)
+	{
+		return Vec3((c & 1) ? box.max.x : box.min.x, (c & 2) ? box.max.y : box.min.y, (c & 4) ? box.max.z : box.min.z);
+	};
+	std::vector<uint32_t> cubeIndices;
+	Bounds unit(Vec3(0.0f), Vec3(1.0f));
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		uint32_t u = 1u << ((axis + 1) % 3), v = 1u << ((axis + 2) % 3);
+		for (uint32_t side = 0; side < 2; ++side)
+		{
+			uint32_t base = side << axis;
+			uint32_t quad[2][3] = { { base, base | u, base | u | v }, { base, base | u | v, base | v } };
+			for (uint32_t* triangle : quad)
+			{
+				Vec3 normal = Cross(corner(unit, triangle[1]) - corner(unit, triangle[0]), corner(unit, triangle[2]) - corner(unit, triangle[0]));
+				if (Dot(normal, corner(unit, triangle[0]) - unit.center()) < 0.0f)
+					std::swap(triangle[1], triangle[2]);
+				cubeIndices.insert(cubeIndices.end(), triangle, triangle + 3);
+			}
+		}
+	}
+
+	std::vector<Bounds> walls;
+	float extent = ROOMS * ROOM_SIZE;
+	for (int line = 0; line <= ROOMS; ++line)
+	{
+		float along = line * ROOM_SIZE;
+		for (int room = 0; room < ROOMS; ++room)
+		{
+			float start = room * ROOM_SIZE;
+			float doorStart = start + (ROOM_SIZE - DOOR_WIDTH) * 0.5f;
+			float doorEnd = doorStart + DOOR_WIDTH;
+			float half = WALL_THICKNESS * 0.5f;
+			walls.push_back(Bounds(Vec3(start, 0.0f, along - half), Vec3(doorStart, WALL_HEIGHT, along + half)));
+			walls.push_back(Bounds(Vec3(doorEnd, 0.0f, along - half), Vec3(start + ROOM_SIZE, WALL_HEIGHT, along + half)));
+			walls.push_back(Bounds(Vec3(along - half, 0.0f, start), Vec3(along + half, WALL_HEIGHT, doorStart)));
+			walls.push_back(Bounds(Vec3(along - half, 0.0f, doorEnd), Vec3(along + half, WALL_HEIGHT, start + ROOM_SIZE)));
+		}
+	}
+
+	// small props scattered over every room
+	std::vector<float> minX(count), minY(count), minZ(count), maxX(count), maxY(count), maxZ(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		Vec3 size(0.1f + random() * 0.4f, 0.1f + random() * 0.8f, 0.1f + random() * 0.4f);
+		Vec3 position(random() * (extent - size.x), random() * (WALL_HEIGHT - size.y), random() * (extent - size.z));
+		minX[i] = position.x;
+		minY[i] = position.y;
+		minZ[i] = position.z;
+		maxX[i] = position.x + size.x;
+		maxY[i] = position.y + size.y;
+		maxZ[i] = position.z + size.z;
+	}
+	BoxArrays boxes = { minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data() };
+
+	// standing in a room in the middle, looking through the doorway and along a row of rooms
+	Vec3 eye(extent * 0.5f - ROOM_SIZE * 0.3f, 1.6f, extent * 0.5f - ROOM_SIZE * 0.3f);
+	Mat4 viewProjection = Mat4::Perspective(1.0472f, (float)WIDTH / HEIGHT, 0.1f, extent * 1.5f)
+		* Mat4::LookAt(eye, eye + Vec3(0.15f, -0.05f, 1.0f), Vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::FromMatrix(viewProjection);
+
+#if VECTORMATH_AVX2
+	const char* rasterizer = "AVX2";
+#else
+	const char* rasterizer = "scalar";
+#endif
+	std::cout << "== occlusion culling: " << count << " objects, " << walls.size() << " walls at " << WIDTH << "x" << HEIGHT
+		<< ", " << rasterizer << " ==" << std::endl;
+	char line[128];
+	auto report = [&](const char* name, double ms, size_t visible)
+	{
+		std::snprintf(line, sizeof(line), "%-20s %8.3f ms  %8zu", name, ms, visible);
+		std::cout << line << std::endl;
+	};
+	auto best = [&](const auto& run)
+	{
+		double fastest = 1e30;
+		for (int i = 0; i < RUNS; ++i)
+		{
+			double start = NowMs();
+			run();
+			double elapsed = NowMs() - start;
+			if (elapsed < fastest)
+				fastest = elapsed;
+		}
+		return fastest;
+	};
+
+	FrustumCuller frustumCuller;
+	double ms = best([&]() { frustumCuller.cullBoxes(frustum, boxes, count); });
+	report("frustum", ms, frustumCuller.visibleCount());
+
+	unsigned int workers = std::thread::hardware_concurrency();
+	JobSystem jobs(workers > 0 ? workers : 1);
+	OcclusionCuller occlusion(WIDTH, HEIGHT);
+	std::vector<uint32_t> candidates;
+	size_t visible = 0;
+	for (JobSystem* pool : { (JobSystem*)nullptr, &jobs })
+	{
+		size_t triangles = 0;
+		ms = best([&]()
+		{
+			occlusion.clear();
+			Vec3 vertices[8];
+			for (const Bounds& wall : walls)
+			{
+				for (uint32_t c = 0; c < 8; ++c)
+					vertices[c] = corner(wall, c);
+				occlusion.addOccluder(viewProjection, vertices, 8, cubeIndices.data(), cubeIndices.size() / 3);
+			}
+			triangles = occlusion.queuedTriangles();
+			occlusion.rasterize(pool);
+		});
+		report(pool ? "rasterize, parallel" : "rasterize", ms, triangles);
+
+		ms = best([&]()
+		{
+			candidates.assign(frustumCuller.visible(), frustumCuller.visible() + frustumCuller.visibleCount());
+			visible = occlusion.cull(viewProjection, boxes, candidates.data(), candidates.size(), pool);
+		});
+		report(pool ? "test boxes, parallel" : "test boxes", ms, visible);
+	}
+	candidates.resize(visible);
+
+	// the same occluders in an exact depth buffer, one depth per pixel. a box the masked
+	// buffer hides must be hidden here too
+	std::vector<float> exact((size_t)WIDTH * HEIGHT, FLT_MAX);
+	auto toScreen = [&](const Vec4& clip)
+	{
+		return Vec4((clip.x / clip.w * 0.5f + 0.5f) * WIDTH, (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT, clip.z / clip.w * 0.5f + 0.5f, clip.w);
+	};
+	for (const Bounds& wall : walls)
+	{
+		for (size_t t = 0; t < cubeIndices.size(); t += 3)
+		{
+			Vec4 v[3];
+			bool clipped = false;
+			for (int k = 0; k < 3; ++k)
+			{
+				Vec4 clip = viewProjection * Vec4(corner(wall, cubeIndices[t + k]), 1.0f);
+				clipped = clipped || clip.w <= 1e-5f || clip.z < -clip.w;
+				v[k] = toScreen(clip);
+			}
+			float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+			if (clipped || area <= 0.0f)
+				continue;
+			int x0 = std::max((int)std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x))), 0);
+			int x1 = std::min((int)std::floor(std::max(v[0].x, std::max(v[1].x, v[2].x))), WIDTH - 1);
+			int y0 = std::max((int)std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y))), 0);
+			int y1 = std::min((int)std::floor(std::max(v[0].y, std::max(v[1].y, v[2].y))), HEIGHT - 1);
+			for (int y = y0; y <= y1; ++y)
+			{
+				for (int x = x0; x <= x1; ++x)
+				{
+					float px = x + 0.5f, py = y + 0.5f;
+					float w[3];
+					for (int k = 0; k < 3; ++k)
+					{
+						const Vec4& a = v[(k + 1) % 3];
+						const Vec4& b = v[(k + 2) % 3];
+						w[k] = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+					}
+					if (w[0] < 0.0f || w[1] < 0.0f || w[2] < 0.0f)
+						continue;
+					float depth = (w[0] * v[0].z + w[1] * v[1].z + w[2] * v[2].z) / area;
+					float& stored = exact[(size_t)y * WIDTH + x];
+					stored = std::min(stored, depth);
+				}
+			}
+		}
+	}
+	size_t exactVisible = 0, wronglyHidden = 0;
+	for (size_t i = 0; i < frustumCuller.visibleCount(); ++i)
+	{
+		uint32_t b = frustumCuller.visible()[i];
+		float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX, nearest = FLT_MAX;
+		bool seen = false;
+		for (uint32_t c = 0; c < 8 && !seen; ++c)
+		{
+			Vec4 clip = viewProjection * Vec4(corner(Bounds(Vec3(minX[b], minY[b], minZ[b]), Vec3(maxX[b], maxY[b], maxZ[b])), c), 1.0f);
+			seen = clip.w <= 1e-5f || clip.z < -clip.w;
+			Vec4 screen = toScreen(clip);
+			x0 = std::min(x0, screen.x);
+			x1 = std::max(x1, screen.x);
+			y0 = std::min(y0, screen.y);
+			y1 = std::max(y1, screen.y);
+			nearest = std::min(nearest, screen.z);
+		}
+		if (!seen)
+		{
+			int px0 = std::max((int)std::floor(std::max(x0, -1.0f)), 0), px1 = std::min((int)std::floor(std::min(x1, (float)WIDTH)), WIDTH - 1);
+			int py0 = std::max((int)std::floor(std::max(y0, -1.0f)), 0), py1 = std::min((int)std::floor(std::min(y1, (float)HEIGHT)), HEIGHT - 1);
+			seen = px0 > px1 || py0 > py1;
+			for (int y = py0; y <= py1 && !seen; ++y)
+			{
+				for (int x = px0; x <= px1 && !seen; ++x)
+					seen = nearest < exact[(size_t)y * WIDTH + x];
+			}
+		}
+		exactVisible += seen ? 1 : 0;
+		if (seen && !std::binary_search(candidates.begin(), candidates.end(), b))
+			++wronglyHidden;
+	}
+	std::cout << "workers " << jobs.workerCount() << ", exact depth buffer keeps " << exactVisible
+		<< ", hidden but visible: " << wronglyHidden << std::endl;
+
+	// compare between builds: the AVX2 and scalar rasterizers should cover the same pixels
+	std::vector<float> resolved;
+	occlusion.resolveDepth(resolved);
+	size_t covered = 0;
+	double depthSum = 0.0;
+	for (float depth : resolved)
+	{
+		if (depth < 1.0f)
+		{
+			++covered;
+			depthSum += depth;
+		}
+	}
+	std::snprintf(line, sizeof(line), "masked buffer: %zu pixels covered, mean depth %.6f", covered, covered ? depthSum / covered : 0.0);
+	std::cout << line << std::endl;
+}
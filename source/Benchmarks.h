@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// standalone measurements that don't need a window, selected from main() with --bench-* flags
+namespace Benchmarks
+{
+	// times the same parallelFor workload with 1..maxWorkers workers and prints speedup
+	// maxWorkers of 0 means one per hardware thread
+	void JobSystemScaling(unsigned int maxWorkers);
+
+	// encodes every image in every block format and quality, then decodes it again and
+	// prints throughput and PSNR over the channels the format stores.
+	// an empty list means every image in assets/textures
+	void BlockCompression(const std::vector<std::string>& images);
+
+	// reads every file in the asset pack into one buffer with 1..hardware threads workers,
+	// files and their chunks spread over the workers, and prints decompressed GB/s
+	void PackStreaming(const std::string& path);
+
+	// random reads across a file, one at a time with blocking reads and then all queued on
+	// AsyncFileSystem (io_uring where available, and the thread pool), prints reads/s and MB/s
+	void AsyncReads(const std::string& path);
+
+	// integrates count entities' positions through EntityWorld, serially and on every worker,
+	// next to the same update over an array of fat game objects
+	void EntityIteration(unsigned int count);
+
+	// world matrices for a random hierarchy of count nodes: a naive recursive walk over
+	// heap allocated nodes against TransformHierarchy recomputing everything, and recomputing
+	// only what a few percent of moving nodes dirtied, serially and on every worker
+	void TransformUpdate(unsigned int count);
+
+	// VectorMath against the scalar linmath.h GLFW ships with: 4x4 multiply, inverse,
+	// look-at and perspective, and transforming a batch of points
+	void VectorMathSpeed();
+
+	// count random bounding spheres and boxes against a camera frustum: one game object at a
+	// time with early outs, then FrustumCuller serially and on every worker
+	void FrustumCulling(unsigned int count);
+
+	// count random boxes in a static and a dynamic BVH: build and insert times, frustum
+	// culls against FrustumCuller going through every box, moving objects by reinsertion
+	// and by refitting, then picking rays and overlap queries
+	void BoundingVolumes(unsigned int count);
+
+	// count props in a grid of walled rooms seen from inside one: frustum culling, then the
+	// walls rasterized into OcclusionCuller and the surviving boxes tested against it,
+	// serially and on every worker. the boxes it hides are checked against an exact depth buffer
+	void OcclusionCulling(unsigned int count);
+}
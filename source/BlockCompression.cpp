@@ -0,0 +1,941 @@
+#include "BlockCompression.h"
+#include "JobSystem.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCKCOMPRESSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// one 4x4 block as floats in 0..255, texel i = x + 4 * y
+	struct Block
+	{
+		float texels[16][4];
+	};
+
+	// palette stored channel by channel so four entries can be compared against one texel at once
+	const int MAX_PALETTE = 16;
+	struct Palette
+	{
+		int size;
+		int channels;
+		alignas(16) float values[4][MAX_PALETTE];
+	};
+
+	float Clamp(float value, float low, float high)
+	{
+		return value < low ? low : (value > high ? high : value);
+	}
+
+	int RoundToInt(float value)
+	{
+		return (int)std::floor(value + 0.5f);
+	}
+
+	void LoadBlock(const uint8_t* rgba, int width, int height, int bx, int by, Block& block)
+	{
+		for (int y = 0; y < 4; ++y)
+		{
+			int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+			for (int x = 0; x < 4; ++x)
+			{
+				int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+				const uint8_t* texel = &rgba[((size_t)sy * width + sx) * 4];
+				for (int c = 0; c < 4; ++c)
+					block.texels[y * 4 + x][c] = (float)texel[c];
+			}
+		}
+	}
+
+	// nearest palette entry for every texel, returns the summed squared error.
+	// channels are read starting at firstChannel of each texel
+	float FindIndices(const Block& block, int firstChannel, const Palette& palette, const bool* skip, uint8_t indices[16])
+	{
+		float total = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			if (skip && skip[i])
+				continue;
+
+			const float* texel = &block.texels[i][firstChannel];
+			float best = 1e30f;
+			int bestIndex = 0;
+#if BLOCKCOMPRESSION_SSE2
+			for (int group = 0; group < palette.size; group += 4)
+			{
+				__m128 distance = _mm_setzero_ps();
+				for (int c = 0; c < palette.channels; ++c)
+				{
+					__m128 d = _mm_sub_ps(_mm_load_ps(&palette.values[c][group]), _mm_set1_ps(texel[c]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+				}
+				alignas(16) float lanes[4];
+				_mm_store_ps(lanes, distance);
+				int count = palette.size - group < 4 ? palette.size - group : 4;
+				for (int lane = 0; lane < count; ++lane)
+				{
+					if (lanes[lane] < best)
+					{
+						best = lanes[lane];
+						bestIndex = group + lane;
+					}
+				}
+			}
+#else
+			for (int entry = 0; entry < palette.size; ++entry)
+			{
+				float distance = 0.0f;
+				for (int c = 0; c < palette.channels; ++c)
+				{
+					float d = palette.values[c][entry] - texel[c];
+					distance += d * d;
+				}
+				if (distance < best)
+				{
+					best = distance;
+					bestIndex = entry;
+				}
+			}
+#endif
+			indices[i] = (uint8_t)bestIndex;
+			total += best;
+		}
+		return total;
+	}
+
+	// principal axis of the texels by power iteration on their covariance
+	void PrincipalAxis(const Block& block, int firstChannel, int channels, const bool* skip, float mean[4], float axis[4])
+	{
+		int count = 0;
+		for (int c = 0; c < 4; ++c)
+			mean[c] = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			if (skip && skip[i])
+				continue;
+			for (int c = 0; c < channels; ++c)
+				mean[c] += block.texels[i][firstChannel + c];
+			++count;
+		}
+		for (int c = 0; c < channels; ++c)
+			mean[c] /= (float)(count > 0 ? count : 1);
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			if (skip && skip[i])
+				continue;
+			float d[4];
+			for (int c = 0; c < channels; ++c)
+				d[c] = block.texels[i][firstChannel + c] - mean[c];
+			for (int a = 0; a < channels; ++a)
+				for (int b = 0; b < channels; ++b)
+					covariance[a][b] += d[a] * d[b];
+		}
+
+		for (int c = 0; c < 4; ++c)
+			axis[c] = c < channels ? 1.0f : 0.0f;
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			for (int a = 0; a < channels; ++a)
+				for (int b = 0; b < channels; ++b)
+					next[a] += covariance[a][b] * axis[b];
+			float length = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				length += next[c] * next[c];
+			if (length < 1e-12f)
+				break;
+			length = 1.0f / std::sqrt(length);
+			for (int c = 0; c < channels; ++c)
+				axis[c] = next[c] * length;
+		}
+	}
+
+	// endpoints from the extremes along the principal axis (or the bounding box when fast)
+	void FitEndpoints(const Block& block, int firstChannel, int channels, const bool* skip,
+		CompressionQuality quality, float e0[4], float e1[4])
+	{
+		if (quality == CompressionQuality::Fast)
+		{
+			for (int c = 0; c < channels; ++c)
+			{
+				e0[c] = 255.0f;
+				e1[c] = 0.0f;
+			}
+			for (int i = 0; i < 16; ++i)
+			{
+				if (skip && skip[i])
+					continue;
+				for (int c = 0; c < channels; ++c)
+				{
+					float v = block.texels[i][firstChannel + c];
+					e0[c] = v < e0[c] ? v : e0[c];
+					e1[c] = v > e1[c] ? v : e1[c];
+				}
+			}
+			// pull in by a sixteenth of the range, the extremes are rarely worth an exact hit
+			for (int c = 0; c < channels; ++c)
+			{
+				float inset = (e1[c] - e0[c]) / 16.0f;
+				e0[c] += inset;
+				e1[c] -= inset;
+			}
+			return;
+		}
+
+		float mean[4];
+		float axis[4];
+		PrincipalAxis(block, firstChannel, channels, skip, mean, axis);
+
+		float low = 1e30f, high = -1e30f;
+		for (int i = 0; i < 16; ++i)
+		{
+			if (skip && skip[i])
+				continue;
+			float t = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				t += (block.texels[i][firstChannel + c] - mean[c]) * axis[c];
+			low = t < low ? t : low;
+			high = t > high ? t : high;
+		}
+		if (low > high)
+			low = high = 0.0f;
+		float inset = (high - low) / 16.0f;
+		low += inset;
+		high -= inset;
+		for (int c = 0; c < channels; ++c)
+		{
+			e0[c] = Clamp(mean[c] + axis[c] * low, 0.0f, 255.0f);
+			e1[c] = Clamp(mean[c] + axis[c] * high, 0.0f, 255.0f);
+		}
+	}
+
+	// least squares endpoints for fixed indices, weights[i] is how far index i sits toward e1
+	bool RefineEndpoints(const Block& block, int firstChannel, int channels, const bool* skip,
+		const uint8_t indices[16], const float* weights, float e0[4], float e1[4])
+	{
+		float a = 0.0f, b = 0.0f, c2 = 0.0f;
+		float x0[4] = {}, x1[4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			if (skip && skip[i])
+				continue;
+			float t = weights[indices[i]];
+			float s = 1.0f - t;
+			a += s * s;
+			b += s * t;
+			c2 += t * t;
+			for (int c = 0; c < channels; ++c)
+			{
+				x0[c] += s * block.texels[i][firstChannel + c];
+				x1[c] += t * block.texels[i][firstChannel + c];
+			}
+		}
+
+		float determinant = a * c2 - b * b;
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+		float inverse = 1.0f / determinant;
+		for (int c = 0; c < channels; ++c)
+		{
+			e0[c] = Clamp((c2 * x0[c] - b * x1[c]) * inverse, 0.0f, 255.0f);
+			e1[c] = Clamp((a * x1[c] - b * x0[c]) * inverse, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+	// BC1 color endpoints
+	// -------------------
+	uint16_t To565(const float color[3])
+	{
+		int r = RoundToInt(Clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f);
+		int g = RoundToInt(Clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f);
+		int b = RoundToInt(Clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void From565(uint16_t value, int color[3])
+	{
+		int r = value >> 11, g = (value >> 5) & 63, b = value & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// the palette exactly as a decoder builds it
+	void ColorPalette(uint16_t c0, uint16_t c1, bool fourColor, int colors[4][3])
+	{
+		From565(c0, colors[0]);
+		From565(c1, colors[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			if (fourColor)
+			{
+				colors[2][c] = (2 * colors[0][c] + colors[1][c]) / 3;
+				colors[3][c] = (colors[0][c] + 2 * colors[1][c]) / 3;
+			}
+			else
+			{
+				colors[2][c] = (colors[0][c] + colors[1][c]) / 2;
+				colors[3][c] = 0;
+			}
+		}
+	}
+
+	float ColorIndices(const Block& block, const bool* transparent, uint16_t c0, uint16_t c1, bool fourColor, uint8_t indices[16])
+	{
+		int colors[4][3];
+		ColorPalette(c0, c1, fourColor, colors);
+
+		Palette palette;
+		palette.size = fourColor ? 4 : 3;
+		palette.channels = 3;
+		for (int entry = 0; entry < 4; ++entry)
+			for (int c = 0; c < 3; ++c)
+				palette.values[c][entry] = (float)colors[entry][c];
+
+		float error = FindIndices(block, 0, palette, transparent, indices);
+		if (transparent)
+		{
+			for (int i = 0; i < 16; ++i)
+				if (transparent[i])
+					indices[i] = 3;
+		}
+		return error;
+	}
+
+	// color part of BC1/BC3. without transparent texels the block uses the four color
+	// mode (c0 > c1); with them the three color mode where index 3 is transparent black
+	void EncodeColorBlock(const Block& block, CompressionQuality quality, bool allowTransparent, uint8_t* out)
+	{
+		bool transparent[16];
+		bool anyTransparent = false;
+		bool anyOpaque = false;
+		for (int i = 0; i < 16; ++i)
+		{
+			transparent[i] = allowTransparent && block.texels[i][3] < 128.0f;
+			anyTransparent |= transparent[i];
+			anyOpaque |= !transparent[i];
+		}
+
+		uint32_t bits = 0;
+		uint16_t c0 = 0, c1 = 0;
+		if (!anyOpaque)
+		{
+			// all transparent: c0 <= c1 with every index 3
+			std::memcpy(out, &c0, 2);
+			std::memcpy(out + 2, &c1, 2);
+			bits = 0xFFFFFFFFu;
+			std::memcpy(out + 4, &bits, 4);
+			return;
+		}
+
+		const bool* skip = anyTransparent ? transparent : nullptr;
+		bool fourColor = !anyTransparent;
+		// how far each index sits toward c1
+		const float FOUR_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		const float THREE_WEIGHTS[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+		const float* weights = fourColor ? FOUR_WEIGHTS : THREE_WEIGHTS;
+
+		float e0[4], e1[4];
+		FitEndpoints(block, 0, 3, skip, quality, e0, e1);
+		c0 = To565(e1);
+		c1 = To565(e0);
+		uint8_t indices[16];
+		float error = ColorIndices(block, skip, c0, c1, fourColor, indices);
+
+		int refinements = quality == CompressionQuality::Fast ? 0 : (quality == CompressionQuality::High ? 2 : 1);
+		for (int pass = 0; pass < refinements; ++pass)
+		{
+			float r0[4], r1[4];
+			if (!RefineEndpoints(block, 0, 3, skip, indices, weights, r0, r1))
+				break;
+			uint16_t t0 = To565(r0), t1 = To565(r1);
+			uint8_t trial[16];
+			float trialError = ColorIndices(block, skip, t0, t1, fourColor, trial);
+			if (trialError >= error)
+				break;
+			c0 = t0;
+			c1 = t1;
+			error = trialError;
+			std::memcpy(indices, trial, 16);
+		}
+
+		// put the endpoints in the order the chosen mode needs, remapping indices to match
+		bool swap = fourColor ? c0 < c1 : c0 > c1;
+		if (swap)
+		{
+			uint16_t t = c0;
+			c0 = c1;
+			c1 = t;
+			const uint8_t FOUR_REMAP[4] = { 1, 0, 3, 2 };
+			const uint8_t THREE_REMAP[4] = { 1, 0, 2, 3 };
+			for (int i = 0; i < 16; ++i)
+				indices[i] = fourColor ? FOUR_REMAP[indices[i]] : THREE_REMAP[indices[i]];
+		}
+		if (fourColor && c0 == c1)
+		{
+			// both endpoints equal means three color mode to a decoder, index 0 is still c0
+			for (int i = 0; i < 16; ++i)
+				indices[i] = 0;
+		}
+
+		for (int i = 0; i < 16; ++i)
+			bits |= (uint32_t)indices[i] << (2 * i);
+		std::memcpy(out, &c0, 2);
+		std::memcpy(out + 2, &c1, 2);
+		std::memcpy(out + 4, &bits, 4);
+	}
+
+	// BC4 single channel blocks, also the alpha of BC3 and both halves of BC5
+	// ------------------------------------------------------------------------
+	void AlphaPalette(int a0, int a1, int values[8])
+	{
+		values[0] = a0;
+		values[1] = a1;
+		if (a0 > a1)
+		{
+			for (int i = 1; i < 7; ++i)
+				values[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; ++i)
+				values[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+			values[6] = 0;
+			values[7] = 255;
+		}
+	}
+
+	float AlphaIndices(const Block& block, int channel, int a0, int a1, uint8_t indices[16])
+	{
+		int values[8];
+		AlphaPalette(a0, a1, values);
+		Palette palette;
+		palette.size = 8;
+		palette.channels = 1;
+		for (int entry = 0; entry < 8; ++entry)
+			palette.values[0][entry] = (float)values[entry];
+		return FindIndices(block, channel, palette, nullptr, indices);
+	}
+
+	void EncodeAlphaBlock(const Block& block, int channel, CompressionQuality quality, uint8_t* out)
+	{
+		int low = 255, high = 0;
+		int innerLow = 255, innerHigh = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			int v = (int)block.texels[i][channel];
+			low = v < low ? v : low;
+			high = v > high ? v : high;
+			if (v != 0 && v != 255)
+			{
+				innerLow = v < innerLow ? v : innerLow;
+				innerHigh = v > innerHigh ? v : innerHigh;
+			}
+		}
+
+		int best0 = high, best1 = low;
+		uint8_t indices[16];
+		float error = AlphaIndices(block, channel, best0, best1, indices);
+
+		if (quality == CompressionQuality::High && high > low)
+		{
+			uint8_t trial[16];
+			// nudge the endpoints of the eight value mode
+			for (int d0 = -2; d0 <= 2; ++d0)
+			{
+				for (int d1 = -2; d1 <= 2; ++d1)
+				{
+					int a0 = high + d0, a1 = low + d1;
+					if (a0 > 255 || a1 < 0 || a0 <= a1)
+						continue;
+					float trialError = AlphaIndices(block, channel, a0, a1, trial);
+					if (trialError < error)
+					{
+						error = trialError;
+						best0 = a0;
+						best1 = a1;
+						std::memcpy(indices, trial, 16);
+					}
+				}
+			}
+
+			// six value mode gets exact 0 and 255 for free
+			if (innerLow <= innerHigh)
+			{
+				float trialError = AlphaIndices(block, channel, innerLow, innerHigh, trial);
+				if (trialError < error)
+				{
+					error = trialError;
+					best0 = innerLow;
+					best1 = innerHigh;
+					std::memcpy(indices, trial, 16);
+				}
+			}
+		}
+
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; ++i)
+			bits |= (uint64_t)indices[i] << (3 * i);
+		out[0] = (uint8_t)best0;
+		out[1] = (uint8_t)best1;
+		for (int i = 0; i < 6; ++i)
+			out[2 + i] = (uint8_t)(bits >> (8 * i));
+	}
+
+	// BC7 bit packing
+	// ---------------
+	struct BitWriter
+	{
+		uint8_t* out;
+		int position;
+
+		void write(uint32_t value, int count)
+		{
+			for (int i = 0; i < count; ++i, ++position)
+			{
+				if (value & (1u << i))
+					out[position >> 3] |= (uint8_t)(1u << (position & 7));
+			}
+		}
+	};
+
+	struct BitReader
+	{
+		const uint8_t* in;
+		int position;
+
+		uint32_t read(int count)
+		{
+			uint32_t value = 0;
+			for (int i = 0; i < count; ++i, ++position)
+				value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << i;
+			return value;
+		}
+	};
+
+	const int BC7_WEIGHTS2[4] = { 0, 21, 43, 64 };
+	const int BC7_WEIGHTS3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	int Bc7Interpolate(int e0, int e1, int weight)
+	{
+		return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+	}
+
+	// mode 6 endpoint: seven bits per channel plus one shared p-bit
+	struct Bc7Endpoint
+	{
+		int value[4];
+		int pbit;
+	};
+
+	Bc7Endpoint QuantizeBc7(const float color[4], int pbit)
+	{
+		Bc7Endpoint endpoint;
+		endpoint.pbit = pbit;
+		for (int c = 0; c < 4; ++c)
+		{
+			int q = RoundToInt((color[c] - (float)pbit) * 0.5f);
+			endpoint.value[c] = q < 0 ? 0 : (q > 127 ? 127 : q);
+		}
+		return endpoint;
+	}
+
+	// pick the p-bit that lands closest to the color
+	Bc7Endpoint QuantizeBc7(const float color[4])
+	{
+		Bc7Endpoint best = QuantizeBc7(color, 0);
+		float bestError = 1e30f;
+		for (int pbit = 0; pbit < 2; ++pbit)
+		{
+			Bc7Endpoint candidate = QuantizeBc7(color, pbit);
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				float d = (float)((candidate.value[c] << 1) | pbit) - color[c];
+				error += d * d;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				best = candidate;
+			}
+		}
+		return best;
+	}
+
+	float Bc7Indices(const Block& block, const Bc7Endpoint& a, const Bc7Endpoint& b, uint8_t indices[16])
+	{
+		Palette palette;
+		palette.size = 16;
+		palette.channels = 4;
+		for (int c = 0; c < 4; ++c)
+		{
+			int e0 = (a.value[c] << 1) | a.pbit;
+			int e1 = (b.value[c] << 1) | b.pbit;
+			for (int entry = 0; entry < 16; ++entry)
+				palette.values[c][entry] = (float)Bc7Interpolate(e0, e1, BC7_WEIGHTS4[entry]);
+		}
+		return FindIndices(block, 0, palette, nullptr, indices);
+	}
+
+	void EncodeBc7Block(const Block& block, CompressionQuality quality, uint8_t* out)
+	{
+		float e0[4], e1[4];
+		FitEndpoints(block, 0, 4, nullptr, quality, e0, e1);
+
+		Bc7Endpoint a = QuantizeBc7(e0), b = QuantizeBc7(e1);
+		uint8_t indices[16];
+		float error = Bc7Indices(block, a, b, indices);
+
+		if (quality == CompressionQuality::High)
+		{
+			float weights[16];
+			for (int i = 0; i < 16; ++i)
+				weights[i] = (float)BC7_WEIGHTS4[i] / 64.0f;
+
+			uint8_t trial[16];
+			for (int pass = 0; pass < 2; ++pass)
+			{
+				float r0[4], r1[4];
+				if (!RefineEndpoints(block, 0, 4, nullptr, indices, weights, r0, r1))
+					break;
+				Bc7Endpoint ta = QuantizeBc7(r0), tb = QuantizeBc7(r1);
+				float trialError = Bc7Indices(block, ta, tb, trial);
+				if (trialError >= error)
+					break;
+				a = ta;
+				b = tb;
+				error = trialError;
+				std::memcpy(indices, trial, 16);
+			}
+
+			// the best p-bit for each endpoint alone isn't always the best pair
+			float c0[4], c1[4];
+			for (int c = 0; c < 4; ++c)
+			{
+				c0[c] = (float)((a.value[c] << 1) | a.pbit);
+				c1[c] = (float)((b.value[c] << 1) | b.pbit);
+			}
+			for (int p0 = 0; p0 < 2; ++p0)
+			{
+				for (int p1 = 0; p1 < 2; ++p1)
+				{
+					Bc7Endpoint ta = QuantizeBc7(c0, p0), tb = QuantizeBc7(c1, p1);
+					float trialError = Bc7Indices(block, ta, tb, trial);
+					if (trialError < error)
+					{
+						a = ta;
+						b = tb;
+						error = trialError;
+						std::memcpy(indices, trial, 16);
+					}
+				}
+			}
+		}
+
+		// the anchor texel stores only three index bits, so its top bit has to be clear
+		if (indices[0] & 8)
+		{
+			Bc7Endpoint t = a;
+			a = b;
+			b = t;
+			for (int i = 0; i < 16; ++i)
+				indices[i] = (uint8_t)(15 - indices[i]);
+		}
+
+		std::memset(out, 0, 16);
+		BitWriter writer = { out, 0 };
+		writer.write(1u << 6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			writer.write((uint32_t)a.value[c], 7);
+			writer.write((uint32_t)b.value[c], 7);
+		}
+		writer.write((uint32_t)a.pbit, 1);
+		writer.write((uint32_t)b.pbit, 1);
+		writer.write(indices[0], 3);
+		for (int i = 1; i < 16; ++i)
+			writer.write(indices[i], 4);
+	}
+
+	void EncodeBlock(TextureFormat format, CompressionQuality quality, const Block& block, uint8_t* out)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC1:
+			EncodeColorBlock(block, quality, true, out);
+			break;
+		case TextureFormat::BC3:
+			EncodeAlphaBlock(block, 3, quality, out);
+			EncodeColorBlock(block, quality, false, out + 8);
+			break;
+		case TextureFormat::BC4:
+			EncodeAlphaBlock(block, 0, quality, out);
+			break;
+		case TextureFormat::BC5:
+			EncodeAlphaBlock(block, 0, quality, out);
+			EncodeAlphaBlock(block, 1, quality, out + 8);
+			break;
+		case TextureFormat::BC7:
+			EncodeBc7Block(block, quality, out);
+			break;
+		case TextureFormat::RGBA8:
+			break;
+		}
+	}
+
+	// decoding
+	// --------
+	void DecodeColorBlock(const uint8_t* in, bool forceFourColor, uint8_t texels[16][4])
+	{
+		uint16_t c0, c1;
+		uint32_t bits;
+		std::memcpy(&c0, in, 2);
+		std::memcpy(&c1, in + 2, 2);
+		std::memcpy(&bits, in + 4, 4);
+
+		bool fourColor = forceFourColor || c0 > c1;
+		int colors[4][3];
+		ColorPalette(c0, c1, fourColor, colors);
+		for (int i = 0; i < 16; ++i)
+		{
+			int index = (bits >> (2 * i)) & 3;
+			for (int c = 0; c < 3; ++c)
+				texels[i][c] = (uint8_t)colors[index][c];
+			texels[i][3] = (!fourColor && index == 3) ? 0 : 255;
+		}
+	}
+
+	void DecodeAlphaBlock(const uint8_t* in, int channel, uint8_t texels[16][4])
+	{
+		int values[8];
+		AlphaPalette(in[0], in[1], values);
+		uint64_t bits = 0;
+		for (int i = 0; i < 6; ++i)
+			bits |= (uint64_t)in[2 + i] << (8 * i);
+		for (int i = 0; i < 16; ++i)
+			texels[i][channel] = (uint8_t)values[(bits >> (3 * i)) & 7];
+	}
+
+	// single subset modes only; they need no partition tables
+	bool DecodeBc7Block(const uint8_t* in, uint8_t texels[16][4])
+	{
+		int mode = 0;
+		while (mode < 8 && !(in[0] & (1 << mode)))
+			++mode;
+
+		BitReader reader = { in, mode + 1 };
+		int endpoints[2][4];
+		int rotation = 0;
+		int colorWeights[16], alphaWeights[16];
+
+		if (mode == 6)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				endpoints[0][c] = (int)reader.read(7) << 1;
+				endpoints[1][c] = (int)reader.read(7) << 1;
+			}
+			int p0 = (int)reader.read(1), p1 = (int)reader.read(1);
+			for (int c = 0; c < 4; ++c)
+			{
+				endpoints[0][c] |= p0;
+				endpoints[1][c] |= p1;
+			}
+			for (int i = 0; i < 16; ++i)
+			{
+				colorWeights[i] = BC7_WEIGHTS4[reader.read(i == 0 ? 3 : 4)];
+				alphaWeights[i] = colorWeights[i];
+			}
+		}
+		else if (mode == 4 || mode == 5)
+		{
+			rotation = (int)reader.read(2);
+			int indexMode = mode == 4 ? (int)reader.read(1) : 0;
+			int colorBits = mode == 4 ? 5 : 7;
+			int alphaBits = mode == 4 ? 6 : 8;
+			for (int c = 0; c < 3; ++c)
+			{
+				for (int e = 0; e < 2; ++e)
+				{
+					int v = (int)reader.read(colorBits);
+					endpoints[e][c] = (v << (8 - colorBits)) | (v >> (2 * colorBits - 8));
+				}
+			}
+			for (int e = 0; e < 2; ++e)
+			{
+				int v = (int)reader.read(alphaBits);
+				endpoints[e][3] = alphaBits == 8 ? v : (v << 2) | (v >> 4);
+			}
+
+			// mode 4 has a 2-bit and a 3-bit index set, mode 5 two 2-bit sets
+			int first[16], second[16];
+			int secondBits = mode == 4 ? 3 : 2;
+			for (int i = 0; i < 16; ++i)
+				first[i] = BC7_WEIGHTS2[reader.read(i == 0 ? 1 : 2)];
+			for (int i = 0; i < 16; ++i)
+			{
+				int index = (int)reader.read(i == 0 ? secondBits - 1 : secondBits);
+				second[i] = secondBits == 3 ? BC7_WEIGHTS3[index] : BC7_WEIGHTS2[index];
+			}
+			for (int i = 0; i < 16; ++i)
+			{
+				colorWeights[i] = indexMode ? second[i] : first[i];
+				alphaWeights[i] = indexMode ? first[i] : second[i];
+			}
+		}
+		else
+		{
+			for (int i = 0; i < 16; ++i)
+			{
+				texels[i][0] = 255;
+				texels[i][1] = 0;
+				texels[i][2] = 255;
+				texels[i][3] = 255;
+			}
+			return false;
+		}
+
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+				texels[i][c] = (uint8_t)Bc7Interpolate(endpoints[0][c], endpoints[1][c], colorWeights[i]);
+			texels[i][3] = (uint8_t)Bc7Interpolate(endpoints[0][3], endpoints[1][3], alphaWeights[i]);
+			if (rotation > 0)
+			{
+				uint8_t t = texels[i][3];
+				texels[i][3] = texels[i][rotation - 1];
+				texels[i][rotation - 1] = t;
+			}
+		}
+		return true;
+	}
+
+	bool DecodeBlock(TextureFormat format, const uint8_t* in, uint8_t texels[16][4])
+	{
+		switch (format)
+		{
+		case TextureFormat::BC1:
+			DecodeColorBlock(in, false, texels);
+			return true;
+		case TextureFormat::BC3:
+			DecodeColorBlock(in + 8, true, texels);
+			DecodeAlphaBlock(in, 3, texels);
+			return true;
+		case TextureFormat::BC4:
+			std::memset(texels, 0, 16 * 4);
+			DecodeAlphaBlock(in, 0, texels);
+			for (int i = 0; i < 16; ++i)
+				texels[i][3] = 255;
+			return true;
+		case TextureFormat::BC5:
+			std::memset(texels, 0, 16 * 4);
+			DecodeAlphaBlock(in, 0, texels);
+			DecodeAlphaBlock(in + 8, 1, texels);
+			for (int i = 0; i < 16; ++i)
+				texels[i][3] = 255;
+			return true;
+		case TextureFormat::BC7:
+			return DecodeBc7Block(in, texels);
+		case TextureFormat::RGBA8:
+			break;
+		}
+		return false;
+	}
+}
+
+size_t BlockBytes(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1:
+	case TextureFormat::BC4:
+		return 8;
+	case TextureFormat::BC3:
+	case TextureFormat::BC5:
+	case TextureFormat::BC7:
+		return 16;
+	case TextureFormat::RGBA8:
+		break;
+	}
+	return 4;
+}
+
+size_t TextureLevelBytes(TextureFormat format, int width, int height)
+{
+	if (format == TextureFormat::RGBA8)
+		return (size_t)width * height * 4;
+	size_t blocksX = (size_t)(width + 3) / 4;
+	size_t blocksY = (size_t)(height + 3) / 4;
+	return blocksX * blocksY * BlockBytes(format);
+}
+
+void CompressImage(JobSystem* jobs, TextureFormat format, CompressionQuality quality,
+	const uint8_t* rgba, int width, int height, std::vector<uint8_t>& blocks)
+{
+	blocks.resize(TextureLevelBytes(format, width, height));
+	if (format == TextureFormat::RGBA8)
+	{
+		std::memcpy(blocks.data(), rgba, blocks.size());
+		return;
+	}
+
+	int blocksX = (width + 3) / 4;
+	int blocksY = (height + 3) / 4;
+	size_t blockBytes = BlockBytes(format);
+	uint8_t* out = blocks.data();
+
+	auto encodeRows = [&](unsigned int begin, unsigned int end)
+	{
+		Block block;
+		for (unsigned int by = begin; by < end; ++by)
+		{
+			for (int bx = 0; bx < blocksX; ++bx)
+			{
+				LoadBlock(rgba, width, height, bx, (int)by, block);
+				EncodeBlock(format, quality, block, out + ((size_t)by * blocksX + bx) * blockBytes);
+			}
+		}
+	};
+
+	if (jobs)
+		jobs->parallelFor((unsigned int)blocksY, 4, encodeRows);
+	else
+		encodeRows(0, (unsigned int)blocksY);
+}
+
+bool DecompressImage(TextureFormat format, const uint8_t* blocks, int width, int height, std::vector<uint8_t>& rgba)
+{
+	rgba.resize((size_t)width * height * 4);
+	if (format == TextureFormat::RGBA8)
+	{
+		std::memcpy(rgba.data(), blocks, rgba.size());
+		return true;
+	}
+
+	int blocksX = (width + 3) / 4;
+	int blocksY = (height + 3) / 4;
+	size_t blockBytes = BlockBytes(format);
+	bool supported = true;
+	uint8_t texels[16][4];
+	for (int by = 0; by < blocksY; ++by)
+	{
+		for (int bx = 0; bx < blocksX; ++bx)
+		{
+			supported &= DecodeBlock(format, blocks + ((size_t)by * blocksX + bx) * blockBytes, texels);
+			for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+			{
+				for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+					std::memcpy(&rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], texels[y * 4 + x], 4);
+			}
+		}
+	}
+	return supported;
+}
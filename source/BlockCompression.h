@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// pixel layouts a cooked texture level can be stored in
+enum class TextureFormat
+{
+	RGBA8,
+	// RGB + 1-bit alpha, 8 bytes per 4x4 block
+	BC1,
+	// BC1 color + BC4 alpha, 16 bytes
+	BC3,
+	// one channel, 8 bytes
+	BC4,
+	// two BC4 channels, 16 bytes
+	BC5,
+	// RGBA, 16 bytes
+	BC7
+};
+
+enum class CompressionQuality
+{
+	// bounding box endpoints, one pass
+	Fast,
+	// principal axis endpoints, one least squares pass on BC1/BC3 color
+	Normal,
+	// principal axis plus least squares refinement and a wider endpoint search
+	High
+};
+
+// bytes per 4x4 block, or per texel for RGBA8
+size_t BlockBytes(TextureFormat format);
+
+// size of one level in the given format, partial blocks round up
+size_t TextureLevelBytes(TextureFormat format, int width, int height);
+
+// encode a tightly packed RGBA8 image into 4x4 blocks. with jobs the block rows are
+// spread over the job system; edge blocks repeat the last row and column.
+// BC7 blocks are always mode 6 (one subset, RGBA endpoints with 4-bit indices)
+void CompressImage(JobSystem* jobs, TextureFormat format, CompressionQuality quality,
+	const uint8_t* rgba, int width, int height, std::vector<uint8_t>& blocks);
+
+// decode back to RGBA8 for GL contexts without the matching compressed formats.
+// BC4 fills red only and BC5 red and green, the rest are 0 with alpha 255.
+// BC7 supports the single-subset modes (4, 5, 6); other blocks come out magenta
+// and make this return false
+bool DecompressImage(TextureFormat format, const uint8_t* blocks, int width, int height, std::vector<uint8_t>& rgba);
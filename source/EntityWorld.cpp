@@ -0,0 +1,399 @@
+#include "EntityWorld.h"
+#include <array>
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// columns start on cache lines so SIMD loads of a column never straddle two
+	const size_t COLUMN_ALIGNMENT = 64;
+	const uint32_t NO_COLUMN = 0xFFFFFFFFu;
+	const uint32_t NO_ARCHETYPE = 0xFFFFFFFFu;
+
+	struct ComponentInfo
+	{
+		uint32_t size;
+		uint32_t alignment;
+	};
+
+	// shared by every world: ids are global so masks mean the same thing everywhere
+	ComponentInfo componentInfo[EntityWorld::MAX_COMPONENTS];
+	std::atomic<uint32_t> componentCount{ 0 };
+
+	size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	unsigned int TrailingZeros64(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return (unsigned int)index;
+#else
+		return (unsigned int)__builtin_ctzll(value);
+#endif
+	}
+}
+
+struct EntityWorld::Chunk
+{
+	// CHUNK_BYTES: capacity entity handles, then each component's column
+	std::byte* data;
+	uint32_t count;
+};
+
+struct EntityWorld::Archetype
+{
+	uint64_t mask = 0;
+	// component ids, ascending
+	std::vector<uint32_t> components;
+	// byte offset of each component's column in a chunk, NO_COLUMN if absent
+	std::array<uint32_t, MAX_COMPONENTS> columns;
+	uint32_t capacity = 0;
+	// every chunk but the last is full
+	std::vector<Chunk> chunks;
+	size_t entityCount = 0;
+};
+
+uint32_t EntityWorld::ChunkView::count() const
+{
+	return chunk->count;
+}
+
+const Entity* EntityWorld::ChunkView::entities() const
+{
+	return reinterpret_cast<const Entity*>(chunk->data);
+}
+
+void* EntityWorld::ChunkView::columnData(uint32_t component) const
+{
+	uint32_t offset = archetype->columns[component];
+	return offset == NO_COLUMN ? nullptr : chunk->data + offset;
+}
+
+size_t EntityWorld::Query::entityCount() const
+{
+	size_t count = 0;
+	for (const Archetype* archetype : archetypes)
+		count += archetype->entityCount;
+	return count;
+}
+
+size_t EntityWorld::Query::chunkCount() const
+{
+	size_t count = 0;
+	for (const Archetype* archetype : archetypes)
+		count += archetype->chunks.size();
+	return count;
+}
+
+EntityWorld::EntityWorld()
+	: liveCount(0)
+{
+	// archetype 0 holds entities without components
+	archetypeFor(0);
+}
+
+EntityWorld::~EntityWorld()
+{
+	for (const std::unique_ptr<Archetype>& archetype : archetypes)
+	{
+		for (const Chunk& chunk : archetype->chunks)
+			::operator delete(chunk.data, std::align_val_t(COLUMN_ALIGNMENT));
+	}
+	for (std::byte* data : freeChunks)
+		::operator delete(data, std::align_val_t(COLUMN_ALIGNMENT));
+}
+
+uint32_t EntityWorld::RegisterComponent(size_t size, size_t alignment)
+{
+	uint32_t id = componentCount.fetch_add(1);
+	if (id >= MAX_COMPONENTS || alignment > COLUMN_ALIGNMENT)
+	{
+		std::cout << "ERROR::ENTITY_WORLD::COMPONENT_NOT_REGISTERED " << MAX_COMPONENTS << " types at most, aligned to "
+			<< COLUMN_ALIGNMENT << " bytes at most" << std::endl;
+		throw std::runtime_error("Too many component types");
+	}
+	componentInfo[id] = { (uint32_t)size, (uint32_t)alignment };
+	return id;
+}
+
+Entity EntityWorld::createWithMask(uint64_t mask)
+{
+	Entity entity;
+	if (!freeIndices.empty())
+	{
+		entity.index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		entity.index = (uint32_t)records.size();
+		records.push_back({ 0, NO_ARCHETYPE, 0, 0 });
+	}
+	entity.generation = records[entity.index].generation;
+
+	uint32_t index = archetypeFor(mask);
+	Archetype& archetype = *archetypes[index];
+	Record& record = records[entity.index];
+	record.archetype = index;
+	appendRow(archetype, record.chunk, record.row);
+
+	Chunk& chunk = archetype.chunks[record.chunk];
+	reinterpret_cast<Entity*>(chunk.data)[record.row] = entity;
+	for (uint32_t component : archetype.components)
+	{
+		uint32_t size = componentInfo[component].size;
+		std::memset(chunk.data + archetype.columns[component] + (size_t)record.row * size, 0, size);
+	}
+	++liveCount;
+	return entity;
+}
+
+void EntityWorld::destroy(Entity entity)
+{
+	if (!alive(entity))
+		return;
+
+	Record& record = records[entity.index];
+	removeRow(*archetypes[record.archetype], record.chunk, record.row);
+	record.archetype = NO_ARCHETYPE;
+	++record.generation;
+	freeIndices.push_back(entity.index);
+	--liveCount;
+}
+
+bool EntityWorld::alive(Entity entity) const
+{
+	return entity.index < records.size() && records[entity.index].generation == entity.generation &&
+		records[entity.index].archetype != NO_ARCHETYPE;
+}
+
+uint64_t EntityWorld::maskOf(Entity entity) const
+{
+	return alive(entity) ? archetypes[records[entity.index].archetype]->mask : 0;
+}
+
+void* EntityWorld::component(Entity entity, uint32_t component)
+{
+	if (!alive(entity))
+		return nullptr;
+	const Record& record = records[entity.index];
+	const Archetype& archetype = *archetypes[record.archetype];
+	uint32_t offset = archetype.columns[component];
+	if (offset == NO_COLUMN)
+		return nullptr;
+	return archetype.chunks[record.chunk].data + offset + (size_t)record.row * componentInfo[component].size;
+}
+
+void* EntityWorld::addComponent(Entity entity, uint32_t component)
+{
+	if (!alive(entity))
+		return nullptr;
+	uint64_t mask = maskOf(entity);
+	uint64_t bit = 1ull << component;
+	if ((mask & bit) == 0)
+		moveEntity(entity, mask | bit);
+	return this->component(entity, component);
+}
+
+void EntityWorld::removeComponent(Entity entity, uint32_t component)
+{
+	uint64_t mask = maskOf(entity);
+	uint64_t bit = 1ull << component;
+	if (alive(entity) && (mask & bit) != 0)
+		moveEntity(entity, mask & ~bit);
+}
+
+EntityWorld::Query& EntityWorld::query(uint64_t include, uint64_t exclude)
+{
+	for (const std::unique_ptr<Query>& query : queries)
+	{
+		if (query->include == include && query->exclude == exclude)
+			return *query;
+	}
+
+	std::unique_ptr<Query> query(new Query());
+	query->include = include;
+	query->exclude = exclude;
+	for (const std::unique_ptr<Archetype>& archetype : archetypes)
+	{
+		if ((archetype->mask & include) == include && (archetype->mask & exclude) == 0)
+			query->archetypes.push_back(archetype.get());
+	}
+	queries.push_back(std::move(query));
+	return *queries.back();
+}
+
+size_t EntityWorld::chunkCount() const
+{
+	size_t count = 0;
+	for (const std::unique_ptr<Archetype>& archetype : archetypes)
+		count += archetype->chunks.size();
+	return count;
+}
+
+uint32_t EntityWorld::archetypeFor(uint64_t mask)
+{
+	auto found = archetypeLookup.find(mask);
+	if (found != archetypeLookup.end())
+		return found->second;
+
+	std::unique_ptr<Archetype> archetype(new Archetype());
+	archetype->mask = mask;
+	archetype->columns.fill(NO_COLUMN);
+	size_t rowBytes = sizeof(Entity);
+	for (uint64_t bits = mask; bits; bits &= bits - 1)
+	{
+		uint32_t component = TrailingZeros64(bits);
+		archetype->components.push_back(component);
+		rowBytes += componentInfo[component].size;
+	}
+
+	// as many rows as fit once every column is padded out to a cache line
+	auto layout = [&](size_t capacity)
+	{
+		size_t offset = sizeof(Entity) * capacity;
+		for (uint32_t component : archetype->components)
+		{
+			offset = AlignUp(offset, COLUMN_ALIGNMENT);
+			archetype->columns[component] = (uint32_t)offset;
+			offset += componentInfo[component].size * capacity;
+		}
+		return offset;
+	};
+	size_t capacity = CHUNK_BYTES / rowBytes;
+	while (capacity > 0 && layout(capacity) > CHUNK_BYTES)
+		--capacity;
+	if (capacity == 0)
+	{
+		std::cout << "ERROR::ENTITY_WORLD::ARCHETYPE_TOO_LARGE one entity doesn't fit in " << CHUNK_BYTES << " bytes" << std::endl;
+		throw std::runtime_error("Archetype too large for a chunk");
+	}
+	archetype->capacity = (uint32_t)capacity;
+
+	// cached queries see the new archetype from now on
+	for (const std::unique_ptr<Query>& query : queries)
+	{
+		if ((mask & query->include) == query->include && (mask & query->exclude) == 0)
+			query->archetypes.push_back(archetype.get());
+	}
+
+	uint32_t index = (uint32_t)archetypes.size();
+	archetypes.push_back(std::move(archetype));
+	archetypeLookup.emplace(mask, index);
+	return index;
+}
+
+// components both archetypes have are carried over, new ones start zeroed
+void EntityWorld::moveEntity(Entity entity, uint64_t mask)
+{
+	Record& record = records[entity.index];
+	Archetype& from = *archetypes[record.archetype];
+	uint32_t toIndex = archetypeFor(mask);
+	Archetype& to = *archetypes[toIndex];
+
+	uint32_t chunk, row;
+	appendRow(to, chunk, row);
+	std::byte* source = from.chunks[record.chunk].data;
+	std::byte* destination = to.chunks[chunk].data;
+	reinterpret_cast<Entity*>(destination)[row] = entity;
+	for (uint32_t component : to.components)
+	{
+		uint32_t size = componentInfo[component].size;
+		std::byte* target = destination + to.columns[component] + (size_t)row * size;
+		if (from.columns[component] != NO_COLUMN)
+			std::memcpy(target, source + from.columns[component] + (size_t)record.row * size, size);
+		else
+			std::memset(target, 0, size);
+	}
+
+	removeRow(from, record.chunk, record.row);
+	record.archetype = toIndex;
+	record.chunk = chunk;
+	record.row = row;
+}
+
+void EntityWorld::appendRow(Archetype& archetype, uint32_t& chunk, uint32_t& row)
+{
+	if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.capacity)
+		archetype.chunks.push_back({ allocateChunk(), 0 });
+	chunk = (uint32_t)(archetype.chunks.size() - 1);
+	row = archetype.chunks.back().count++;
+	++archetype.entityCount;
+}
+
+// fill the hole with the archetype's last entity so chunks stay packed
+void EntityWorld::removeRow(Archetype& archetype, uint32_t chunk, uint32_t row)
+{
+	Chunk& last = archetype.chunks.back();
+	uint32_t lastRow = last.count - 1;
+	Chunk& hole = archetype.chunks[chunk];
+	if (&hole != &last || row != lastRow)
+	{
+		Entity moved = reinterpret_cast<Entity*>(last.data)[lastRow];
+		reinterpret_cast<Entity*>(hole.data)[row] = moved;
+		for (uint32_t component : archetype.components)
+		{
+			uint32_t size = componentInfo[component].size;
+			uint32_t column = archetype.columns[component];
+			std::memcpy(hole.data + column + (size_t)row * size, last.data + column + (size_t)lastRow * size, size);
+		}
+		records[moved.index].chunk = chunk;
+		records[moved.index].row = row;
+	}
+
+	--archetype.entityCount;
+	if (--last.count == 0)
+	{
+		freeChunks.push_back(last.data);
+		archetype.chunks.pop_back();
+	}
+}
+
+std::byte* EntityWorld::allocateChunk()
+{
+	if (!freeChunks.empty())
+	{
+		std::byte* data = freeChunks.back();
+		freeChunks.pop_back();
+		return data;
+	}
+	return static_cast<std::byte*>(::operator new(CHUNK_BYTES, std::align_val_t(COLUMN_ALIGNMENT)));
+}
+
+size_t EntityWorld::chunkCountOf(const Archetype* archetype)
+{
+	return archetype->chunks.size();
+}
+
+EntityWorld::ChunkView EntityWorld::viewOf(Archetype* archetype, size_t chunk, size_t first)
+{
+	ChunkView view;
+	view.archetype = archetype;
+	view.chunk = &archetype->chunks[chunk];
+	view.first = first;
+	return view;
+}
+
+void EntityWorld::gatherChunks(Query& query)
+{
+	query.views.clear();
+	size_t first = 0;
+	for (Archetype* archetype : query.archetypes)
+	{
+		for (size_t i = 0; i < archetype->chunks.size(); ++i)
+		{
+			query.views.push_back(viewOf(archetype, i, first));
+			first += archetype->chunks[i].count;
+		}
+	}
+}
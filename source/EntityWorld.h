@@ -0,0 +1,256 @@
+#pragma once
+#include "JobSystem.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// generational handle: the index is reused once the entity is destroyed, the
+// generation tells the old handle apart from whoever lives there now
+struct Entity
+{
+	uint32_t index = 0xFFFFFFFFu;
+	uint32_t generation = 0;
+
+	bool valid() const { return index != 0xFFFFFFFFu; }
+
+	bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+// entities and their components, grouped by archetype (the exact set of component types
+// an entity has). each archetype keeps its entities in CHUNK_BYTES blocks laid out as
+// structure of arrays: the entity handles, then one cache line aligned column per
+// component, so a system touching two components streams through two dense arrays.
+// entities are kept packed (removal moves the archetype's last entity into the hole),
+// which means component pointers and chunk views are only good until the next create,
+// destroy, add or remove. components are plain data and are moved with memcpy.
+// queries are cached and pick up archetypes created after them, so hold on to them
+// ---------------------------------------------------------------------------------------
+class EntityWorld
+{
+	struct Archetype;
+	struct Chunk;
+public:
+	static const size_t CHUNK_BYTES = 16 * 1024;
+	static const uint32_t MAX_COMPONENTS = 64;
+
+	// one chunk's worth of entities as seen by a query
+	class ChunkView
+	{
+	public:
+		uint32_t count() const;
+
+		// index of the chunk's first entity among everything the query visits, so
+		// parallel chunk passes can write into one flat output array
+		size_t offset() const { return first; }
+
+		const Entity* entities() const;
+
+		// the component's column, nullptr if this chunk's archetype doesn't have it
+		template<typename T>
+		T* column() const
+		{
+			return static_cast<T*>(columnData(ComponentId<T>()));
+		}
+	private:
+		friend class EntityWorld;
+		void* columnData(uint32_t component) const;
+
+		const Archetype* archetype = nullptr;
+		Chunk* chunk = nullptr;
+		size_t first = 0;
+	};
+
+	// entities with every include component and none of the exclude ones
+	class Query
+	{
+	public:
+		size_t entityCount() const;
+		size_t chunkCount() const;
+	private:
+		friend class EntityWorld;
+		uint64_t include = 0;
+		uint64_t exclude = 0;
+		std::vector<Archetype*> archetypes;
+		// rebuilt by every parallel pass
+		std::vector<ChunkView> views;
+	};
+
+	EntityWorld();
+	~EntityWorld();
+
+	EntityWorld(const EntityWorld&) = delete;
+	EntityWorld& operator=(const EntityWorld&) = delete;
+
+	// ids are handed out on first use, for the whole process
+	template<typename T>
+	static uint32_t ComponentId()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "components are moved with memcpy");
+		static const uint32_t id = RegisterComponent(sizeof(T), alignof(T));
+		return id;
+	}
+
+	template<typename... T>
+	static uint64_t Mask()
+	{
+		return (0ull | ... | (1ull << ComponentId<T>()));
+	}
+
+	template<typename... T>
+	Entity create(const T&... components)
+	{
+		Entity entity = createWithMask(Mask<T...>());
+		(std::memcpy(component(entity, ComponentId<T>()), &components, sizeof(T)), ...);
+		return entity;
+	}
+
+	// an entity with the given components, all zeroed
+	Entity createWithMask(uint64_t mask);
+
+	// no-op for dead or invalid handles
+	void destroy(Entity entity);
+
+	bool alive(Entity entity) const;
+
+	// add or overwrite a component, moving the entity to its new archetype
+	template<typename T>
+	void add(Entity entity, const T& value)
+	{
+		void* data = addComponent(entity, ComponentId<T>());
+		if (data)
+			std::memcpy(data, &value, sizeof(T));
+	}
+
+	template<typename T>
+	void remove(Entity entity)
+	{
+		removeComponent(entity, ComponentId<T>());
+	}
+
+	// nullptr if the entity is dead or has no such component
+	template<typename T>
+	T* get(Entity entity)
+	{
+		return static_cast<T*>(component(entity, ComponentId<T>()));
+	}
+
+	template<typename T>
+	bool has(Entity entity) const
+	{
+		return alive(entity) && (maskOf(entity) & Mask<T>()) != 0;
+	}
+
+	uint64_t maskOf(Entity entity) const;
+
+	template<typename... T>
+	Query& query()
+	{
+		return query(Mask<T...>());
+	}
+
+	Query& query(uint64_t include, uint64_t exclude = 0);
+
+	// fn(const ChunkView&) for every chunk the query matches, in order
+	template<typename Function>
+	void forEachChunk(Query& query, const Function& fn)
+	{
+		size_t first = 0;
+		for (Archetype* archetype : query.archetypes)
+		{
+			for (size_t i = 0; i < chunkCountOf(archetype); ++i)
+			{
+				ChunkView view = viewOf(archetype, i, first);
+				fn(view);
+				first += view.count();
+			}
+		}
+	}
+
+	// the same, spread over the job system's workers a few chunks per job. fn must not
+	// create, destroy, add or remove anything
+	template<typename Function>
+	void parallelForChunks(JobSystem& jobs, Query& query, const Function& fn)
+	{
+		gatherChunks(query);
+		unsigned int count = (unsigned int)query.views.size();
+		unsigned int grain = count / (jobs.workerCount() * 4);
+		jobs.parallelFor(count, grain ? grain : 1, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; ++i)
+				fn(query.views[i]);
+		});
+	}
+
+	// fn(Entity, T&...) for every entity in the query, which has to include every T
+	template<typename... T, typename Function>
+	void each(Query& query, const Function& fn)
+	{
+		forEachChunk(query, [&](const ChunkView& chunk)
+		{
+			EachRow(chunk.count(), chunk.entities(), fn, chunk.column<T>()...);
+		});
+	}
+
+	template<typename... T, typename Function>
+	void parallelEach(JobSystem& jobs, Query& query, const Function& fn)
+	{
+		parallelForChunks(jobs, query, [&](const ChunkView& chunk)
+		{
+			EachRow(chunk.count(), chunk.entities(), fn, chunk.column<T>()...);
+		});
+	}
+
+	size_t entityCount() const { return liveCount; }
+
+	size_t archetypeCount() const { return archetypes.size(); }
+
+	// chunks in use by every archetype
+	size_t chunkCount() const;
+private:
+	struct Record
+	{
+		uint32_t generation;
+		uint32_t archetype;
+		uint32_t chunk;
+		uint32_t row;
+	};
+
+	static uint32_t RegisterComponent(size_t size, size_t alignment);
+
+	template<typename Function, typename... P>
+	static void EachRow(uint32_t count, const Entity* entities, const Function& fn, P*... columns)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+			fn(entities[i], columns[i]...);
+	}
+
+	void* component(Entity entity, uint32_t component);
+	void* addComponent(Entity entity, uint32_t component);
+	void removeComponent(Entity entity, uint32_t component);
+
+	uint32_t archetypeFor(uint64_t mask);
+	void moveEntity(Entity entity, uint64_t mask);
+	void appendRow(Archetype& archetype, uint32_t& chunk, uint32_t& row);
+	void removeRow(Archetype& archetype, uint32_t chunk, uint32_t row);
+	std::byte* allocateChunk();
+
+	static size_t chunkCountOf(const Archetype* archetype);
+	static ChunkView viewOf(Archetype* archetype, size_t chunk, size_t first);
+	void gatherChunks(Query& query);
+
+	std::vector<Record> records;
+	std::vector<uint32_t> freeIndices;
+	size_t liveCount;
+
+	std::vector<std::unique_ptr<Archetype>> archetypes;
+	std::unordered_map<uint64_t, uint32_t> archetypeLookup;
+	// emptied chunks are kept for the next archetype that grows
+	std::vector<std::byte*> freeChunks;
+	// few enough that a linear search beats hashing two masks
+	std::vector<std::unique_ptr<Query>> queries;
+};
@@ -0,0 +1,68 @@
+#include "FrameStats.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace
+{
+	// nearest-rank percentile on an already sorted sample set
+	double Percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty())
+			return 0.0;
+		size_t rank = (size_t)(p / 100.0 * (double)(sorted.size() - 1) + 0.5);
+		return sorted[std::min(rank, sorted.size() - 1)];
+	}
+
+	void PrintRow(const char* label, std::vector<double> samples)
+	{
+		if (samples.empty())
+		{
+			std::cout << label << ": no samples" << std::endl;
+			return;
+		}
+		std::sort(samples.begin(), samples.end());
+		double sum = 0.0;
+		for (double s : samples)
+			sum += s;
+
+		char line[256];
+		std::snprintf(line, sizeof(line),
+			"%-4s mean %8.3f  p50 %8.3f  p90 %8.3f  p95 %8.3f  p99 %8.3f  max %8.3f  (ms)",
+			label, sum / (double)samples.size(),
+			Percentile(samples, 50.0), Percentile(samples, 90.0),
+			Percentile(samples, 95.0), Percentile(samples, 99.0),
+			samples.back());
+		std::cout << line << std::endl;
+	}
+}
+
+void FrameStats::reserve(size_t frameCount)
+{
+	cpuTimes.reserve(frameCount);
+	gpuTimes.reserve(frameCount);
+	renderThreadTimes.reserve(frameCount);
+}
+
+void FrameStats::addFrame(double cpuMs, double gpuMs, double renderThreadMs)
+{
+	cpuTimes.push_back(cpuMs);
+	if (gpuMs >= 0.0)
+		gpuTimes.push_back(gpuMs);
+	if (renderThreadMs >= 0.0)
+		renderThreadTimes.push_back(renderThreadMs);
+}
+
+size_t FrameStats::frameCount() const
+{
+	return cpuTimes.size();
+}
+
+void FrameStats::print(const std::string& title) const
+{
+	std::cout << "== " << title << " (" << cpuTimes.size() << " frames) ==" << std::endl;
+	PrintRow("CPU", cpuTimes);
+	if (!renderThreadTimes.empty())
+		PrintRow("RT", renderThreadTimes);
+	PrintRow("GPU", gpuTimes);
+}
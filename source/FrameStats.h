@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// collects per-frame CPU/GPU (and optionally render thread) timings and reports percentiles
+// ----------------------------------------------------------
+class FrameStats
+{
+public:
+	void reserve(size_t frameCount);
+
+	// negative gpu/render times mean "not measured" and are skipped
+	void addFrame(double cpuMs, double gpuMs, double renderThreadMs = -1.0);
+
+	size_t frameCount() const;
+
+	void print(const std::string& title) const;
+private:
+	std::vector<double> cpuTimes;
+	std::vector<double> gpuTimes;
+	std::vector<double> renderThreadTimes;
+};
@@ -0,0 +1,259 @@
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+#include <cfloat>
+#include <cstring>
+
+namespace
+{
+	// elements per job. a multiple of every lane width, so only the last chunk has a tail
+	const size_t CHUNK_SIZE = 16384;
+
+#if VECTORMATH_AVX2
+	// for each 8 bit visibility mask, the set lanes packed to the front one byte each
+	struct CompactTable
+	{
+		uint64_t lanes[256];
+		uint32_t counts[256];
+
+		CompactTable()
+		{
+			for (unsigned int mask = 0; mask < 256; ++mask)
+			{
+				lanes[mask] = 0;
+				counts[mask] = 0;
+				for (unsigned int lane = 0; lane < 8; ++lane)
+				{
+					if (mask & (1u << lane))
+						lanes[mask] |= (uint64_t)lane << (8 * counts[mask]++);
+				}
+			}
+		}
+	};
+
+	const CompactTable COMPACT;
+#endif
+
+	// one float per element; the tests are written once against these and run 8, 4 or 1
+	// elements at a time. Append writes the indices of the lanes set in mask starting at
+	// out and returns the end. it may write up to WIDTH indices, which stays inside a
+	// chunk's part of the list since no more than the elements before first were kept
+	struct Lanes1
+	{
+		static const size_t WIDTH = 1;
+		float v;
+
+		explicit Lanes1(float value) : v(value) {}
+
+		static Lanes1 Load(const float* in) { return Lanes1(*in); }
+
+		Lanes1 operator+(Lanes1 other) const { return Lanes1(v + other.v); }
+		Lanes1 operator-(Lanes1 other) const { return Lanes1(v - other.v); }
+		Lanes1 operator*(Lanes1 other) const { return Lanes1(v * other.v); }
+		Lanes1 min(Lanes1 other) const { return Lanes1(v < other.v ? v : other.v); }
+
+		// lanes at or above zero; NaNs count as outside
+		unsigned int nonNegative() const { return v >= 0.0f ? 1u : 0u; }
+
+		static uint32_t* Append(uint32_t* out, unsigned int mask, uint32_t first)
+		{
+			*out = first;
+			return out + mask;
+		}
+	};
+
+#if VECTORMATH_SSE
+	struct Lanes4
+	{
+		static const size_t WIDTH = 4;
+		__m128 v;
+
+		explicit Lanes4(__m128 value) : v(value) {}
+		explicit Lanes4(float value) : v(_mm_set1_ps(value)) {}
+
+		static Lanes4 Load(const float* in) { return Lanes4(_mm_loadu_ps(in)); }
+
+		Lanes4 operator+(Lanes4 other) const { return Lanes4(_mm_add_ps(v, other.v)); }
+		Lanes4 operator-(Lanes4 other) const { return Lanes4(_mm_sub_ps(v, other.v)); }
+		Lanes4 operator*(Lanes4 other) const { return Lanes4(_mm_mul_ps(v, other.v)); }
+		Lanes4 min(Lanes4 other) const { return Lanes4(_mm_min_ps(v, other.v)); }
+
+		unsigned int nonNegative() const { return (unsigned int)_mm_movemask_ps(_mm_cmpge_ps(v, _mm_setzero_ps())); }
+
+		// no byte shuffle before SSSE3, so every lane is written and only the kept ones advance
+		static uint32_t* Append(uint32_t* out, unsigned int mask, uint32_t first)
+		{
+			for (uint32_t lane = 0; lane < WIDTH; ++lane)
+			{
+				*out = first + lane;
+				out += (mask >> lane) & 1u;
+			}
+			return out;
+		}
+	};
+#endif
+
+#if VECTORMATH_AVX2
+	struct Lanes8
+	{
+		static const size_t WIDTH = 8;
+		__m256 v;
+
+		explicit Lanes8(__m256 value) : v(value) {}
+		explicit Lanes8(float value) : v(_mm256_set1_ps(value)) {}
+
+		static Lanes8 Load(const float* in) { return Lanes8(_mm256_loadu_ps(in)); }
+
+		Lanes8 operator+(Lanes8 other) const { return Lanes8(_mm256_add_ps(v, other.v)); }
+		Lanes8 operator-(Lanes8 other) const { return Lanes8(_mm256_sub_ps(v, other.v)); }
+		Lanes8 operator*(Lanes8 other) const { return Lanes8(_mm256_mul_ps(v, other.v)); }
+		Lanes8 min(Lanes8 other) const { return Lanes8(_mm256_min_ps(v, other.v)); }
+
+		unsigned int nonNegative() const { return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GE_OQ)); }
+
+		// left-pack: widen the table's lane bytes and store all 8, kept ones first
+		static uint32_t* Append(uint32_t* out, unsigned int mask, uint32_t first)
+		{
+			__m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&COMPACT.lanes[mask]));
+			_mm256_storeu_si256((__m256i*)out, _mm256_add_epi32(lanes, _mm256_set1_epi32((int)first)));
+			return out + COMPACT.counts[mask];
+		}
+	};
+#endif
+
+	// indices of the elements in [begin, end) kept by test(i, Lanes), which returns one bit
+	// per lane. returns how many were written to out
+	template<typename Test>
+	uint32_t CullRange(size_t begin, size_t end, uint32_t* out, const Test& test)
+	{
+		uint32_t* start = out;
+		size_t i = begin;
+#if VECTORMATH_AVX2
+		for (; i + Lanes8::WIDTH <= end; i += Lanes8::WIDTH)
+			out = Lanes8::Append(out, test(i, Lanes8(0.0f)), (uint32_t)i);
+#elif VECTORMATH_SSE
+		for (; i + Lanes4::WIDTH <= end; i += Lanes4::WIDTH)
+			out = Lanes4::Append(out, test(i, Lanes4(0.0f)), (uint32_t)i);
+#endif
+		for (; i < end; ++i)
+			out = Lanes1::Append(out, test(i, Lanes1(0.0f)), (uint32_t)i);
+		return (uint32_t)(out - start);
+	}
+}
+
+Frustum Frustum::FromMatrix(const Mat4& viewProjection)
+{
+	// a clip space point is inside when -w <= x, y, z <= w; each inequality is a row
+	// combination of the matrix
+	Mat4 rows = Transpose(viewProjection);
+	Frustum frustum;
+	frustum.planes[LEFT] = rows[3] + rows[0];
+	frustum.planes[RIGHT] = rows[3] - rows[0];
+	frustum.planes[BOTTOM] = rows[3] + rows[1];
+	frustum.planes[TOP] = rows[3] - rows[1];
+	frustum.planes[NEAR_SIDE] = rows[3] + rows[2];
+	frustum.planes[FAR_SIDE] = rows[3] - rows[2];
+	for (Vec4& plane : frustum.planes)
+		plane *= 1.0f / Length(plane.xyz());
+	return frustum;
+}
+
+FrustumCuller::FrustumCuller()
+	: visibleTotal(0)
+{
+}
+
+template<typename Kernel>
+size_t FrustumCuller::cull(size_t count, JobSystem* jobs, const Kernel& kernel)
+{
+	if (indices.size() < count)
+		indices.resize(count);
+
+	size_t chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	if (!jobs || chunks <= 1)
+	{
+		visibleTotal = CullRange(0, count, indices.data(), kernel);
+		return visibleTotal;
+	}
+
+	// every chunk culls into its own stretch of the scratch list...
+	if (chunkIndices.size() < count)
+		chunkIndices.resize(count);
+	chunkCounts.resize(chunks);
+	chunkOffsets.resize(chunks);
+	jobs->parallelFor((unsigned int)chunks, 1, [this, count, &kernel](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int chunk = begin; chunk < end; ++chunk)
+		{
+			size_t first = chunk * CHUNK_SIZE;
+			size_t last = first + CHUNK_SIZE < count ? first + CHUNK_SIZE : count;
+			chunkCounts[chunk] = CullRange(first, last, chunkIndices.data() + first, kernel);
+		}
+	});
+
+	// ...and the stretches are packed together, still in index order
+	size_t total = 0;
+	for (size_t chunk = 0; chunk < chunks; ++chunk)
+	{
+		chunkOffsets[chunk] = (uint32_t)total;
+		total += chunkCounts[chunk];
+	}
+	jobs->parallelFor((unsigned int)chunks, 1, [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int chunk = begin; chunk < end; ++chunk)
+			std::memcpy(indices.data() + chunkOffsets[chunk], chunkIndices.data() + chunk * CHUNK_SIZE, chunkCounts[chunk] * sizeof(uint32_t));
+	});
+	visibleTotal = total;
+	return visibleTotal;
+}
+
+size_t FrustumCuller::cullSpheres(const Frustum& frustum, const SphereArrays& spheres, size_t count, JobSystem* jobs)
+{
+	const Vec4* planes = frustum.planes;
+	// visible unless the center is further than the radius behind some plane
+	return cull(count, jobs, [planes, &spheres](size_t i, auto lanes)
+	{
+		using Lanes = decltype(lanes);
+		Lanes x = Lanes::Load(spheres.x + i);
+		Lanes y = Lanes::Load(spheres.y + i);
+		Lanes z = Lanes::Load(spheres.z + i);
+		Lanes radius = Lanes::Load(spheres.radius + i);
+		Lanes nearest(FLT_MAX);
+		for (int side = 0; side < Frustum::SIDES; ++side)
+		{
+			const Vec4& p = planes[side];
+			Lanes distance = Lanes(p.x) * x + Lanes(p.y) * y + Lanes(p.z) * z + Lanes(p.w);
+			nearest = nearest.min(distance + radius);
+		}
+		return nearest.nonNegative();
+	});
+}
+
+size_t FrustumCuller::cullBoxes(const Frustum& frustum, const BoxArrays& boxes, size_t count, JobSystem* jobs)
+{
+	const Vec4* planes = frustum.planes;
+	// the extents projected on each normal, for the corner furthest along it
+	Vec4 absolute[Frustum::SIDES];
+	for (int side = 0; side < Frustum::SIDES; ++side)
+		absolute[side] = Vec4(std::fabs(planes[side].x), std::fabs(planes[side].y), std::fabs(planes[side].z), 0.0f);
+	return cull(count, jobs, [planes, &absolute, &boxes](size_t i, auto lanes)
+	{
+		using Lanes = decltype(lanes);
+		Lanes half(0.5f);
+		Lanes minX = Lanes::Load(boxes.minX + i), maxX = Lanes::Load(boxes.maxX + i);
+		Lanes minY = Lanes::Load(boxes.minY + i), maxY = Lanes::Load(boxes.maxY + i);
+		Lanes minZ = Lanes::Load(boxes.minZ + i), maxZ = Lanes::Load(boxes.maxZ + i);
+		Lanes centerX = (minX + maxX) * half, extentX = (maxX - minX) * half;
+		Lanes centerY = (minY + maxY) * half, extentY = (maxY - minY) * half;
+		Lanes centerZ = (minZ + maxZ) * half, extentZ = (maxZ - minZ) * half;
+		Lanes nearest(FLT_MAX);
+		for (int side = 0; side < Frustum::SIDES; ++side)
+		{
+			const Vec4& p = planes[side];
+			const Vec4& a = absolute[side];
+			Lanes distance = Lanes(p.x) * centerX + Lanes(p.y) * centerY + Lanes(p.z) * centerZ + Lanes(p.w);
+			Lanes reach = Lanes(a.x) * extentX + Lanes(a.y) * extentY + Lanes(a.z) * extentZ;
+			nearest = nearest.min(distance + reach);
+		}
+		return nearest.nonNegative();
+	});
+}
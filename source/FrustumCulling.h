@@ -0,0 +1,63 @@
+#pragma once
+#include "VectorMath.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// the six planes bounding what a camera sees, normals pointing inwards and unit length so
+// a point's plane distance is in world units
+struct Frustum
+{
+	enum Side { LEFT, RIGHT, BOTTOM, TOP, NEAR_SIDE, FAR_SIDE, SIDES };
+
+	// a, b, c, d of a * x + b * y + c * z + d >= 0 on the inside
+	Vec4 planes[SIDES];
+
+	// from projection * view, OpenGL's -1..1 depth (Gribb and Hartmann)
+	static Frustum FromMatrix(const Mat4& viewProjection);
+};
+
+// structure of arrays view of bounding spheres, element i is (x[i], y[i], z[i]) radius[i]
+struct SphereArrays
+{
+	float* x;
+	float* y;
+	float* z;
+	float* radius;
+};
+
+// visibility for large numbers of bounding volumes: every volume is tested against the six
+// frustum planes, 8 at a time with AVX2 (4 with SSE), and the indices of those not entirely
+// outside one plane are packed into a list for draw submission to walk.
+// the test is conservative: a volume near a corner of the frustum can be outside every view
+// and still be kept, never the other way round.
+// with a job system the volumes are split into chunks culled on every worker, each into its
+// own part of a scratch list, and the parts are then copied together in order
+// ---------------------------------------------------------------------------------------
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	// returns the number of visible spheres
+	size_t cullSpheres(const Frustum& frustum, const SphereArrays& spheres, size_t count, JobSystem* jobs = nullptr);
+
+	// returns the number of visible boxes
+	size_t cullBoxes(const Frustum& frustum, const BoxArrays& boxes, size_t count, JobSystem* jobs = nullptr);
+
+	// ascending indices of what the last cull kept, until the next cull
+	const uint32_t* visible() const { return indices.data(); }
+	size_t visibleCount() const { return visibleTotal; }
+private:
+	template<typename Kernel>
+	size_t cull(size_t count, JobSystem* jobs, const Kernel& kernel);
+
+	// each chunk's visible indices from the chunk's first element onwards
+	std::vector<uint32_t> chunkIndices;
+	std::vector<uint32_t> chunkCounts;
+	std::vector<uint32_t> chunkOffsets;
+	std::vector<uint32_t> indices;
+	size_t visibleTotal;
+};
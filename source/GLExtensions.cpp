@@ -0,0 +1,114 @@
+#include "GLExtensions.h"
+#include "GLFW/glfw3.h"
+#include <cstring>
+
+namespace GLExt
+{
+	int majorVersion = 0;
+	int minorVersion = 0;
+
+	bool programBinary = false;
+	PFN_GetProgramBinary GetProgramBinary = nullptr;
+	PFN_ProgramBinary ProgramBinary = nullptr;
+	PFN_ProgramParameteri ProgramParameteri = nullptr;
+
+	bool parallelShaderCompile = false;
+	PFN_MaxShaderCompilerThreads MaxShaderCompilerThreads = nullptr;
+
+	bool bufferStorage = false;
+	PFN_BufferStorage BufferStorage = nullptr;
+
+	bool gpuDrivenDraws = false;
+	PFN_DispatchCompute DispatchCompute = nullptr;
+	PFN_MemoryBarrier ShaderMemoryBarrier = nullptr;
+	PFN_MultiDrawElementsIndirect MultiDrawElementsIndirect = nullptr;
+
+	bool indirectCount = false;
+	PFN_MultiDrawElementsIndirectCount MultiDrawElementsIndirectCount = nullptr;
+
+	bool textureS3TC = false;
+	bool textureS3TCsRGB = false;
+	bool textureBPTC = false;
+}
+
+namespace
+{
+	bool AtLeast(int major, int minor)
+	{
+		return GLExt::majorVersion > major || (GLExt::majorVersion == major && GLExt::minorVersion >= minor);
+	}
+
+	template<typename T>
+	T LoadProc(const char* name)
+	{
+		return reinterpret_cast<T>(glfwGetProcAddress(name));
+	}
+}
+
+bool GLExt::HasExtension(const char* name)
+{
+	int count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; ++i)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+void GLExt::Load()
+{
+	glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+	glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+
+	if (AtLeast(4, 1) || HasExtension("GL_ARB_get_program_binary"))
+	{
+		GetProgramBinary = LoadProc<PFN_GetProgramBinary>("glGetProgramBinary");
+		ProgramBinary = LoadProc<PFN_ProgramBinary>("glProgramBinary");
+		ProgramParameteri = LoadProc<PFN_ProgramParameteri>("glProgramParameteri");
+
+		// a driver may expose the entry points but no formats, which makes them useless
+		int formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		programBinary = GetProgramBinary && ProgramBinary && ProgramParameteri && formats > 0;
+	}
+
+	if (HasExtension("GL_KHR_parallel_shader_compile"))
+		MaxShaderCompilerThreads = LoadProc<PFN_MaxShaderCompilerThreads>("glMaxShaderCompilerThreadsKHR");
+	else if (HasExtension("GL_ARB_parallel_shader_compile"))
+		MaxShaderCompilerThreads = LoadProc<PFN_MaxShaderCompilerThreads>("glMaxShaderCompilerThreadsARB");
+	parallelShaderCompile = MaxShaderCompilerThreads != nullptr;
+
+	if (AtLeast(4, 4) || HasExtension("GL_ARB_buffer_storage"))
+		BufferStorage = LoadProc<PFN_BufferStorage>("glBufferStorage");
+	bufferStorage = BufferStorage != nullptr;
+
+	if (AtLeast(4, 3) || (HasExtension("GL_ARB_compute_shader") && HasExtension("GL_ARB_shader_storage_buffer_object")
+		&& HasExtension("GL_ARB_multi_draw_indirect") && HasExtension("GL_ARB_base_instance")))
+	{
+		DispatchCompute = LoadProc<PFN_DispatchCompute>("glDispatchCompute");
+		ShaderMemoryBarrier = LoadProc<PFN_MemoryBarrier>("glMemoryBarrier");
+		MultiDrawElementsIndirect = LoadProc<PFN_MultiDrawElementsIndirect>("glMultiDrawElementsIndirect");
+	}
+	gpuDrivenDraws = DispatchCompute && ShaderMemoryBarrier && MultiDrawElementsIndirect;
+	if (gpuDrivenDraws)
+	{
+		// 4.3 only promises storage blocks to compute shaders, the vertex shader reads
+		// the objects from one too
+		int vertexBlocks = 0;
+		glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexBlocks);
+		gpuDrivenDraws = vertexBlocks >= 1;
+	}
+
+	if (AtLeast(4, 6))
+		MultiDrawElementsIndirectCount = LoadProc<PFN_MultiDrawElementsIndirectCount>("glMultiDrawElementsIndirectCount");
+	else if (HasExtension("GL_ARB_indirect_parameters"))
+		MultiDrawElementsIndirectCount = LoadProc<PFN_MultiDrawElementsIndirectCount>("glMultiDrawElementsIndirectCountARB");
+	indirectCount = gpuDrivenDraws && MultiDrawElementsIndirectCount != nullptr;
+
+	textureS3TC = HasExtension("GL_EXT_texture_compression_s3tc");
+	textureS3TCsRGB = textureS3TC && (HasExtension("GL_EXT_texture_sRGB") || HasExtension("GL_EXT_texture_compression_s3tc_srgb"));
+	textureBPTC = AtLeast(4, 2) || HasExtension("GL_ARB_texture_compression_bptc");
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "glad/glad.h"
+
+// GLAD is generated for plain GL 3.3 core. anything newer is loaded here by hand
+// after GLAD, and only used when the context reports the matching version or extension
+// -------------------------------------------------------------------------------------
+
+// ARB_get_program_binary / GL 4.1
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+// KHR_parallel_shader_compile (ARB_parallel_shader_compile uses the same values)
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+// ARB_buffer_storage / GL 4.4
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+
+// EXT_texture_compression_s3tc, and the srgb variants from EXT_texture_sRGB
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+
+// ARB_texture_compression_bptc / GL 4.2
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+
+// ARB_draw_indirect / GL 4.0
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+
+// ARB_shader_image_load_store / GL 4.2
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+
+// ARB_compute_shader and ARB_shader_storage_buffer_object / GL 4.3
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS 0x90D6
+
+// ARB_indirect_parameters / GL 4.6
+#define GL_PARAMETER_BUFFER 0x80EE
+
+namespace GLExt
+{
+	typedef void (APIENTRYP PFN_GetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+	typedef void (APIENTRYP PFN_ProgramBinary)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+	typedef void (APIENTRYP PFN_ProgramParameteri)(GLuint program, GLenum pname, GLint value);
+	typedef void (APIENTRYP PFN_MaxShaderCompilerThreads)(GLuint count);
+	typedef void (APIENTRYP PFN_BufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+	typedef void (APIENTRYP PFN_DispatchCompute)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+	typedef void (APIENTRYP PFN_MemoryBarrier)(GLbitfield barriers);
+	typedef void (APIENTRYP PFN_MultiDrawElementsIndirect)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+	typedef void (APIENTRYP PFN_MultiDrawElementsIndirectCount)(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+
+	// context version, filled in by Load()
+	extern int majorVersion;
+	extern int minorVersion;
+
+	// glGetProgramBinary / glProgramBinary, with at least one binary format to use
+	extern bool programBinary;
+	extern PFN_GetProgramBinary GetProgramBinary;
+	extern PFN_ProgramBinary ProgramBinary;
+	extern PFN_ProgramParameteri ProgramParameteri;
+
+	// compiles continue in driver threads and GL_COMPLETION_STATUS_KHR can be polled
+	extern bool parallelShaderCompile;
+	extern PFN_MaxShaderCompilerThreads MaxShaderCompilerThreads;
+
+	// immutable buffer storage that can stay mapped while the GPU reads it
+	extern bool bufferStorage;
+	extern PFN_BufferStorage BufferStorage;
+
+	// compute shaders, shader storage buffers readable from vertex shaders and
+	// glMultiDrawElementsIndirect with base instances, everything GPU-driven drawing needs
+	extern bool gpuDrivenDraws;
+	extern PFN_DispatchCompute DispatchCompute;
+	// glMemoryBarrier, named so it doesn't collide with the MemoryBarrier macro in windows.h
+	extern PFN_MemoryBarrier ShaderMemoryBarrier;
+	extern PFN_MultiDrawElementsIndirect MultiDrawElementsIndirect;
+
+	// the draw count of a multi-draw read from a buffer instead of passed in
+	extern bool indirectCount;
+	extern PFN_MultiDrawElementsIndirectCount MultiDrawElementsIndirectCount;
+
+	// block compressed formats beyond RGTC, which is core in 3.0. uploads go through
+	// the core glCompressedTexImage calls, so these are only flags
+	extern bool textureS3TC;
+	extern bool textureS3TCsRGB;
+	extern bool textureBPTC;
+
+	bool HasExtension(const char* name);
+
+	// needs a current context and GLAD already loaded
+	void Load();
+}
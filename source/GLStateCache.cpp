@@ -0,0 +1,252 @@
+#include "glad/glad.h"
+
+#include "GLStateCache.h"
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	// no real GL name or enum uses this, so the first call always goes through
+	const unsigned int UNKNOWN = 0xFFFFFFFFu;
+}
+
+GLStateCache::GLStateCache()
+{
+	invalidate();
+	stats = GLStateStats{ 0, 0 };
+}
+
+void GLStateCache::invalidate()
+{
+	program = UNKNOWN;
+	vertexArray = UNKNOWN;
+	arrayBuffer = UNKNOWN;
+	elementBuffer = UNKNOWN;
+	uniformBuffer = UNKNOWN;
+	pixelUnpackBuffer = UNKNOWN;
+	otherBufferTarget = UNKNOWN;
+	otherBuffer = UNKNOWN;
+	activeUnit = UNKNOWN;
+	for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; ++i)
+	{
+		textureTargets[i] = UNKNOWN;
+		textures[i] = UNKNOWN;
+		samplers[i] = UNKNOWN;
+	}
+
+	blend = STATE_UNKNOWN;
+	blendSource = UNKNOWN;
+	blendDestination = UNKNOWN;
+	depthTest = STATE_UNKNOWN;
+	depthFunction = UNKNOWN;
+	depthWrite = STATE_UNKNOWN;
+	cull = STATE_UNKNOWN;
+	cullMode = UNKNOWN;
+	for (int i = 0; i < 4; ++i)
+		viewportRect[i] = -1;
+	// NaN never compares equal, so the first clear color is always sent
+	for (int i = 0; i < 4; ++i)
+		clearRGBA[i] = std::numeric_limits<float>::quiet_NaN();
+}
+
+GLStateStats GLStateCache::beginFrame()
+{
+	GLStateStats finished = stats;
+	stats = GLStateStats{ 0, 0 };
+	return finished;
+}
+
+GLStateStats GLStateCache::frameStats() const
+{
+	return stats;
+}
+
+template<typename T>
+bool GLStateCache::change(T& current, const T& value)
+{
+	if (current == value)
+	{
+		++stats.elided;
+		return false;
+	}
+	current = value;
+	++stats.issued;
+	return true;
+}
+
+bool GLStateCache::changeToggle(Tristate& current, bool enabled)
+{
+	return change(current, enabled ? STATE_ON : STATE_OFF);
+}
+
+void GLStateCache::useProgram(unsigned int id)
+{
+	if (change(program, id))
+		glUseProgram(id);
+}
+
+void GLStateCache::bindVertexArray(unsigned int vao)
+{
+	if (change(vertexArray, vao))
+	{
+		glBindVertexArray(vao);
+		// the element buffer binding belongs to the VAO we just switched to
+		elementBuffer = UNKNOWN;
+	}
+}
+
+void GLStateCache::bindBuffer(unsigned int target, unsigned int buffer)
+{
+	unsigned int* slot;
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER: slot = &arrayBuffer; break;
+	case GL_ELEMENT_ARRAY_BUFFER: slot = &elementBuffer; break;
+	case GL_UNIFORM_BUFFER: slot = &uniformBuffer; break;
+	case GL_PIXEL_UNPACK_BUFFER: slot = &pixelUnpackBuffer; break;
+	default:
+		// rarely used targets share one slot keyed by target
+		if (otherBufferTarget != target)
+		{
+			otherBufferTarget = target;
+			otherBuffer = UNKNOWN;
+		}
+		slot = &otherBuffer;
+		break;
+	}
+	if (change(*slot, buffer))
+		glBindBuffer(target, buffer);
+}
+
+void GLStateCache::activeTexture(unsigned int unit)
+{
+	if (change(activeUnit, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLStateCache::bindTexture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+	if (unit >= MAX_TEXTURE_UNITS)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		activeUnit = UNKNOWN;
+		stats.issued += 2;
+		return;
+	}
+
+	if (textures[unit] == texture && textureTargets[unit] == target)
+	{
+		++stats.elided;
+		return;
+	}
+	activeTexture(unit);
+	textures[unit] = texture;
+	textureTargets[unit] = target;
+	++stats.issued;
+	glBindTexture(target, texture);
+}
+
+void GLStateCache::bindSampler(unsigned int unit, unsigned int sampler)
+{
+	if (unit >= MAX_TEXTURE_UNITS)
+	{
+		glBindSampler(unit, sampler);
+		++stats.issued;
+		return;
+	}
+	if (change(samplers[unit], sampler))
+		glBindSampler(unit, sampler);
+}
+
+void GLStateCache::setBlend(bool enabled)
+{
+	if (changeToggle(blend, enabled))
+	{
+		if (enabled)
+			glEnable(GL_BLEND);
+		else
+			glDisable(GL_BLEND);
+	}
+}
+
+void GLStateCache::blendFunc(unsigned int source, unsigned int destination)
+{
+	if (blendSource == source && blendDestination == destination)
+	{
+		++stats.elided;
+		return;
+	}
+	blendSource = source;
+	blendDestination = destination;
+	++stats.issued;
+	glBlendFunc(source, destination);
+}
+
+void GLStateCache::setDepthTest(bool enabled)
+{
+	if (changeToggle(depthTest, enabled))
+	{
+		if (enabled)
+			glEnable(GL_DEPTH_TEST);
+		else
+			glDisable(GL_DEPTH_TEST);
+	}
+}
+
+void GLStateCache::depthFunc(unsigned int function)
+{
+	if (change(depthFunction, function))
+		glDepthFunc(function);
+}
+
+void GLStateCache::depthMask(bool write)
+{
+	if (changeToggle(depthWrite, write))
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLStateCache::setCullFace(bool enabled)
+{
+	if (changeToggle(cull, enabled))
+	{
+		if (enabled)
+			glEnable(GL_CULL_FACE);
+		else
+			glDisable(GL_CULL_FACE);
+	}
+}
+
+void GLStateCache::cullFace(unsigned int face)
+{
+	if (change(cullMode, face))
+		glCullFace(face);
+}
+
+void GLStateCache::viewport(int x, int y, int width, int height)
+{
+	int rect[4] = { x, y, width, height };
+	if (std::memcmp(viewportRect, rect, sizeof(rect)) == 0)
+	{
+		++stats.elided;
+		return;
+	}
+	std::memcpy(viewportRect, rect, sizeof(rect));
+	++stats.issued;
+	glViewport(x, y, width, height);
+}
+
+void GLStateCache::clearColor(float r, float g, float b, float a)
+{
+	if (clearRGBA[0] == r && clearRGBA[1] == g && clearRGBA[2] == b && clearRGBA[3] == a)
+	{
+		++stats.elided;
+		return;
+	}
+	clearRGBA[0] = r;
+	clearRGBA[1] = g;
+	clearRGBA[2] = b;
+	clearRGBA[3] = a;
+	++stats.issued;
+	glClearColor(r, g, b, a);
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+
+// issued/elided GL calls for one frame
+struct GLStateStats
+{
+	unsigned int issued;
+	unsigned int elided;
+};
+
+// shadow copy of the GL state the renderer touches. every setter compares against
+// what is already bound and only calls into the driver when something changes.
+// lives on the render thread; call invalidate() after any GL code that bypasses it
+// ---------------------------------------------------------------------------------
+class GLStateCache
+{
+public:
+	static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+	GLStateCache();
+
+	// forget everything, the next call of each kind always reaches GL
+	void invalidate();
+
+	// start counting a new frame, returns the counters of the one that just ended
+	GLStateStats beginFrame();
+
+	GLStateStats frameStats() const;
+
+	void useProgram(unsigned int program);
+
+	void bindVertexArray(unsigned int vao);
+
+	// GL_ELEMENT_ARRAY_BUFFER is tracked per VAO, so it is forgotten whenever the VAO changes
+	void bindBuffer(unsigned int target, unsigned int buffer);
+
+	void bindTexture(unsigned int unit, unsigned int target, unsigned int texture);
+
+	void bindSampler(unsigned int unit, unsigned int sampler);
+
+	void setBlend(bool enabled);
+
+	void blendFunc(unsigned int source, unsigned int destination);
+
+	void setDepthTest(bool enabled);
+
+	void depthFunc(unsigned int function);
+
+	void depthMask(bool write);
+
+	void setCullFace(bool enabled);
+
+	void cullFace(unsigned int face);
+
+	void viewport(int x, int y, int width, int height);
+
+	void clearColor(float r, float g, float b, float a);
+private:
+	// true when the value changed and the call has to go out
+	template<typename T>
+	bool change(T& current, const T& value);
+
+	void activeTexture(unsigned int unit);
+
+	enum Tristate : uint8_t { STATE_UNKNOWN, STATE_OFF, STATE_ON };
+	bool changeToggle(Tristate& current, bool enabled);
+
+	unsigned int program;
+	unsigned int vertexArray;
+	unsigned int arrayBuffer;
+	unsigned int elementBuffer;
+	unsigned int uniformBuffer;
+	unsigned int pixelUnpackBuffer;
+	unsigned int otherBufferTarget;
+	unsigned int otherBuffer;
+	unsigned int activeUnit;
+	unsigned int textureTargets[MAX_TEXTURE_UNITS];
+	unsigned int textures[MAX_TEXTURE_UNITS];
+	unsigned int samplers[MAX_TEXTURE_UNITS];
+
+	Tristate blend;
+	unsigned int blendSource;
+	unsigned int blendDestination;
+	Tristate depthTest;
+	unsigned int depthFunction;
+	Tristate depthWrite;
+	Tristate cull;
+	unsigned int cullMode;
+	int viewportRect[4];
+	float clearRGBA[4];
+
+	GLStateStats stats;
+};
@@ -0,0 +1,60 @@
+#include "GameLoop.h"
+
+FixedTimestep::FixedTimestep(double tickSeconds, int maxTicksPerFrame)
+	: tick(tickSeconds), maxTicks(maxTicksPerFrame), previousTime(0.0), accumulator(0.0), dropped(0)
+{
+}
+
+void FixedTimestep::reset(double now)
+{
+	previousTime = now;
+	accumulator = 0.0;
+}
+
+int FixedTimestep::advance(double now)
+{
+	double frameTime = now - previousTime;
+	previousTime = now;
+	if (frameTime < 0.0)
+		frameTime = 0.0;
+
+	accumulator += frameTime;
+	int ticks = (int)(accumulator / tick);
+	if (ticks > maxTicks)
+	{
+		// spiral of death guard: throw away the whole ticks we can't afford,
+		// keep the fractional remainder so interpolation stays smooth
+		dropped += (unsigned long long)(ticks - maxTicks);
+		accumulator -= (double)(ticks - maxTicks) * tick;
+		ticks = maxTicks;
+	}
+	accumulator -= (double)ticks * tick;
+	if (accumulator < 0.0)
+		accumulator = 0.0;
+	return ticks;
+}
+
+float FixedTimestep::alpha() const
+{
+	return (float)(accumulator / tick);
+}
+
+double FixedTimestep::tickSeconds() const
+{
+	return tick;
+}
+
+unsigned long long FixedTimestep::droppedTicks() const
+{
+	return dropped;
+}
+
+Transform2D Lerp(const Transform2D& a, const Transform2D& b, float t)
+{
+	Transform2D result;
+	result.x = a.x + (b.x - a.x) * t;
+	result.y = a.y + (b.y - a.y) * t;
+	result.rotation = a.rotation + (b.rotation - a.rotation) * t;
+	result.scale = a.scale + (b.scale - a.scale) * t;
+	return result;
+}
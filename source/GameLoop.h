@@ -0,0 +1,68 @@
+#pragma once
+
+// fixed-timestep accumulator
+// the simulation advances in constant ticks no matter how fast frames are rendered.
+// when a frame takes too long, at most maxTicksPerFrame ticks are run and the rest
+// of the backlog is dropped so one slow frame can't snowball into the next
+// ----------------------------------------------------------------------------------
+class FixedTimestep
+{
+public:
+	FixedTimestep(double tickSeconds, int maxTicksPerFrame);
+
+	// start measuring from the given time (seconds, e.g. glfwGetTime())
+	void reset(double now);
+
+	// feed the current time, returns how many ticks to simulate this frame
+	int advance(double now);
+
+	// how far we are between the last two ticks, in [0, 1)
+	float alpha() const;
+
+	double tickSeconds() const;
+
+	// ticks dropped so far because a frame fell too far behind
+	unsigned long long droppedTicks() const;
+private:
+	double tick;
+	int maxTicks;
+	double previousTime;
+	double accumulator;
+	unsigned long long dropped;
+};
+
+// keeps the state of the last two ticks so rendering can blend between them
+template<typename T>
+struct Interpolated
+{
+	T previous;
+	T current;
+
+	void reset(const T& value)
+	{
+		previous = value;
+		current = value;
+	}
+
+	void push(const T& next)
+	{
+		previous = current;
+		current = next;
+	}
+
+	T at(float alpha) const
+	{
+		return Lerp(previous, current, alpha);
+	}
+};
+
+// 2d placement of an object in normalized device coordinates
+struct Transform2D
+{
+	float x;
+	float y;
+	float rotation;
+	float scale;
+};
+
+Transform2D Lerp(const Transform2D& a, const Transform2D& b, float t);
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a. pass the previous result as seed to fold several pieces together
+inline uint64_t HashBytes64(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// includes the terminator so "ab"+"c" and "a"+"bc" hash differently
+inline uint64_t HashString64(const std::string& text, uint64_t seed = 14695981039346656037ull)
+{
+	return HashBytes64(text.c_str(), text.size() + 1, seed);
+}
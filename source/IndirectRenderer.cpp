@@ -0,0 +1,315 @@
+#include "glad/glad.h"
+
+#include "IndirectRenderer.h"
+#include "GLExtensions.h"
+#include "GLStateCache.h"
+#include "RenderCommands.h"
+#include "RenderQueue.h"
+#include "Shader.h"
+#include "ShaderPreprocessor.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	const int FLOATS_PER_VERTEX = 8;
+	// smallest radius over distance worth drawing into the occlusion buffer, about 5% of
+	// the screen's height at a 45 degree field of view
+	const float OCCLUDER_MIN_SIZE = 0.02f;
+
+	// the layout glMultiDrawElementsIndirect reads, written by cull.comp
+	struct DrawElementsIndirectCommand
+	{
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+}
+
+IndirectRenderer::IndirectRenderer(size_t maxObjects)
+	: maxObjects(maxObjects), occlusion(OCCLUSION_WIDTH, OCCLUSION_HEIGHT), gpu(false), drawn(0), dropped(0), occluded(0),
+	VAO(0), VBO(0), EBO(0), objectIdBuffer(0), objectBuffer(0), meshBuffer(0), commandBuffer(0), drawCountBuffer(0)
+{
+}
+
+uint32_t IndirectRenderer::addMesh(const float* meshVertices, size_t vertexCount, const uint32_t* meshIndices, size_t indexCount)
+{
+	// indices are made absolute, so draws need no base vertex
+	uint32_t baseVertex = (uint32_t)(vertices.size() / FLOATS_PER_VERTEX);
+	MeshRange range = { (uint32_t)indices.size(), (uint32_t)indexCount };
+	vertices.insert(vertices.end(), meshVertices, meshVertices + vertexCount * FLOATS_PER_VERTEX);
+	for (size_t i = 0; i < indexCount; ++i)
+		indices.push_back(meshIndices[i] + baseVertex);
+	meshes.push_back(range);
+
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		const float* position = meshVertices + i * FLOATS_PER_VERTEX;
+		positions.push_back(Vec3(position[0], position[1], position[2]));
+	}
+	localIndices.insert(localIndices.end(), meshIndices, meshIndices + indexCount);
+	firstVertices.push_back(baseVertex);
+	return (uint32_t)(meshes.size() - 1);
+}
+
+bool IndirectRenderer::addObject(const MeshObject& object)
+{
+	if (objects.size() >= maxObjects)
+		return false;
+	objects.push_back(object);
+	for (int k = 0; k < 4; ++k)
+		spheres[k].push_back(object.sphere[k]);
+	for (int k = 0; k < 3; ++k)
+	{
+		boxes[k].push_back(object.sphere[k] - object.sphere[3]);
+		boxes[k + 3].push_back(object.sphere[k] + object.sphere[3]);
+	}
+	return true;
+}
+
+std::shared_ptr<Shader> IndirectRenderer::CreateCullProgram(ShaderPreprocessor& preprocessor, const std::string& path)
+{
+	if (!GLExt::gpuDrivenDraws)
+		return nullptr;
+
+	// commands can only be packed when the draw reads its count from a buffer
+	std::vector<std::string> defines;
+	if (GLExt::indirectCount)
+		defines.push_back("COMPACT_DRAWS");
+	std::string code;
+	if (!preprocessor.process(path, defines, code))
+		return nullptr;
+	return Shader::Compute(code);
+}
+
+void IndirectRenderer::createResources(std::shared_ptr<Shader> cull, std::shared_ptr<Shader> draw)
+{
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+
+	// same layout as the quad, so shader.vs draws these too
+	const int stride = FLOATS_PER_VERTEX * sizeof(float);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+
+	// programs from a shader batch exist even when they failed to link
+	int linked = 0;
+	if (draw)
+		glGetProgramiv(draw->ID, GL_LINK_STATUS, &linked);
+	gpu = GLExt::gpuDrivenDraws && cull && linked && !objects.empty();
+	if (gpu)
+	{
+		cullProgram = cull;
+		drawProgram = draw;
+
+		// an instanced attribute starts at the draw's base instance, which cull.comp sets
+		// to the object's index
+		std::vector<uint32_t> ids(objects.size());
+		for (size_t i = 0; i < ids.size(); ++i)
+			ids[i] = (uint32_t)i;
+		glGenBuffers(1, &objectIdBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, objectIdBuffer);
+		glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(uint32_t), ids.data(), GL_STATIC_DRAW);
+		glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)0);
+		glVertexAttribDivisor(3, 1);
+		glEnableVertexAttribArray(3);
+
+		glGenBuffers(1, &objectBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(MeshObject), objects.data(), GL_STATIC_DRAW);
+
+		glGenBuffers(1, &meshBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, meshes.size() * sizeof(MeshRange), meshes.data(), GL_STATIC_DRAW);
+
+		// written by the GPU, read by the GPU
+		glGenBuffers(1, &commandBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_COPY);
+
+		uint32_t zero = 0;
+		glGenBuffers(1, &drawCountBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawCountBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), &zero, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+	else
+	{
+		// one without the other is no use
+		if (cull)
+			glDeleteProgram(cull->ID);
+		if (draw)
+			glDeleteProgram(draw->ID);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void IndirectRenderer::destroyResources()
+{
+	if (gpu)
+	{
+		// whatever the last replayed frame kept, for the stats printed at exit
+		uint32_t count = 0;
+		glBindBuffer(GL_COPY_READ_BUFFER, drawCountBuffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(count), &count);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		drawn = count;
+
+		unsigned int buffers[] = { objectIdBuffer, objectBuffer, meshBuffer, commandBuffer, drawCountBuffer };
+		glDeleteBuffers(5, buffers);
+		glDeleteProgram(cullProgram->ID);
+		glDeleteProgram(drawProgram->ID);
+		cullProgram.reset();
+		drawProgram.reset();
+	}
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &EBO);
+}
+
+bool IndirectRenderer::gpuDriven() const
+{
+	return gpu;
+}
+
+void IndirectRenderer::record(RenderCommandBuffer& commands, RenderQueue& queue, const Shader* fallback, const Mat4& viewProjection, JobSystem* jobs)
+{
+	if (objects.empty())
+		return;
+
+	if (gpu)
+	{
+		// the camera travels in the command stream, the callbacks only read GL objects
+		// that don't change after createResources()
+		commands.useProgram(cullProgram->ID);
+		commands.uniformMatrix4f(cullProgram.get(), "viewProjection"_uniform, viewProjection.data());
+		commands.callback(Cull, this);
+		commands.useProgram(drawProgram->ID);
+		commands.uniformMatrix4f(drawProgram.get(), "viewProjection"_uniform, viewProjection.data());
+		commands.bindVertexArray(VAO);
+		commands.callback(Draw, this);
+		return;
+	}
+
+	SphereArrays bounds = { spheres[0].data(), spheres[1].data(), spheres[2].data(), spheres[3].data() };
+	size_t inFrustum = culler.cullSpheres(Frustum::FromMatrix(viewProjection), bounds, objects.size(), jobs);
+	candidates.assign(culler.visible(), culler.visible() + inFrustum);
+
+	// the objects taking up the most of the screen hide the most. their meshes go into the
+	// occlusion buffer, then every survivor's box is tested against it, the occluders'
+	// own too; a box always reaches in front of the mesh inside it
+	occluders.clear();
+	const Vec4 row3(viewProjection[0].w, viewProjection[1].w, viewProjection[2].w, viewProjection[3].w);
+	for (uint32_t index : candidates)
+	{
+		float distance = Dot(row3, Vec4(spheres[0][index], spheres[1][index], spheres[2][index], 1.0f));
+		float size = spheres[3][index] / distance;
+		if (distance > 0.0f && size >= OCCLUDER_MIN_SIZE)
+			occluders.push_back(std::make_pair(size, index));
+	}
+	if (occluders.size() > MAX_OCCLUDERS)
+	{
+		std::nth_element(occluders.begin(), occluders.begin() + MAX_OCCLUDERS, occluders.end(),
+			[](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; });
+		occluders.resize(MAX_OCCLUDERS);
+	}
+	occlusion.clear();
+	for (const std::pair<float, uint32_t>& occluder : occluders)
+	{
+		const MeshObject& object = objects[occluder.second];
+		const MeshRange& mesh = meshes[object.mesh];
+		Mat4 model;
+		std::memcpy(&model[0].x, object.model, sizeof(object.model));
+		size_t vertexEnd = object.mesh + 1 < firstVertices.size() ? firstVertices[object.mesh + 1] : positions.size();
+		occlusion.addOccluder(viewProjection * model, positions.data() + firstVertices[object.mesh], vertexEnd - firstVertices[object.mesh],
+			localIndices.data() + mesh.firstIndex, mesh.indexCount / 3);
+	}
+	occlusion.rasterize(jobs);
+	BoxArrays boxArrays = { boxes[0].data(), boxes[1].data(), boxes[2].data(), boxes[3].data(), boxes[4].data(), boxes[5].data() };
+	size_t visible = occlusion.cull(viewProjection, boxArrays, candidates.data(), inFrustum, jobs);
+	occluded = inFrustum - visible;
+
+	drawn = 0;
+	for (size_t i = 0; i < visible && drawn < MAX_FALLBACK_DRAWS; ++i)
+	{
+		const MeshObject& object = objects[candidates[i]];
+		const MeshRange& mesh = meshes[object.mesh];
+		DrawPacket packet = { fallback, VAO, 0, (int)mesh.indexCount, mesh.firstIndex * sizeof(uint32_t), {} };
+		std::memcpy(packet.model, object.model, sizeof(packet.model));
+		if (!queue.submit(SortKey::Make(0, false, 0.0f, fallback->ID, 0, object.mesh), packet))
+			break;
+		++drawn;
+	}
+	dropped += visible - drawn;
+}
+
+void IndirectRenderer::Cull(void* data, GLStateCache& state)
+{
+	IndirectRenderer& renderer = *static_cast<IndirectRenderer*>(data);
+	GLuint count = (GLuint)renderer.objects.size();
+	renderer.cullProgram->setInt("objectCount"_uniform, (int)count);
+
+	// the count starts over on the GPU's timeline, nothing waits for the last frame's
+	uint32_t zero = 0;
+	state.bindBuffer(GL_COPY_WRITE_BUFFER, renderer.drawCountBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(zero), &zero);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, renderer.objectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, renderer.meshBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, renderer.commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, renderer.drawCountBuffer);
+	GLExt::DispatchCompute((count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	// the draw reads the commands and the count as indirect parameters
+	GLExt::ShaderMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+}
+
+void IndirectRenderer::Draw(void* data, GLStateCache& state)
+{
+	IndirectRenderer& renderer = *static_cast<IndirectRenderer*>(data);
+	GLsizei count = (GLsizei)renderer.objects.size();
+	state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer.commandBuffer);
+	if (GLExt::indirectCount)
+	{
+		state.bindBuffer(GL_PARAMETER_BUFFER, renderer.drawCountBuffer);
+		GLExt::MultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, 0, count, 0);
+	}
+	else
+	{
+		GLExt::MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, count, 0);
+	}
+}
+
+size_t IndirectRenderer::objectCount() const
+{
+	return objects.size();
+}
+
+size_t IndirectRenderer::drawnObjects() const
+{
+	return drawn;
+}
+
+size_t IndirectRenderer::droppedDraws() const
+{
+	return dropped;
+}
+
+size_t IndirectRenderer::occludedObjects() const
+{
+	return occluded;
+}
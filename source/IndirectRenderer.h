@@ -0,0 +1,138 @@
+#pragma once
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Shader;
+class ShaderPreprocessor;
+class RenderCommandBuffer;
+class RenderQueue;
+class GLStateCache;
+class JobSystem;
+
+// one object as the culling and vertex shaders read it from storage (std430, objects.glsl)
+struct MeshObject
+{
+	// column-major
+	float model[16];
+	// world space bounding sphere: center and radius
+	float sphere[4];
+	uint32_t mesh;
+	uint32_t padding[3];
+};
+
+// GPU-driven renderer for large numbers of static meshes. meshes share one vertex and one
+// index buffer and every object lives in a shader storage buffer. each frame a compute
+// shader frustum culls the objects and writes a DrawElementsIndirectCommand per visible
+// one, then a single glMultiDrawElementsIndirect draws them all, so the CPU's share of the
+// frame doesn't grow with the object count. with GL 4.6 / ARB_indirect_parameters the
+// commands are packed and the draw count never leaves the GPU; without it every object
+// keeps a command slot that is left empty when it is culled.
+// below GL 4.3 objects are culled on the CPU with FrustumCuller instead, then the objects
+// biggest on screen are rasterized into an OcclusionCuller and whatever they hide is dropped
+// too; the rest are submitted to a RenderQueue one draw each, up to MAX_FALLBACK_DRAWS
+// -----------------------------------------------------------------------------------------
+class IndirectRenderer
+{
+public:
+	// objects per compute work group, local_size_x in cull.comp
+	static const unsigned int CULL_GROUP_SIZE = 64;
+	// one uniform and one draw command each, about what the command buffer holds
+	static const size_t MAX_FALLBACK_DRAWS = 16384;
+	// the CPU path's occlusion buffer, and how many of the objects biggest on screen are
+	// drawn into it each frame
+	static const int OCCLUSION_WIDTH = 256;
+	static const int OCCLUSION_HEIGHT = 144;
+	static const size_t MAX_OCCLUDERS = 256;
+
+	explicit IndirectRenderer(size_t maxObjects);
+
+	// main thread, before createResources(). vertices are 8 floats like the quad's:
+	// position, color and texture coordinates. returns the mesh's id
+	uint32_t addMesh(const float* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount);
+
+	// false once maxObjects are there
+	bool addObject(const MeshObject& object);
+
+	// render thread: builds cull.comp the way this context needs it, nullptr without GL 4.3
+	static std::shared_ptr<Shader> CreateCullProgram(ShaderPreprocessor& preprocessor, const std::string& path);
+
+	// render thread: buffers and vertex array. cull is the cull.comp program and draw a
+	// program reading its model matrices from the objects buffer; without either, or if
+	// draw didn't link, the renderer stays on the CPU path
+	void createResources(std::shared_ptr<Shader> cull, std::shared_ptr<Shader> draw);
+	void destroyResources();
+
+	bool gpuDriven() const;
+
+	// main thread: cull and draw every object, depth testing is up to the caller. the GPU path records
+	// the dispatch and the multi-draw; the CPU path submits the visible objects to queue to
+	// be drawn with fallback, a program with a "model" uniform like shader.vs
+	void record(RenderCommandBuffer& commands, RenderQueue& queue, const Shader* fallback, const Mat4& viewProjection, JobSystem* jobs = nullptr);
+
+	size_t objectCount() const;
+
+	// objects drawn in the last frame. for the GPU path that is the count the last
+	// replayed dispatch left behind, read back when the resources are destroyed
+	size_t drawnObjects() const;
+
+	// objects the CPU path culled in but couldn't submit
+	size_t droppedDraws() const;
+
+	// objects inside the frustum that the CPU path's occlusion test hid in the last frame
+	size_t occludedObjects() const;
+private:
+	// render thread, recorded as callbacks
+	static void Cull(void* data, GLStateCache& state);
+	static void Draw(void* data, GLStateCache& state);
+
+	// one mesh's stretch of the index buffer, as cull.comp reads it
+	struct MeshRange
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+
+	size_t maxObjects;
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshRange> meshes;
+	std::vector<MeshObject> objects;
+	// the objects' spheres as x, y, z, radius arrays and the boxes around them as min x,
+	// y, z, max x, y, z arrays, for the CPU path
+	std::vector<float> spheres[4];
+	std::vector<float> boxes[6];
+	FrustumCuller culler;
+
+	// the meshes again for the occlusion buffer: positions, and indices relative to each
+	// mesh's first vertex at the same places as in indices
+	std::vector<Vec3> positions;
+	std::vector<uint32_t> localIndices;
+	std::vector<uint32_t> firstVertices;
+	OcclusionCuller occlusion;
+	// record() scratch: frustum survivors, and occluder candidates with their size on screen
+	std::vector<uint32_t> candidates;
+	std::vector<std::pair<float, uint32_t>> occluders;
+
+	std::shared_ptr<Shader> cullProgram;
+	std::shared_ptr<Shader> drawProgram;
+	bool gpu;
+	size_t drawn;
+	size_t dropped;
+	size_t occluded;
+
+	unsigned int VAO;
+	unsigned int VBO;
+	unsigned int EBO;
+	// 0, 1, 2, ... per instance, so the base instance becomes the object index
+	unsigned int objectIdBuffer;
+	unsigned int objectBuffer;
+	unsigned int meshBuffer;
+	unsigned int commandBuffer;
+	unsigned int drawCountBuffer;
+};
@@ -0,0 +1,366 @@
+#include "JobSystem.h"
+#include <iostream>
+
+namespace
+{
+	const unsigned int QUEUE_CAPACITY = 4096;
+	const unsigned int JOB_POOL_SIZE = 4096;
+	const int SPINS_BEFORE_SLEEP = 64;
+
+	// which JobSystem / worker the current thread belongs to
+	thread_local JobSystem* tlsSystem = nullptr;
+	thread_local int tlsWorker = -1;
+
+	uint32_t XorShift(uint32_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+}
+
+// job counter
+// -----------
+JobCounter::JobCounter()
+	: pending(0)
+{
+}
+
+JobCounter::~JobCounter()
+{
+	// a finishing worker may still be inside finish() right after the count hit zero,
+	// taking the lock makes sure it has let go of us
+	std::lock_guard<std::mutex> lock(continuationLock);
+}
+
+bool JobCounter::done() const
+{
+	return pending.load(std::memory_order_acquire) == 0;
+}
+
+// work-stealing queue
+// -------------------
+WorkStealingQueue::WorkStealingQueue(unsigned int capacity)
+	: top(0), bottom(0), buffer(capacity), mask((int64_t)capacity - 1)
+{
+	// capacity must be a power of two so indices can wrap with a mask
+	if ((capacity & (capacity - 1)) != 0)
+		std::cout << "ERROR::JOBSYSTEM::QUEUE_CAPACITY_NOT_POWER_OF_TWO" << std::endl;
+}
+
+bool WorkStealingQueue::push(Job* job)
+{
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_acquire);
+	if (b - t > mask)
+		return false;
+
+	buffer[b & mask].store(job, std::memory_order_release);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+Job* WorkStealingQueue::pop()
+{
+	int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// queue was already empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = buffer[b & mask].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// last item: race any thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* WorkStealingQueue::steal()
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+		return nullptr;
+
+	Job* job = buffer[t & mask].load(std::memory_order_acquire);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+bool WorkStealingQueue::empty() const
+{
+	return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+}
+
+// job system
+// ----------
+JobSystem::Worker::Worker(unsigned int queueCapacity)
+	: queue(queueCapacity), jobPool(JOB_POOL_SIZE), nextJob(0), randomState(0)
+{
+}
+
+JobSystem::JobSystem(unsigned int workerCount)
+	: injectionPool(JOB_POOL_SIZE), nextInjectionJob(0),
+	queuedJobs(0), sleepingWorkers(0), stopping(false)
+{
+	if (workerCount == 0)
+		workerCount = std::thread::hardware_concurrency();
+	if (workerCount == 0)
+		workerCount = 1;
+
+	for (unsigned int i = 0; i < workerCount; ++i)
+	{
+		workers.push_back(new Worker(QUEUE_CAPACITY));
+		workers[i]->randomState = 0x9E3779B9u * (i + 1);
+	}
+
+	// the creating thread is worker 0
+	tlsSystem = this;
+	tlsWorker = 0;
+
+	for (unsigned int i = 1; i < workerCount; ++i)
+		workers[i]->thread = std::thread(&JobSystem::workerMain, this, (int)i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+		stopping.store(true);
+	}
+	wakeUp.notify_all();
+
+	// every thread has to be gone before any queue is freed, idle workers steal from all of them
+	for (Worker* worker : workers)
+	{
+		if (worker->thread.joinable())
+			worker->thread.join();
+	}
+	for (Worker* worker : workers)
+		delete worker;
+
+	if (tlsSystem == this)
+	{
+		tlsSystem = nullptr;
+		tlsWorker = -1;
+	}
+}
+
+unsigned int JobSystem::workerCount() const
+{
+	return (unsigned int)workers.size();
+}
+
+int JobSystem::currentWorker() const
+{
+	return tlsSystem == this ? tlsWorker : -1;
+}
+
+void JobSystem::run(void (*function)(const Job& job), void* data, JobCounter* counter,
+	unsigned int begin, unsigned int end)
+{
+	Job* job = allocateJob(currentWorker());
+	job->function = function;
+	job->data = data;
+	job->begin = begin;
+	job->end = end;
+	job->counter = counter;
+	if (counter)
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+	submit(job);
+}
+
+void JobSystem::runAfter(JobCounter& dependency, void (*function)(const Job& job), void* data,
+	JobCounter* counter, unsigned int begin, unsigned int end)
+{
+	Job* job = allocateJob(currentWorker());
+	job->function = function;
+	job->data = data;
+	job->begin = begin;
+	job->end = end;
+	job->counter = counter;
+	if (counter)
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+	{
+		// the lock orders us against finish() draining the continuation list
+		std::lock_guard<std::mutex> lock(dependency.continuationLock);
+		if (!dependency.done())
+		{
+			dependency.continuations.push_back(job);
+			return;
+		}
+	}
+	submit(job);
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	int worker = currentWorker();
+	while (!counter.done())
+	{
+		Job* job = worker >= 0 ? findJob(worker) : nullptr;
+		if (job)
+			execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+Job* JobSystem::allocateJob(int worker)
+{
+	Job* job;
+	if (worker >= 0)
+	{
+		Worker& self = *workers[worker];
+		job = &self.jobPool[self.nextJob++ & (JOB_POOL_SIZE - 1)];
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(injectionLock);
+		job = &injectionPool[nextInjectionJob++ & (JOB_POOL_SIZE - 1)];
+	}
+
+	// more than JOB_POOL_SIZE jobs in flight from one thread: help out until the slot frees up
+	while (job->busy.load(std::memory_order_acquire))
+	{
+		Job* other = worker >= 0 ? findJob(worker) : nullptr;
+		if (other)
+			execute(other);
+		else
+			std::this_thread::yield();
+	}
+	job->busy.store(true, std::memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::submit(Job* job)
+{
+	int worker = currentWorker();
+	if (worker >= 0)
+	{
+		if (!workers[worker]->queue.push(job))
+		{
+			// our deque is full, just do the work now
+			execute(job);
+			return;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(injectionLock);
+		injectionQueue.push_back(job);
+	}
+
+	queuedJobs.fetch_add(1);
+	if (sleepingWorkers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+		wakeUp.notify_one();
+	}
+}
+
+Job* JobSystem::findJob(int worker)
+{
+	Worker& self = *workers[worker];
+
+	Job* job = self.queue.pop();
+	if (!job)
+	{
+		// pick a random victim to start from so thieves don't all pile onto worker 0
+		unsigned int count = (unsigned int)workers.size();
+		unsigned int start = XorShift(self.randomState) % count;
+		for (unsigned int i = 0; i < count && !job; ++i)
+		{
+			unsigned int victim = (start + i) % count;
+			if (victim != (unsigned int)worker)
+				job = workers[victim]->queue.steal();
+		}
+	}
+	if (!job && queuedJobs.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock(injectionLock);
+		if (!injectionQueue.empty())
+		{
+			job = injectionQueue.back();
+			injectionQueue.pop_back();
+		}
+	}
+
+	if (job)
+		queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::execute(Job* job)
+{
+	job->function(*job);
+	finish(job);
+}
+
+void JobSystem::finish(Job* job)
+{
+	JobCounter* counter = job->counter;
+	job->busy.store(false, std::memory_order_release);
+
+	if (!counter)
+		return;
+
+	// the count drops under the lock so runAfter can't slip a continuation in after we drained,
+	// and the counter is never touched again once a waiter can see it at zero
+	std::vector<Job*> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->continuationLock);
+		if (counter->pending.load(std::memory_order_relaxed) == 1)
+			ready.swap(counter->continuations);
+		counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+	}
+	for (Job* next : ready)
+		submit(next);
+}
+
+void JobSystem::workerMain(int worker)
+{
+	tlsSystem = this;
+	tlsWorker = worker;
+
+	int idleSpins = 0;
+	while (!stopping.load(std::memory_order_relaxed))
+	{
+		Job* job = findJob(worker);
+		if (job)
+		{
+			execute(job);
+			idleSpins = 0;
+			continue;
+		}
+
+		if (++idleSpins < SPINS_BEFORE_SLEEP)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepLock);
+		sleepingWorkers.fetch_add(1);
+		wakeUp.wait(lock, [this] { return queuedJobs.load() > 0 || stopping.load(); });
+		sleepingWorkers.fetch_sub(1);
+		idleSpins = 0;
+	}
+}
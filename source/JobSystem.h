@@ -0,0 +1,156 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+class JobCounter;
+
+// a unit of work. jobs are plain data so they can live in lock-free queues:
+// the function gets the job back and reads whatever it needs from data/begin/end
+struct Job
+{
+	void (*function)(const Job& job);
+	void* data;
+	unsigned int begin;
+	unsigned int end;
+	JobCounter* counter;
+
+	// owned by the JobSystem: set while the job is queued or running so its pool slot isn't reused
+	std::atomic<bool> busy;
+};
+
+// counts jobs that have been submitted but not finished yet.
+// other jobs can be made to wait on a counter (see JobSystem::runAfter),
+// and the submitting thread can wait on it with JobSystem::wait
+class JobCounter
+{
+public:
+	JobCounter();
+	~JobCounter();
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool done() const;
+private:
+	friend class JobSystem;
+	std::atomic<int> pending;
+	std::mutex continuationLock;
+	std::vector<Job*> continuations;
+};
+
+// Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli 2013).
+// the owning worker pushes and pops at the bottom, any other thread steals from the top.
+// capacity is fixed; push returns false when full and the caller runs the job inline
+// ------------------------------------------------------------------------------------
+class WorkStealingQueue
+{
+public:
+	explicit WorkStealingQueue(unsigned int capacity);
+
+	bool push(Job* job);
+
+	Job* pop();
+
+	Job* steal();
+
+	bool empty() const;
+private:
+	std::atomic<int64_t> top;
+	std::atomic<int64_t> bottom;
+	std::vector<std::atomic<Job*>> buffer;
+	int64_t mask;
+};
+
+// pool of worker threads, one per core by default.
+// the thread that creates the JobSystem counts as worker 0 and helps run jobs
+// whenever it waits on a counter. threads that are not workers (e.g. a render thread)
+// may also submit; their jobs go through a shared injection queue
+// ------------------------------------------------------------------------------------
+class JobSystem
+{
+public:
+	// workerCount includes the calling thread, 0 means one per hardware thread
+	explicit JobSystem(unsigned int workerCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	unsigned int workerCount() const;
+
+	// queue a job, counter (if any) is incremented before the job becomes visible
+	void run(void (*function)(const Job& job), void* data, JobCounter* counter,
+		unsigned int begin = 0, unsigned int end = 0);
+
+	// like run, but the job is held back until dependency reaches zero
+	void runAfter(JobCounter& dependency, void (*function)(const Job& job), void* data,
+		JobCounter* counter, unsigned int begin = 0, unsigned int end = 0);
+
+	// run other jobs on this thread until the counter reaches zero
+	void wait(JobCounter& counter);
+
+	// split [0, count) into chunks of at most grainSize and call fn(begin, end) for each,
+	// returns once every chunk is done
+	template<typename Function>
+	void parallelFor(unsigned int count, unsigned int grainSize, const Function& fn)
+	{
+		if (count == 0)
+			return;
+		if (grainSize == 0)
+			grainSize = 1;
+
+		JobCounter counter;
+		for (unsigned int begin = 0; begin < count; begin += grainSize)
+		{
+			unsigned int end = begin + grainSize < count ? begin + grainSize : count;
+			run(&InvokeRange<Function>, (void*)&fn, &counter, begin, end);
+		}
+		wait(counter);
+	}
+
+	// index of the calling worker thread, or -1 when called from a non-worker thread
+	int currentWorker() const;
+private:
+	template<typename Function>
+	static void InvokeRange(const Job& job)
+	{
+		(*static_cast<const Function*>(job.data))(job.begin, job.end);
+	}
+
+	struct Worker
+	{
+		explicit Worker(unsigned int queueCapacity);
+
+		WorkStealingQueue queue;
+		std::vector<Job> jobPool;
+		unsigned int nextJob;
+		uint32_t randomState;
+		std::thread thread;
+	};
+
+	Job* allocateJob(int worker);
+	void submit(Job* job);
+	Job* findJob(int worker);
+	void execute(Job* job);
+	void finish(Job* job);
+	void workerMain(int worker);
+
+	std::vector<Worker*> workers;
+
+	// submissions from threads that aren't workers
+	std::mutex injectionLock;
+	std::vector<Job*> injectionQueue;
+	std::vector<Job> injectionPool;
+	unsigned int nextInjectionJob;
+
+	// sleeping when there is nothing to do
+	std::mutex sleepLock;
+	std::condition_variable wakeUp;
+	std::atomic<int> queuedJobs;
+	std::atomic<int> sleepingWorkers;
+	std::atomic<bool> stopping;
+};
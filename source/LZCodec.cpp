@@ -0,0 +1,255 @@
+#include "LZCodec.h"
+#include <cstring>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	const size_t MIN_MATCH = 4;
+	// the format ends every block with at least 5 literals, and the last match
+	// has to start 12 bytes or more before the end
+	const size_t LAST_LITERALS = 5;
+	const size_t MATCH_FIND_LIMIT = 12;
+	const size_t MAX_OFFSET = 65535;
+	const int HASH_BITS = 14;
+
+	uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	uint64_t Read64(const uint8_t* p)
+	{
+		uint64_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	uint32_t Hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	unsigned int TrailingZeros64(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return (unsigned int)index;
+#else
+		return (unsigned int)__builtin_ctzll(value);
+#endif
+	}
+
+	// length of the common run at a and b, without reading past limit on a
+	size_t MatchLength(const uint8_t* a, const uint8_t* b, const uint8_t* limit)
+	{
+		const uint8_t* start = a;
+		while (a + 8 <= limit)
+		{
+			uint64_t difference = Read64(a) ^ Read64(b);
+			if (difference)
+				return (size_t)(a - start) + TrailingZeros64(difference) / 8;
+			a += 8;
+			b += 8;
+		}
+		while (a < limit && *a == *b)
+		{
+			++a;
+			++b;
+		}
+		return (size_t)(a - start);
+	}
+
+	// 15 in the token nibble means "more follows" as a run of 255s and a final byte
+	uint8_t* WriteLength(uint8_t* op, size_t length)
+	{
+		while (length >= 255)
+		{
+			*op++ = 255;
+			length -= 255;
+		}
+		*op++ = (uint8_t)length;
+		return op;
+	}
+
+	// literals [anchor, ip) then, unless matchLength is 0, the match. nullptr when out of room
+	uint8_t* WriteSequence(uint8_t* op, uint8_t* end, const uint8_t* anchor, const uint8_t* ip, size_t offset, size_t matchLength)
+	{
+		size_t literals = (size_t)(ip - anchor);
+		size_t needed = 1 + literals / 255 + 1 + literals + (matchLength ? 2 + matchLength / 255 + 1 : 0);
+		if ((size_t)(end - op) < needed)
+			return nullptr;
+
+		uint8_t* token = op++;
+		*token = (uint8_t)((literals < 15 ? literals : 15) << 4);
+		if (literals >= 15)
+			op = WriteLength(op, literals - 15);
+		if (literals)
+			std::memcpy(op, anchor, literals);
+		op += literals;
+
+		if (matchLength == 0)
+			return op;
+
+		*op++ = (uint8_t)(offset & 0xFF);
+		*op++ = (uint8_t)(offset >> 8);
+		size_t extra = matchLength - MIN_MATCH;
+		*token |= (uint8_t)(extra < 15 ? extra : 15);
+		if (extra >= 15)
+			op = WriteLength(op, extra - 15);
+		return op;
+	}
+}
+
+size_t LZ::Bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t LZ::Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity)
+{
+	uint8_t* op = dst;
+	uint8_t* end = dst + capacity;
+	const uint8_t* anchor = src;
+
+	if (size > MATCH_FIND_LIMIT)
+	{
+		// positions of the last 4-byte sequence with each hash, per call so threads don't share it
+		std::vector<uint32_t> table((size_t)1 << HASH_BITS, 0);
+		const uint8_t* ip = src + 1;
+		const uint8_t* limit = src + size - MATCH_FIND_LIMIT;
+		const uint8_t* matchLimit = src + size - LAST_LITERALS;
+
+		while (ip < limit)
+		{
+			uint32_t sequence = Read32(ip);
+			uint32_t& slot = table[Hash(sequence)];
+			const uint8_t* candidate = src + slot;
+			slot = (uint32_t)(ip - src);
+
+			if (candidate >= ip || (size_t)(ip - candidate) > MAX_OFFSET || Read32(candidate) != sequence)
+			{
+				// skip ahead faster the longer nothing has matched, incompressible data stays cheap
+				ip += 1 + ((size_t)(ip - anchor) >> 6);
+				continue;
+			}
+
+			// grow the match backwards into the pending literals
+			while (ip > anchor && candidate > src && ip[-1] == candidate[-1])
+			{
+				--ip;
+				--candidate;
+			}
+
+			size_t length = MIN_MATCH + MatchLength(ip + MIN_MATCH, candidate + MIN_MATCH, matchLimit);
+			op = WriteSequence(op, end, anchor, ip, (size_t)(ip - candidate), length);
+			if (!op)
+				return 0;
+
+			ip += length;
+			anchor = ip;
+			// seed the table inside the match so the next one can be found right away
+			if (ip - 2 < limit)
+				table[Hash(Read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+		}
+	}
+
+	op = WriteSequence(op, end, anchor, src + size, 0, 0);
+	return op ? (size_t)(op - dst) : 0;
+}
+
+bool LZ::Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+	const uint8_t* ip = src;
+	const uint8_t* iend = src + srcSize;
+	uint8_t* op = dst;
+	uint8_t* oend = dst + dstSize;
+
+	while (ip < iend)
+	{
+		unsigned int token = *ip++;
+
+		size_t literals = token >> 4;
+		if (literals == 15)
+		{
+			unsigned int byte;
+			do
+			{
+				if (ip >= iend)
+					return false;
+				byte = *ip++;
+				literals += byte;
+			} while (byte == 255);
+		}
+		if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op))
+			return false;
+		if (literals)
+			std::memcpy(op, ip, literals);
+		op += literals;
+		ip += literals;
+
+		// the last sequence is literals only
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+		size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst))
+			return false;
+
+		size_t length = token & 15;
+		if (length == 15)
+		{
+			unsigned int byte;
+			do
+			{
+				if (ip >= iend)
+					return false;
+				byte = *ip++;
+				length += byte;
+			} while (byte == 255);
+		}
+		length += MIN_MATCH;
+		if (length > (size_t)(oend - op))
+			return false;
+
+		uint8_t* copyEnd = op + length;
+		// 8-byte copies may run up to 7 bytes past the match (the next sequence overwrites
+		// them) but never past the output
+		uint8_t* wideEnd = (size_t)(oend - copyEnd) >= 8 ? copyEnd : ((size_t)(oend - op) >= 8 ? oend - 8 : op);
+
+		// a short offset repeats a pattern, which also repeats at any multiple of the
+		// offset; lay down one copy of the pattern at 8 bytes or more by hand
+		size_t distance = offset;
+		if (distance < 8)
+		{
+			while (distance < 8)
+				distance += offset;
+			size_t head = distance < length ? distance : length;
+			for (size_t i = 0; i < head; ++i)
+				op[i] = (op - offset)[i];
+			op += head;
+		}
+		while (op < wideEnd)
+		{
+			std::memcpy(op, op - distance, 8);
+			op += 8;
+		}
+		if (op > copyEnd)
+			op = copyEnd;
+		while (op < copyEnd)
+		{
+			*op = *(op - distance);
+			++op;
+		}
+	}
+	return op == oend;
+}
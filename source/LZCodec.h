@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// byte-oriented LZ77 in the LZ4 block format: sequences of literals followed by a match
+// of at least 4 bytes up to 64 KiB back, no entropy coding. compression is one greedy pass
+// over a hash of 4-byte prefixes, decompression is a tight copy loop that does no more
+// than bounds checks, so it runs at memory speed and is safe on corrupt input
+// ---------------------------------------------------------------------------------------
+namespace LZ
+{
+	// worst case output size for size input bytes (incompressible data grows slightly)
+	size_t Bound(size_t size);
+
+	// compress into dst, returns the compressed size or 0 if it didn't fit in capacity
+	size_t Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+
+	// decompress exactly dstSize bytes, false if the input is malformed or decodes to a
+	// different size. dst must not overlap src
+	bool Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+}
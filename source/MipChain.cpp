@@ -0,0 +1,223 @@
+#include "MipChain.h"
+#include <cmath>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPCHAIN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// one RGBA texel in a register
+#if MIPCHAIN_SSE2
+	typedef __m128 Float4;
+	inline Float4 Load(const float* p) { return _mm_loadu_ps(p); }
+	inline void Store(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+	inline Float4 Splat(float s) { return _mm_set1_ps(s); }
+	inline Float4 Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+	inline Float4 Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+#else
+	struct Float4 { float v[4]; };
+	inline Float4 Load(const float* p) { return Float4{ { p[0], p[1], p[2], p[3] } }; }
+	inline void Store(float* p, Float4 a) { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+	inline Float4 Splat(float s) { return Float4{ { s, s, s, s } }; }
+	inline Float4 Add(Float4 a, Float4 b) { return Float4{ { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+	inline Float4 Mul(Float4 a, Float4 b) { return Float4{ { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+#endif
+
+	// linear float image, 4 floats per texel
+	struct Image
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<float> texels;
+
+		const float* at(int x, int y) const { return &texels[((size_t)y * width + x) * 4]; }
+		float* at(int x, int y) { return &texels[((size_t)y * width + x) * 4]; }
+	};
+
+	// the kaiser kernel for a 2:1 reduction, taps at -2..3 around 2x
+	const int KAISER_TAPS = 6;
+	const float KAISER_RADIUS = 1.5f;
+	const float KAISER_ALPHA = 4.0f;
+
+	int Clamp(int value, int low, int high)
+	{
+		return value < low ? low : (value > high ? high : value);
+	}
+
+	float SrgbToLinear(float c)
+	{
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float LinearToSrgb(float c)
+	{
+		return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+	}
+
+	uint8_t Quantize(float c)
+	{
+		c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+		return (uint8_t)(c * 255.0f + 0.5f);
+	}
+
+	// zeroth order modified bessel function, the series converges quickly for the alphas used here
+	float BesselI0(float x)
+	{
+		float sum = 1.0f;
+		float term = 1.0f;
+		float halfX = x * 0.5f;
+		for (int k = 1; k < 32; ++k)
+		{
+			term *= (halfX / (float)k) * (halfX / (float)k);
+			sum += term;
+			if (term < sum * 1e-8f)
+				break;
+		}
+		return sum;
+	}
+
+	void KaiserWeights(float weights[KAISER_TAPS])
+	{
+		const float PI = 3.14159265358979f;
+		float total = 0.0f;
+		for (int i = 0; i < KAISER_TAPS; ++i)
+		{
+			// distance from the output texel center, in output texels
+			float d = ((float)(i - 2) + 0.5f - 1.0f) * 0.5f;
+			float sinc = d == 0.0f ? 1.0f : std::sin(PI * d) / (PI * d);
+			float t = d / KAISER_RADIUS;
+			float window = BesselI0(KAISER_ALPHA * std::sqrt(1.0f - t * t)) / BesselI0(KAISER_ALPHA);
+			weights[i] = sinc * window;
+			total += weights[i];
+		}
+		for (int i = 0; i < KAISER_TAPS; ++i)
+			weights[i] /= total;
+	}
+
+	void Downsample2x2(const Image& source, Image& target)
+	{
+		const Float4 quarter = Splat(0.25f);
+		for (int y = 0; y < target.height; ++y)
+		{
+			int y0 = Clamp(2 * y, 0, source.height - 1);
+			int y1 = Clamp(2 * y + 1, 0, source.height - 1);
+			for (int x = 0; x < target.width; ++x)
+			{
+				int x0 = Clamp(2 * x, 0, source.width - 1);
+				int x1 = Clamp(2 * x + 1, 0, source.width - 1);
+				Float4 sum = Add(Add(Load(source.at(x0, y0)), Load(source.at(x1, y0))),
+					Add(Load(source.at(x0, y1)), Load(source.at(x1, y1))));
+				Store(target.at(x, y), Mul(sum, quarter));
+			}
+		}
+	}
+
+	// separable: halve the width into scratch, then halve the height into target
+	void DownsampleKaiser(const Image& source, Image& scratch, Image& target)
+	{
+		float weights[KAISER_TAPS];
+		KaiserWeights(weights);
+		Float4 w[KAISER_TAPS];
+		for (int i = 0; i < KAISER_TAPS; ++i)
+			w[i] = Splat(weights[i]);
+
+		scratch.width = target.width;
+		scratch.height = source.height;
+		scratch.texels.resize((size_t)scratch.width * scratch.height * 4);
+		for (int y = 0; y < source.height; ++y)
+		{
+			for (int x = 0; x < scratch.width; ++x)
+			{
+				Float4 sum = Splat(0.0f);
+				for (int i = 0; i < KAISER_TAPS; ++i)
+					sum = Add(sum, Mul(w[i], Load(source.at(Clamp(2 * x - 2 + i, 0, source.width - 1), y))));
+				Store(scratch.at(x, y), sum);
+			}
+		}
+
+		for (int y = 0; y < target.height; ++y)
+		{
+			int rows[KAISER_TAPS];
+			for (int i = 0; i < KAISER_TAPS; ++i)
+				rows[i] = Clamp(2 * y - 2 + i, 0, scratch.height - 1);
+			for (int x = 0; x < target.width; ++x)
+			{
+				Float4 sum = Splat(0.0f);
+				for (int i = 0; i < KAISER_TAPS; ++i)
+					sum = Add(sum, Mul(w[i], Load(scratch.at(x, rows[i]))));
+				Store(target.at(x, y), sum);
+			}
+		}
+	}
+
+	void ToLevel(const Image& image, bool srgb, MipLevel& level)
+	{
+		level.width = image.width;
+		level.height = image.height;
+		level.pixels.resize((size_t)image.width * image.height * 4);
+		size_t count = (size_t)image.width * image.height;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float* texel = &image.texels[i * 4];
+			for (int c = 0; c < 3; ++c)
+				level.pixels[i * 4 + c] = Quantize(srgb ? LinearToSrgb(texel[c]) : texel[c]);
+			level.pixels[i * 4 + 3] = Quantize(texel[3]);
+		}
+	}
+}
+
+void BuildMipChain(const uint8_t* rgba, int width, int height, bool srgb, MipFilter filter, std::vector<MipLevel>& levels)
+{
+	levels.clear();
+	if (width <= 0 || height <= 0)
+		return;
+
+	float toFloat[256];
+	float srgbToFloat[256];
+	for (int i = 0; i < 256; ++i)
+	{
+		toFloat[i] = (float)i / 255.0f;
+		srgbToFloat[i] = SrgbToLinear(toFloat[i]);
+	}
+	const float* colorTable = srgb ? srgbToFloat : toFloat;
+
+	Image current;
+	current.width = width;
+	current.height = height;
+	current.texels.resize((size_t)width * height * 4);
+	size_t count = (size_t)width * height;
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+			current.texels[i * 4 + c] = colorTable[rgba[i * 4 + c]];
+		current.texels[i * 4 + 3] = toFloat[rgba[i * 4 + 3]];
+	}
+
+	// the base level goes out as given rather than through a float round trip
+	MipLevel base;
+	base.width = width;
+	base.height = height;
+	base.pixels.assign(rgba, rgba + count * 4);
+	levels.push_back(base);
+
+	Image next;
+	Image scratch;
+	while (current.width > 1 || current.height > 1)
+	{
+		next.width = current.width > 1 ? current.width / 2 : 1;
+		next.height = current.height > 1 ? current.height / 2 : 1;
+		next.texels.resize((size_t)next.width * next.height * 4);
+
+		if (filter == MipFilter::Kaiser)
+			DownsampleKaiser(current, scratch, next);
+		else
+			Downsample2x2(current, next);
+
+		levels.push_back(MipLevel());
+		ToLevel(next, srgb, levels.back());
+		std::swap(current, next);
+	}
+}
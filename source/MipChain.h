@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+enum class MipFilter
+{
+	// 2x2 average, fast and a little blurry
+	Box,
+	// windowed sinc over 6x6 texels, keeps more detail without ringing much
+	Kaiser
+};
+
+struct MipLevel
+{
+	int width;
+	int height;
+	// tightly packed RGBA8 rows
+	std::vector<uint8_t> pixels;
+};
+
+// builds every level from the RGBA8 base image down to 1x1, base included.
+// filtering happens on linear floats, so srgb images are converted to linear first
+// and back afterwards, alpha is always linear
+void BuildMipChain(const uint8_t* rgba, int width, int height, bool srgb, MipFilter filter, std::vector<MipLevel>& levels);
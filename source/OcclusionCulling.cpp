@@ -0,0 +1,489 @@
+#include "OcclusionCulling.h"
+#include "BVH.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	// tile rows per bin, each bin is rasterized by one job
+	const int BAND_TILE_ROWS = 2;
+	// clip space w below which a vertex counts as crossing the near plane
+	const float NEAR_W = 1e-5f;
+	// boxes tested per job
+	const unsigned int CULL_GRAIN = 256;
+
+#if VECTORMATH_AVX2
+	// coverage of one tile: a 32 bit mask per row, one row per lane
+	struct TileMask
+	{
+		__m256i v;
+
+		static TileMask Load(const uint32_t* rows) { return { _mm256_load_si256((const __m256i*)rows) }; }
+		void store(uint32_t* rows) const { _mm256_store_si256((__m256i*)rows, v); }
+		static TileMask Empty() { return { _mm256_setzero_si256() }; }
+
+		TileMask operator&(TileMask other) const { return { _mm256_and_si256(v, other.v) }; }
+		TileMask operator|(TileMask other) const { return { _mm256_or_si256(v, other.v) }; }
+		// this and not other
+		TileMask without(TileMask other) const { return { _mm256_andnot_si256(other.v, v) }; }
+
+		bool empty() const { return _mm256_testz_si256(v, v) != 0; }
+		bool full() const { return _mm256_testc_si256(v, _mm256_set1_epi32(-1)) != 0; }
+
+		// pixels inside a * x + b * y + c >= 0, sampled at pixel centers, for the tile whose
+		// bottom left pixel is (x, y)
+		static TileMask Edge(float a, float b, float c, float x, float y)
+		{
+			__m256 rowY = _mm256_add_ps(_mm256_set1_ps(y + 0.5f), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+			__m256 rowC = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(b), rowY), _mm256_set1_ps(c));
+			if (a == 0.0f)
+				return { _mm256_castps_si256(_mm256_cmp_ps(rowC, _mm256_setzero_ps(), _CMP_GE_OQ)) };
+
+			// where the edge crosses each row's centers, in pixels from the tile's left
+			__m256 crossing = _mm256_sub_ps(_mm256_div_ps(rowC, _mm256_set1_ps(-a)), _mm256_set1_ps(x + 0.5f));
+			__m256i ones = _mm256_set1_epi32(-1);
+			__m256 zero = _mm256_setzero_ps();
+			__m256 width = _mm256_set1_ps(32.0f);
+			if (a > 0.0f)
+			{
+				// pixels from the crossing rightwards
+				__m256 first = _mm256_min_ps(_mm256_max_ps(_mm256_ceil_ps(crossing), zero), width);
+				return { _mm256_sllv_epi32(ones, _mm256_cvttps_epi32(first)) };
+			}
+			// pixels left of the crossing, up to and including it
+			__m256 end = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_floor_ps(crossing), _mm256_set1_ps(1.0f)), zero), width);
+			return { _mm256_andnot_si256(_mm256_sllv_epi32(ones, _mm256_cvttps_epi32(end)), ones) };
+		}
+	};
+#else
+	struct TileMask
+	{
+		uint32_t rows[OcclusionCuller::TILE_HEIGHT];
+
+		static TileMask Load(const uint32_t* in)
+		{
+			TileMask mask;
+			std::copy(in, in + OcclusionCuller::TILE_HEIGHT, mask.rows);
+			return mask;
+		}
+		void store(uint32_t* out) const { std::copy(rows, rows + OcclusionCuller::TILE_HEIGHT, out); }
+		static TileMask Empty() { return TileMask(); }
+
+		TileMask operator&(const TileMask& other) const
+		{
+			TileMask result;
+			for (int row = 0; row < OcclusionCuller::TILE_HEIGHT; ++row)
+				result.rows[row] = rows[row] & other.rows[row];
+			return result;
+		}
+		TileMask operator|(const TileMask& other) const
+		{
+			TileMask result;
+			for (int row = 0; row < OcclusionCuller::TILE_HEIGHT; ++row)
+				result.rows[row] = rows[row] | other.rows[row];
+			return result;
+		}
+		TileMask without(const TileMask& other) const
+		{
+			TileMask result;
+			for (int row = 0; row < OcclusionCuller::TILE_HEIGHT; ++row)
+				result.rows[row] = rows[row] & ~other.rows[row];
+			return result;
+		}
+
+		bool empty() const
+		{
+			uint32_t any = 0;
+			for (int row = 0; row < OcclusionCuller::TILE_HEIGHT; ++row)
+				any |= rows[row];
+			return any == 0;
+		}
+		bool full() const
+		{
+			uint32_t all = ~0u;
+			for (int row = 0; row < OcclusionCuller::TILE_HEIGHT; ++row)
+				all &= rows[row];
+			return all == ~0u;
+		}
+
+		static TileMask Edge(float a, float b, float c, float x, float y)
+		{
+			TileMask mask;
+			for (int row = 0; row < OcclusionCuller::TILE_HEIGHT; ++row)
+			{
+				float rowC = b * (y + row + 0.5f) + c;
+				if (a == 0.0f)
+				{
+					mask.rows[row] = rowC >= 0.0f ? ~0u : 0u;
+					continue;
+				}
+				float crossing = rowC / -a - (x + 0.5f);
+				if (a > 0.0f)
+				{
+					float first = std::min(std::max(std::ceil(crossing), 0.0f), 32.0f);
+					mask.rows[row] = first >= 32.0f ? 0u : ~0u << (int)first;
+				}
+				else
+				{
+					float end = std::min(std::max(std::floor(crossing) + 1.0f, 0.0f), 32.0f);
+					mask.rows[row] = end >= 32.0f ? ~0u : ~(~0u << (int)end);
+				}
+			}
+			return mask;
+		}
+	};
+#endif
+
+	// pixels first..last of the tile's rows rowFirst..rowLast, all inclusive
+	TileMask RectangleMask(int first, int last, int rowFirst, int rowLast)
+	{
+		uint32_t bits = (last >= 31 ? ~0u : ((1u << (last + 1)) - 1)) & (~0u << first);
+		alignas(32) uint32_t rows[OcclusionCuller::TILE_HEIGHT];
+		for (int row = 0; row < OcclusionCuller::TILE_HEIGHT; ++row)
+			rows[row] = row >= rowFirst && row <= rowLast ? bits : 0u;
+		return TileMask::Load(rows);
+	}
+
+	// in front of the near plane, where the projection is still well behaved
+	bool BeyondNear(const Vec4& clip)
+	{
+		return clip.w > NEAR_W && clip.z >= -clip.w;
+	}
+
+	// pixel coordinate to int without overflowing far off screen
+	int PixelOf(float coordinate, int size)
+	{
+		return (int)std::floor(std::min(std::max(coordinate, -1.0f), (float)size));
+	}
+
+	// OpenGL window coordinates: pixels from the bottom left, depth 0..1
+	Vec4 ToScreen(const Vec4& clip, float width, float height)
+	{
+		float inverseW = 1.0f / clip.w;
+		return Vec4((clip.x * inverseW * 0.5f + 0.5f) * width, (clip.y * inverseW * 0.5f + 0.5f) * height,
+			clip.z * inverseW * 0.5f + 0.5f, clip.w);
+	}
+
+	// the screen rectangle around a box's corners and the nearest corner's depth, false if a
+	// corner is behind the near plane. the corners are the min corner plus any of the edges
+	// along each axis, so they take one transform and some adds
+	bool ProjectBox(const Mat4& clipFromWorld, const Bounds& box, float width, float height,
+		float& minX, float& minY, float& maxX, float& maxY, float& nearest)
+	{
+		Vec3 size = box.max - box.min;
+		Vec4 origin = clipFromWorld * Vec4(box.min, 1.0f);
+		Vec4 edgeX = clipFromWorld[0] * size.x;
+		Vec4 edgeY = clipFromWorld[1] * size.y;
+		Vec4 edgeZ = clipFromWorld[2] * size.z;
+#if VECTORMATH_AVX2
+		// one corner per lane
+		__m256 alongX = _mm256_setr_ps(0, 1, 0, 1, 0, 1, 0, 1);
+		__m256 alongY = _mm256_setr_ps(0, 0, 1, 1, 0, 0, 1, 1);
+		__m256 alongZ = _mm256_setr_ps(0, 0, 0, 0, 1, 1, 1, 1);
+		auto corners = [&](int component)
+		{
+			__m256 v = _mm256_set1_ps(origin[component]);
+			v = _mm256_add_ps(v, _mm256_mul_ps(alongX, _mm256_set1_ps(edgeX[component])));
+			v = _mm256_add_ps(v, _mm256_mul_ps(alongY, _mm256_set1_ps(edgeY[component])));
+			return _mm256_add_ps(v, _mm256_mul_ps(alongZ, _mm256_set1_ps(edgeZ[component])));
+		};
+		__m256 x = corners(0), y = corners(1), z = corners(2), w = corners(3);
+		__m256 inFront = _mm256_and_ps(_mm256_cmp_ps(w, _mm256_set1_ps(NEAR_W), _CMP_GT_OQ),
+			_mm256_cmp_ps(z, _mm256_sub_ps(_mm256_setzero_ps(), w), _CMP_GE_OQ));
+		if (_mm256_movemask_ps(inFront) != 0xFF)
+			return false;
+		__m256 half = _mm256_set1_ps(0.5f);
+		__m256 inverseW = _mm256_div_ps(half, w);
+		x = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(x, inverseW), half), _mm256_set1_ps(width));
+		y = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(y, inverseW), half), _mm256_set1_ps(height));
+		z = _mm256_add_ps(_mm256_mul_ps(z, inverseW), half);
+		// reduce across the lanes: halves, then pairs, then neighbours
+		auto reduce = [](__m256 v, auto op)
+		{
+			__m128 r = op(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+			r = op(r, _mm_movehl_ps(r, r));
+			r = op(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)));
+			return _mm_cvtss_f32(r);
+		};
+		auto lower = [](__m128 a, __m128 b) { return _mm_min_ps(a, b); };
+		auto upper = [](__m128 a, __m128 b) { return _mm_max_ps(a, b); };
+		minX = reduce(x, lower);
+		maxX = reduce(x, upper);
+		minY = reduce(y, lower);
+		maxY = reduce(y, upper);
+		nearest = reduce(z, lower);
+#else
+		minX = minY = nearest = FLT_MAX;
+		maxX = maxY = -FLT_MAX;
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			Vec4 clip = origin;
+			if (corner & 1)
+				clip += edgeX;
+			if (corner & 2)
+				clip += edgeY;
+			if (corner & 4)
+				clip += edgeZ;
+			if (!BeyondNear(clip))
+				return false;
+			Vec4 screen = ToScreen(clip, width, height);
+			minX = std::min(minX, screen.x);
+			maxX = std::max(maxX, screen.x);
+			minY = std::min(minY, screen.y);
+			maxY = std::max(maxY, screen.y);
+			nearest = std::min(nearest, screen.z);
+		}
+#endif
+		return true;
+	}
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+	: tilesX((width + TILE_WIDTH - 1) / TILE_WIDTH)
+	, tilesY((height + TILE_HEIGHT - 1) / TILE_HEIGHT)
+	, tiles((size_t)tilesX * tilesY)
+	, bins((tilesY + BAND_TILE_ROWS - 1) / BAND_TILE_ROWS)
+{
+	clear();
+}
+
+void OcclusionCuller::clear()
+{
+	for (Tile& tile : tiles)
+	{
+		std::fill(tile.rows, tile.rows + TILE_HEIGHT, 0u);
+		tile.reference = FLT_MAX;
+		tile.working = 0.0f;
+	}
+	triangles.clear();
+	for (std::vector<uint32_t>& bin : bins)
+		bin.clear();
+}
+
+void OcclusionCuller::addOccluder(const Mat4& clipFromModel, const Vec3* vertices, size_t vertexCount, const uint32_t* indices, size_t triangleCount)
+{
+	float screenWidth = (float)width();
+	float screenHeight = (float)height();
+	screenVertices.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		Vec4 clip = clipFromModel * Vec4(vertices[i], 1.0f);
+		// w is zeroed so triangles crossing the near plane can be left out
+		screenVertices[i] = BeyondNear(clip) ? ToScreen(clip, screenWidth, screenHeight) : Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const Vec4& v0 = screenVertices[indices[t * 3 + 0]];
+		const Vec4& v1 = screenVertices[indices[t * 3 + 1]];
+		const Vec4& v2 = screenVertices[indices[t * 3 + 2]];
+		if (v0.w <= NEAR_W || v1.w <= NEAR_W || v2.w <= NEAR_W)
+			continue;
+
+		// twice the signed area, positive for counter-clockwise
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (area <= 0.0f)
+			continue;
+
+		float minX = std::min(v0.x, std::min(v1.x, v2.x));
+		float maxX = std::max(v0.x, std::max(v1.x, v2.x));
+		float minY = std::min(v0.y, std::min(v1.y, v2.y));
+		float maxY = std::max(v0.y, std::max(v1.y, v2.y));
+		float nearest = std::min(v0.z, std::min(v1.z, v2.z));
+		if (maxX < 0.0f || maxY < 0.0f || minX >= screenWidth || minY >= screenHeight || nearest > 1.0f)
+			continue;
+
+		Triangle triangle;
+		const Vec4* corners[3] = { &v0, &v1, &v2 };
+		for (int edge = 0; edge < 3; ++edge)
+		{
+			const Vec4& from = *corners[edge];
+			const Vec4& to = *corners[(edge + 1) % 3];
+			// counter-clockwise, so the inside is on the left of each edge
+			triangle.edgeA[edge] = from.y - to.y;
+			triangle.edgeB[edge] = to.x - from.x;
+			triangle.edgeC[edge] = -(triangle.edgeA[edge] * from.x + triangle.edgeB[edge] * from.y);
+		}
+		// depth is linear in screen space: solve for the plane through the three vertices
+		float inverseArea = 1.0f / area;
+		float dz1 = v1.z - v0.z;
+		float dz2 = v2.z - v0.z;
+		triangle.depthA = (dz1 * (v2.y - v0.y) - dz2 * (v1.y - v0.y)) * inverseArea;
+		triangle.depthB = (dz2 * (v1.x - v0.x) - dz1 * (v2.x - v0.x)) * inverseArea;
+		triangle.depthC = v0.z - triangle.depthA * v0.x - triangle.depthB * v0.y;
+		triangle.farthest = std::max(v0.z, std::max(v1.z, v2.z));
+		triangle.tileMinX = std::max(PixelOf(minX, width()) / TILE_WIDTH, 0);
+		triangle.tileMaxX = std::min(PixelOf(maxX, width()) / TILE_WIDTH, tilesX - 1);
+		triangle.tileMinY = std::max(PixelOf(minY, height()) / TILE_HEIGHT, 0);
+		triangle.tileMaxY = std::min(PixelOf(maxY, height()) / TILE_HEIGHT, tilesY - 1);
+
+		uint32_t index = (uint32_t)triangles.size();
+		triangles.push_back(triangle);
+		for (int band = triangle.tileMinY / BAND_TILE_ROWS; band <= triangle.tileMaxY / BAND_TILE_ROWS; ++band)
+			bins[band].push_back(index);
+	}
+}
+
+void OcclusionCuller::rasterize(JobSystem* jobs)
+{
+	auto rasterizeBands = [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int band = begin; band < end; ++band)
+		{
+			int rowBegin = (int)band * BAND_TILE_ROWS;
+			int rowEnd = std::min(rowBegin + BAND_TILE_ROWS, tilesY);
+			for (uint32_t index : bins[band])
+				rasterizeTriangle(triangles[index], rowBegin, rowEnd);
+		}
+	};
+	// bands don't share tiles, so they need no synchronization
+	if (jobs)
+		jobs->parallelFor((unsigned int)bins.size(), 1, rasterizeBands);
+	else
+		rasterizeBands(0, (unsigned int)bins.size());
+
+	triangles.clear();
+	for (std::vector<uint32_t>& bin : bins)
+		bin.clear();
+}
+
+void OcclusionCuller::rasterizeTriangle(const Triangle& triangle, int tileRowBegin, int tileRowEnd)
+{
+	int firstRow = std::max(triangle.tileMinY, tileRowBegin);
+	int lastRow = std::min(triangle.tileMaxY, tileRowEnd - 1);
+	for (int tileY = firstRow; tileY <= lastRow; ++tileY)
+	{
+		float y = (float)(tileY * TILE_HEIGHT);
+		for (int tileX = triangle.tileMinX; tileX <= triangle.tileMaxX; ++tileX)
+		{
+			Tile& tile = tiles[(size_t)tileY * tilesX + tileX];
+			float x = (float)(tileX * TILE_WIDTH);
+
+			// the plane's farthest point over the tile, or the farthest vertex if that's nearer
+			float depth = triangle.depthC
+				+ triangle.depthA * (triangle.depthA > 0.0f ? x + TILE_WIDTH : x)
+				+ triangle.depthB * (triangle.depthB > 0.0f ? y + TILE_HEIGHT : y);
+			depth = std::min(depth, triangle.farthest);
+			// nothing the triangle covers here can be in front of what's there already
+			if (depth >= tile.reference)
+				continue;
+
+			TileMask coverage = TileMask::Edge(triangle.edgeA[0], triangle.edgeB[0], triangle.edgeC[0], x, y)
+				& TileMask::Edge(triangle.edgeA[1], triangle.edgeB[1], triangle.edgeC[1], x, y)
+				& TileMask::Edge(triangle.edgeA[2], triangle.edgeB[2], triangle.edgeC[2], x, y);
+			if (coverage.empty())
+				continue;
+
+			TileMask working = TileMask::Load(tile.rows);
+			if (coverage.full())
+			{
+				// a new reference for the whole tile, and the working layer only stays if
+				// it is nearer still
+				tile.reference = depth;
+				if (tile.working >= depth)
+				{
+					TileMask::Empty().store(tile.rows);
+					tile.working = 0.0f;
+				}
+				continue;
+			}
+
+			// a triangle much nearer than the working layer would only drag it forward a
+			// little; start the layer over from the triangle instead
+			if (!working.empty() && tile.working - depth > tile.reference - tile.working)
+			{
+				working = TileMask::Empty();
+				tile.working = 0.0f;
+			}
+			working = working | coverage;
+			tile.working = std::max(tile.working, depth);
+			if (working.full())
+			{
+				tile.reference = std::min(tile.reference, tile.working);
+				working = TileMask::Empty();
+				tile.working = 0.0f;
+			}
+			working.store(tile.rows);
+		}
+	}
+}
+
+bool OcclusionCuller::visible(const Mat4& clipFromWorld, const Bounds& box) const
+{
+	float screenWidth = (float)width();
+	float screenHeight = (float)height();
+	float minX, minY, maxX, maxY, nearest;
+	if (!ProjectBox(clipFromWorld, box, screenWidth, screenHeight, minX, minY, maxX, maxY, nearest))
+		return true;
+	// off screen is the frustum's business, not ours
+	if (maxX < 0.0f || maxY < 0.0f || minX >= screenWidth || minY >= screenHeight)
+		return true;
+
+	// every pixel the box touches
+	int pixelMinX = std::max(PixelOf(minX, width()), 0);
+	int pixelMaxX = std::min(PixelOf(maxX, width()), width() - 1);
+	int pixelMinY = std::max(PixelOf(minY, height()), 0);
+	int pixelMaxY = std::min(PixelOf(maxY, height()), height() - 1);
+	for (int tileY = pixelMinY / TILE_HEIGHT; tileY <= pixelMaxY / TILE_HEIGHT; ++tileY)
+	{
+		int rowFirst = std::max(pixelMinY - tileY * TILE_HEIGHT, 0);
+		int rowLast = std::min(pixelMaxY - tileY * TILE_HEIGHT, TILE_HEIGHT - 1);
+		for (int tileX = pixelMinX / TILE_WIDTH; tileX <= pixelMaxX / TILE_WIDTH; ++tileX)
+		{
+			const Tile& tile = tiles[(size_t)tileY * tilesX + tileX];
+			if (nearest >= tile.reference)
+				continue;
+			// pixels outside the working layer are only bounded by the reference, the ones
+			// inside also by the working depth
+			int first = std::max(pixelMinX - tileX * TILE_WIDTH, 0);
+			int last = std::min(pixelMaxX - tileX * TILE_WIDTH, TILE_WIDTH - 1);
+			TileMask covered = RectangleMask(first, last, rowFirst, rowLast);
+			TileMask working = TileMask::Load(tile.rows);
+			if (!covered.without(working).empty() || nearest < tile.working)
+				return true;
+		}
+	}
+	return false;
+}
+
+size_t OcclusionCuller::cull(const Mat4& clipFromWorld, const BoxArrays& boxes, uint32_t* candidates, size_t count, JobSystem* jobs)
+{
+	results.resize(count);
+	auto test = [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			uint32_t b = candidates[i];
+			Bounds box(Vec3(boxes.minX[b], boxes.minY[b], boxes.minZ[b]), Vec3(boxes.maxX[b], boxes.maxY[b], boxes.maxZ[b]));
+			results[i] = visible(clipFromWorld, box) ? 1 : 0;
+		}
+	};
+	if (jobs)
+		jobs->parallelFor((unsigned int)count, CULL_GRAIN, test);
+	else
+		test(0, (unsigned int)count);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		candidates[kept] = candidates[i];
+		kept += results[i];
+	}
+	return kept;
+}
+
+void OcclusionCuller::resolveDepth(std::vector<float>& depth) const
+{
+	depth.resize((size_t)width() * height());
+	for (int y = 0; y < height(); ++y)
+	{
+		for (int x = 0; x < width(); ++x)
+		{
+			const Tile& tile = tiles[(size_t)(y / TILE_HEIGHT) * tilesX + x / TILE_WIDTH];
+			bool covered = (tile.rows[y % TILE_HEIGHT] >> (x % TILE_WIDTH)) & 1u;
+			depth[(size_t)y * width() + x] = covered ? std::min(tile.reference, tile.working) : tile.reference;
+		}
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "VectorMath.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+struct Bounds;
+
+// CPU occlusion culling with a masked depth buffer (Hasselgren, Andersson and
+// Akenine-Moller, "Masked Software Occlusion Culling", HPG 2016). the buffer is split in
+// 32x8 pixel tiles; a tile keeps one reference depth everything in it is in front of, plus
+// a working layer: a coverage bit per pixel and the farthest depth of the occluders that
+// covered those pixels. once the working layer covers the whole tile it becomes the new
+// reference. triangles are rasterized a tile at a time, all eight rows at once with AVX2,
+// and without per pixel depths the buffer is small enough to stay in cache.
+// occluders are queued, binned into bands of tile rows, and rasterized with the bands
+// spread over the job system; then object boxes are tested against the tiles they cover.
+// depth is OpenGL's window depth, 0 at the near plane and 1 at the far one. everything
+// errs towards visible: back faces and triangles crossing the near plane are left out of
+// the buffer and boxes crossing it are always visible
+// ---------------------------------------------------------------------------------------
+class OcclusionCuller
+{
+public:
+	static const int TILE_WIDTH = 32;
+	static const int TILE_HEIGHT = 8;
+
+	// rounded up to whole tiles
+	OcclusionCuller(int width, int height);
+
+	int width() const { return tilesX * TILE_WIDTH; }
+	int height() const { return tilesY * TILE_HEIGHT; }
+
+	// empties the buffer and the occluder queue
+	void clear();
+
+	// queues a mesh's triangles for the next rasterize. indices are triples into vertices,
+	// counter-clockwise seen from the front
+	void addOccluder(const Mat4& clipFromModel, const Vec3* vertices, size_t vertexCount, const uint32_t* indices, size_t triangleCount);
+
+	// draws the queued triangles into the buffer and empties the queue
+	void rasterize(JobSystem* jobs = nullptr);
+
+	// false only when every pixel the box can cover is behind the occluders
+	bool visible(const Mat4& clipFromWorld, const Bounds& box) const;
+
+	// keeps the candidates whose boxes are visible, in order, and returns how many that is.
+	// candidates index boxes, like FrustumCuller's visible list
+	size_t cull(const Mat4& clipFromWorld, const BoxArrays& boxes, uint32_t* candidates, size_t count, JobSystem* jobs = nullptr);
+
+	// the farthest depth each pixel can have, rows from the bottom, for checks and debug views
+	void resolveDepth(std::vector<float>& depth) const;
+
+	// triangles queued for the next rasterize, after dropping back faces and the like
+	size_t queuedTriangles() const { return triangles.size(); }
+private:
+	struct alignas(32) Tile
+	{
+		// working layer coverage, bit x of row y is pixel (x, y) of the tile
+		uint32_t rows[TILE_HEIGHT];
+		float reference;
+		// 0 while the working layer is empty
+		float working;
+	};
+
+	// a screen space triangle set up for rasterizing: a * x + b * y + c >= 0 inside each
+	// edge, depth as a plane over the screen, and the tiles its bounding box touches
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA, depthB, depthC;
+		float farthest;
+		int tileMinX, tileMinY, tileMaxX, tileMaxY;
+	};
+
+	void rasterizeTriangle(const Triangle& triangle, int tileRowBegin, int tileRowEnd);
+
+	int tilesX;
+	int tilesY;
+	std::vector<Tile> tiles;
+
+	std::vector<Triangle> triangles;
+	// per band of tile rows, the triangles touching it in the order they were queued
+	std::vector<std::vector<uint32_t>> bins;
+
+	// addOccluder and cull scratch
+	std::vector<Vec4> screenVertices;
+	std::vector<uint8_t> results;
+};
@@ -0,0 +1,298 @@
+#include "glad/glad.h"
+
+#include "RenderCommands.h"
+#include "Shader.h"
+#include "GLStateCache.h"
+#include "StreamBuffer.h"
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	// command payloads, stored right after their header
+	struct ViewportCommand { int x, y, width, height; };
+	struct ClearCommand { float color[4]; unsigned int mask; };
+	struct UseProgramCommand { unsigned int program; };
+	struct Uniform4fCommand { const Shader* shader; UniformId name; float value[4]; };
+	struct UniformMatrix4fCommand { const Shader* shader; UniformId name; float value[16]; };
+	struct BindTextureCommand { unsigned int unit, target, texture; };
+	struct BindVertexArrayCommand { unsigned int vao; };
+	struct DrawElementsCommand { unsigned int mode; int count; unsigned int type; size_t offset; };
+	struct BlendCommand { unsigned int enabled, source, destination; };
+	struct DepthTestCommand { unsigned int enabled, function; };
+	struct DrawElementsInstancedCommand { unsigned int mode; int count; unsigned int type; int instanceCount; size_t offset; };
+	struct VertexAttribPointerCommand { unsigned int index; int size; unsigned int type, normalized; int stride; unsigned int buffer; size_t offset; };
+	struct StreamCommand { StreamBuffer* stream; unsigned int region; };
+	struct CallbackCommand { void (*function)(void*, GLStateCache&); void* data; };
+
+	const size_t COMMAND_ALIGNMENT = 8;
+
+	size_t AlignUp(size_t value)
+	{
+		return (value + COMMAND_ALIGNMENT - 1) & ~(COMMAND_ALIGNMENT - 1);
+	}
+
+	template<typename T>
+	T Read(const unsigned char* data)
+	{
+		T command;
+		std::memcpy(&command, data, sizeof(T));
+		return command;
+	}
+}
+
+RenderCommandBuffer::RenderCommandBuffer(size_t capacityBytes)
+	: storage(capacityBytes), used(0), count(0), overflow(false)
+{
+}
+
+void RenderCommandBuffer::reset()
+{
+	used = 0;
+	count = 0;
+	overflow = false;
+}
+
+template<typename T>
+void RenderCommandBuffer::push(RenderCommandType type, const T& command)
+{
+	size_t payloadOffset = AlignUp(sizeof(Header));
+	size_t total = AlignUp(payloadOffset + sizeof(T));
+	if (used + total > storage.size())
+	{
+		if (!overflow)
+			std::cout << "ERROR::RENDER_COMMANDS::BUFFER_FULL dropping commands this frame" << std::endl;
+		overflow = true;
+		return;
+	}
+
+	Header header = { type, (uint16_t)total };
+	std::memcpy(&storage[used], &header, sizeof(Header));
+	std::memcpy(&storage[used + payloadOffset], &command, sizeof(T));
+	used += total;
+	++count;
+}
+
+void RenderCommandBuffer::viewport(int x, int y, int width, int height)
+{
+	ViewportCommand command = { x, y, width, height };
+	push(RenderCommandType::Viewport, command);
+}
+
+void RenderCommandBuffer::clear(float r, float g, float b, float a, unsigned int mask)
+{
+	ClearCommand command = { { r, g, b, a }, mask };
+	push(RenderCommandType::Clear, command);
+}
+
+void RenderCommandBuffer::useProgram(unsigned int program)
+{
+	UseProgramCommand command = { program };
+	push(RenderCommandType::UseProgram, command);
+}
+
+void RenderCommandBuffer::uniform4f(const Shader* shader, UniformId name, float x, float y, float z, float w)
+{
+	Uniform4fCommand command = { shader, name, { x, y, z, w } };
+	push(RenderCommandType::Uniform4f, command);
+}
+
+void RenderCommandBuffer::uniformMatrix4f(const Shader* shader, UniformId name, const float* value)
+{
+	UniformMatrix4fCommand command;
+	command.shader = shader;
+	command.name = name;
+	std::memcpy(command.value, value, sizeof(command.value));
+	push(RenderCommandType::UniformMatrix4f, command);
+}
+
+void RenderCommandBuffer::bindTexture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+	BindTextureCommand command = { unit, target, texture };
+	push(RenderCommandType::BindTexture, command);
+}
+
+void RenderCommandBuffer::bindVertexArray(unsigned int vao)
+{
+	BindVertexArrayCommand command = { vao };
+	push(RenderCommandType::BindVertexArray, command);
+}
+
+void RenderCommandBuffer::drawElements(unsigned int mode, int count, unsigned int type, size_t offset)
+{
+	DrawElementsCommand command = { mode, count, type, offset };
+	push(RenderCommandType::DrawElements, command);
+}
+
+void RenderCommandBuffer::blend(bool enabled, unsigned int source, unsigned int destination)
+{
+	BlendCommand command = { enabled ? 1u : 0u, source, destination };
+	push(RenderCommandType::Blend, command);
+}
+
+void RenderCommandBuffer::depthTest(bool enabled, unsigned int function)
+{
+	DepthTestCommand command = { enabled ? 1u : 0u, function };
+	push(RenderCommandType::DepthTest, command);
+}
+
+void RenderCommandBuffer::drawElementsInstanced(unsigned int mode, int count, unsigned int type, size_t offset, int instanceCount)
+{
+	DrawElementsInstancedCommand command = { mode, count, type, instanceCount, offset };
+	push(RenderCommandType::DrawElementsInstanced, command);
+}
+
+void RenderCommandBuffer::vertexAttribPointer(unsigned int index, int size, unsigned int type, bool normalized,
+	int stride, unsigned int buffer, size_t offset)
+{
+	VertexAttribPointerCommand command = { index, size, type, normalized ? 1u : 0u, stride, buffer, offset };
+	push(RenderCommandType::VertexAttribPointer, command);
+}
+
+void RenderCommandBuffer::streamUpload(StreamBuffer* stream, unsigned int region)
+{
+	StreamCommand command = { stream, region };
+	push(RenderCommandType::StreamUpload, command);
+}
+
+void RenderCommandBuffer::streamRetire(StreamBuffer* stream, unsigned int region)
+{
+	StreamCommand command = { stream, region };
+	push(RenderCommandType::StreamRetire, command);
+}
+
+void RenderCommandBuffer::callback(void (*function)(void* data, GLStateCache& state), void* data)
+{
+	CallbackCommand command = { function, data };
+	push(RenderCommandType::Callback, command);
+}
+
+void RenderCommandBuffer::execute(GLStateCache& state) const
+{
+	const size_t payloadOffset = AlignUp(sizeof(Header));
+	size_t cursor = 0;
+	while (cursor < used)
+	{
+		Header header = Read<Header>(&storage[cursor]);
+		const unsigned char* payload = &storage[cursor + payloadOffset];
+
+		switch (header.type)
+		{
+		case RenderCommandType::Viewport:
+		{
+			ViewportCommand c = Read<ViewportCommand>(payload);
+			state.viewport(c.x, c.y, c.width, c.height);
+			break;
+		}
+		case RenderCommandType::Clear:
+		{
+			ClearCommand c = Read<ClearCommand>(payload);
+			state.clearColor(c.color[0], c.color[1], c.color[2], c.color[3]);
+			glClear(c.mask);
+			break;
+		}
+		case RenderCommandType::UseProgram:
+		{
+			UseProgramCommand c = Read<UseProgramCommand>(payload);
+			state.useProgram(c.program);
+			break;
+		}
+		case RenderCommandType::Uniform4f:
+		{
+			Uniform4fCommand c = Read<Uniform4fCommand>(payload);
+			c.shader->setVec4(c.name, c.value[0], c.value[1], c.value[2], c.value[3]);
+			break;
+		}
+		case RenderCommandType::UniformMatrix4f:
+		{
+			UniformMatrix4fCommand c = Read<UniformMatrix4fCommand>(payload);
+			c.shader->setMat4(c.name, c.value);
+			break;
+		}
+		case RenderCommandType::BindTexture:
+		{
+			BindTextureCommand c = Read<BindTextureCommand>(payload);
+			state.bindTexture(c.unit, c.target, c.texture);
+			break;
+		}
+		case RenderCommandType::BindVertexArray:
+		{
+			BindVertexArrayCommand c = Read<BindVertexArrayCommand>(payload);
+			state.bindVertexArray(c.vao);
+			break;
+		}
+		case RenderCommandType::DrawElements:
+		{
+			DrawElementsCommand c = Read<DrawElementsCommand>(payload);
+			glDrawElements(c.mode, c.count, c.type, (void*)c.offset);
+			break;
+		}
+		case RenderCommandType::Blend:
+		{
+			BlendCommand c = Read<BlendCommand>(payload);
+			state.setBlend(c.enabled != 0);
+			if (c.enabled)
+				state.blendFunc(c.source, c.destination);
+			break;
+		}
+		case RenderCommandType::DepthTest:
+		{
+			DepthTestCommand c = Read<DepthTestCommand>(payload);
+			state.setDepthTest(c.enabled != 0);
+			if (c.enabled)
+			{
+				state.depthFunc(c.function);
+				state.depthMask(true);
+			}
+			break;
+		}
+		case RenderCommandType::DrawElementsInstanced:
+		{
+			DrawElementsInstancedCommand c = Read<DrawElementsInstancedCommand>(payload);
+			glDrawElementsInstanced(c.mode, c.count, c.type, (void*)c.offset, c.instanceCount);
+			break;
+		}
+		case RenderCommandType::VertexAttribPointer:
+		{
+			VertexAttribPointerCommand c = Read<VertexAttribPointerCommand>(payload);
+			state.bindBuffer(GL_ARRAY_BUFFER, c.buffer);
+			glVertexAttribPointer(c.index, c.size, c.type, c.normalized ? GL_TRUE : GL_FALSE, c.stride, (void*)c.offset);
+			break;
+		}
+		case RenderCommandType::StreamUpload:
+		{
+			StreamCommand c = Read<StreamCommand>(payload);
+			c.stream->upload(state, c.region);
+			break;
+		}
+		case RenderCommandType::StreamRetire:
+		{
+			StreamCommand c = Read<StreamCommand>(payload);
+			c.stream->retire(c.region);
+			break;
+		}
+		case RenderCommandType::Callback:
+		{
+			CallbackCommand c = Read<CallbackCommand>(payload);
+			c.function(c.data, state);
+			break;
+		}
+		}
+		cursor += header.size;
+	}
+}
+
+size_t RenderCommandBuffer::sizeBytes() const
+{
+	return used;
+}
+
+size_t RenderCommandBuffer::commandCount() const
+{
+	return count;
+}
+
+bool RenderCommandBuffer::overflowed() const
+{
+	return overflow;
+}
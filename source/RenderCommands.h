@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Shader;
+class GLStateCache;
+class StreamBuffer;
+struct UniformId;
+
+enum class RenderCommandType : uint16_t
+{
+	Viewport,
+	Clear,
+	UseProgram,
+	Uniform4f,
+	UniformMatrix4f,
+	BindTexture,
+	BindVertexArray,
+	DrawElements,
+	Blend,
+	DrawElementsInstanced,
+	VertexAttribPointer,
+	StreamUpload,
+	StreamRetire,
+	Callback,
+	DepthTest
+};
+
+// compact list of GL calls recorded on the main thread and replayed on the render thread.
+// commands are packed back to back into storage reserved up front, so recording never
+// allocates; if a frame runs out of room the remaining commands are dropped and reported
+// -----------------------------------------------------------------------------------------
+class RenderCommandBuffer
+{
+public:
+	explicit RenderCommandBuffer(size_t capacityBytes);
+
+	// forget everything recorded so the buffer can be filled for a new frame
+	void reset();
+
+	void viewport(int x, int y, int width, int height);
+
+	void clear(float r, float g, float b, float a, unsigned int mask);
+
+	void useProgram(unsigned int program);
+
+	// goes through the shader's uniform cache on replay, so unchanged values are never re-sent
+	void uniform4f(const Shader* shader, UniformId name, float x, float y, float z, float w);
+
+	// 16 floats, column-major, copied into the buffer
+	void uniformMatrix4f(const Shader* shader, UniformId name, const float* value);
+
+	void bindTexture(unsigned int unit, unsigned int target, unsigned int texture);
+
+	void bindVertexArray(unsigned int vao);
+
+	void drawElements(unsigned int mode, int count, unsigned int type, size_t offset);
+
+	void blend(bool enabled, unsigned int source, unsigned int destination);
+
+	// depth writes stay on whenever the test is
+	void depthTest(bool enabled, unsigned int function);
+
+	void drawElementsInstanced(unsigned int mode, int count, unsigned int type, size_t offset, int instanceCount);
+
+	// points an attribute of the bound vertex array at buffer + offset
+	void vertexAttribPointer(unsigned int index, int size, unsigned int type, bool normalized,
+		int stride, unsigned int buffer, size_t offset);
+
+	// recorded by StreamBuffer itself around each frame
+	void streamUpload(StreamBuffer* stream, unsigned int region);
+	void streamRetire(StreamBuffer* stream, unsigned int region);
+
+	// run function(data, state) on the render thread at this point of the frame,
+	// for systems that need to do their own GL work once per frame
+	void callback(void (*function)(void* data, GLStateCache& state), void* data);
+
+	// issue every recorded command through the state cache so redundant binds are dropped,
+	// must be called on the thread that owns the GL context
+	void execute(GLStateCache& state) const;
+
+	size_t sizeBytes() const;
+
+	size_t commandCount() const;
+
+	bool overflowed() const;
+private:
+	struct Header
+	{
+		RenderCommandType type;
+		uint16_t size;
+	};
+
+	template<typename T>
+	void push(RenderCommandType type, const T& command);
+
+	std::vector<unsigned char> storage;
+	size_t used;
+	size_t count;
+	bool overflow;
+};
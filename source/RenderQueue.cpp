@@ -0,0 +1,162 @@
+#include "glad/glad.h"
+
+#include "RenderQueue.h"
+#include "RenderCommands.h"
+#include "Shader.h"
+#include <cstring>
+
+namespace
+{
+	uint64_t Field(unsigned int value, unsigned int bits)
+	{
+		return (uint64_t)value & ((1ull << bits) - 1);
+	}
+
+	uint64_t QuantizeDepth(float depth)
+	{
+		if (!(depth > 0.0f))
+			depth = 0.0f;
+		if (depth > 1.0f)
+			depth = 1.0f;
+		return (uint64_t)(depth * (float)((1u << SortKey::DEPTH_BITS) - 1));
+	}
+}
+
+uint64_t SortKey::Make(unsigned int pass, bool translucent, float depth,
+	unsigned int program, unsigned int material, unsigned int mesh)
+{
+	uint64_t state = (Field(program, PROGRAM_BITS) << (MATERIAL_BITS + MESH_BITS)) |
+		(Field(material, MATERIAL_BITS) << MESH_BITS) |
+		Field(mesh, MESH_BITS);
+	uint64_t quantized = QuantizeDepth(depth);
+
+	uint64_t low;
+	if (translucent)
+	{
+		// farthest first
+		uint64_t backToFront = ((1ull << DEPTH_BITS) - 1) - quantized;
+		low = (backToFront << (PROGRAM_BITS + MATERIAL_BITS + MESH_BITS)) | state;
+	}
+	else
+	{
+		low = (state << DEPTH_BITS) | quantized;
+	}
+
+	return (Field(pass, PASS_BITS) << 60) | ((uint64_t)(translucent ? 1 : 0) << 59) | low;
+}
+
+RenderQueue::RenderQueue(size_t capacity)
+	: capacity(capacity)
+{
+	const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	std::memcpy(viewProjection, identity, sizeof(viewProjection));
+	entries.reserve(capacity);
+	scratch.resize(capacity);
+	packets.reserve(capacity);
+}
+
+void RenderQueue::reset()
+{
+	entries.clear();
+	packets.clear();
+}
+
+void RenderQueue::setViewProjection(const float* matrix)
+{
+	std::memcpy(viewProjection, matrix, sizeof(viewProjection));
+}
+
+bool RenderQueue::submit(uint64_t key, const DrawPacket& packet)
+{
+	if (entries.size() >= capacity)
+		return false;
+
+	Entry entry = { key, (uint32_t)packets.size() };
+	entries.push_back(entry);
+	packets.push_back(packet);
+	return true;
+}
+
+// 8 passes of 8 bits. all histograms are built in one sweep, and any pass where
+// every key has the same byte is skipped since it wouldn't move anything
+void RenderQueue::sort()
+{
+	size_t count = entries.size();
+	if (count < 2)
+		return;
+
+	uint32_t histograms[8][256];
+	std::memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint64_t key = entries[i].key;
+		for (int pass = 0; pass < 8; ++pass)
+			++histograms[pass][(key >> (pass * 8)) & 0xFF];
+	}
+
+	Entry* source = entries.data();
+	Entry* destination = scratch.data();
+	for (int pass = 0; pass < 8; ++pass)
+	{
+		uint32_t* histogram = histograms[pass];
+		uint8_t firstByte = (uint8_t)((source[0].key >> (pass * 8)) & 0xFF);
+		if (histogram[firstByte] == count)
+			continue;
+
+		// turn counts into starting offsets
+		uint32_t offset = 0;
+		for (int bucket = 0; bucket < 256; ++bucket)
+		{
+			uint32_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint8_t byte = (uint8_t)((source[i].key >> (pass * 8)) & 0xFF);
+			destination[histogram[byte]++] = source[i];
+		}
+		Entry* swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	if (source != entries.data())
+		std::memcpy(entries.data(), source, count * sizeof(Entry));
+}
+
+void RenderQueue::record(RenderCommandBuffer& commands) const
+{
+	const Shader* shader = nullptr;
+	unsigned int texture = 0xFFFFFFFFu;
+	unsigned int vertexArray = 0xFFFFFFFFu;
+
+	for (const Entry& entry : entries)
+	{
+		const DrawPacket& packet = packets[entry.packet];
+		if (packet.shader != shader)
+		{
+			shader = packet.shader;
+			commands.useProgram(shader->ID);
+			commands.uniformMatrix4f(shader, "viewProjection"_uniform, viewProjection);
+		}
+		if (packet.texture != texture)
+		{
+			texture = packet.texture;
+			commands.bindTexture(0, GL_TEXTURE_2D, texture);
+		}
+		if (packet.vertexArray != vertexArray)
+		{
+			vertexArray = packet.vertexArray;
+			commands.bindVertexArray(vertexArray);
+		}
+		commands.uniformMatrix4f(shader, "model"_uniform, packet.model);
+		commands.drawElements(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, packet.indexOffset);
+	}
+}
+
+size_t RenderQueue::size() const
+{
+	return entries.size();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Shader;
+class RenderCommandBuffer;
+
+// everything needed to issue one indexed draw
+struct DrawPacket
+{
+	const Shader* shader;
+	unsigned int vertexArray;
+	unsigned int texture;
+	int indexCount;
+	size_t indexOffset;
+	// per-draw "model" uniform, column-major
+	float model[16];
+};
+
+// 64-bit draw sort key, most significant bits first:
+//   pass (4) | translucent (1) | 59 bits that depend on translucency
+// opaque draws sort by program (10), material (14), mesh (14), then coarse depth (21)
+// front to back, so state changes are grouped and depth only breaks ties.
+// translucent draws need back-to-front order for blending, so depth comes first there
+// -------------------------------------------------------------------------------------
+namespace SortKey
+{
+	const unsigned int PASS_BITS = 4;
+	const unsigned int PROGRAM_BITS = 10;
+	const unsigned int MATERIAL_BITS = 14;
+	const unsigned int MESH_BITS = 14;
+	const unsigned int DEPTH_BITS = 21;
+
+	// depth is view depth normalized to [0, 1], ids are truncated to their field width
+	uint64_t Make(unsigned int pass, bool translucent, float depth,
+		unsigned int program, unsigned int material, unsigned int mesh);
+}
+
+// per-frame list of draws. submit() in any order, sort() with an LSD radix sort on the
+// keys, then record() emits them in order, skipping binds that wouldn't change anything
+// -------------------------------------------------------------------------------------
+class RenderQueue
+{
+public:
+	explicit RenderQueue(size_t capacity);
+
+	void reset();
+
+	// the "viewProjection" uniform every program is given when it's bound, column-major
+	void setViewProjection(const float* matrix);
+
+	// false when the queue is full for this frame
+	bool submit(uint64_t key, const DrawPacket& packet);
+
+	void sort();
+
+	void record(RenderCommandBuffer& commands) const;
+
+	size_t size() const;
+private:
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	std::vector<Entry> entries;
+	std::vector<Entry> scratch;
+	std::vector<DrawPacket> packets;
+	float viewProjection[16];
+	size_t capacity;
+};
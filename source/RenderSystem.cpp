@@ -1,18 +1,43 @@
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 #include "Shader.h"
+#include "ShaderCache.h"
+#include "ShaderBatch.h"
+#include "ShaderPreprocessor.h"
+#include "ShaderVariants.h"
+#include "GLExtensions.h"
 #include "RenderSystem.h"
+#include "RenderThread.h"
+#include "RenderQueue.h"
+#include "SpriteBatch.h"
+#include "StreamBuffer.h"
+#include "TextureLoader.h"
+#include "AssetPack.h"
+#include "JobSystem.h"
+#include "AsyncFileSystem.h"
+#include "EntityWorld.h"
+#include "TransformHierarchy.h"
+#include "VectorMath.h"
+#include "FrustumCulling.h"
+#include "IndirectRenderer.h"
+#include "FrameStats.h"
+#include "GameLoop.h"
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
 
 
 
 namespace GLFW
 {
-	GLFWwindow* CreateWindow();
-	void framebuffer_size_callback(GLFWwindow* window, int height, int width);
+	GLFWwindow* CreateWindow(bool headless);
 }
 
 namespace GLAD
@@ -20,23 +45,419 @@ namespace GLAD
 	void LoadOpenGLFunPtr();
 }
 
+// offscreen color + depth target used when there is no default framebuffer to look at
+struct OffscreenTarget
+{
+	unsigned int FBO;
+	unsigned int colorRBO;
+	unsigned int depthRBO;
+};
+
+namespace Headless
+{
+	OffscreenTarget CreateTarget(int width, int height);
+	void DestroyTarget(OffscreenTarget& target);
+	void RunBenchmark(RenderThread& renderThread, int frameCount,
+		void (*recordFrame)(void*, RenderCommandBuffer&), void* scene);
+}
+
 
 void processInput(GLFWwindow* window);
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
+// simulation runs at a fixed rate, rendering interpolates between ticks
+const double SIM_TICK_SECONDS = 1.0 / 60.0;
+const int SIM_MAX_TICKS_PER_FRAME = 5;
+
+const size_t MAX_DRAWS_PER_FRAME = 1 << 16;
+
+const size_t MAX_SPRITES = 1 << 18;
+const size_t SPRITES_PER_DRAW = 1 << 14;
+// visible sprites copied into the batch per job
+const unsigned int SPRITE_COPY_GRAIN = 4096;
+// background texture loading: most textures fit a 2048x2048 RGBA8 staging buffer
+const size_t MAX_TEXTURES = 1024;
+const unsigned int TEXTURE_STAGING_SLOTS = 4;
+const size_t TEXTURE_STAGING_BYTES = 16 << 20;
+const char* const COOKED_TEXTURE_DIR = "./cache/textures";
+// built by the assetpack tool; when missing every asset is read from loose files
+const char* const ASSET_PACK_PATH = "./assets.pack";
+
+const size_t MAX_MESH_OBJECTS = 1 << 20;
+// the mesh field fills a box this far out from the quad, wider than the view
+const float MESH_FIELD_HALF_WIDTH = 60.0f;
+const float MESH_FIELD_HALF_HEIGHT = 45.0f;
+const float MESH_FIELD_NEAR = 5.0f;
+const float MESH_FIELD_FAR = 95.0f;
+
+// dynamic vertex data per frame, enough for MAX_SPRITES
+const size_t STREAM_FRAME_BYTES = 16 << 20;
+
+// permutation bits of the quad shader, in the order of QUAD_SHADER_FEATURES
+enum QuadShaderFeature : uint32_t
+{
+	QUAD_TEXTURED = 1 << 0,
+	QUAD_VERTEX_COLOR = 1 << 1
+};
 
+const std::vector<std::string> QUAD_SHADER_FEATURES = { "USE_TEXTURE", "USE_VERTEX_COLOR" };
 
-void OpenGLPractice()
+// components of the sprite field entities
+struct SpriteCell
 {
-	GLFWwindow* window = GLFW::CreateWindow();
+	float column;
+	float row;
+};
+
+struct SpriteSpin
+{
+	// added to the simulation time
+	float phase;
+};
+
+struct SpriteTint
+{
+	uint32_t rgba;
+};
+
+// everything the textured quad needs to be drawn.
+// GL objects are created and destroyed on the render thread, the rest is main thread state
+struct QuadScene
+{
+	GLFWwindow* window = nullptr;
+	bool headless = false;
+	OffscreenTarget target = {};
+	const AssetPack* pack = nullptr;
+
+	unsigned int VAO = 0;
+	unsigned int VBO = 0;
+	unsigned int EBO = 0;
+	std::unique_ptr<TextureLoader> textures;
+	TextureHandle texture;
+	std::shared_ptr<Shader> shader;
+
+	FixedTimestep timestep = FixedTimestep(SIM_TICK_SECONDS, SIM_MAX_TICKS_PER_FRAME);
+	Interpolated<Transform2D> transform = {};
+	double simTime = 0.0;
+	TransformHierarchy transforms;
+	TransformNode quadNode;
+
+	RenderQueue queue = RenderQueue(MAX_DRAWS_PER_FRAME);
+
+	// the sprite field, one entity per sprite
+	JobSystem* jobs = nullptr;
+	EntityWorld world;
+	EntityWorld::Query* spriteQuery = nullptr;
+	int spriteColumns = 1;
+	StreamBuffer stream = StreamBuffer(GL_ARRAY_BUFFER, STREAM_FRAME_BYTES);
+	SpriteBatch sprites = SpriteBatch(stream, SPRITES_PER_DRAW);
+	std::shared_ptr<Shader> spriteShader;
+	TextureHandle spriteTexture;
+	// every sprite before culling, and its bounding circle as x, y, z, radius arrays
+	std::vector<SpriteInstance> spriteStaging;
+	std::vector<float> spriteBounds[4];
+	FrustumCuller spriteCuller;
+
+	// the mesh field. the GPU path brings its own programs, the CPU one draws with the
+	// quad shader
+	IndirectRenderer meshes = IndirectRenderer(MAX_MESH_OBJECTS);
+	std::shared_ptr<Shader> meshFallbackShader;
+};
+
+// textures cooked by texcook are used in place of their source image when present,
+// in the pack or on disk
+static std::string TexturePath(const std::string& source, const AssetPack* pack)
+{
+	std::filesystem::path cooked = std::filesystem::path(COOKED_TEXTURE_DIR) / std::filesystem::path(source).stem();
+	cooked += ".ktx2";
+	if (pack && pack->contains(cooked.string()))
+		return cooked.string();
+	std::error_code error;
+	return std::filesystem::exists(cooked, error) ? cooked.string() : source;
+}
+
+// one simulation tick: spin the quad and sway it side to side
+static Transform2D SimulateQuad(const Transform2D& current, double simTime, double dt)
+{
+	Transform2D next = current;
+	next.rotation = current.rotation + (float)dt;
+	next.x = 0.25f * (float)std::sin(simTime);
+	next.y = 0.0f;
+	next.scale = 1.0f;
+	return next;
+}
+
+// run however many fixed ticks have accumulated since the last frame
+static void UpdateQuadScene(QuadScene& scene)
+{
+	int ticks = scene.timestep.advance(glfwGetTime());
+	double dt = scene.timestep.tickSeconds();
+	for (int i = 0; i < ticks; ++i)
+	{
+		scene.simTime += dt;
+		scene.transform.push(SimulateQuad(scene.transform.current, scene.simTime, dt));
+	}
+}
+
+// perspective camera backed off until the quad's [-1, 1] height fills the view vertically
+static Mat4 CameraViewProjection(int width, int height)
+{
+	const float FIELD_OF_VIEW = 0.785398f;
+	const float NEAR_PLANE = 0.1f;
+	const float FAR_PLANE = 100.0f;
+
+	float aspect = height > 0 ? (float)width / (float)height : 1.0f;
+	float distance = 1.0f / std::tan(FIELD_OF_VIEW * 0.5f);
+	return Mat4::Perspective(FIELD_OF_VIEW, aspect, NEAR_PLANE, FAR_PLANE)
+		* Mat4::LookAt(Vec3(0.0f, 0.0f, distance), Vec3(), Vec3(0.0f, 1.0f, 0.0f));
+}
+
+// a grid of spinning sprites, one per entity
+static void CreateSpriteField(QuadScene& scene, int count)
+{
+	scene.spriteColumns = (int)std::sqrt((double)count) + 1;
+	for (int i = 0; i < count; ++i)
+	{
+		SpriteCell cell = { (float)(i % scene.spriteColumns), (float)(i / scene.spriteColumns) };
+		SpriteSpin spin = { (float)i * 0.01f };
+		SpriteTint tint = { 0x80FFFFFFu | ((uint32_t)(i & 0xFF) << 8) };
+		scene.world.create(cell, spin, tint);
+	}
+	scene.spriteQuery = &scene.world.query<SpriteCell, SpriteSpin, SpriteTint>();
+}
+
+// count cubes and octahedra at random behind the quad, most of them outside the view
+static void CreateMeshField(QuadScene& scene, int count)
+{
+	if (count <= 0)
+		return;
+
+	// position, color, texture coordinates; every face of the cube its own color
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+	const float corners[4][2] = { { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f } };
+	for (int face = 0; face < 6; ++face)
+	{
+		int axis = face / 2;
+		uint32_t first = (uint32_t)(vertices.size() / 8);
+		for (const float* corner : corners)
+		{
+			float vertex[8] = {};
+			vertex[axis] = (face & 1) ? 0.5f : -0.5f;
+			vertex[(axis + 1) % 3] = corner[0];
+			vertex[(axis + 2) % 3] = corner[1];
+			for (int k = 0; k < 3; ++k)
+				vertex[3 + k] = k == axis ? 1.0f : ((face & 1) ? 0.5f : 0.2f);
+			vertex[6] = corner[0] + 0.5f;
+			vertex[7] = corner[1] + 0.5f;
+			vertices.insert(vertices.end(), vertex, vertex + 8);
+		}
+		// counter-clockwise seen from outside, which the occlusion buffer relies on
+		uint32_t quad[6] = { first, first + 1, first + 2, first + 2, first + 3, first };
+		if ((face & 1) == 0)
+		{
+			std::swap(quad[1], quad[2]);
+			std::swap(quad[4], quad[5]);
+		}
+		indices.insert(indices.end(), quad, quad + 6);
+	}
+	uint32_t cube = scene.meshes.addMesh(vertices.data(), vertices.size() / 8, indices.data(), indices.size());
+
+	// one vertex per axis end, colored by axis
+	vertices.clear();
+	indices.clear();
+	for (int end = 0; end < 6; ++end)
+	{
+		float vertex[8] = {};
+		vertex[end / 2] = (end & 1) ? 0.5f : -0.5f;
+		vertex[3 + end / 2] = 1.0f;
+		vertices.insert(vertices.end(), vertex, vertex + 8);
+	}
+	for (uint32_t x = 0; x < 2; ++x)
+	{
+		for (uint32_t y = 2; y < 4; ++y)
+		{
+			for (uint32_t z = 4; z < 6; ++z)
+			{
+				// ends 0, 2 and 4 are the negative ones; an odd number of them flips the winding
+				uint32_t triangle[3] = { x, y, z };
+				if (((x + y + z) & 1) == 0)
+					std::swap(triangle[1], triangle[2]);
+				indices.insert(indices.end(), triangle, triangle + 3);
+			}
+		}
+	}
+	uint32_t octahedron = scene.meshes.addMesh(vertices.data(), vertices.size() / 8, indices.data(), indices.size());
+
+	uint32_t state = 0x2545F491u;
+	auto random = [&state]()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (float)(state & 0xFFFF) / 65535.0f;
+	};
+	for (int i = 0; i < count; ++i)
+	{
+		Vec3 position((random() * 2.0f - 1.0f) * MESH_FIELD_HALF_WIDTH, (random() * 2.0f - 1.0f) * MESH_FIELD_HALF_HEIGHT,
+			-(MESH_FIELD_NEAR + random() * (MESH_FIELD_FAR - MESH_FIELD_NEAR)));
+		Vec3 axis = Normalize(Vec3(random() - 0.5f, random() - 0.5f, random() - 0.5f) + Vec3(0.0f, 0.0f, 0.01f));
+		float scale = 0.3f + random() * 0.7f;
+		bool isCube = (i & 1) == 0;
+
+		MeshObject object = {};
+		Mat4 model = Mat4::TRS(position, Quat::AxisAngle(axis, random() * 6.2832f), Vec3(scale));
+		std::memcpy(object.model, model.data(), sizeof(object.model));
+		object.sphere[0] = position.x;
+		object.sphere[1] = position.y;
+		object.sphere[2] = position.z;
+		// half the cube's diagonal, or the octahedron's tips
+		object.sphere[3] = scale * (isCube ? 0.8661f : 0.5f);
+		object.mesh = isCube ? cube : octahedron;
+		if (!scene.meshes.addObject(object))
+			break;
+	}
+}
+
+// every chunk of sprite entities is written by its own job at the chunk's offset, along
+// with a bounding circle per sprite. sprites entirely off screen are culled and only the
+// visible ones are copied into the batch, still in entity order
+static void RecordSprites(QuadScene& scene, RenderCommandBuffer& commands, int width, int height)
+{
+	unsigned int texture = scene.textures->texture(scene.spriteTexture);
+	size_t count = scene.spriteQuery ? scene.spriteQuery->entityCount() : 0;
+	if (count == 0 || texture == 0)
+		return;
+
+	scene.spriteStaging.resize(count);
+	for (std::vector<float>& bounds : scene.spriteBounds)
+		bounds.resize(count);
+
+	float cell = (float)width / (float)scene.spriteColumns;
+	// half the diagonal, so the circle holds the sprite at any rotation
+	float radius = cell * 0.7072f;
+	float time = (float)scene.simTime;
+	scene.world.parallelForChunks(*scene.jobs, *scene.spriteQuery, [&](const EntityWorld::ChunkView& chunk)
+	{
+		const SpriteCell* cells = chunk.column<SpriteCell>();
+		const SpriteSpin* spins = chunk.column<SpriteSpin>();
+		const SpriteTint* tints = chunk.column<SpriteTint>();
+		SpriteInstance* out = scene.spriteStaging.data() + chunk.offset();
+		for (uint32_t i = 0; i < chunk.count(); ++i)
+		{
+			SpriteInstance& sprite = out[i];
+			sprite.position[0] = (cells[i].column + 0.5f) * cell;
+			sprite.position[1] = (cells[i].row + 0.5f) * cell;
+			sprite.size[0] = cell;
+			sprite.size[1] = cell;
+			sprite.uvRect[0] = 0.0f;
+			sprite.uvRect[1] = 0.0f;
+			sprite.uvRect[2] = 1.0f;
+			sprite.uvRect[3] = 1.0f;
+			sprite.rotation = time + spins[i].phase;
+			sprite.layer = 0.0f;
+			sprite.tint = tints[i].rgba;
+			sprite.padding = 0;
+
+			size_t index = chunk.offset() + i;
+			scene.spriteBounds[0][index] = sprite.position[0];
+			scene.spriteBounds[1][index] = sprite.position[1];
+			scene.spriteBounds[2][index] = 0.0f;
+			scene.spriteBounds[3][index] = radius;
+		}
+	});
+
+	// sprites are in pixels, origin at the bottom left
+	Frustum screen = Frustum::FromMatrix(Mat4::Orthographic(0.0f, (float)width, 0.0f, (float)height, -1.0f, 1.0f));
+	SphereArrays bounds = { scene.spriteBounds[0].data(), scene.spriteBounds[1].data(), scene.spriteBounds[2].data(), scene.spriteBounds[3].data() };
+	unsigned int visible = (unsigned int)scene.spriteCuller.cullSpheres(screen, bounds, count, scene.jobs);
+	if (visible == 0)
+		return;
+
+	scene.sprites.begin();
+	SpriteInstance* sprites = scene.sprites.allocate(visible);
+	if (!sprites)
+		return;
+
+	const uint32_t* indices = scene.spriteCuller.visible();
+	const SpriteInstance* staging = scene.spriteStaging.data();
+	scene.jobs->parallelFor(visible, SPRITE_COPY_GRAIN, [sprites, indices, staging](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; ++i)
+			sprites[i] = staging[indices[i]];
+	});
+
+	scene.sprites.record(commands, scene.spriteShader.get(), texture, width, height);
+}
+
+static void RecordQuadScene(QuadScene& scene, RenderCommandBuffer& commands)
+{
+	int width = SCR_WIDTH, height = SCR_HEIGHT;
+	if (!scene.headless)
+		glfwGetFramebufferSize(scene.window, &width, &height);
+	commands.viewport(0, 0, width, height);
+
+	scene.stream.beginFrame(commands);
+	scene.textures->update(commands);
+
+	commands.clear(0.2f, 0.3f, 0.3f, 1.0f, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	Transform2D t = scene.transform.at(scene.timestep.alpha());
+	Transform local;
+	local.position[0] = t.x;
+	local.position[1] = t.y;
+	Quat rotation = Quat::AxisAngle(Vec3(0.0f, 0.0f, 1.0f), t.rotation);
+	std::memcpy(local.rotation, &rotation.x, sizeof(local.rotation));
+	local.scale[0] = local.scale[1] = local.scale[2] = t.scale;
+	scene.transforms.setLocal(scene.quadNode, local);
+	scene.transforms.update(scene.jobs);
+
+	Mat4 viewProjection = CameraViewProjection(width, height);
+
+	// draws go through the queue so they reach the command buffer in state order.
+	// the quad waits for its texture to finish loading
+	scene.queue.reset();
+	scene.queue.setViewProjection(viewProjection.data());
+	// the meshes and the quad are depth tested against each other, sprites go on top.
+	// on the GPU path the meshes are culled and drawn right here, on the CPU path they
+	// join the queue
+	commands.depthTest(true, GL_LESS);
+	scene.meshes.record(commands, scene.queue, scene.meshFallbackShader.get(), viewProjection, scene.jobs);
+	unsigned int texture = scene.textures->texture(scene.texture);
+	if (texture != 0)
+	{
+		DrawPacket quad = { scene.shader.get(), scene.VAO, texture, 6, 0, {} };
+		std::memcpy(quad.model, scene.transforms.world(scene.quadNode), sizeof(quad.model));
+		scene.queue.submit(SortKey::Make(0, false, 0.0f, scene.shader->ID, texture, scene.VAO), quad);
+	}
+	scene.queue.sort();
+	scene.queue.record(commands);
+	commands.depthTest(false, GL_LESS);
+
+	RecordSprites(scene, commands, width, height);
+
+	scene.stream.endFrame(commands);
+}
+
+// everything the main thread does for one displayed frame
+static void FrameQuadScene(void* userData, RenderCommandBuffer& commands)
+{
+	QuadScene& scene = *static_cast<QuadScene*>(userData);
+	UpdateQuadScene(scene);
+	RecordQuadScene(scene, commands);
+}
+
+// render thread: load GL and build the scene's GL objects
+static void CreateQuadResources(void* userData)
+{
+	QuadScene& scene = *static_cast<QuadScene*>(userData);
 
-	
 	GLAD::LoadOpenGLFunPtr();
-	
 
-	Shader shader();
+	if (scene.headless)
+		scene.target = Headless::CreateTarget(SCR_WIDTH, SCR_HEIGHT);
 
 	//set up vertex data and buffers and configure vertex attributes
 	// -------------------------------------------------------------
@@ -49,106 +470,231 @@ void OpenGLPractice()
 		-0.5f,  0.5f, 0.0f,   1.0f, 1.0f, 0.0f,   0.0f, 1.0f    // top left 
 	};
 
-	float texCoords[] = {
-		0.0f, 0.0f,
-		1.0f, 0.0f,
-		0.5f, 1.0f
+	unsigned int indices[] =
+	{
+		0, 1, 3, // first triangle
+		1, 2, 3  // second triangle
 	};
 
 
-	unsigned int VBO, VAO;
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
+	glGenVertexArrays(1, &scene.VAO);
+	glGenBuffers(1, &scene.VBO);
+	glGenBuffers(1, &scene.EBO);
 
 	//bind the vertex array object first, then bind and set the vertex buffers,
 	//and then configure vertex attributes
-	glBindVertexArray(VAO);
+	glBindVertexArray(scene.VAO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, scene.VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene.EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 	
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 
 	// this passes the additional 3 floats as colors
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
 	glEnableVertexAttribArray(1);
 
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
 	glEnableVertexAttribArray(2);
 
-	//texture code
-
-	
+	// every program goes into one batch so the driver can compile them side by side,
+	// the rest of the setup below overlaps with that work
+	ShaderCache shaderCache("./cache/shaders");
+	ShaderBatch shaderBatch(&shaderCache);
+	ShaderPreprocessor preprocessor(scene.pack);
+	ShaderVariants quadVariants(preprocessor, "./assets/shaders/shader.vs", "./assets/shaders/shader.fs", QUAD_SHADER_FEATURES);
+	auto quadShader = quadVariants.request(shaderBatch, QUAD_TEXTURED);
+	ShaderVariants spriteVariants(preprocessor, "./assets/shaders/sprite.vs", "./assets/shaders/sprite.fs", {});
+	auto spriteShader = spriteVariants.request(shaderBatch, 0);
+
+	// the mesh field culls and draws on the GPU when the context can, and needs the quad
+	// shader with vertex colors for when it can't
+	bool hasMeshes = scene.meshes.objectCount() > 0;
+	std::shared_future<std::shared_ptr<Shader>> meshShader, meshFallbackShader;
+	std::shared_ptr<Shader> meshCullShader;
+	if (hasMeshes)
+	{
+		meshFallbackShader = quadVariants.request(shaderBatch, QUAD_VERTEX_COLOR);
+		meshCullShader = IndirectRenderer::CreateCullProgram(preprocessor, "./assets/shaders/cull.comp");
+		if (meshCullShader)
+		{
+			ShaderVariants meshVariants(preprocessor, "./assets/shaders/mesh_indirect.vs", "./assets/shaders/shader.fs", QUAD_SHADER_FEATURES);
+			meshShader = meshVariants.request(shaderBatch, QUAD_VERTEX_COLOR);
+		}
+	}
 
-	Shader currentShader("./assets/shaders/shader.vs", "./assets/shaders/shader.fs");
+	scene.stream.createResources();
+	std::cout << "stream buffer: " << (scene.stream.persistent() ? "persistent mapped" : "orphaned (no buffer storage)") << std::endl;
+	scene.sprites.createResources();
+
+	// decoded on job workers and uploaded over the next frames, nothing waits for them here
+	scene.textures->createResources();
+	std::string container = TexturePath("./assets/textures/container.jpg", scene.pack);
+	scene.texture = scene.textures->load(container, GL_TEXTURE_2D);
+	// sprites sample a texture array so one draw can mix layers, for now it holds the one image
+	scene.spriteTexture = scene.textures->load(container, GL_TEXTURE_2D_ARRAY);
+
+	shaderBatch.finish();
+	shaderBatch.printStats();
+	shaderCache.printStats();
+
+	scene.shader = quadShader.get();
+	if (!scene.shader)
+		throw std::runtime_error("Failed to build quad shader");
+	scene.spriteShader = spriteShader.get();
+	if (!scene.spriteShader)
+		throw std::runtime_error("Failed to build sprite shader");
+
+	if (hasMeshes)
+	{
+		scene.meshFallbackShader = meshFallbackShader.get();
+		if (!scene.meshFallbackShader)
+			throw std::runtime_error("Failed to build mesh shader");
+		scene.meshes.createResources(meshCullShader, meshShader.valid() ? meshShader.get() : nullptr);
+		std::cout << "meshes: " << scene.meshes.objectCount() << " objects, "
+			<< (scene.meshes.gpuDriven() ? (GLExt::indirectCount ? "culled on the GPU, multi-draw indirect with a GPU draw count"
+				: "culled on the GPU, multi-draw indirect over every object") : "culled on the CPU, one draw each") << std::endl;
+	}
+}
 
-	
+// render thread: de-allocate all resources
+static void DestroyQuadResources(void* userData)
+{
+	QuadScene& scene = *static_cast<QuadScene*>(userData);
+
+	glDeleteVertexArrays(1, &scene.VAO);
+	glDeleteBuffers(1, &scene.VBO);
+	glDeleteBuffers(1, &scene.EBO);
+	glDeleteProgram(scene.shader->ID);
+	scene.textures->destroyResources();
+	glDeleteProgram(scene.spriteShader->ID);
+	scene.sprites.destroyResources();
+	if (scene.meshFallbackShader)
+	{
+		scene.meshes.destroyResources();
+		glDeleteProgram(scene.meshFallbackShader->ID);
+	}
+	scene.stream.destroyResources();
 
-	unsigned int texture;
-	glGenTextures(1, &texture);
+	if (scene.headless)
+		Headless::DestroyTarget(scene.target);
+}
 
-	glBindTexture(GL_TEXTURE_2D, texture);
 
-	//x axis
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-	//y axis
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-	//mipmapping
-	//basically further away textures uses smaller resolution texels so that less memory is used
-	//Open GL handles this automatically for us
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void OpenGLPractice()
+{
+	OpenGLPractice(RenderSettings());
+}
 
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load("container.jpg", &width, &height, &nrChannels, 0);
-	if (data)
+void OpenGLPractice(const RenderSettings& settings)
+{
+	GLFWwindow* window = GLFW::CreateWindow(settings.headless);
+
+	// the main thread is worker 0 but only runs jobs while it waits on them,
+	// so keep at least one background worker for loading
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	JobSystem jobs(hardwareThreads > 2 ? hardwareThreads : 2);
+	// loose files the pack doesn't hold are read without tying up workers
+	AsyncFileSystem files;
+	std::cout << "file reads: " << files.backend() << std::endl;
+
+	// one mapping for every asset; views into it stay valid until the scene is gone
+	AssetPack pack;
+	auto packStart = std::chrono::steady_clock::now();
+	if (pack.open(ASSET_PACK_PATH))
 	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - packStart).count();
+		std::cout << "asset pack: " << pack.fileCount() << " files, " << pack.mappedBytes() / 1024 << " KiB mapped in "
+			<< ms << " ms" << std::endl;
 	}
-	else
+
+	QuadScene scene;
+	scene.pack = pack.isOpen() ? &pack : nullptr;
+	scene.textures.reset(new TextureLoader(jobs, MAX_TEXTURES, TEXTURE_STAGING_SLOTS, TEXTURE_STAGING_BYTES, scene.pack, &files));
+	scene.window = window;
+	scene.headless = settings.headless;
+	scene.jobs = &jobs;
+	CreateSpriteField(scene, settings.spriteCount < (int)MAX_SPRITES ? settings.spriteCount : (int)MAX_SPRITES);
+	CreateMeshField(scene, settings.meshCount < (int)MAX_MESH_OBJECTS ? settings.meshCount : (int)MAX_MESH_OBJECTS);
+	Transform2D initial = { 0.0f, 0.0f, 0.0f, 1.0f };
+	scene.transform.reset(initial);
+	scene.quadNode = scene.transforms.create();
+
+	// the render thread owns the context from here on, GL calls only happen over there
+	RenderThread renderThread;
+	// headless keeps timings for the measured frames, the warmup ones roll out of the ring
+	size_t frameHistory = settings.headless && settings.benchmarkFrames > 0 ? (size_t)settings.benchmarkFrames
+		: RenderThread::DEFAULT_FRAME_HISTORY;
+	renderThread.start(window, CreateQuadResources, DestroyQuadResources, &scene, settings.headless, frameHistory);
+
+	scene.timestep.reset(glfwGetTime());
+
+	if (settings.headless)
 	{
-		std::cout << "Failed to load texture" << std::endl;
+		Headless::RunBenchmark(renderThread, settings.benchmarkFrames, FrameQuadScene, &scene);
 	}
-	stbi_image_free(data);
-
-
-	//render loop
-	while (!glfwWindowShouldClose(window))
+	else
 	{
-		processInput(window);
+		//render loop
+		while (!glfwWindowShouldClose(window))
+		{
+			glfwPollEvents();
+			processInput(window);
 
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+			FrameQuadScene(&scene, renderThread.beginFrame());
 
-		currentShader.use();
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			renderThread.submitFrame();
+		}
 
-
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		if (scene.timestep.droppedTicks() > 0)
+			std::cout << "simulation dropped " << scene.timestep.droppedTicks() << " ticks to keep up" << std::endl;
 	}
 
-	//de-allocate all resources
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
+	renderThread.stop();
+
+	scene.textures->printStats();
+	if (scene.stream.stalls() > 0)
+		std::cout << "stream buffer waited on the GPU " << scene.stream.stalls() << " times" << std::endl;
+	if (scene.sprites.droppedSprites() > 0)
+		std::cout << "sprite batch dropped " << scene.sprites.droppedSprites() << " sprites that didn't fit" << std::endl;
+	if (scene.meshes.objectCount() > 0)
+		std::cout << "meshes: " << scene.meshes.drawnObjects() << " of " << scene.meshes.objectCount() << " drawn in the last frame, "
+			<< scene.meshes.occludedObjects() << " hidden by occlusion culling" << std::endl;
+	if (scene.meshes.droppedDraws() > 0)
+		std::cout << "meshes: dropped " << scene.meshes.droppedDraws() << " draws past the CPU path's limit" << std::endl;
 	
 	glfwTerminate();
 	return;
 }
 
 // glfw: Window Creation
-GLFWwindow* GLFW::CreateWindow()
+// headless windows live on the null platform and get their context from OSMesa,
+// so no display server or GPU is needed
+GLFWwindow* GLFW::CreateWindow(bool headless)
 {
-	glfwInit();
+	if (headless)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+
+	if (!glfwInit())
+	{
+		std::cout << "Failed to initialize GLFW" << std::endl;
+		throw std::runtime_error("Failed to initialize GLFW");
+	}
 	//tell glfw version and core profile
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+	if (headless)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
+
 	//Creating the actual window itself
 	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
 	if (window == NULL)
@@ -157,20 +703,12 @@ GLFWwindow* GLFW::CreateWindow()
 		glfwTerminate();
 		throw std::runtime_error("Failed to create GLFW window");
 	}
-	glfwMakeContextCurrent(window);
-	//set the callback for resizing
-	glfwSetFramebufferSizeCallback(window, GLFW::framebuffer_size_callback);
+	// the viewport follows the framebuffer size, which the main thread reads every frame
+	// and records into the command stream, so no resize callback is needed
 
 	return window;
 }
 
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-// ---------------------------------------------------------------------------------------------
-void GLFW::framebuffer_size_callback(GLFWwindow* window, int width, int height)
-{
-	glViewport(0, 0, width, height);
-}
-
 // glad: load all opengl pointers
 // // --------------------------
 void GLAD::LoadOpenGLFunPtr()
@@ -180,6 +718,96 @@ void GLAD::LoadOpenGLFunPtr()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		throw std::runtime_error("Failed to initialize GLAD");
 	}
+	GLExt::Load();
+}
+
+// headless: framebuffer object with renderbuffer attachments to draw into
+// -----------------------------------------------------------------------
+OffscreenTarget Headless::CreateTarget(int width, int height)
+{
+	OffscreenTarget target;
+	glGenFramebuffers(1, &target.FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+
+	glGenRenderbuffers(1, &target.colorRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.colorRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.colorRBO);
+
+	glGenRenderbuffers(1, &target.depthRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.depthRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target.depthRBO);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Failed to create offscreen framebuffer" << std::endl;
+		throw std::runtime_error("Failed to create offscreen framebuffer");
+	}
+	glViewport(0, 0, width, height);
+	return target;
+}
+
+void Headless::DestroyTarget(OffscreenTarget& target)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteRenderbuffers(1, &target.depthRBO);
+	glDeleteRenderbuffers(1, &target.colorRBO);
+	glDeleteFramebuffers(1, &target.FBO);
+}
+
+// headless: render a fixed number of frames and print percentiles.
+// CPU is the main thread's frame (simulate, record, hand off), RT is the render
+// thread's replay + swap and GPU comes from its GL_TIME_ELAPSED queries
+// ---------------------------------------------------------------------------
+void Headless::RunBenchmark(RenderThread& renderThread, int frameCount,
+	void (*recordFrame)(void*, RenderCommandBuffer&), void* scene)
+{
+	const int WARMUP_FRAMES = 10;
+
+	int totalFrames = WARMUP_FRAMES + frameCount;
+	std::vector<double> cpuMs(totalFrames, 0.0);
+
+	for (int frame = 0; frame < totalFrames; ++frame)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		recordFrame(scene, renderThread.beginFrame());
+		renderThread.submitFrame();
+		glfwPollEvents();
+
+		auto end = std::chrono::steady_clock::now();
+		cpuMs[frame] = std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	// drains the last frame and resolves the remaining timer queries
+	renderThread.stop();
+
+	const std::vector<double>& gpuMs = renderThread.gpuTimes();
+	const std::vector<double>& replayMs = renderThread.replayTimes();
+
+	// the render thread only keeps the most recent frames, entry 0 is frame firstKept
+	int firstKept = totalFrames - (int)replayMs.size();
+	int firstMeasured = firstKept > WARMUP_FRAMES ? firstKept : WARMUP_FRAMES;
+
+	FrameStats stats;
+	stats.reserve(frameCount);
+	for (int frame = firstMeasured; frame < totalFrames; ++frame)
+		stats.addFrame(cpuMs[frame], gpuMs[frame - firstKept], replayMs[frame - firstKept]);
+
+	std::cout << "GL_RENDERER: " << glGetString(GL_RENDERER) << std::endl;
+	stats.print("headless benchmark");
+
+	const std::vector<GLStateStats>& stateStats = renderThread.stateStats();
+	double issued = 0.0, elided = 0.0;
+	for (int frame = firstMeasured; frame < totalFrames; ++frame)
+	{
+		issued += stateStats[frame - firstKept].issued;
+		elided += stateStats[frame - firstKept].elided;
+	}
+	double measured = totalFrames > firstMeasured ? (double)(totalFrames - firstMeasured) : 1.0;
+	std::cout << "GL state calls per frame: " << issued / measured << " issued, "
+		<< elided / measured << " elided" << std::endl;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -189,4 +817,3 @@ void processInput(GLFWwindow* window)
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
 }
-
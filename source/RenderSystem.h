@@ -1,6 +1,20 @@
 #pragma once
 #include <string>
 
+// how OpenGLPractice() should run
+// headless runs use GLFW's null platform with an OSMesa context and render
+// a fixed number of frames into an offscreen framebuffer, then print timings
+struct RenderSettings
+{
+	bool headless = false;
+	int benchmarkFrames = 500;
+	// instanced sprites drawn over the quad each frame
+	int spriteCount = 0;
+	// static meshes scattered behind the quad, culled and drawn by IndirectRenderer
+	int meshCount = 0;
+};
+
 void OpenGLPractice();
 
+void OpenGLPractice(const RenderSettings& settings);
 
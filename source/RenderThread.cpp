@@ -0,0 +1,219 @@
+#include "glad/glad.h"
+#include "GLFW/glfw3.h"
+
+#include "RenderThread.h"
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	// commands for one frame; large scenes can raise this
+	const size_t COMMAND_BUFFER_BYTES = 4 << 20;
+	const size_t TIMER_QUERY_RING = 4;
+}
+
+RenderThread::RenderThread()
+	: window(nullptr), initFunction(nullptr), shutdownFunction(nullptr), userData(nullptr), timeGpu(false),
+	buffers{ RenderCommandBuffer(COMMAND_BUFFER_BYTES), RenderCommandBuffer(COMMAND_BUFFER_BYTES) },
+	recordIndex(0), pendingIndex(-1), frameReady(false), rendering(false), initialized(false), stopRequested(false),
+	history(0), replayedFrames(0), timerQueries{}
+{
+}
+
+RenderThread::~RenderThread()
+{
+	stop();
+}
+
+void RenderThread::start(GLFWwindow* window, void (*init)(void*), void (*shutdown)(void*), void* userData, bool gpuTiming,
+	size_t frameHistory)
+{
+	this->window = window;
+	initFunction = init;
+	shutdownFunction = shutdown;
+	this->userData = userData;
+	timeGpu = gpuTiming;
+
+	// a timer query is read back TIMER_QUERY_RING frames later, its frame's slot has to survive that long
+	history = std::max(frameHistory, TIMER_QUERY_RING);
+	replayedFrames = 0;
+	gpuMs.assign(history, -1.0);
+	replayMs.assign(history, 0.0);
+	stateCounts.assign(history, GLStateStats());
+
+	// a context can only be current on one thread at a time
+	glfwMakeContextCurrent(NULL);
+	thread = std::thread(&RenderThread::threadMain, this);
+
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this] { return initialized; });
+	if (initError)
+	{
+		guard.unlock();
+		thread.join();
+		std::rethrow_exception(initError);
+	}
+}
+
+RenderCommandBuffer& RenderThread::beginFrame()
+{
+	RenderCommandBuffer& buffer = buffers[recordIndex];
+	buffer.reset();
+	return buffer;
+}
+
+void RenderThread::submitFrame()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	// the render thread must be done with the previous frame before we give it this one,
+	// and only then is the other buffer free to record into
+	changed.wait(guard, [this] { return !frameReady && !rendering; });
+	pendingIndex = recordIndex;
+	frameReady = true;
+	recordIndex ^= 1;
+	guard.unlock();
+	changed.notify_all();
+}
+
+void RenderThread::stop()
+{
+	if (!thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopRequested = true;
+	}
+	changed.notify_all();
+	thread.join();
+
+	// give the context back to the main thread for teardown
+	glfwMakeContextCurrent(window);
+}
+
+const std::vector<double>& RenderThread::gpuTimes() const
+{
+	return gpuMs;
+}
+
+const std::vector<double>& RenderThread::replayTimes() const
+{
+	return replayMs;
+}
+
+const std::vector<GLStateStats>& RenderThread::stateStats() const
+{
+	return stateCounts;
+}
+
+void RenderThread::readGpuTimer(size_t frame)
+{
+	GLuint64 elapsedNs = 0;
+	glGetQueryObjectui64v(timerQueries[frame % TIMER_QUERY_RING], GL_QUERY_RESULT, &elapsedNs);
+	gpuMs[frame % history] = (double)elapsedNs / 1.0e6;
+}
+
+void RenderThread::threadMain()
+{
+	glfwMakeContextCurrent(window);
+	try
+	{
+		if (initFunction)
+			initFunction(userData);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		initError = std::current_exception();
+		initialized = true;
+		glfwMakeContextCurrent(NULL);
+		changed.notify_all();
+		return;
+	}
+
+	if (timeGpu)
+		glGenQueries(TIMER_QUERY_RING, timerQueries);
+
+	// init made GL calls of its own behind the cache's back
+	state.invalidate();
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		initialized = true;
+	}
+	changed.notify_all();
+
+	for (;;)
+	{
+		int index;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [this] { return frameReady || stopRequested; });
+			if (!frameReady)
+				break;
+			index = pendingIndex;
+			frameReady = false;
+			rendering = true;
+		}
+
+		size_t frame = replayedFrames;
+		size_t slot = frame % history;
+		auto start = std::chrono::steady_clock::now();
+
+		if (timeGpu)
+		{
+			// the query slot we are about to reuse belongs to TIMER_QUERY_RING frames ago
+			if (frame >= TIMER_QUERY_RING)
+				readGpuTimer(frame - TIMER_QUERY_RING);
+			glBeginQuery(GL_TIME_ELAPSED, timerQueries[frame % TIMER_QUERY_RING]);
+		}
+
+		state.beginFrame();
+		buffers[index].execute(state);
+		stateCounts[slot] = state.frameStats();
+
+		if (timeGpu)
+			glEndQuery(GL_TIME_ELAPSED);
+
+		glfwSwapBuffers(window);
+
+		auto end = std::chrono::steady_clock::now();
+		replayMs[slot] = std::chrono::duration<double, std::milli>(end - start).count();
+		gpuMs[slot] = -1.0;
+		++replayedFrames;
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			rendering = false;
+		}
+		changed.notify_all();
+	}
+
+	if (timeGpu)
+	{
+		size_t frames = replayedFrames;
+		for (size_t frame = frames > TIMER_QUERY_RING ? frames - TIMER_QUERY_RING : 0; frame < frames; ++frame)
+			readGpuTimer(frame);
+		glDeleteQueries(TIMER_QUERY_RING, timerQueries);
+	}
+
+	// unroll the ring: oldest frame first, and no slots that were never written
+	if (replayedFrames > history)
+	{
+		size_t oldest = replayedFrames % history;
+		std::rotate(gpuMs.begin(), gpuMs.begin() + oldest, gpuMs.end());
+		std::rotate(replayMs.begin(), replayMs.begin() + oldest, replayMs.end());
+		std::rotate(stateCounts.begin(), stateCounts.begin() + oldest, stateCounts.end());
+	}
+	else
+	{
+		gpuMs.resize(replayedFrames);
+		replayMs.resize(replayedFrames);
+		stateCounts.resize(replayedFrames);
+	}
+
+	if (shutdownFunction)
+		shutdownFunction(userData);
+
+	glfwMakeContextCurrent(NULL);
+}
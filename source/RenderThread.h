@@ -0,0 +1,86 @@
+#pragma once
+#include "RenderCommands.h"
+#include "GLStateCache.h"
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+// thread that owns the GL context and replays the command buffer the main thread
+// recorded for the previous frame. there are two buffers: while the render thread
+// replays frame N the main thread records frame N+1 into the other one, so the two
+// threads overlap by exactly one frame
+// ---------------------------------------------------------------------------------
+class RenderThread
+{
+public:
+	static const size_t DEFAULT_FRAME_HISTORY = 1024;
+
+	RenderThread();
+	~RenderThread();
+
+	RenderThread(const RenderThread&) = delete;
+	RenderThread& operator=(const RenderThread&) = delete;
+
+	// take over the window's context on a new thread. init runs there first (load GL,
+	// create resources) and start() returns once it's done, rethrowing anything it threw.
+	// shutdown runs on the render thread from stop(). with gpuTiming every frame is
+	// wrapped in a GL_TIME_ELAPSED query. timings are kept for the last frameHistory
+	// frames in a ring allocated here, so the render thread never grows it
+	void start(GLFWwindow* window, void (*init)(void*), void (*shutdown)(void*), void* userData, bool gpuTiming,
+		size_t frameHistory = DEFAULT_FRAME_HISTORY);
+
+	// buffer for the main thread to record the next frame into
+	RenderCommandBuffer& beginFrame();
+
+	// hand the recorded frame over, waiting first for the render thread to finish the one before
+	void submitFrame();
+
+	// finish outstanding work and run shutdown, then make the context current on the
+	// calling thread for whatever teardown comes after
+	void stop();
+
+	// per-frame timings of the last frameHistory replayed frames, oldest first.
+	// gpu entries are -1 when timing is off; read them after stop()
+	const std::vector<double>& gpuTimes() const;
+
+	const std::vector<double>& replayTimes() const;
+
+	// GL calls issued vs. dropped by the state cache, per replayed frame
+	const std::vector<GLStateStats>& stateStats() const;
+private:
+	void threadMain();
+	void readGpuTimer(size_t frame);
+
+	GLFWwindow* window;
+	void (*initFunction)(void*);
+	void (*shutdownFunction)(void*);
+	void* userData;
+	bool timeGpu;
+
+	std::thread thread;
+	std::mutex lock;
+	std::condition_variable changed;
+
+	RenderCommandBuffer buffers[2];
+	int recordIndex;
+	int pendingIndex;
+	bool frameReady;
+	bool rendering;
+	bool initialized;
+	bool stopRequested;
+	std::exception_ptr initError;
+
+	// ring of recent frames, slot is frame % history. written only by the render
+	// thread while running and put back in submission order when it exits
+	size_t history;
+	size_t replayedFrames;
+	std::vector<double> gpuMs;
+	std::vector<double> replayMs;
+	std::vector<GLStateStats> stateCounts;
+	GLStateCache state;
+	unsigned int timerQueries[4];
+};
@@ -2,39 +2,115 @@
 #include "GLFW/glfw3.h"
 
 #include "Shader.h"
+#include "ShaderCache.h"
+#include "GLExtensions.h"
+#include "AssetPack.h"
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+Shader::Shader(const char* vertexPath, const char* fragmentPath, ShaderCache* cache, const AssetPack* pack)
+	: uniformMask(0), uploads(0), skips(0)
 {
 	std::string vertexCode;
 	std::string fragmentCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	readSource(vertexPath, vertexCode, pack);
+	readSource(fragmentPath, fragmentCode, pack);
+
+	auto compileStart = std::chrono::steady_clock::now();
+	PendingProgram pending = submitProgram(vertexCode, fragmentCode, cache);
+	finishProgram(pending, cache);
+	if (cache && !pending.fromCache)
+		cache->addCompileTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count());
+}
+
+Shader::Shader(const PendingProgram& pending, ShaderCache* cache)
+	: uniformMask(0), uploads(0), skips(0)
+{
+	finishProgram(pending, cache);
+}
+
+Shader::Shader()
+	: ID(0), uniformMask(0), uploads(0), skips(0)
+{
+}
+
+std::shared_ptr<Shader> Shader::Compute(const std::string& computeCode)
+{
+	const char* code = computeCode.c_str();
+	unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute, 1, &code, NULL);
+	glCompileShader(compute);
+
+	std::shared_ptr<Shader> shader(new Shader());
+	shader->ID = glCreateProgram();
+	glAttachShader(shader->ID, compute);
+	glLinkProgram(shader->ID);
+	shader->checkCompileErrors(compute, "COMPUTE");
+	shader->checkCompileErrors(shader->ID, "PROGRAM");
+	glDeleteShader(compute);
+
+	int success = 0;
+	glGetProgramiv(shader->ID, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glDeleteProgram(shader->ID);
+		return nullptr;
+	}
+	shader->reflectUniforms();
+	return shader;
+}
+
+bool Shader::readSource(const char* path, std::string& code, const AssetPack* pack)
+{
+	size_t index = pack ? pack->lookup(path) : AssetPack::NOT_FOUND;
+	if (index != AssetPack::NOT_FOUND)
+	{
+		code.resize(pack->size(index));
+		return pack->read(index, reinterpret_cast<std::byte*>(code.data()));
+	}
+
+	std::ifstream shaderFile;
+	shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
 	try
 	{
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream, fShaderStream;
+		shaderFile.open(path);
+		std::stringstream shaderStream;
 		//read file's buffer contents into streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
+		shaderStream << shaderFile.rdbuf();
 		// close file handlers
-		vShaderFile.close();
-		fShaderFile.close();
+		shaderFile.close();
 		// convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-
+		code = shaderStream.str();
 	}
-	catch (std::ifstream::failure e)
+	catch (const std::ifstream::failure&)
 	{
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// hand the sources to the driver without asking for any status back,
+// so a driver with background compiler threads can work on many programs at once
+PendingProgram Shader::submitProgram(const std::string& vertexCode, const std::string& fragmentCode, ShaderCache* cache)
+{
+	PendingProgram pending = {};
+
+	//a cached binary skips compiling and linking altogether
+	pending.program = glCreateProgram();
+	if (cache)
+	{
+		pending.cacheKey = cache->key(vertexCode, fragmentCode);
+		if (cache->load(pending.cacheKey, pending.program))
+		{
+			pending.fromCache = true;
+			return pending;
+		}
 	}
 
 	const char* vShaderCode = vertexCode.c_str();
@@ -42,50 +118,59 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 
 	//compile shaders stage
 
-	unsigned int vertex, fragment;
-	int success;
-	char infoLog[512];
-
 	// vertex shader
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
-	glCompileShader(vertex);
-	checkCompileErrors(vertex, "VERTEX");
-	// print compile errors
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-	}
+	pending.vertex = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(pending.vertex, 1, &vShaderCode, NULL);
+	glCompileShader(pending.vertex);
 
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	checkCompileErrors(fragment, "FRAGMENT");
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+	pending.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(pending.fragment, 1, &fShaderCode, NULL);
+	glCompileShader(pending.fragment);
 
-	if (!success)
+	//Shader program
+	glAttachShader(pending.program, pending.vertex);
+	glAttachShader(pending.program, pending.fragment);
+	if (cache && cache->enabled())
+		GLExt::ProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(pending.program);
+	return pending;
+}
+
+bool Shader::isProgramComplete(const PendingProgram& pending)
+{
+	if (pending.fromCache || !GLExt::parallelShaderCompile)
+		return true;
+
+	int complete = 0;
+	glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete != 0;
+}
+
+// the first status query here waits for the driver if it is still compiling
+void Shader::finishProgram(const PendingProgram& pending, ShaderCache* cache)
+{
+	ID = pending.program;
+	if (pending.fromCache)
 	{
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+		reflectUniforms();
+		return;
 	}
 
-	//Shader program
-	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
-	glLinkProgram(ID);
-	checkCompileErrors(ID, "PROGRAM");
+	// print compile errors
+	checkCompileErrors(pending.vertex, "VERTEX");
+	checkCompileErrors(pending.fragment, "FRAGMENT");
 	//print linking errors if any
+	checkCompileErrors(ID, "PROGRAM");
+
+	int success;
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
-	if (!success)
-	{
-		glGetProgramInfoLog(ID, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-	}
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
+	glDeleteShader(pending.vertex);
+	glDeleteShader(pending.fragment);
+
+	if (cache && success)
+		cache->store(pending.cacheKey, ID);
+
+	reflectUniforms();
 }
 
 void Shader::use()
@@ -93,19 +178,188 @@ void Shader::use()
 	glUseProgram(ID);
 }
 
+int Shader::uniformLocation(const std::string& name) const
+{
+	return uniformLocation(MakeUniformId(name.c_str(), name.size()));
+}
+
+int Shader::uniformLocation(UniformId name) const
+{
+	Uniform* uniform = findUniform(name);
+	return uniform ? uniform->location : -1;
+}
+
 void Shader::setBool(const std::string& name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	setInt(MakeUniformId(name.c_str(), name.size()), (int)value);
 }
 
 void Shader::setInt(const std::string& name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	setInt(MakeUniformId(name.c_str(), name.size()), value);
 }
 
 void Shader::setFloat(const std::string& name, float value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	setFloat(MakeUniformId(name.c_str(), name.size()), value);
+}
+
+void Shader::setVec4(const std::string& name, float x, float y, float z, float w) const
+{
+	setVec4(MakeUniformId(name.c_str(), name.size()), x, y, z, w);
+}
+
+void Shader::setInt(UniformId name, int value) const
+{
+	Uniform* uniform = findUniform(name);
+	if (updateCache(uniform, &value, sizeof(value)))
+		glUniform1i(uniform->location, value);
+}
+
+void Shader::setFloat(UniformId name, float value) const
+{
+	Uniform* uniform = findUniform(name);
+	if (updateCache(uniform, &value, sizeof(value)))
+		glUniform1f(uniform->location, value);
+}
+
+void Shader::setVec2(UniformId name, float x, float y) const
+{
+	float value[2] = { x, y };
+	Uniform* uniform = findUniform(name);
+	if (updateCache(uniform, value, sizeof(value)))
+		glUniform2fv(uniform->location, 1, value);
+}
+
+void Shader::setVec3(UniformId name, float x, float y, float z) const
+{
+	float value[3] = { x, y, z };
+	Uniform* uniform = findUniform(name);
+	if (updateCache(uniform, value, sizeof(value)))
+		glUniform3fv(uniform->location, 1, value);
+}
+
+void Shader::setVec4(UniformId name, float x, float y, float z, float w) const
+{
+	float value[4] = { x, y, z, w };
+	Uniform* uniform = findUniform(name);
+	if (updateCache(uniform, value, sizeof(value)))
+		glUniform4fv(uniform->location, 1, value);
+}
+
+void Shader::setMat3(UniformId name, const float* value) const
+{
+	Uniform* uniform = findUniform(name);
+	if (updateCache(uniform, value, 9 * sizeof(float)))
+		glUniformMatrix3fv(uniform->location, 1, GL_FALSE, value);
+}
+
+void Shader::setMat4(UniformId name, const float* value) const
+{
+	Uniform* uniform = findUniform(name);
+	if (updateCache(uniform, value, 16 * sizeof(float)))
+		glUniformMatrix4fv(uniform->location, 1, GL_FALSE, value);
+}
+
+unsigned long long Shader::uploadedUniforms() const
+{
+	return uploads;
+}
+
+unsigned long long Shader::skippedUniforms() const
+{
+	return skips;
+}
+
+// ask the linked program for all of its active uniforms once, so setters never
+// have to go through glGetUniformLocation and its string lookup again
+void Shader::reflectUniforms()
+{
+	int count = 0;
+	int maxNameLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	// keep the table at most half full so probes stay short
+	uint32_t capacity = 8;
+	while (capacity < (uint32_t)count * 2)
+		capacity *= 2;
+	uniforms.assign(capacity, Uniform());
+	uniformMask = capacity - 1;
+
+	std::vector<char> name(maxNameLength > 0 ? maxNameLength : 1);
+	for (int i = 0; i < count; ++i)
+	{
+		int length = 0;
+		int arraySize = 0;
+		GLenum type = 0;
+		glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &arraySize, &type, name.data());
+
+		// uniforms in blocks have no location and can't be set this way
+		int location = glGetUniformLocation(ID, name.data());
+		if (location < 0)
+			continue;
+
+		// arrays are reported as "name[0]", look them up by their plain name
+		if (length > 3 && std::strcmp(&name[length - 3], "[0]") == 0)
+			length -= 3;
+
+		UniformId id = MakeUniformId(name.data(), (size_t)length);
+		uint32_t slot = id.hash & uniformMask;
+		bool collision = false;
+		while (uniforms[slot].hash != 0)
+		{
+			collision = collision || (uniforms[slot].hash == id.hash && uniforms[slot].check == id.check);
+			slot = (slot + 1) & uniformMask;
+		}
+		// both hashes equal would make the two names one uniform; the second stays unset
+		// rather than writing to the first one's location
+		if (collision)
+		{
+			std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION " << std::string(name.data(), length) << std::endl;
+			continue;
+		}
+
+		Uniform& uniform = uniforms[slot];
+		uniform.hash = id.hash;
+		uniform.check = id.check;
+		uniform.location = location;
+		uniform.type = type;
+		uniform.arraySize = arraySize;
+		uniform.hasValue = false;
+	}
+}
+
+Shader::Uniform* Shader::findUniform(UniformId name) const
+{
+	if (uniforms.empty())
+		return nullptr;
+
+	uint32_t slot = name.hash & uniformMask;
+	while (uniforms[slot].hash != 0)
+	{
+		if (uniforms[slot].hash == name.hash && uniforms[slot].check == name.check)
+			return &uniforms[slot];
+		slot = (slot + 1) & uniformMask;
+	}
+	return nullptr;
+}
+
+bool Shader::updateCache(Uniform* uniform, const void* data, size_t size) const
+{
+	// setting a uniform the program doesn't have is a no-op in GL too
+	if (!uniform)
+		return false;
+
+	if (uniform->hasValue && std::memcmp(uniform->value, data, size) == 0)
+	{
+		++skips;
+		return false;
+	}
+	std::memcpy(uniform->value, data, size);
+	uniform->hasValue = true;
+	++uploads;
+	return true;
 }
 
 void Shader::checkCompileErrors(unsigned int shader, std::string type)
@@ -1,20 +1,147 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
+
+class ShaderCache;
+class AssetPack;
+
+// 32-bit FNV-1a over a uniform name. constexpr so names hash at compile time
+constexpr uint32_t HashUniformName(const char* name, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= (uint8_t)name[i];
+		hash *= 16777619u;
+	}
+	// 0 marks an empty slot in the uniform table
+	return hash == 0 ? 1 : hash;
+}
+
+// a second, unrelated hash (djb2, xor variant) seeded with the length. lookups compare it
+// too, so two names sharing a HashUniformName can't be taken for each other
+constexpr uint32_t CheckUniformName(const char* name, size_t length)
+{
+	uint32_t check = 5381u + (uint32_t)length;
+	for (size_t i = 0; i < length; ++i)
+		check = (check * 33u) ^ (uint8_t)name[i];
+	return check;
+}
+
+// pre-hashed uniform name, write "transform"_uniform at the call site
+struct UniformId
+{
+	uint32_t hash;
+	uint32_t check;
+};
+
+constexpr UniformId MakeUniformId(const char* name, size_t length)
+{
+	return UniformId{ HashUniformName(name, length), CheckUniformName(name, length) };
+}
+
+constexpr UniformId operator"" _uniform(const char* name, size_t length)
+{
+	return MakeUniformId(name, length);
+}
+
+// program whose compile and link were submitted but not checked yet, see ShaderBatch
+struct PendingProgram
+{
+	unsigned int program;
+	unsigned int vertex;
+	unsigned int fragment;
+	uint64_t cacheKey;
+	bool fromCache;
+};
 
 class Shader
 {
 public:
 	unsigned int ID;
 
-	Shader(const char* vertexPath, const char* fragmentPath);
+	// with a cache the linked binary is reused across runs when the driver accepts it.
+	// with a pack, sources it holds are read from there and anything else from disk
+	Shader(const char* vertexPath, const char* fragmentPath, ShaderCache* cache = nullptr, const AssetPack* pack = nullptr);
+
+	// finish a program started with submitProgram, waits if the driver is still compiling it
+	Shader(const PendingProgram& pending, ShaderCache* cache);
+
+	// compute program from source that is already in memory, nullptr if it doesn't compile
+	// or link. needs GL 4.3 or ARB_compute_shader, and is always built from source
+	static std::shared_ptr<Shader> Compute(const std::string& computeCode);
+
+	static bool readSource(const char* path, std::string& code, const AssetPack* pack = nullptr);
+
+	static PendingProgram submitProgram(const std::string& vertexCode, const std::string& fragmentCode, ShaderCache* cache);
+
+	// true once finishing the program won't block, always true without KHR_parallel_shader_compile
+	static bool isProgramComplete(const PendingProgram& pending);
 
 	void use();
 
+	// -1 when the program has no active uniform by that name
+	int uniformLocation(const std::string& name) const;
+
+	int uniformLocation(UniformId name) const;
+
+	// setters expect the program to be bound and skip the upload
+	// when the uniform already holds that value
 	void setBool(const std::string& name, bool value) const;
 
 	void setInt(const std::string& name, int value) const;
 
 	void setFloat(const std::string& name, float value) const;
+
+	void setVec4(const std::string& name, float x, float y, float z, float w) const;
+
+	void setInt(UniformId name, int value) const;
+
+	void setFloat(UniformId name, float value) const;
+
+	void setVec2(UniformId name, float x, float y) const;
+
+	void setVec3(UniformId name, float x, float y, float z) const;
+
+	void setVec4(UniformId name, float x, float y, float z, float w) const;
+
+	// column-major, like glUniformMatrix with transpose off
+	void setMat3(UniformId name, const float* value) const;
+
+	void setMat4(UniformId name, const float* value) const;
+
+	// uniform uploads that actually reached GL vs. were dropped as redundant
+	unsigned long long uploadedUniforms() const;
+
+	unsigned long long skippedUniforms() const;
 private:
+	Shader();
+
+	// one active uniform found by reflection after link, along with the last value sent
+	struct Uniform
+	{
+		uint32_t hash;
+		uint32_t check;
+		int location;
+		unsigned int type;
+		int arraySize;
+		bool hasValue;
+		unsigned char value[64];
+	};
+
 	void checkCompileErrors(unsigned int shader, std::string type);
+	void finishProgram(const PendingProgram& pending, ShaderCache* cache);
+	void reflectUniforms();
+	Uniform* findUniform(UniformId name) const;
+	// compare against the cached value and remember the new one, false means skip the upload
+	bool updateCache(Uniform* uniform, const void* data, size_t size) const;
+
+	// open-addressed hash table keyed by name hash, size is a power of two
+	mutable std::vector<Uniform> uniforms;
+	uint32_t uniformMask;
+	mutable unsigned long long uploads;
+	mutable unsigned long long skips;
 };
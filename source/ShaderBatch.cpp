@@ -0,0 +1,125 @@
+#include "glad/glad.h"
+
+#include "ShaderBatch.h"
+#include "ShaderCache.h"
+#include "GLExtensions.h"
+#include "Hash.h"
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+ShaderBatch::ShaderBatch(ShaderCache* cache)
+	: cache(cache), wallMs(0.0), compiling(0), submitted(0), fromCache(0), deduplicated(0), polls(0)
+{
+	// let the driver use as many compiler threads as it likes
+	if (GLExt::parallelShaderCompile)
+		GLExt::MaxShaderCompilerThreads(0xFFFFFFFFu);
+}
+
+std::shared_future<std::shared_ptr<Shader>> ShaderBatch::add(const char* vertexPath, const char* fragmentPath)
+{
+	std::string vertexCode;
+	std::string fragmentCode;
+	if (!Shader::readSource(vertexPath, vertexCode) || !Shader::readSource(fragmentPath, fragmentCode))
+	{
+		std::promise<std::shared_ptr<Shader>> failed;
+		failed.set_value(nullptr);
+		return failed.get_future().share();
+	}
+	return addSource(vertexCode, fragmentCode);
+}
+
+std::shared_future<std::shared_ptr<Shader>> ShaderBatch::addSource(const std::string& vertexCode, const std::string& fragmentCode)
+{
+	uint64_t sourceHash = HashString64(fragmentCode, HashString64(vertexCode));
+	auto existing = bySource.find(sourceHash);
+	if (existing != bySource.end())
+	{
+		++deduplicated;
+		return existing->second;
+	}
+
+	if (submitted == 0)
+		firstSubmit = std::chrono::steady_clock::now();
+	++submitted;
+
+	std::promise<std::shared_ptr<Shader>> ready;
+	std::shared_future<std::shared_ptr<Shader>> future = ready.get_future().share();
+	bySource.emplace(sourceHash, future);
+
+	Entry entry;
+	entry.pending = Shader::submitProgram(vertexCode, fragmentCode, cache);
+	entry.ready = std::move(ready);
+	if (entry.pending.fromCache)
+	{
+		++fromCache;
+	}
+	else if (compiling++ == 0)
+	{
+		// the driver compiles side by side, so the cache is charged for the stretch
+		// while anything compiled, not per program
+		compileStart = std::chrono::steady_clock::now();
+	}
+	entries.push_back(std::move(entry));
+	return future;
+}
+
+size_t ShaderBatch::poll()
+{
+	++polls;
+	bool draining = !entries.empty();
+	size_t remaining = 0;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		Entry& entry = entries[i];
+		if (!Shader::isProgramComplete(entry.pending))
+		{
+			// keep the still-compiling ones packed at the front
+			if (remaining != i)
+				entries[remaining] = std::move(entry);
+			++remaining;
+			continue;
+		}
+		std::shared_ptr<Shader> shader = std::make_shared<Shader>(entry.pending, cache);
+		int success = 0;
+		glGetProgramiv(shader->ID, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glDeleteProgram(shader->ID);
+			shader = nullptr;
+		}
+		entry.ready.set_value(shader);
+
+		if (!entry.pending.fromCache && --compiling == 0 && cache)
+			cache->addCompileTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count());
+	}
+	entries.resize(remaining);
+
+	// once, on the poll that finished the last program
+	if (draining && entries.empty())
+		wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - firstSubmit).count();
+	return remaining;
+}
+
+void ShaderBatch::finish()
+{
+	while (poll() > 0)
+	{
+		// nothing else to do here, give the driver threads the core
+		std::this_thread::yield();
+	}
+}
+
+bool ShaderBatch::done() const
+{
+	return entries.empty();
+}
+
+void ShaderBatch::printStats() const
+{
+	char line[256];
+	std::snprintf(line, sizeof(line),
+		"shader batch: %u programs (%u from cache, %u duplicates skipped) ready in %.2f ms over %u polls, parallel compile %s",
+		submitted, fromCache, deduplicated, wallMs, polls, GLExt::parallelShaderCompile ? "on" : "unavailable");
+	std::cout << line << std::endl;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "Shader.h"
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ShaderCache;
+
+// builds many programs at once. add() submits compile and link right away without
+// any status queries, poll() picks up whatever the driver has finished. with
+// KHR_parallel_shader_compile the driver compiles on its own threads and poll() never
+// stalls; without it poll() finishes everything it has, which may block.
+// must be used on the thread that owns the GL context
+// -------------------------------------------------------------------------------------
+class ShaderBatch
+{
+public:
+	explicit ShaderBatch(ShaderCache* cache);
+
+	// becomes ready with the shader, or nullptr if the sources could not be read or the
+	// program did not link
+	std::shared_future<std::shared_ptr<Shader>> add(const char* vertexPath, const char* fragmentPath);
+
+	// same, for sources that are already in memory (e.g. preprocessed variants).
+	// identical sources submitted twice share one program
+	std::shared_future<std::shared_ptr<Shader>> addSource(const std::string& vertexCode, const std::string& fragmentCode);
+
+	// finish completed programs, returns how many are still compiling
+	size_t poll();
+
+	// block until every program is ready
+	void finish();
+
+	bool done() const;
+
+	void printStats() const;
+private:
+	struct Entry
+	{
+		PendingProgram pending;
+		std::promise<std::shared_ptr<Shader>> ready;
+	};
+
+	ShaderCache* cache;
+	std::vector<Entry> entries;
+	std::unordered_map<uint64_t, std::shared_future<std::shared_ptr<Shader>>> bySource;
+	std::chrono::steady_clock::time_point firstSubmit;
+	double wallMs;
+	// programs submitted without a cached binary that haven't finished, and since when
+	unsigned int compiling;
+	std::chrono::steady_clock::time_point compileStart;
+	unsigned int submitted;
+	unsigned int fromCache;
+	unsigned int deduplicated;
+	unsigned int polls;
+};
@@ -0,0 +1,164 @@
+#include "GLExtensions.h"
+
+#include "ShaderCache.h"
+#include "Hash.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	const uint32_t CACHE_MAGIC = 0x42504B53; // "SKPB"
+	const uint32_t CACHE_VERSION = 1;
+
+	struct CacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t format;
+		uint32_t length;
+	};
+
+	std::string GLString(GLenum name)
+	{
+		const GLubyte* value = glGetString(name);
+		return value ? std::string((const char*)value) : std::string();
+	}
+
+	double ElapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+ShaderCache::ShaderCache(const std::string& directory)
+	: directory(directory), driverHash(0), available(GLExt::programBinary),
+	hits(0), misses(0), rejected(0), loadMs(0.0), compileMs(0.0)
+{
+	uint64_t hash = HashBytes64(&CACHE_VERSION, sizeof(CACHE_VERSION));
+	hash = HashString64(GLString(GL_VENDOR), hash);
+	hash = HashString64(GLString(GL_RENDERER), hash);
+	hash = HashString64(GLString(GL_VERSION), hash);
+	driverHash = hash;
+}
+
+bool ShaderCache::enabled() const
+{
+	return available;
+}
+
+uint64_t ShaderCache::key(const std::string& vertexCode, const std::string& fragmentCode) const
+{
+	uint64_t hash = HashString64(vertexCode, driverHash);
+	return HashString64(fragmentCode, hash);
+}
+
+std::string ShaderCache::pathFor(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return directory + "/" + name;
+}
+
+bool ShaderCache::load(uint64_t key, unsigned int program)
+{
+	if (!available)
+	{
+		++misses;
+		return false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::string path = pathFor(key);
+	std::ifstream file(path, std::ios::binary);
+	CacheHeader header = {};
+	std::error_code error;
+	uintmax_t fileSize = std::filesystem::file_size(path, error);
+	// the length comes from disk, a truncated or corrupt file must not size the buffer
+	if (!file || error || fileSize < sizeof(header) || !file.read((char*)&header, sizeof(header)) ||
+		header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.key != key ||
+		header.length > fileSize - sizeof(header))
+	{
+		++misses;
+		return false;
+	}
+
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), header.length))
+	{
+		++misses;
+		return false;
+	}
+
+	GLExt::ProgramBinary(program, header.format, binary.data(), (GLsizei)header.length);
+	int success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		// driver changed its mind about the binary (e.g. internal update), rebuild it
+		++rejected;
+		++misses;
+		return false;
+	}
+
+	++hits;
+	loadMs += ElapsedMs(start);
+	return true;
+}
+
+void ShaderCache::store(uint64_t key, unsigned int program)
+{
+	if (!available)
+		return;
+
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLExt::GetProgramBinary(program, length, &length, &format, binary.data());
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	// write to a temporary name first so a crash never leaves a half-written entry behind
+	std::string path = pathFor(key);
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		CacheHeader header = { CACHE_MAGIC, CACHE_VERSION, key, format, (uint32_t)length };
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), length);
+		if (!file)
+		{
+			std::cout << "ERROR::SHADER_CACHE::WRITE_FAILED " << path << std::endl;
+			return;
+		}
+	}
+	std::filesystem::rename(temporary, path, error);
+	if (error)
+		std::cout << "ERROR::SHADER_CACHE::WRITE_FAILED " << path << std::endl;
+}
+
+void ShaderCache::addCompileTime(double ms)
+{
+	compileMs += ms;
+}
+
+void ShaderCache::printStats() const
+{
+	unsigned int total = hits + misses;
+	char line[256];
+	std::snprintf(line, sizeof(line),
+		"shader cache: %s, %u programs, %u hits (%.0f%%), %u misses (%u rejected), binary load %.2f ms, compile %.2f ms",
+		available ? "on" : "unsupported by driver", total, hits,
+		total ? 100.0 * hits / total : 0.0, misses, rejected, loadMs, compileMs);
+	std::cout << line << std::endl;
+}
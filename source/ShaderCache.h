@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// on-disk cache of linked program binaries (glGetProgramBinary).
+// entries are keyed by a hash of the exact sources handed to the compiler plus the
+// driver's vendor/renderer/version strings, so a driver update never loads stale binaries.
+// a binary the driver rejects is treated as a miss and rebuilt from source
+// ---------------------------------------------------------------------------------------
+class ShaderCache
+{
+public:
+	// directory is created on first store, needs a current context for the driver strings
+	explicit ShaderCache(const std::string& directory);
+
+	bool enabled() const;
+
+	uint64_t key(const std::string& vertexCode, const std::string& fragmentCode) const;
+
+	// try to fill program from the cache, true if it linked successfully
+	bool load(uint64_t key, unsigned int program);
+
+	// write program's binary for next time
+	void store(uint64_t key, unsigned int program);
+
+	// the time it took to build a program from source, for the startup report
+	void addCompileTime(double ms);
+
+	void printStats() const;
+private:
+	std::string pathFor(uint64_t key) const;
+
+	std::string directory;
+	uint64_t driverHash;
+	bool available;
+
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int rejected;
+	double loadMs;
+	double compileMs;
+};
@@ -0,0 +1,183 @@
+#include "ShaderPreprocessor.h"
+#include "Shader.h"
+#include <cctype>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	const int MAX_INCLUDE_DEPTH = 16;
+
+	std::string DirectoryOf(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	// the directive name if the line is "#name ...", with any whitespace around the '#'
+	std::string Directive(const std::string& line, size_t& argumentStart)
+	{
+		size_t i = line.find_first_not_of(" \t");
+		if (i == std::string::npos || line[i] != '#')
+			return std::string();
+		i = line.find_first_not_of(" \t", i + 1);
+		if (i == std::string::npos)
+			return std::string();
+		size_t end = i;
+		while (end < line.size() && std::isalpha((unsigned char)line[end]))
+			++end;
+		argumentStart = end;
+		return line.substr(i, end - i);
+	}
+
+	bool IsIdentifierChar(char c)
+	{
+		return std::isalnum((unsigned char)c) || c == '_';
+	}
+
+	bool ContainsWord(const std::string& text, const std::string& word)
+	{
+		size_t at = text.find(word);
+		while (at != std::string::npos)
+		{
+			bool startOk = at == 0 || !IsIdentifierChar(text[at - 1]);
+			bool endOk = at + word.size() >= text.size() || !IsIdentifierChar(text[at + word.size()]);
+			if (startOk && endOk)
+				return true;
+			at = text.find(word, at + 1);
+		}
+		return false;
+	}
+}
+
+ShaderPreprocessor::ShaderPreprocessor(const AssetPack* pack)
+	: pack(pack)
+{
+}
+
+const std::string* ShaderPreprocessor::load(const std::string& path)
+{
+	auto found = files.find(path);
+	if (found != files.end())
+		return &found->second;
+
+	std::string code;
+	if (!Shader::readSource(path.c_str(), code, pack))
+		return nullptr;
+	return &files.emplace(path, std::move(code)).first->second;
+}
+
+size_t ShaderPreprocessor::fileIndex(const std::string& path)
+{
+	for (size_t i = 0; i < fileNames.size(); ++i)
+	{
+		if (fileNames[i] == path)
+			return i;
+	}
+	fileNames.push_back(path);
+	return fileNames.size() - 1;
+}
+
+const std::string& ShaderPreprocessor::fileName(size_t index) const
+{
+	return fileNames[index];
+}
+
+bool ShaderPreprocessor::expand(const std::string& path, std::string& output, int depth)
+{
+	if (depth > MAX_INCLUDE_DEPTH)
+	{
+		std::cout << "ERROR::SHADER::PREPROCESSOR::INCLUDE_TOO_DEEP " << path << std::endl;
+		return false;
+	}
+
+	const std::string* source = load(path);
+	if (!source)
+		return false;
+
+	size_t index = fileIndex(path);
+	std::istringstream lines(*source);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(lines, line))
+	{
+		++lineNumber;
+		size_t argument = 0;
+		std::string directive = Directive(line, argument);
+
+		if (directive == "pragma" && line.find("once", argument) != std::string::npos)
+		{
+			if (!included.insert(path).second)
+				return true;
+			output += "\n";
+			continue;
+		}
+
+		if (directive != "include")
+		{
+			output += line;
+			output += "\n";
+			continue;
+		}
+
+		size_t open = line.find('"', argument);
+		size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+		if (close == std::string::npos)
+		{
+			std::cout << "ERROR::SHADER::PREPROCESSOR::BAD_INCLUDE " << path << ":" << lineNumber << std::endl;
+			return false;
+		}
+
+		std::string includePath = DirectoryOf(path) + line.substr(open + 1, close - open - 1);
+		output += "#line 1 " + std::to_string(fileIndex(includePath)) + "\n";
+		if (!expand(includePath, output, depth + 1))
+			return false;
+		output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(index) + "\n";
+	}
+	return true;
+}
+
+bool ShaderPreprocessor::process(const std::string& path, const std::vector<std::string>& defines, std::string& output)
+{
+	std::string body;
+	included.clear();
+	if (!expand(path, body, 0))
+		return false;
+
+	// #version has to stay the first thing the compiler sees, defines go right after it
+	size_t insertAt = 0;
+	int versionLine = 0;
+	size_t version = body.find("#version");
+	if (version != std::string::npos)
+	{
+		size_t lineEnd = body.find('\n', version);
+		insertAt = lineEnd == std::string::npos ? body.size() : lineEnd + 1;
+		for (size_t i = 0; i < insertAt; ++i)
+			versionLine += body[i] == '\n';
+	}
+
+	std::string injected;
+	for (const std::string& define : defines)
+		injected += "#define " + define + " 1\n";
+	if (!injected.empty())
+		injected += "#line " + std::to_string(versionLine + 1) + " " + std::to_string(fileIndex(path)) + "\n";
+
+	output = body.substr(0, insertAt) + injected + body.substr(insertAt);
+	return true;
+}
+
+uint32_t ShaderPreprocessor::usedFeatures(const std::string& path, const std::vector<std::string>& features)
+{
+	std::string body;
+	included.clear();
+	if (!expand(path, body, 0))
+		return 0;
+
+	uint32_t mask = 0;
+	for (size_t i = 0; i < features.size() && i < 32; ++i)
+	{
+		if (ContainsWord(body, features[i]))
+			mask |= 1u << i;
+	}
+	return mask;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class AssetPack;
+
+// GLSL front end: expands #include "file" (relative to the including file), honors
+// #pragma once, and injects #defines right after #version. #line directives are emitted
+// so driver errors point at the right line; the second number is the index of the
+// file in fileName()
+// -------------------------------------------------------------------------------------
+class ShaderPreprocessor
+{
+public:
+	// files in the pack are read from it, everything else from disk
+	explicit ShaderPreprocessor(const AssetPack* pack = nullptr);
+
+	// false if a file couldn't be read or includes nest too deep
+	bool process(const std::string& path, const std::vector<std::string>& defines, std::string& output);
+
+	// bit i is set when features[i] appears as a word anywhere in the file or its includes
+	uint32_t usedFeatures(const std::string& path, const std::vector<std::string>& features);
+
+	const std::string& fileName(size_t index) const;
+private:
+	bool expand(const std::string& path, std::string& output, int depth);
+	const std::string* load(const std::string& path);
+	size_t fileIndex(const std::string& path);
+
+	const AssetPack* pack;
+	// sources stay loaded so every variant doesn't read them again
+	std::unordered_map<std::string, std::string> files;
+	std::vector<std::string> fileNames;
+	std::unordered_set<std::string> included;
+};
@@ -0,0 +1,54 @@
+#include "ShaderVariants.h"
+#include "ShaderBatch.h"
+#include "ShaderPreprocessor.h"
+
+ShaderVariants::ShaderVariants(ShaderPreprocessor& preprocessor, const std::string& vertexPath,
+	const std::string& fragmentPath, const std::vector<std::string>& features)
+	: preprocessor(preprocessor), vertexPath(vertexPath), fragmentPath(fragmentPath), features(features), used(0)
+{
+	used = preprocessor.usedFeatures(vertexPath, features) | preprocessor.usedFeatures(fragmentPath, features);
+}
+
+std::shared_future<std::shared_ptr<Shader>> ShaderVariants::request(ShaderBatch& batch, uint32_t mask)
+{
+	mask &= used;
+	auto existing = variants.find(mask);
+	if (existing != variants.end())
+		return existing->second;
+
+	std::vector<std::string> defines;
+	for (size_t i = 0; i < features.size() && i < 32; ++i)
+	{
+		if (mask & (1u << i))
+			defines.push_back(features[i]);
+	}
+
+	std::shared_future<std::shared_ptr<Shader>> variant;
+	std::string vertexCode;
+	std::string fragmentCode;
+	if (preprocessor.process(vertexPath, defines, vertexCode) &&
+		preprocessor.process(fragmentPath, defines, fragmentCode))
+	{
+		// the batch also folds together variants whose expanded code comes out identical
+		variant = batch.addSource(vertexCode, fragmentCode);
+	}
+	else
+	{
+		std::promise<std::shared_ptr<Shader>> failed;
+		failed.set_value(nullptr);
+		variant = failed.get_future().share();
+	}
+
+	variants.emplace(mask, variant);
+	return variant;
+}
+
+uint32_t ShaderVariants::usedMask() const
+{
+	return used;
+}
+
+size_t ShaderVariants::variantCount() const
+{
+	return variants.size();
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "Shader.h"
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ShaderBatch;
+class ShaderPreprocessor;
+
+// every permutation of one vertex/fragment pair. a variant is chosen by a bitmask
+// over the feature names given here, bit i turning on "#define features[i] 1".
+// only variants that are actually requested get compiled
+// -------------------------------------------------------------------------------
+class ShaderVariants
+{
+public:
+	ShaderVariants(ShaderPreprocessor& preprocessor, const std::string& vertexPath,
+		const std::string& fragmentPath, const std::vector<std::string>& features);
+
+	// features the sources never mention are dropped from the mask first,
+	// so masks that only differ in those end up sharing one program
+	std::shared_future<std::shared_ptr<Shader>> request(ShaderBatch& batch, uint32_t features);
+
+	// features that actually change the generated code
+	uint32_t usedMask() const;
+
+	size_t variantCount() const;
+private:
+	ShaderPreprocessor& preprocessor;
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::vector<std::string> features;
+	uint32_t used;
+	std::unordered_map<uint32_t, std::shared_future<std::shared_ptr<Shader>>> variants;
+};
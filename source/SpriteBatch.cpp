@@ -0,0 +1,138 @@
+#include "glad/glad.h"
+
+#include "SpriteBatch.h"
+#include "RenderCommands.h"
+#include "Shader.h"
+#include "StreamBuffer.h"
+#include <cstring>
+#include <iostream>
+
+SpriteBatch::SpriteBatch(StreamBuffer& stream, size_t instancesPerDraw)
+	: stream(stream), count(0), instancesPerDraw(instancesPerDraw), dropped(0),
+	VAO(0), cornerVBO(0), EBO(0)
+{
+	spans.reserve(16);
+}
+
+void SpriteBatch::createResources()
+{
+	float corners[] =
+	{
+		-0.5f, -0.5f,
+		 0.5f, -0.5f,
+		 0.5f,  0.5f,
+		-0.5f,  0.5f
+	};
+	unsigned int indices[] = { 0, 1, 2, 2, 3, 0 };
+
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &cornerVBO);
+	glGenBuffers(1, &EBO);
+
+	glBindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, cornerVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	// per-instance attributes advance once per quad instead of once per vertex.
+	// they point into the stream buffer, which moves every draw, so record() sets them
+	for (unsigned int attribute = 1; attribute <= 4; ++attribute)
+	{
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribDivisor(attribute, 1);
+	}
+
+	glBindVertexArray(0);
+}
+
+void SpriteBatch::destroyResources()
+{
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &cornerVBO);
+	glDeleteBuffers(1, &EBO);
+}
+
+void SpriteBatch::begin()
+{
+	spans.clear();
+	count = 0;
+}
+
+void SpriteBatch::add(const SpriteInstance& sprite)
+{
+	SpriteInstance* slot = allocate(1);
+	if (slot)
+		*slot = sprite;
+}
+
+SpriteInstance* SpriteBatch::allocate(size_t spriteCount)
+{
+	StreamAllocation allocation = stream.allocate(spriteCount * sizeof(SpriteInstance), 16);
+	if (!allocation.data)
+	{
+		dropped += spriteCount;
+		return nullptr;
+	}
+
+	// sprites added one at a time usually land right after the previous ones
+	if (!spans.empty() && spans.back().offset + spans.back().count * sizeof(SpriteInstance) == allocation.offset)
+		spans.back().count += spriteCount;
+	else
+		spans.push_back(Span{ allocation.offset, spriteCount });
+
+	count += spriteCount;
+	return static_cast<SpriteInstance*>(allocation.data);
+}
+
+void SpriteBatch::record(RenderCommandBuffer& commands, const Shader* shader, unsigned int textureArray, int width, int height)
+{
+	if (count == 0)
+		return;
+
+	commands.blend(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	commands.useProgram(shader->ID);
+	// pixels to clip space
+	commands.uniform4f(shader, "view"_uniform, 2.0f / (float)width, 2.0f / (float)height, -1.0f, -1.0f);
+	commands.bindTexture(0, GL_TEXTURE_2D_ARRAY, textureArray);
+	commands.bindVertexArray(VAO);
+
+	// GL 3.3 has no base instance, so every draw re-points the instance attributes
+	const int stride = (int)sizeof(SpriteInstance);
+	unsigned int buffer = stream.buffer();
+	for (const Span& span : spans)
+	{
+		for (size_t first = 0; first < span.count; first += instancesPerDraw)
+		{
+			size_t batch = span.count - first < instancesPerDraw ? span.count - first : instancesPerDraw;
+			size_t base = span.offset + first * sizeof(SpriteInstance);
+
+			// position and size
+			commands.vertexAttribPointer(1, 4, GL_FLOAT, false, stride, buffer, base + offsetof(SpriteInstance, position));
+			// uv rect
+			commands.vertexAttribPointer(2, 4, GL_FLOAT, false, stride, buffer, base + offsetof(SpriteInstance, uvRect));
+			// rotation and layer
+			commands.vertexAttribPointer(3, 2, GL_FLOAT, false, stride, buffer, base + offsetof(SpriteInstance, rotation));
+			// tint
+			commands.vertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, true, stride, buffer, base + offsetof(SpriteInstance, tint));
+
+			commands.drawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, (int)batch);
+		}
+	}
+
+	commands.blend(false, GL_ONE, GL_ZERO);
+}
+
+size_t SpriteBatch::size() const
+{
+	return count;
+}
+
+size_t SpriteBatch::droppedSprites() const
+{
+	return dropped;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Shader;
+class RenderCommandBuffer;
+class StreamBuffer;
+
+// one quad as the sprite shader sees it, streamed as a per-instance vertex attribute
+struct SpriteInstance
+{
+	// center and size in pixels, origin at the bottom left of the viewport
+	float position[2];
+	float size[2];
+	// u0, v0, u1, v1 into the texture layer
+	float uvRect[4];
+	float rotation;
+	float layer;
+	// RGBA8, red in the lowest byte
+	uint32_t tint;
+	uint32_t padding;
+};
+
+// instanced quad renderer for UI and particles. sprites are written on the main thread
+// straight into a StreamBuffer and go out as one glDrawElementsInstanced per
+// instancesPerDraw sprites, so a frame costs no copies beyond filling the instances
+// -----------------------------------------------------------------------------------------
+class SpriteBatch
+{
+public:
+	SpriteBatch(StreamBuffer& stream, size_t instancesPerDraw);
+
+	// render thread: build and free the vertex array and buffers
+	void createResources();
+	void destroyResources();
+
+	// main thread: start gathering sprites for a new frame, after the stream's beginFrame()
+	void begin();
+
+	void add(const SpriteInstance& sprite);
+
+	// room for count sprites written in place, nullptr when the stream is full
+	SpriteInstance* allocate(size_t count);
+
+	// draws everything gathered since begin() with a 2D array texture on unit 0
+	void record(RenderCommandBuffer& commands, const Shader* shader, unsigned int textureArray, int width, int height);
+
+	size_t size() const;
+
+	size_t droppedSprites() const;
+private:
+	// sprites that sit back to back in the stream
+	struct Span
+	{
+		size_t offset;
+		size_t count;
+	};
+
+	StreamBuffer& stream;
+	std::vector<Span> spans;
+	size_t count;
+	size_t instancesPerDraw;
+	size_t dropped;
+
+	unsigned int VAO;
+	unsigned int cornerVBO;
+	unsigned int EBO;
+};
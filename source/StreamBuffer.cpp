@@ -0,0 +1,155 @@
+#include "StreamBuffer.h"
+#include "GLExtensions.h"
+#include "GLStateCache.h"
+#include "RenderCommands.h"
+#include <iostream>
+
+StreamBuffer::StreamBuffer(unsigned int target, size_t frameBytes)
+	: target(target), frameBytes(frameBytes), id(0), isPersistent(false), mapped(nullptr), staging(nullptr),
+	fences(), used(), region(0), frame(0), cursor(0), stallCount(0), dropped(0)
+{
+}
+
+void StreamBuffer::createResources()
+{
+	glGenBuffers(1, &id);
+	glBindBuffer(target, id);
+
+	if (GLExt::bufferStorage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLsizeiptr size = (GLsizeiptr)(frameBytes * REGIONS);
+		GLExt::BufferStorage(target, size, nullptr, flags);
+		mapped = (unsigned char*)glMapBufferRange(target, 0, size, flags);
+		if (mapped)
+		{
+			isPersistent = true;
+			return;
+		}
+
+		// storage is immutable, so start over with a plain buffer
+		std::cout << "ERROR::STREAM_BUFFER::PERSISTENT_MAP_FAILED falling back to orphaning" << std::endl;
+		glDeleteBuffers(1, &id);
+		glGenBuffers(1, &id);
+		glBindBuffer(target, id);
+	}
+
+	glBufferData(target, (GLsizeiptr)frameBytes, nullptr, GL_STREAM_DRAW);
+	staging = new unsigned char[frameBytes * REGIONS];
+}
+
+void StreamBuffer::destroyResources()
+{
+	for (unsigned int i = 0; i < REGIONS; ++i)
+	{
+		if (fences[i])
+			glDeleteSync(fences[i]);
+		fences[i] = nullptr;
+	}
+
+	if (isPersistent)
+	{
+		glBindBuffer(target, id);
+		glUnmapBuffer(target);
+	}
+	glDeleteBuffers(1, &id);
+	id = 0;
+	mapped = nullptr;
+
+	delete[] staging;
+	staging = nullptr;
+}
+
+void StreamBuffer::beginFrame(RenderCommandBuffer& commands)
+{
+	region = (unsigned int)(frame % REGIONS);
+	++frame;
+	cursor = 0;
+
+	// the size is read when the command is replayed, after endFrame() has set it
+	if (!isPersistent)
+		commands.streamUpload(this, region);
+}
+
+StreamAllocation StreamBuffer::allocate(size_t bytes, size_t alignment)
+{
+	size_t start = (cursor + alignment - 1) & ~(alignment - 1);
+	if (start + bytes > frameBytes)
+	{
+		dropped += bytes;
+		return StreamAllocation{ nullptr, 0 };
+	}
+	cursor = start + bytes;
+
+	size_t regionStart = region * frameBytes;
+	unsigned char* base = isPersistent ? mapped : staging;
+	// orphaned buffers only ever hold the current frame, so offsets start at zero
+	size_t offset = isPersistent ? regionStart + start : start;
+	return StreamAllocation{ base + regionStart + start, offset };
+}
+
+void StreamBuffer::endFrame(RenderCommandBuffer& commands)
+{
+	used[region] = cursor;
+	if (isPersistent)
+		commands.streamRetire(this, region);
+}
+
+unsigned int StreamBuffer::buffer() const
+{
+	return id;
+}
+
+bool StreamBuffer::persistent() const
+{
+	return isPersistent;
+}
+
+void StreamBuffer::upload(GLStateCache& state, unsigned int uploadRegion)
+{
+	if (used[uploadRegion] == 0)
+		return;
+
+	state.bindBuffer(target, id);
+	glBufferData(target, (GLsizeiptr)frameBytes, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(target, 0, (GLsizeiptr)used[uploadRegion], staging + uploadRegion * frameBytes);
+}
+
+// fence this frame's region, then make sure the GPU is done with the previous one.
+// the main thread only starts writing that region again after this frame is replayed,
+// so with three regions the GPU can run a full frame behind without the CPU waiting
+void StreamBuffer::retire(unsigned int retiredRegion)
+{
+	fences[retiredRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	unsigned int previous = (retiredRegion + REGIONS - 1) % REGIONS;
+	GLsync fence = fences[previous];
+	if (!fence)
+		return;
+
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		++stallCount;
+		const GLuint64 ONE_SECOND = 1000000000ull;
+		do
+		{
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, ONE_SECOND);
+		} while (status == GL_TIMEOUT_EXPIRED);
+	}
+	if (status == GL_WAIT_FAILED)
+		std::cout << "ERROR::STREAM_BUFFER::FENCE_WAIT_FAILED" << std::endl;
+
+	glDeleteSync(fence);
+	fences[previous] = nullptr;
+}
+
+unsigned long long StreamBuffer::stalls() const
+{
+	return stallCount;
+}
+
+size_t StreamBuffer::droppedBytes() const
+{
+	return dropped;
+}
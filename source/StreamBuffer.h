@@ -0,0 +1,71 @@
+#pragma once
+#include "glad/glad.h"
+#include <cstddef>
+
+class RenderCommandBuffer;
+class GLStateCache;
+
+// where an allocation went: data is written on the main thread, offset is what draws
+// use to find it in buffer(). data is nullptr when the frame ran out of room
+struct StreamAllocation
+{
+	void* data;
+	size_t offset;
+};
+
+// ring of REGIONS per-frame regions for dynamic vertex and uniform data. each frame bump
+// allocates from its own region and the main thread writes straight into it.
+// with GL 4.4 / ARB_buffer_storage the buffer is mapped once, persistent and coherent, and
+// a fence per region keeps the CPU from overwriting what the GPU hasn't read yet.
+// on plain 3.3 regions live in system memory and are copied into an orphaned buffer
+// at the start of each replayed frame instead
+// -----------------------------------------------------------------------------------------
+class StreamBuffer
+{
+public:
+	static const unsigned int REGIONS = 3;
+
+	StreamBuffer(unsigned int target, size_t frameBytes);
+
+	// render thread: create (and map) the buffer, or free it
+	void createResources();
+	void destroyResources();
+
+	// main thread: switch to the next region, recording whatever the render thread
+	// needs to do first. data allocated this frame is valid until endFrame()
+	void beginFrame(RenderCommandBuffer& commands);
+
+	StreamAllocation allocate(size_t bytes, size_t alignment);
+
+	// main thread: close the region, recording the fence that guards it
+	void endFrame(RenderCommandBuffer& commands);
+
+	unsigned int buffer() const;
+
+	bool persistent() const;
+
+	// render thread, called while replaying the commands recorded above
+	void upload(GLStateCache& state, unsigned int region);
+	void retire(unsigned int region);
+
+	// how often the render thread had to wait for the GPU to free a region
+	unsigned long long stalls() const;
+
+	size_t droppedBytes() const;
+private:
+	unsigned int target;
+	size_t frameBytes;
+	unsigned int id;
+	bool isPersistent;
+	unsigned char* mapped;
+	unsigned char* staging;
+
+	GLsync fences[REGIONS];
+	size_t used[REGIONS];
+	unsigned int region;
+	unsigned long long frame;
+	size_t cursor;
+
+	unsigned long long stallCount;
+	size_t dropped;
+};
@@ -0,0 +1,313 @@
+#include "TextureFile.h"
+#include "MipChain.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	const unsigned char IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// identifier, then the fixed header fields and the index, see the KTX 2.0 spec
+	struct Header
+	{
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+
+	struct LevelIndex
+	{
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	const size_t HEADER_OFFSET = sizeof(IDENTIFIER);
+	const size_t LEVEL_INDEX_OFFSET = HEADER_OFFSET + sizeof(Header);
+
+	uint32_t VkFormat(TextureFormat format, bool srgb)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC1:
+			return srgb ? KTX2::VK_FORMAT_BC1_RGBA_SRGB_BLOCK : KTX2::VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+		case TextureFormat::BC3:
+			return srgb ? KTX2::VK_FORMAT_BC3_SRGB_BLOCK : KTX2::VK_FORMAT_BC3_UNORM_BLOCK;
+		case TextureFormat::BC4:
+			return KTX2::VK_FORMAT_BC4_UNORM_BLOCK;
+		case TextureFormat::BC5:
+			return KTX2::VK_FORMAT_BC5_UNORM_BLOCK;
+		case TextureFormat::BC7:
+			return srgb ? KTX2::VK_FORMAT_BC7_SRGB_BLOCK : KTX2::VK_FORMAT_BC7_UNORM_BLOCK;
+		case TextureFormat::RGBA8:
+			break;
+		}
+		return srgb ? KTX2::VK_FORMAT_R8G8B8A8_SRGB : KTX2::VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	bool FromVkFormat(uint32_t vkFormat, TextureFormat& format, bool& srgb)
+	{
+		switch (vkFormat)
+		{
+		case KTX2::VK_FORMAT_R8G8B8A8_UNORM: format = TextureFormat::RGBA8; srgb = false; return true;
+		case KTX2::VK_FORMAT_R8G8B8A8_SRGB: format = TextureFormat::RGBA8; srgb = true; return true;
+		case KTX2::VK_FORMAT_BC1_RGBA_UNORM_BLOCK: format = TextureFormat::BC1; srgb = false; return true;
+		case KTX2::VK_FORMAT_BC1_RGBA_SRGB_BLOCK: format = TextureFormat::BC1; srgb = true; return true;
+		case KTX2::VK_FORMAT_BC3_UNORM_BLOCK: format = TextureFormat::BC3; srgb = false; return true;
+		case KTX2::VK_FORMAT_BC3_SRGB_BLOCK: format = TextureFormat::BC3; srgb = true; return true;
+		case KTX2::VK_FORMAT_BC4_UNORM_BLOCK: format = TextureFormat::BC4; srgb = false; return true;
+		case KTX2::VK_FORMAT_BC5_UNORM_BLOCK: format = TextureFormat::BC5; srgb = false; return true;
+		case KTX2::VK_FORMAT_BC7_UNORM_BLOCK: format = TextureFormat::BC7; srgb = false; return true;
+		case KTX2::VK_FORMAT_BC7_SRGB_BLOCK: format = TextureFormat::BC7; srgb = true; return true;
+		}
+		return false;
+	}
+
+	// basic data format descriptor. RGBA8 has one 8-bit sample per channel in byte order,
+	// block formats one sample per 64-bit half of the block, as the KDFS tables list them
+	void AppendDescriptor(std::vector<uint32_t>& words, TextureFormat format, bool srgb)
+	{
+		const uint32_t MODEL_RGBSDA = 1;
+		const uint32_t MODEL_BC1A = 128;
+		const uint32_t MODEL_BC3 = 130;
+		const uint32_t MODEL_BC4 = 131;
+		const uint32_t MODEL_BC5 = 132;
+		const uint32_t MODEL_BC7 = 134;
+		const uint32_t PRIMARIES_BT709 = 1;
+		const uint32_t TRANSFER = srgb ? 2 : 1;
+		const uint32_t QUALIFIER_LINEAR = 0x10;
+		const uint32_t CHANNEL_ALPHA = 15;
+
+		struct Sample
+		{
+			uint32_t bitOffset;
+			uint32_t bitLength;
+			uint32_t channel;
+			uint32_t upper;
+		};
+		Sample samples[4];
+		uint32_t sampleCount = 0;
+		uint32_t model = MODEL_RGBSDA;
+		uint32_t blockDimensions = 0;
+		switch (format)
+		{
+		case TextureFormat::RGBA8:
+			samples[sampleCount++] = { 0, 8, 0, 255 };
+			samples[sampleCount++] = { 8, 8, 1, 255 };
+			samples[sampleCount++] = { 16, 8, 2, 255 };
+			samples[sampleCount++] = { 24, 8, CHANNEL_ALPHA, 255 };
+			break;
+		case TextureFormat::BC1:
+			model = MODEL_BC1A;
+			// channel 1 is "alpha present"
+			samples[sampleCount++] = { 0, 64, 1, 0xFFFFFFFF };
+			break;
+		case TextureFormat::BC3:
+			model = MODEL_BC3;
+			samples[sampleCount++] = { 0, 64, CHANNEL_ALPHA, 0xFFFFFFFF };
+			samples[sampleCount++] = { 64, 64, 0, 0xFFFFFFFF };
+			break;
+		case TextureFormat::BC4:
+			model = MODEL_BC4;
+			samples[sampleCount++] = { 0, 64, 0, 0xFFFFFFFF };
+			break;
+		case TextureFormat::BC5:
+			model = MODEL_BC5;
+			samples[sampleCount++] = { 0, 64, 0, 0xFFFFFFFF };
+			samples[sampleCount++] = { 64, 64, 1, 0xFFFFFFFF };
+			break;
+		case TextureFormat::BC7:
+			model = MODEL_BC7;
+			samples[sampleCount++] = { 0, 128, 0, 0xFFFFFFFF };
+			break;
+		}
+		if (format != TextureFormat::RGBA8)
+			blockDimensions = 3 | (3 << 8);
+
+		const uint32_t BLOCK_SIZE = 24 + 16 * sampleCount;
+		words.push_back(4 + BLOCK_SIZE);
+		words.push_back(0);
+		words.push_back((BLOCK_SIZE << 16) | 2);
+		words.push_back(model | (PRIMARIES_BT709 << 8) | (TRANSFER << 16));
+		words.push_back(blockDimensions);
+		words.push_back((uint32_t)BlockBytes(format));
+		words.push_back(0);
+		for (uint32_t i = 0; i < sampleCount; ++i)
+		{
+			uint32_t channel = samples[i].channel;
+			// alpha stays linear in an srgb image
+			if (srgb && channel == CHANNEL_ALPHA)
+				channel |= QUALIFIER_LINEAR;
+			words.push_back(samples[i].bitOffset | ((samples[i].bitLength - 1) << 16) | (channel << 24));
+			words.push_back(0);
+			words.push_back(0);
+			words.push_back(samples[i].upper);
+		}
+	}
+
+	// levels start on a multiple of both the block size and 4
+	size_t AlignLevel(size_t value, TextureFormat format)
+	{
+		size_t alignment = BlockBytes(format) > 4 ? BlockBytes(format) : 4;
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	size_t Align4(size_t value)
+	{
+		return (value + 3) & ~(size_t)3;
+	}
+}
+
+bool KTX2::Write(const std::string& path, const std::vector<MipLevel>& levels, TextureFormat format, bool srgb)
+{
+	if (levels.empty())
+		return false;
+	if (format == TextureFormat::BC4 || format == TextureFormat::BC5)
+		srgb = false;
+
+	std::vector<uint32_t> descriptor;
+	AppendDescriptor(descriptor, format, srgb);
+
+	const char WRITER_KEY[] = "KTXwriter";
+	const char WRITER_VALUE[] = "Sakura texcook";
+	uint32_t keyValueLength = (uint32_t)(sizeof(WRITER_KEY) + sizeof(WRITER_VALUE));
+
+	Header header = {};
+	header.vkFormat = VkFormat(format, srgb);
+	header.typeSize = 1;
+	header.pixelWidth = (uint32_t)levels[0].width;
+	header.pixelHeight = (uint32_t)levels[0].height;
+	header.faceCount = 1;
+	header.levelCount = (uint32_t)levels.size();
+	header.dfdByteOffset = (uint32_t)(LEVEL_INDEX_OFFSET + levels.size() * sizeof(LevelIndex));
+	header.dfdByteLength = (uint32_t)(descriptor.size() * sizeof(uint32_t));
+	header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+	header.kvdByteLength = (uint32_t)Align4(sizeof(uint32_t) + keyValueLength);
+
+	// the spec wants the smallest level first in the file
+	std::vector<LevelIndex> index(levels.size());
+	size_t offset = AlignLevel(header.kvdByteOffset + header.kvdByteLength, format);
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		index[i].byteOffset = offset;
+		index[i].byteLength = levels[i].pixels.size();
+		index[i].uncompressedByteLength = levels[i].pixels.size();
+		offset = AlignLevel(offset + levels[i].pixels.size(), format);
+	}
+
+	std::filesystem::path target(path);
+	std::error_code error;
+	if (target.has_parent_path())
+		std::filesystem::create_directories(target.parent_path(), error);
+
+	// written next to the target and renamed, so readers never see half a file
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		const char zeros[16] = {};
+		file.write((const char*)IDENTIFIER, sizeof(IDENTIFIER));
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)index.data(), (std::streamsize)(index.size() * sizeof(LevelIndex)));
+		file.write((const char*)descriptor.data(), header.dfdByteLength);
+		file.write((const char*)&keyValueLength, sizeof(keyValueLength));
+		file.write(WRITER_KEY, sizeof(WRITER_KEY));
+		file.write(WRITER_VALUE, sizeof(WRITER_VALUE));
+		size_t written = header.kvdByteOffset + sizeof(uint32_t) + keyValueLength;
+		for (size_t i = levels.size(); i-- > 0;)
+		{
+			file.write(zeros, (std::streamsize)(index[i].byteOffset - written));
+			file.write((const char*)levels[i].pixels.data(), (std::streamsize)levels[i].pixels.size());
+			written = index[i].byteOffset + levels[i].pixels.size();
+		}
+		if (!file)
+			return false;
+	}
+
+	std::filesystem::rename(temporary, target, error);
+	if (error)
+	{
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool KTX2::Parse(const unsigned char* data, size_t size, Info& info)
+{
+	return Parse(data, size, size, info);
+}
+
+bool KTX2::Parse(const unsigned char* data, size_t available, size_t size, Info& info)
+{
+	if (available > size)
+		available = size;
+	if (available < LEVEL_INDEX_OFFSET || std::memcmp(data, IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+		return false;
+
+	Header header;
+	std::memcpy(&header, data + HEADER_OFFSET, sizeof(header));
+
+	TextureFormat format;
+	bool srgb;
+	bool known = FromVkFormat(header.vkFormat, format, srgb);
+	if (!known || header.supercompressionScheme != 0 || header.pixelDepth > 1 ||
+		header.layerCount > 1 || header.faceCount != 1 || header.levelCount == 0 ||
+		header.pixelWidth == 0 || header.pixelHeight == 0)
+	{
+		std::cout << "ERROR::KTX2::UNSUPPORTED_LAYOUT only 2D RGBA8 and BC1/3/4/5/7 images are supported" << std::endl;
+		return false;
+	}
+	// a full chain ends at 1x1, so more levels than that would shift the size away
+	uint32_t maxLevels = 0;
+	for (uint32_t largest = std::max(header.pixelWidth, header.pixelHeight); largest > 0; largest >>= 1)
+		++maxLevels;
+	if (header.levelCount > maxLevels || available < LEVEL_INDEX_OFFSET + header.levelCount * sizeof(LevelIndex))
+		return false;
+
+	info.width = (int)header.pixelWidth;
+	info.height = (int)header.pixelHeight;
+	info.srgb = srgb;
+	info.format = format;
+	info.levels.resize(header.levelCount);
+	for (uint32_t i = 0; i < header.levelCount; ++i)
+	{
+		LevelIndex index;
+		std::memcpy(&index, data + LEVEL_INDEX_OFFSET + i * sizeof(LevelIndex), sizeof(index));
+
+		Level& level = info.levels[i];
+		level.width = info.width >> i > 0 ? info.width >> i : 1;
+		level.height = info.height >> i > 0 ? info.height >> i : 1;
+		level.offset = (size_t)index.byteOffset;
+		level.size = (size_t)index.byteLength;
+		// written so that corrupt offsets can't wrap around
+		if (level.size != TextureLevelBytes(format, level.width, level.height) ||
+			index.byteOffset > size || index.byteLength > size - index.byteOffset)
+			return false;
+	}
+	return true;
+}
+
+bool KTX2::IsTextureFile(const std::string& path)
+{
+	const std::string EXTENSION = ".ktx2";
+	return path.size() >= EXTENSION.size() && path.compare(path.size() - EXTENSION.size(), EXTENSION.size(), EXTENSION) == 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "BlockCompression.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MipLevel;
+
+// KTX2 containers holding a full mip chain, either uncompressed RGBA8 or one of the BC
+// block formats. RGBA8 rows are tightly packed, which for 4-byte texels also satisfies
+// GL's default unpack alignment, and BC levels are plain block rows, so every level
+// can be handed to glTexImage2D / glCompressedTexImage2D as it is
+// ---------------------------------------------------------------------------------------
+namespace KTX2
+{
+	const uint32_t VK_FORMAT_R8G8B8A8_UNORM = 37;
+	const uint32_t VK_FORMAT_R8G8B8A8_SRGB = 43;
+	const uint32_t VK_FORMAT_BC1_RGBA_UNORM_BLOCK = 133;
+	const uint32_t VK_FORMAT_BC1_RGBA_SRGB_BLOCK = 134;
+	const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+	const uint32_t VK_FORMAT_BC3_SRGB_BLOCK = 138;
+	const uint32_t VK_FORMAT_BC4_UNORM_BLOCK = 139;
+	const uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+	const uint32_t VK_FORMAT_BC7_UNORM_BLOCK = 145;
+	const uint32_t VK_FORMAT_BC7_SRGB_BLOCK = 146;
+
+	struct Level
+	{
+		int width;
+		int height;
+		// from the start of the file
+		size_t offset;
+		size_t size;
+	};
+
+	struct Info
+	{
+		int width = 0;
+		int height = 0;
+		bool srgb = false;
+		TextureFormat format = TextureFormat::RGBA8;
+		// level 0 is the full size image
+		std::vector<Level> levels;
+	};
+
+	// write levels[0] (base) down to the smallest level, false if the file can't be written.
+	// level pixels hold data already in the given format. BC4 and BC5 have no srgb variant
+	bool Write(const std::string& path, const std::vector<MipLevel>& levels, TextureFormat format, bool srgb);
+
+	// check the header and fill in where each level lives, without copying anything
+	bool Parse(const unsigned char* data, size_t size, Info& info);
+
+	// same, when only the first available bytes of a size byte file are at hand (a header
+	// peeked out of a compressed pack entry). levels are still checked against the whole file
+	bool Parse(const unsigned char* data, size_t available, size_t size, Info& info);
+
+	bool IsTextureFile(const std::string& path);
+}
@@ -0,0 +1,550 @@
+#include "TextureLoader.h"
+#include "JobSystem.h"
+#include "GLStateCache.h"
+#include "RenderCommands.h"
+#include "GLExtensions.h"
+#include "AssetPack.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+	bool ReadFile(const std::string& path, std::vector<unsigned char>& bytes)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+		std::streamsize size = file.tellg();
+		if (size <= 0)
+			return false;
+		bytes.resize((size_t)size);
+		file.seekg(0);
+		return (bool)file.read((char*)bytes.data(), size);
+	}
+
+	// GL internal format for a block compressed file, 0 if the context can't sample it
+	GLenum CompressedInternalFormat(TextureFormat format, bool srgb)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC1:
+			if (!(srgb ? GLExt::textureS3TCsRGB : GLExt::textureS3TC))
+				return 0;
+			return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		case TextureFormat::BC3:
+			if (!(srgb ? GLExt::textureS3TCsRGB : GLExt::textureS3TC))
+				return 0;
+			return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case TextureFormat::BC4:
+			return GL_COMPRESSED_RED_RGTC1;
+		case TextureFormat::BC5:
+			return GL_COMPRESSED_RG_RGTC2;
+		case TextureFormat::BC7:
+			if (!GLExt::textureBPTC)
+				return 0;
+			return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+		case TextureFormat::RGBA8:
+			break;
+		}
+		return 0;
+	}
+
+	// rewrite a parsed block compressed file as RGBA8 levels in decoded, laid out the way
+	// Parse would have described them, so the upload path doesn't need to know.
+	// data may point into decoded itself
+	bool DecompressLevels(const unsigned char* data, std::vector<unsigned char>& output, KTX2::Info& info)
+	{
+		std::vector<unsigned char> decoded;
+		size_t total = 0;
+		for (const KTX2::Level& level : info.levels)
+			total += TextureLevelBytes(TextureFormat::RGBA8, level.width, level.height);
+		decoded.reserve(total);
+
+		bool supported = true;
+		std::vector<uint8_t> rgba;
+		for (KTX2::Level& level : info.levels)
+		{
+			supported &= DecompressImage(info.format, data + level.offset, level.width, level.height, rgba);
+			level.offset = decoded.size();
+			level.size = rgba.size();
+			decoded.insert(decoded.end(), rgba.begin(), rgba.end());
+		}
+		output.swap(decoded);
+		info.format = TextureFormat::RGBA8;
+		return supported;
+	}
+}
+
+TextureLoader::TextureLoader(JobSystem& jobs, size_t maxTextures, unsigned int stagingSlots, size_t slotBytes,
+	const AssetPack* pack, AsyncFileSystem* files)
+	: jobs(jobs), pack(pack), files(files), outstanding(new JobCounter()), entries(new Entry[maxTextures]), maxTextures(maxTextures),
+	slotBytes(slotBytes), entryCount(0), slots(stagingSlots), finished(0), decodeMicros(0)
+{
+	decoded.reserve(maxTextures);
+}
+
+TextureLoader::~TextureLoader()
+{
+	// reads and jobs point at our entries, so never leave while one could still run
+	waitForReads();
+	jobs.wait(*outstanding);
+}
+
+void TextureLoader::createResources()
+{
+	for (StagingSlot& slot : slots)
+		glGenBuffers(1, &slot.buffer);
+}
+
+void TextureLoader::destroyResources()
+{
+	// workers may still be writing into staging memory
+	waitForReads();
+	jobs.wait(*outstanding);
+
+	for (StagingSlot& slot : slots)
+	{
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.buffer);
+		slot = StagingSlot();
+	}
+
+	for (uint32_t index : decoded)
+		releasePixels(entries[index]);
+	decoded.clear();
+
+	for (size_t i = 0; i < entryCount; ++i)
+	{
+		// uploaded but not yet published textures are freed too
+		if (entries[i].uploaded)
+			glDeleteTextures(1, &entries[i].uploaded);
+	}
+}
+
+TextureHandle TextureLoader::load(const std::string& path, unsigned int target)
+{
+	TextureHandle handle;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (size_t i = 0; i < entryCount; ++i)
+		{
+			if (entries[i].target == target && entries[i].path == path)
+			{
+				handle.index = (uint32_t)i;
+				return handle;
+			}
+		}
+
+		if (entryCount >= maxTextures)
+		{
+			std::cout << "ERROR::TEXTURE_LOADER::TOO_MANY_TEXTURES " << path << std::endl;
+			return handle;
+		}
+		if (entryCount == finished.load())
+			firstRequest = std::chrono::steady_clock::now();
+
+		// filled in before the lock goes, so a concurrent load() of the same path finds it
+		handle.index = (uint32_t)entryCount++;
+		Entry& added = entries[handle.index];
+		added.loader = this;
+		added.path = path;
+		added.target = target;
+	}
+
+	Entry& entry = entries[handle.index];
+
+	// a read in flight costs no thread; its callback queues the decode
+	if (files && !(pack && pack->contains(path)))
+	{
+		std::error_code error;
+		uintmax_t size = std::filesystem::file_size(path, error);
+		if (!error && size > 0)
+		{
+			entry.file.resize((size_t)size);
+			entry.read = files->read(path, 0, (size_t)size, entry.file.data(), AsyncFileSystem::Priority::Normal, &ReadCallback, &entry);
+			if (entry.read.valid())
+				return handle;
+		}
+	}
+	jobs.run(&DecodeJob, &entry, outstanding.get());
+	return handle;
+}
+
+// I/O thread: anything short of the whole file is read again, blocking, by DecodeJob
+void TextureLoader::ReadCallback(const AsyncFileSystem::Completion& completion)
+{
+	Entry& entry = *static_cast<Entry*>(completion.data);
+	entry.fetched = completion.result == AsyncFileSystem::Result::Done && completion.bytes == entry.file.size();
+	entry.loader->jobs.run(&DecodeJob, &entry, entry.loader->outstanding.get());
+}
+
+void TextureLoader::waitForReads()
+{
+	if (!files)
+		return;
+	size_t count;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		count = entryCount;
+	}
+	for (size_t i = 0; i < count; ++i)
+		files->wait(entries[i].read);
+}
+
+void TextureLoader::update(RenderCommandBuffer& commands)
+{
+	if (pending() > 0)
+		commands.callback(&ServiceCallback, this);
+}
+
+void TextureLoader::ServiceCallback(void* data, GLStateCache& state)
+{
+	static_cast<TextureLoader*>(data)->service(state);
+}
+
+// worker: read and decode, then move the pixels into staging memory if any is free
+void TextureLoader::DecodeJob(const Job& job)
+{
+	Entry& entry = *static_cast<Entry*>(job.data);
+	TextureLoader& loader = *entry.loader;
+
+	auto start = std::chrono::steady_clock::now();
+	const AssetPack* pack = loader.pack;
+	size_t index = pack ? pack->lookup(entry.path) : AssetPack::NOT_FOUND;
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+	if (index != AssetPack::NOT_FOUND && !pack->compressed(index))
+	{
+		std::span<const std::byte> packed = pack->file(index);
+		data = reinterpret_cast<const unsigned char*>(packed.data());
+		size = packed.size();
+		entry.packed = true;
+	}
+	else if (index != AssetPack::NOT_FOUND)
+	{
+		// a cooked file that fits staging and needs no conversion never has to exist
+		// decompressed anywhere but the staging buffer, so peek at its header only
+		size = pack->size(index);
+		if (KTX2::IsTextureFile(entry.path) && size <= loader.slotBytes)
+		{
+			std::vector<unsigned char> head(pack->headSize(index));
+			if (pack->readHead(index, reinterpret_cast<std::byte*>(head.data())) &&
+				KTX2::Parse(head.data(), head.size(), size, entry.cooked) &&
+				(entry.cooked.format == TextureFormat::RGBA8 || CompressedInternalFormat(entry.cooked.format, entry.cooked.srgb)))
+			{
+				entry.streamed = true;
+				entry.packIndex = index;
+				entry.bytes = size;
+				entry.width = entry.cooked.width;
+				entry.height = entry.cooked.height;
+			}
+		}
+		if (!entry.streamed)
+		{
+			entry.file.resize(size);
+			if (pack->read(index, reinterpret_cast<std::byte*>(entry.file.data()), &loader.jobs))
+				data = entry.file.data();
+		}
+	}
+	else if (entry.fetched || ReadFile(entry.path, entry.file))
+	{
+		entry.fetched = false;
+		data = entry.file.data();
+		size = entry.file.size();
+	}
+
+	if (data && KTX2::IsTextureFile(entry.path))
+	{
+		if (KTX2::Parse(data, size, entry.cooked))
+		{
+			// decoded here rather than on the render thread when the driver lacks the format
+			if (entry.cooked.format != TextureFormat::RGBA8 && !CompressedInternalFormat(entry.cooked.format, entry.cooked.srgb))
+			{
+				if (!DecompressLevels(data, entry.file, entry.cooked))
+					std::cout << "ERROR::TEXTURE_LOADER::UNSUPPORTED_BLOCKS " << entry.path << std::endl;
+				data = entry.file.data();
+				size = entry.file.size();
+				entry.packed = false;
+			}
+			entry.pixels = data;
+			entry.bytes = size;
+			entry.width = entry.cooked.width;
+			entry.height = entry.cooked.height;
+		}
+	}
+	else if (data)
+	{
+		int channels = 0;
+		entry.pixels = stbi_load_from_memory(data, (int)size, &entry.width, &entry.height, &channels, 4);
+		entry.bytes = (size_t)entry.width * (size_t)entry.height * 4;
+		entry.packed = false;
+		std::vector<unsigned char>().swap(entry.file);
+	}
+	auto end = std::chrono::steady_clock::now();
+	loader.decodeMicros += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+	if (!entry.pixels && !entry.streamed)
+	{
+		std::vector<unsigned char>().swap(entry.file);
+		std::cout << "Failed to load texture " << entry.path << std::endl;
+		loader.markFailed(entry);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(loader.lock);
+		if (loader.claimSlot(entry) < 0)
+		{
+			// the render thread hands it a slot once one frees up
+			loader.decoded.push_back((uint32_t)(&entry - loader.entries.get()));
+			return;
+		}
+	}
+	loader.copyToSlot(entry);
+}
+
+void TextureLoader::CopyJob(const Job& job)
+{
+	Entry& entry = *static_cast<Entry*>(job.data);
+	entry.loader->copyToSlot(entry);
+}
+
+int TextureLoader::claimSlot(Entry& entry)
+{
+	if (entry.bytes > slotBytes)
+		return -1;
+
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		if (slots[i].state == SlotState::Mapped)
+		{
+			slots[i].state = SlotState::Assigned;
+			slots[i].entry = (uint32_t)(&entry - entries.get());
+			entry.slot = (int)i;
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+void TextureLoader::copyToSlot(Entry& entry)
+{
+	StagingSlot& slot = slots[entry.slot];
+	if (entry.streamed)
+	{
+		// every worker helps decompress this one texture, straight into the mapped buffer
+		entry.streamed = false;
+		if (!pack->read(entry.packIndex, reinterpret_cast<std::byte*>(slot.mapped), &jobs))
+		{
+			std::cout << "Failed to load texture " << entry.path << std::endl;
+			std::lock_guard<std::mutex> guard(lock);
+			slot.state = SlotState::Mapped;
+			entry.slot = -1;
+			markFailed(entry);
+			return;
+		}
+	}
+	else
+	{
+		std::memcpy(slot.mapped, entry.pixels, entry.bytes);
+		releasePixels(entry);
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	slot.state = SlotState::Filled;
+}
+
+void TextureLoader::service(GLStateCache& state)
+{
+	std::vector<uint32_t> direct;
+	std::vector<uint32_t> copies;
+	std::vector<size_t> toMap;
+	std::vector<size_t> toUpload;
+	std::vector<size_t> uploading;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (size_t i = 0; i < slots.size(); ++i)
+		{
+			if (slots[i].state == SlotState::Free)
+				toMap.push_back(i);
+			else if (slots[i].state == SlotState::Filled)
+				toUpload.push_back(i);
+			else if (slots[i].state == SlotState::Uploading)
+				uploading.push_back(i);
+		}
+	}
+
+	// uploads from earlier frames: the texture is usable once its fence has passed
+	for (size_t i : uploading)
+	{
+		StagingSlot& slot = slots[i];
+		if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			continue;
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		markReady(entries[slot.entry]);
+
+		std::lock_guard<std::mutex> guard(lock);
+		slot.state = SlotState::Free;
+		toMap.push_back(i);
+	}
+
+	// the driver copies out of the unpack buffer on its own time
+	for (size_t i : toUpload)
+	{
+		StagingSlot& slot = slots[i];
+		state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		slot.mapped = nullptr;
+		upload(state, entries[slot.entry], nullptr);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		std::lock_guard<std::mutex> guard(lock);
+		slot.state = SlotState::Uploading;
+	}
+
+	// orphan and map idle slots so workers can write into them
+	for (size_t i : toMap)
+	{
+		StagingSlot& slot = slots[i];
+		state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)slotBytes, nullptr, GL_STREAM_DRAW);
+		unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)slotBytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (!mapped)
+			continue;
+
+		std::lock_guard<std::mutex> guard(lock);
+		slot.mapped = mapped;
+		slot.state = SlotState::Mapped;
+	}
+	state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// images that were decoded while every slot was busy
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		size_t kept = 0;
+		for (uint32_t index : decoded)
+		{
+			Entry& entry = entries[index];
+			if (entry.bytes > slotBytes)
+				direct.push_back(index);
+			else if (claimSlot(entry) >= 0)
+				copies.push_back(index);
+			else
+				decoded[kept++] = index;
+		}
+		decoded.resize(kept);
+	}
+
+	for (uint32_t index : copies)
+		jobs.run(&CopyJob, &entries[index], outstanding.get());
+
+	// too big for staging: upload from client memory, which GL copies before returning
+	for (uint32_t index : direct)
+	{
+		Entry& entry = entries[index];
+		upload(state, entry, entry.pixels);
+		releasePixels(entry);
+		markReady(entry);
+	}
+}
+
+// pixels is nullptr when uploading from the bound unpack buffer
+void TextureLoader::upload(GLStateCache& state, Entry& entry, const void* pixels)
+{
+	glGenTextures(1, &entry.uploaded);
+	state.bindTexture(0, entry.target, entry.uploaded);
+	glTexParameteri(entry.target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(entry.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	if (entry.cooked.levels.empty())
+	{
+		if (entry.target == GL_TEXTURE_2D_ARRAY)
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, entry.width, entry.height, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		else
+			glTexImage2D(entry.target, 0, GL_RGBA8, entry.width, entry.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		glGenerateMipmap(entry.target);
+		return;
+	}
+
+	// every level comes straight out of the file
+	bool compressed = entry.cooked.format != TextureFormat::RGBA8;
+	GLint internalFormat = compressed ? (GLint)CompressedInternalFormat(entry.cooked.format, entry.cooked.srgb) :
+		(entry.cooked.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8);
+	int levelCount = (int)entry.cooked.levels.size();
+	glTexParameteri(entry.target, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	for (int i = 0; i < levelCount; ++i)
+	{
+		const KTX2::Level& level = entry.cooked.levels[i];
+		const void* data = pixels ? (const void*)((const unsigned char*)pixels + level.offset) : (const void*)level.offset;
+		if (compressed && entry.target == GL_TEXTURE_2D_ARRAY)
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, internalFormat, level.width, level.height, 1, 0, (GLsizei)level.size, data);
+		else if (compressed)
+			glCompressedTexImage2D(entry.target, i, internalFormat, level.width, level.height, 0, (GLsizei)level.size, data);
+		else if (entry.target == GL_TEXTURE_2D_ARRAY)
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, i, internalFormat, level.width, level.height, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		else
+			glTexImage2D(entry.target, i, internalFormat, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+}
+
+void TextureLoader::releasePixels(Entry& entry)
+{
+	if (entry.packed)
+		entry.packed = false;
+	else if (entry.cooked.levels.empty())
+		stbi_image_free(const_cast<unsigned char*>(entry.pixels));
+	else
+		std::vector<unsigned char>().swap(entry.file);
+	entry.pixels = nullptr;
+}
+
+void TextureLoader::markReady(Entry& entry)
+{
+	entry.texture.store(entry.uploaded, std::memory_order_release);
+	lastFinished = std::chrono::steady_clock::now();
+	finished.fetch_add(1);
+}
+
+void TextureLoader::markFailed(Entry& entry)
+{
+	entry.failed.store(true, std::memory_order_release);
+	finished.fetch_add(1);
+}
+
+unsigned int TextureLoader::texture(TextureHandle handle) const
+{
+	if (!handle.valid())
+		return 0;
+	return entries[handle.index].texture.load(std::memory_order_acquire);
+}
+
+bool TextureLoader::failed(TextureHandle handle) const
+{
+	return !handle.valid() || entries[handle.index].failed.load(std::memory_order_acquire);
+}
+
+size_t TextureLoader::pending() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return entryCount - finished.load();
+}
+
+void TextureLoader::printStats() const
+{
+	size_t count = finished.load();
+	if (count == 0)
+		return;
+
+	double wallMs = std::chrono::duration<double, std::milli>(lastFinished - firstRequest).count();
+	std::cout << "textures: " << count << " loaded in " << wallMs << " ms, "
+		<< (double)decodeMicros.load() / 1000.0 << " ms of decoding across workers" << std::endl;
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include "glad/glad.h"
+#include "TextureFile.h"
+#include "AsyncFileSystem.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class JobSystem;
+class JobCounter;
+class AssetPack;
+class GLStateCache;
+class RenderCommandBuffer;
+struct Job;
+
+struct TextureHandle
+{
+	uint32_t index = 0xFFFFFFFFu;
+
+	bool valid() const { return index != 0xFFFFFFFFu; }
+};
+
+// loads textures in the background. files are read and decoded to RGBA8 on job system
+// workers, copied into a pixel unpack buffer the render thread mapped ahead of time, and
+// uploaded from there by the render thread, which fences the upload. texture() stays 0
+// until that fence has passed, so callers just skip whatever isn't ready yet.
+// .ktx2 files from texcook skip decoding: the file goes to staging as it is and every
+// level is uploaded from there, so no mipmaps are generated at runtime either. block
+// compressed files the context can't sample are expanded to RGBA8 on the worker first.
+// files found in the asset pack are decoded (or, when cooked, staged) straight out of
+// the mapping without being read into memory first. cooked files the pack holds compressed
+// only have their header decoded up front; the rest is decompressed by all workers at once
+// directly into the staging buffer. loose files go through the async file system when
+// there is one, so no worker sits blocked on the disk: decoding starts once the read lands
+// ---------------------------------------------------------------------------------------
+class TextureLoader
+{
+public:
+	// stagingSlots unpack buffers of slotBytes each; larger images are uploaded straight
+	// from client memory instead. the pack and file system, if any, have to outlive the loader
+	TextureLoader(JobSystem& jobs, size_t maxTextures, unsigned int stagingSlots, size_t slotBytes,
+		const AssetPack* pack = nullptr, AsyncFileSystem* files = nullptr);
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// render thread: create the staging buffers, or wait for outstanding jobs and free everything
+	void createResources();
+	void destroyResources();
+
+	// any thread: queue a file for loading as GL_TEXTURE_2D or a one-layer GL_TEXTURE_2D_ARRAY.
+	// asking for the same file and target again returns the same handle
+	TextureHandle load(const std::string& path, unsigned int target);
+
+	// main thread: record this frame's service() call
+	void update(RenderCommandBuffer& commands);
+
+	// render thread: retire finished uploads, start new ones and map free staging buffers
+	void service(GLStateCache& state);
+
+	// GL name of the texture, 0 while it is still loading or if it failed
+	unsigned int texture(TextureHandle handle) const;
+
+	bool failed(TextureHandle handle) const;
+
+	size_t pending() const;
+
+	void printStats() const;
+private:
+	enum class SlotState
+	{
+		Free,       // unmapped and idle
+		Mapped,     // waiting for a decoded image
+		Assigned,   // a worker is copying into it
+		Filled,     // ready to upload
+		Uploading   // upload issued, waiting on its fence
+	};
+
+	struct StagingSlot
+	{
+		unsigned int buffer = 0;
+		unsigned char* mapped = nullptr;
+		SlotState state = SlotState::Free;
+		uint32_t entry = 0;
+		GLsync fence = nullptr;
+	};
+
+	struct Entry
+	{
+		TextureLoader* loader = nullptr;
+		std::string path;
+		unsigned int target = 0;
+		std::atomic<unsigned int> texture{ 0 };
+		std::atomic<bool> failed{ false };
+
+		// decoded image (or the whole cooked file), owned by whoever holds the entry at the time
+		const unsigned char* pixels = nullptr;
+		// pixels point into the asset pack and are never freed
+		bool packed = false;
+		// no pixels at all: copyToSlot decompresses pack entry packIndex into staging
+		bool streamed = false;
+		size_t packIndex = 0;
+		size_t bytes = 0;
+		int width = 0;
+		int height = 0;
+		std::vector<unsigned char> file;
+		// file already holds the whole file, read ahead of DecodeJob
+		bool fetched = false;
+		AsyncFileSystem::Request read;
+		KTX2::Info cooked;
+		int slot = -1;
+		// GL name between the upload and its fence passing
+		unsigned int uploaded = 0;
+	};
+
+	static void ReadCallback(const AsyncFileSystem::Completion& completion);
+	static void DecodeJob(const Job& job);
+	static void CopyJob(const Job& job);
+	static void ServiceCallback(void* data, GLStateCache& state);
+
+	// with lock held: hand a mapped slot big enough for the entry to it, or return -1
+	int claimSlot(Entry& entry);
+	void copyToSlot(Entry& entry);
+	void upload(GLStateCache& state, Entry& entry, const void* pixels);
+	void markReady(Entry& entry);
+	void markFailed(Entry& entry);
+	static void releasePixels(Entry& entry);
+	void waitForReads();
+
+	JobSystem& jobs;
+	const AssetPack* pack;
+	AsyncFileSystem* files;
+	std::unique_ptr<JobCounter> outstanding;
+	std::unique_ptr<Entry[]> entries;
+	size_t maxTextures;
+	size_t slotBytes;
+
+	// guards entryCount, slot states and the decoded list
+	mutable std::mutex lock;
+	size_t entryCount;
+	std::vector<StagingSlot> slots;
+	std::vector<uint32_t> decoded;
+
+	std::atomic<size_t> finished;
+	std::atomic<long long> decodeMicros;
+	std::chrono::steady_clock::time_point firstRequest;
+	std::chrono::steady_clock::time_point lastFinished;
+};
@@ -0,0 +1,551 @@
+#include "TransformHierarchy.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#if defined(__AVX2__)
+#define TRANSFORMHIERARCHY_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORMHIERARCHY_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const uint32_t NONE = 0xFFFFFFFFu;
+
+	// levels smaller than this aren't worth handing to the job system
+	const size_t PARALLEL_NODES = 4096;
+	const unsigned int PARALLEL_GRAIN = 1024;
+
+	enum LocalComponent
+	{
+		POSITION_X, POSITION_Y, POSITION_Z,
+		ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION_W,
+		SCALE_X, SCALE_Y, SCALE_Z,
+		LOCAL_COMPONENTS
+	};
+
+	const float IDENTITY[16] =
+	{
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	struct WorldPass
+	{
+		const float* locals[LOCAL_COMPONENTS];
+		const uint32_t* parents;
+		float* worlds;
+	};
+
+	// one float per node; the kernel below is written once against these and runs
+	// 8, 4 or 1 nodes at a time
+	struct Lanes1
+	{
+		static const int WIDTH = 1;
+		float v;
+
+		explicit Lanes1(float value) : v(value) {}
+
+		static Lanes1 Gather(const float* base, const int32_t* indices) { return Lanes1(base[indices[0]]); }
+		void store(float* out) const { out[0] = v; }
+
+		Lanes1 operator+(Lanes1 other) const { return Lanes1(v + other.v); }
+		Lanes1 operator-(Lanes1 other) const { return Lanes1(v - other.v); }
+		Lanes1 operator*(Lanes1 other) const { return Lanes1(v * other.v); }
+	};
+
+#if TRANSFORMHIERARCHY_SSE2
+	struct Lanes4
+	{
+		static const int WIDTH = 4;
+		__m128 v;
+
+		explicit Lanes4(__m128 value) : v(value) {}
+		explicit Lanes4(float value) : v(_mm_set1_ps(value)) {}
+
+		static Lanes4 Gather(const float* base, const int32_t* indices)
+		{
+			return Lanes4(_mm_setr_ps(base[indices[0]], base[indices[1]], base[indices[2]], base[indices[3]]));
+		}
+		void store(float* out) const { _mm_store_ps(out, v); }
+
+		Lanes4 operator+(Lanes4 other) const { return Lanes4(_mm_add_ps(v, other.v)); }
+		Lanes4 operator-(Lanes4 other) const { return Lanes4(_mm_sub_ps(v, other.v)); }
+		Lanes4 operator*(Lanes4 other) const { return Lanes4(_mm_mul_ps(v, other.v)); }
+	};
+#endif
+
+#if TRANSFORMHIERARCHY_AVX2
+	struct Lanes8
+	{
+		static const int WIDTH = 8;
+		__m256 v;
+
+		explicit Lanes8(__m256 value) : v(value) {}
+		explicit Lanes8(float value) : v(_mm256_set1_ps(value)) {}
+
+		static Lanes8 Gather(const float* base, const int32_t* indices)
+		{
+			return Lanes8(_mm256_i32gather_ps(base, _mm256_load_si256(reinterpret_cast<const __m256i*>(indices)), 4));
+		}
+		void store(float* out) const { _mm256_store_ps(out, v); }
+
+		Lanes8 operator+(Lanes8 other) const { return Lanes8(_mm256_add_ps(v, other.v)); }
+		Lanes8 operator-(Lanes8 other) const { return Lanes8(_mm256_sub_ps(v, other.v)); }
+		Lanes8 operator*(Lanes8 other) const { return Lanes8(_mm256_mul_ps(v, other.v)); }
+	};
+#endif
+
+	// world = parent world * local for WIDTH nodes whose parents are already up to date.
+	// locals and the parents' 3x4 affine part are gathered into lanes, the local matrix is
+	// built from TRS and multiplied in, and each node's column-major matrix is written back
+	template<typename Lanes>
+	void ComputeBatch(const WorldPass& pass, const uint32_t* slots)
+	{
+		const int WIDTH = Lanes::WIDTH;
+		alignas(32) int32_t nodes[WIDTH];
+		alignas(32) int32_t parents[WIDTH];
+		for (int i = 0; i < WIDTH; ++i)
+		{
+			nodes[i] = (int32_t)slots[i];
+			parents[i] = (int32_t)pass.parents[slots[i]] * 16;
+		}
+
+		Lanes tx = Lanes::Gather(pass.locals[POSITION_X], nodes);
+		Lanes ty = Lanes::Gather(pass.locals[POSITION_Y], nodes);
+		Lanes tz = Lanes::Gather(pass.locals[POSITION_Z], nodes);
+		Lanes qx = Lanes::Gather(pass.locals[ROTATION_X], nodes);
+		Lanes qy = Lanes::Gather(pass.locals[ROTATION_Y], nodes);
+		Lanes qz = Lanes::Gather(pass.locals[ROTATION_Z], nodes);
+		Lanes qw = Lanes::Gather(pass.locals[ROTATION_W], nodes);
+		Lanes sx = Lanes::Gather(pass.locals[SCALE_X], nodes);
+		Lanes sy = Lanes::Gather(pass.locals[SCALE_Y], nodes);
+		Lanes sz = Lanes::Gather(pass.locals[SCALE_Z], nodes);
+
+		// rotation matrix from the quaternion, each column scaled
+		Lanes one(1.0f);
+		Lanes x2 = qx + qx, y2 = qy + qy, z2 = qz + qz;
+		Lanes xx = qx * x2, yy = qy * y2, zz = qz * z2;
+		Lanes xy = qx * y2, xz = qx * z2, yz = qy * z2;
+		Lanes wx = qw * x2, wy = qw * y2, wz = qw * z2;
+		Lanes l[3][3] =
+		{
+			{ (one - (yy + zz)) * sx, (xy + wz) * sx, (xz - wy) * sx },
+			{ (xy - wz) * sy, (one - (xx + zz)) * sy, (yz + wx) * sy },
+			{ (xz + wy) * sz, (yz - wx) * sz, (one - (xx + yy)) * sz }
+		};
+
+		// p[column][row] of the parents' world matrices
+		Lanes p[4][3] =
+		{
+			{ Lanes::Gather(pass.worlds + 0, parents), Lanes::Gather(pass.worlds + 1, parents), Lanes::Gather(pass.worlds + 2, parents) },
+			{ Lanes::Gather(pass.worlds + 4, parents), Lanes::Gather(pass.worlds + 5, parents), Lanes::Gather(pass.worlds + 6, parents) },
+			{ Lanes::Gather(pass.worlds + 8, parents), Lanes::Gather(pass.worlds + 9, parents), Lanes::Gather(pass.worlds + 10, parents) },
+			{ Lanes::Gather(pass.worlds + 12, parents), Lanes::Gather(pass.worlds + 13, parents), Lanes::Gather(pass.worlds + 14, parents) }
+		};
+
+		alignas(32) float out[4][3][WIDTH];
+		for (int column = 0; column < 3; ++column)
+		{
+			for (int row = 0; row < 3; ++row)
+				(p[0][row] * l[column][0] + p[1][row] * l[column][1] + p[2][row] * l[column][2]).store(out[column][row]);
+		}
+		for (int row = 0; row < 3; ++row)
+			(p[0][row] * tx + p[1][row] * ty + p[2][row] * tz + p[3][row]).store(out[3][row]);
+
+		for (int i = 0; i < WIDTH; ++i)
+		{
+			float* world = pass.worlds + (size_t)slots[i] * 16;
+			for (int column = 0; column < 4; ++column)
+			{
+				world[column * 4 + 0] = out[column][0][i];
+				world[column * 4 + 1] = out[column][1][i];
+				world[column * 4 + 2] = out[column][2][i];
+				world[column * 4 + 3] = column == 3 ? 1.0f : 0.0f;
+			}
+		}
+	}
+
+	template<typename T>
+	void Permute(std::vector<T>& values, const std::vector<uint32_t>& order, std::vector<T>& scratch)
+	{
+		scratch.resize(order.size());
+		for (size_t i = 0; i < order.size(); ++i)
+			scratch[i] = values[order[i]];
+		values.swap(scratch);
+	}
+}
+
+TransformHierarchy::TransformHierarchy()
+	: structureChanged(false), liveCount(0), lastUpdated(0)
+{
+	// slot 0: the identity every root is parented to, so the update never special cases roots
+	parents.push_back(NONE);
+	firstChild.push_back(NONE);
+	nextSibling.push_back(NONE);
+	previousSibling.push_back(NONE);
+	childCount.push_back(0);
+	handles.push_back(NONE);
+	Transform identity;
+	for (int i = 0; i < 3; ++i)
+	{
+		locals[POSITION_X + i].push_back(identity.position[i]);
+		locals[SCALE_X + i].push_back(identity.scale[i]);
+	}
+	for (int i = 0; i < 4; ++i)
+		locals[ROTATION_X + i].push_back(identity.rotation[i]);
+	worlds.assign(IDENTITY, IDENTITY + 16);
+	dirty.push_back(0);
+	levelStarts = { 0, 1 };
+}
+
+TransformNode TransformHierarchy::create(TransformNode parent, const Transform& local)
+{
+	uint32_t parentSlot = 0;
+	if (parent.valid())
+	{
+		parentSlot = slotOf(parent);
+		if (parentSlot == NONE)
+		{
+			std::cout << "ERROR::TRANSFORM_HIERARCHY::DEAD_PARENT node not created" << std::endl;
+			return TransformNode();
+		}
+	}
+
+	TransformNode node;
+	if (!freeIndices.empty())
+	{
+		node.index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		node.index = (uint32_t)records.size();
+		records.push_back({ 0, NONE });
+	}
+	node.generation = records[node.index].generation;
+
+	// appended out of order for now, the next update moves it into place
+	uint32_t slot = (uint32_t)parents.size();
+	records[node.index].slot = slot;
+	parents.push_back(NONE);
+	firstChild.push_back(NONE);
+	nextSibling.push_back(NONE);
+	previousSibling.push_back(NONE);
+	childCount.push_back(0);
+	handles.push_back(node.index);
+	for (std::vector<float>& component : locals)
+		component.push_back(0.0f);
+	worlds.insert(worlds.end(), IDENTITY, IDENTITY + 16);
+	dirty.push_back(0);
+
+	link(slot, parentSlot);
+	setLocal(node, local);
+	++liveCount;
+	return node;
+}
+
+void TransformHierarchy::destroy(TransformNode node)
+{
+	uint32_t slot = slotOf(node);
+	if (slot == NONE)
+		return;
+
+	unlink(slot);
+	scratch.clear();
+	scratch.push_back(slot);
+	while (!scratch.empty())
+	{
+		uint32_t current = scratch.back();
+		scratch.pop_back();
+		for (uint32_t child = firstChild[current]; child != NONE; child = nextSibling[child])
+			scratch.push_back(child);
+
+		// the slot stays behind, unreachable, until the next update compacts the arrays
+		Record& record = records[handles[current]];
+		++record.generation;
+		record.slot = NONE;
+		freeIndices.push_back(handles[current]);
+		handles[current] = NONE;
+		--liveCount;
+	}
+}
+
+bool TransformHierarchy::alive(TransformNode node) const
+{
+	return slotOf(node) != NONE;
+}
+
+bool TransformHierarchy::setParent(TransformNode node, TransformNode parent)
+{
+	uint32_t slot = slotOf(node);
+	uint32_t parentSlot = parent.valid() ? slotOf(parent) : 0;
+	if (slot == NONE || parentSlot == NONE)
+		return false;
+
+	for (uint32_t ancestor = parentSlot; ancestor != NONE; ancestor = parents[ancestor])
+	{
+		if (ancestor == slot)
+		{
+			std::cout << "ERROR::TRANSFORM_HIERARCHY::CYCLE a node can't be parented to its own subtree" << std::endl;
+			return false;
+		}
+	}
+
+	if (parents[slot] != parentSlot)
+	{
+		unlink(slot);
+		link(slot, parentSlot);
+		markDirty(slot);
+	}
+	return true;
+}
+
+TransformNode TransformHierarchy::parent(TransformNode node) const
+{
+	uint32_t slot = slotOf(node);
+	if (slot == NONE || parents[slot] == 0)
+		return TransformNode();
+	uint32_t index = handles[parents[slot]];
+	return TransformNode{ index, records[index].generation };
+}
+
+void TransformHierarchy::setLocal(TransformNode node, const Transform& local)
+{
+	uint32_t slot = slotOf(node);
+	if (slot == NONE)
+		return;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		locals[POSITION_X + i][slot] = local.position[i];
+		locals[SCALE_X + i][slot] = local.scale[i];
+	}
+	for (int i = 0; i < 4; ++i)
+		locals[ROTATION_X + i][slot] = local.rotation[i];
+	markDirty(slot);
+}
+
+Transform TransformHierarchy::local(TransformNode node) const
+{
+	Transform local;
+	uint32_t slot = slotOf(node);
+	if (slot == NONE)
+		return local;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		local.position[i] = locals[POSITION_X + i][slot];
+		local.scale[i] = locals[SCALE_X + i][slot];
+	}
+	for (int i = 0; i < 4; ++i)
+		local.rotation[i] = locals[ROTATION_X + i][slot];
+	return local;
+}
+
+const float* TransformHierarchy::world(TransformNode node) const
+{
+	uint32_t slot = slotOf(node);
+	return slot == NONE ? nullptr : &worlds[(size_t)slot * 16];
+}
+
+void TransformHierarchy::update(JobSystem* jobs)
+{
+	if (structureChanged)
+		rebuild();
+
+	lastUpdated = 0;
+	if (dirtySlots.empty())
+		return;
+
+	size_t levels = levelStarts.size() - 1;
+	if (levelQueues.size() < levels)
+		levelQueues.resize(levels);
+	for (uint32_t slot : dirtySlots)
+	{
+		size_t level = (size_t)(std::upper_bound(levelStarts.begin(), levelStarts.end(), slot) - levelStarts.begin()) - 1;
+		levelQueues[level].push_back(slot);
+	}
+	dirtySlots.clear();
+
+	// every parent is final before its level is reached, so the nodes within a level
+	// are independent of each other
+	for (size_t level = 1; level < levels; ++level)
+	{
+		std::vector<uint32_t>& queue = levelQueues[level];
+		if (queue.empty())
+			continue;
+
+		if (jobs && queue.size() >= PARALLEL_NODES)
+		{
+			jobs->parallelFor((unsigned int)queue.size(), PARALLEL_GRAIN, [this, &queue](unsigned int begin, unsigned int end)
+			{
+				computeWorlds(queue.data() + begin, end - begin);
+			});
+		}
+		else
+		{
+			computeWorlds(queue.data(), queue.size());
+		}
+		lastUpdated += queue.size();
+
+		// children sit next to each other, so pushing them keeps the next level's queue
+		// mostly in slot order
+		if (level + 1 < levels)
+		{
+			std::vector<uint32_t>& next = levelQueues[level + 1];
+			for (uint32_t slot : queue)
+			{
+				if (childCount[slot] == 0)
+					continue;
+				uint32_t end = firstChild[slot] + childCount[slot];
+				for (uint32_t child = firstChild[slot]; child < end; ++child)
+				{
+					if (!dirty[child])
+					{
+						dirty[child] = 1;
+						next.push_back(child);
+					}
+				}
+			}
+		}
+		for (uint32_t slot : queue)
+			dirty[slot] = 0;
+		queue.clear();
+	}
+}
+
+uint32_t TransformHierarchy::slotOf(TransformNode node) const
+{
+	if (node.index >= records.size() || records[node.index].generation != node.generation)
+		return NONE;
+	return records[node.index].slot;
+}
+
+void TransformHierarchy::markDirty(uint32_t slot)
+{
+	if (!dirty[slot])
+	{
+		dirty[slot] = 1;
+		dirtySlots.push_back(slot);
+	}
+}
+
+// new children go first, the order among siblings doesn't mean anything
+void TransformHierarchy::link(uint32_t slot, uint32_t parentSlot)
+{
+	parents[slot] = parentSlot;
+	previousSibling[slot] = NONE;
+	nextSibling[slot] = firstChild[parentSlot];
+	if (firstChild[parentSlot] != NONE)
+		previousSibling[firstChild[parentSlot]] = slot;
+	firstChild[parentSlot] = slot;
+	++childCount[parentSlot];
+	structureChanged = true;
+}
+
+void TransformHierarchy::unlink(uint32_t slot)
+{
+	uint32_t parentSlot = parents[slot];
+	if (previousSibling[slot] != NONE)
+		nextSibling[previousSibling[slot]] = nextSibling[slot];
+	else
+		firstChild[parentSlot] = nextSibling[slot];
+	if (nextSibling[slot] != NONE)
+		previousSibling[nextSibling[slot]] = previousSibling[slot];
+	--childCount[parentSlot];
+	parents[slot] = NONE;
+	previousSibling[slot] = NONE;
+	nextSibling[slot] = NONE;
+	structureChanged = true;
+}
+
+// breadth-first walk over the sibling links from slot 0, then every array is permuted into
+// that order. dead slots aren't reachable any more and drop out here
+void TransformHierarchy::rebuild()
+{
+	order.clear();
+	order.push_back(0);
+	levelStarts.clear();
+	size_t begin = 0;
+	while (begin < order.size())
+	{
+		levelStarts.push_back((uint32_t)begin);
+		size_t end = order.size();
+		for (size_t i = begin; i < end; ++i)
+		{
+			for (uint32_t child = firstChild[order[i]]; child != NONE; child = nextSibling[child])
+				order.push_back(child);
+		}
+		begin = end;
+	}
+	levelStarts.push_back((uint32_t)order.size());
+
+	remap.assign(parents.size(), NONE);
+	for (size_t i = 0; i < order.size(); ++i)
+		remap[order[i]] = (uint32_t)i;
+
+	auto permuteSlots = [this](std::vector<uint32_t>& values)
+	{
+		Permute(values, order, scratch);
+		for (uint32_t& value : values)
+		{
+			if (value != NONE)
+				value = remap[value];
+		}
+	};
+	permuteSlots(parents);
+	permuteSlots(firstChild);
+	permuteSlots(nextSibling);
+	permuteSlots(previousSibling);
+	Permute(childCount, order, scratch);
+	Permute(handles, order, scratch);
+	for (std::vector<float>& component : locals)
+		Permute(component, order, scratchFloats);
+	std::vector<uint8_t> dirtyScratch;
+	Permute(dirty, order, dirtyScratch);
+
+	scratchFloats.resize(order.size() * 16);
+	for (size_t i = 0; i < order.size(); ++i)
+		std::memcpy(&scratchFloats[i * 16], &worlds[(size_t)order[i] * 16], 16 * sizeof(float));
+	worlds.swap(scratchFloats);
+
+	for (size_t i = 1; i < handles.size(); ++i)
+		records[handles[i]].slot = (uint32_t)i;
+
+	size_t kept = 0;
+	for (uint32_t slot : dirtySlots)
+	{
+		if (remap[slot] != NONE)
+			dirtySlots[kept++] = remap[slot];
+	}
+	dirtySlots.resize(kept);
+
+	structureChanged = false;
+}
+
+void TransformHierarchy::computeWorlds(const uint32_t* slots, size_t count)
+{
+	WorldPass pass;
+	for (int i = 0; i < LOCAL_COMPONENTS; ++i)
+		pass.locals[i] = locals[i].data();
+	pass.parents = parents.data();
+	pass.worlds = worlds.data();
+
+	size_t i = 0;
+#if TRANSFORMHIERARCHY_AVX2
+	for (; i + Lanes8::WIDTH <= count; i += Lanes8::WIDTH)
+		ComputeBatch<Lanes8>(pass, slots + i);
+#elif TRANSFORMHIERARCHY_SSE2
+	for (; i + Lanes4::WIDTH <= count; i += Lanes4::WIDTH)
+		ComputeBatch<Lanes4>(pass, slots + i);
+#endif
+	for (; i < count; ++i)
+		ComputeBatch<Lanes1>(pass, slots + i);
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+struct TransformNode
+{
+	uint32_t index = 0xFFFFFFFFu;
+	uint32_t generation = 0;
+
+	bool valid() const { return index != 0xFFFFFFFFu; }
+};
+
+// placement relative to the parent: scale, then rotate, then translate
+struct Transform
+{
+	float position[3] = { 0.0f, 0.0f, 0.0f };
+	// unit quaternion x, y, z, w
+	float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	float scale[3] = { 1.0f, 1.0f, 1.0f };
+};
+
+// a scene graph of transforms kept in flat arrays in breadth-first order, so every parent
+// comes before its children, each level is one contiguous range and a node's children are
+// next to each other. local transforms are stored as structure of arrays and world matrices
+// as column-major 4x4s ready for glUniformMatrix4fv.
+// update() only recomputes what moved: nodes changed since the last update and everything
+// below them, level by level, several nodes at once with SSE (AVX2 when compiled for it)
+// and large levels spread over the job system. create, destroy and setParent just link
+// nodes; the arrays are put back into breadth-first order by the next update
+// ---------------------------------------------------------------------------------------
+class TransformHierarchy
+{
+public:
+	TransformHierarchy();
+
+	// an invalid parent makes a root
+	TransformNode create(TransformNode parent = TransformNode(), const Transform& local = Transform());
+
+	// destroys the whole subtree. no-op for dead or invalid handles
+	void destroy(TransformNode node);
+
+	bool alive(TransformNode node) const;
+
+	// moves the subtree under a new parent (or to the top with an invalid one) keeping its
+	// local transform. false if that would make the node its own ancestor
+	bool setParent(TransformNode node, TransformNode parent);
+
+	TransformNode parent(TransformNode node) const;
+
+	void setLocal(TransformNode node, const Transform& local);
+
+	Transform local(TransformNode node) const;
+
+	// as of the last update, 16 floats until the next create, destroy, setParent or update.
+	// nullptr for dead handles
+	const float* world(TransformNode node) const;
+
+	// recompute the world matrix of every changed node and its descendants
+	void update(JobSystem* jobs = nullptr);
+
+	size_t nodeCount() const { return liveCount; }
+
+	// world matrices computed by the last update
+	size_t updatedNodes() const { return lastUpdated; }
+private:
+	struct Record
+	{
+		uint32_t generation;
+		uint32_t slot;
+	};
+
+	// ----- per slot; slot 0 is an identity node every root hangs off -----
+	uint32_t slotOf(TransformNode node) const;
+	void markDirty(uint32_t slot);
+	void link(uint32_t slot, uint32_t parentSlot);
+	void unlink(uint32_t slot);
+	void rebuild();
+	void computeWorlds(const uint32_t* slots, size_t count);
+
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> firstChild;
+	std::vector<uint32_t> nextSibling;
+	std::vector<uint32_t> previousSibling;
+	std::vector<uint32_t> childCount;
+	std::vector<uint32_t> handles;
+	// position xyz, rotation xyzw, scale xyz; one array each
+	std::vector<float> locals[10];
+	std::vector<float> worlds;
+	// queued for the next update, set by setLocal and for children of recomputed nodes
+	std::vector<uint8_t> dirty;
+	std::vector<uint32_t> dirtySlots;
+
+	// from the last rebuild: slots of level i are levelStarts[i] .. levelStarts[i + 1]
+	std::vector<uint32_t> levelStarts;
+	// nodes were linked or unlinked since then, so the order and child ranges are stale
+	bool structureChanged;
+
+	std::vector<Record> records;
+	std::vector<uint32_t> freeIndices;
+	size_t liveCount;
+	size_t lastUpdated;
+
+	// update scratch: nodes to recompute per level
+	std::vector<std::vector<uint32_t>> levelQueues;
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> remap;
+	std::vector<uint32_t> scratch;
+	std::vector<float> scratchFloats;
+};
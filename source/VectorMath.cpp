@@ -0,0 +1,367 @@
+#include "VectorMath.h"
+
+namespace
+{
+#if VECTORMATH_SSE
+	// 2x2 blocks of the inverse below, one per register as (m00, m01, m10, m11): A * B
+	inline __m128 Mul2x2(__m128 a, __m128 b)
+	{
+		return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+			_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+	}
+
+	// adjugate(A) * B
+	inline __m128 AdjugateMul2x2(__m128 a, __m128 b)
+	{
+		return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+			_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+	}
+
+	// A * adjugate(B)
+	inline __m128 MulAdjugate2x2(__m128 a, __m128 b)
+	{
+		return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+			_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+	}
+#endif
+
+	// one float per element; the batch kernels are written once against these and run
+	// 8, 4 or 1 elements at a time
+	struct Lanes1
+	{
+		static const size_t WIDTH = 1;
+		float v;
+
+		explicit Lanes1(float value) : v(value) {}
+
+		static Lanes1 Load(const float* in) { return Lanes1(*in); }
+		void store(float* out) const { *out = v; }
+
+		Lanes1 operator+(Lanes1 other) const { return Lanes1(v + other.v); }
+		Lanes1 operator-(Lanes1 other) const { return Lanes1(v - other.v); }
+		Lanes1 operator*(Lanes1 other) const { return Lanes1(v * other.v); }
+	};
+
+#if VECTORMATH_SSE
+	struct Lanes4
+	{
+		static const size_t WIDTH = 4;
+		__m128 v;
+
+		explicit Lanes4(__m128 value) : v(value) {}
+		explicit Lanes4(float value) : v(_mm_set1_ps(value)) {}
+
+		static Lanes4 Load(const float* in) { return Lanes4(_mm_loadu_ps(in)); }
+		void store(float* out) const { _mm_storeu_ps(out, v); }
+
+		Lanes4 operator+(Lanes4 other) const { return Lanes4(_mm_add_ps(v, other.v)); }
+		Lanes4 operator-(Lanes4 other) const { return Lanes4(_mm_sub_ps(v, other.v)); }
+		Lanes4 operator*(Lanes4 other) const { return Lanes4(_mm_mul_ps(v, other.v)); }
+	};
+#endif
+
+#if VECTORMATH_AVX2
+	struct Lanes8
+	{
+		static const size_t WIDTH = 8;
+		__m256 v;
+
+		explicit Lanes8(__m256 value) : v(value) {}
+		explicit Lanes8(float value) : v(_mm256_set1_ps(value)) {}
+
+		static Lanes8 Load(const float* in) { return Lanes8(_mm256_loadu_ps(in)); }
+		void store(float* out) const { _mm256_storeu_ps(out, v); }
+
+		Lanes8 operator+(Lanes8 other) const { return Lanes8(_mm256_add_ps(v, other.v)); }
+		Lanes8 operator-(Lanes8 other) const { return Lanes8(_mm256_sub_ps(v, other.v)); }
+		Lanes8 operator*(Lanes8 other) const { return Lanes8(_mm256_mul_ps(v, other.v)); }
+	};
+#endif
+
+	// widest lanes first, then one at a time for the tail. kernel(i, Lanes) handles
+	// elements i .. i + WIDTH
+	template<typename Kernel>
+	void ForEachBatch(size_t count, const Kernel& kernel)
+	{
+		size_t i = 0;
+#if VECTORMATH_AVX2
+		for (; i + Lanes8::WIDTH <= count; i += Lanes8::WIDTH)
+			kernel(i, Lanes8(0.0f));
+#elif VECTORMATH_SSE
+		for (; i + Lanes4::WIDTH <= count; i += Lanes4::WIDTH)
+			kernel(i, Lanes4(0.0f));
+#endif
+		for (; i < count; ++i)
+			kernel(i, Lanes1(0.0f));
+	}
+}
+
+Quat Quat::AxisAngle(const Vec3& axis, float radians)
+{
+	float s = std::sin(radians * 0.5f);
+	return Quat(axis.x * s, axis.y * s, axis.z * s, std::cos(radians * 0.5f));
+}
+
+Quat Slerp(const Quat& a, const Quat& b, float t)
+{
+	float cosine = Dot(a, b);
+	Quat to = b;
+	// q and -q are the same rotation, go the short way round
+	if (cosine < 0.0f)
+	{
+		cosine = -cosine;
+		to = Quat(-b.x, -b.y, -b.z, -b.w);
+	}
+
+	float wa, wb;
+	if (cosine > 0.9995f)
+	{
+		wa = 1.0f - t;
+		wb = t;
+	}
+	else
+	{
+		float angle = std::acos(cosine);
+		float s = 1.0f / std::sin(angle);
+		wa = std::sin((1.0f - t) * angle) * s;
+		wb = std::sin(t * angle) * s;
+	}
+	return Normalize(Quat(a.x * wa + to.x * wb, a.y * wa + to.y * wb, a.z * wa + to.z * wb, a.w * wa + to.w * wb));
+}
+
+Mat4 Mat4::Translation(const Vec3& t)
+{
+	Mat4 m;
+	m[3] = Vec4(t, 1.0f);
+	return m;
+}
+
+Mat4 Mat4::Scale(const Vec3& s)
+{
+	Mat4 m;
+	m[0].x = s.x;
+	m[1].y = s.y;
+	m[2].z = s.z;
+	return m;
+}
+
+Mat4 Mat4::Rotation(const Quat& q)
+{
+	return TRS(Vec3(), q, Vec3(1.0f));
+}
+
+Mat4 Mat4::TRS(const Vec3& t, const Quat& r, const Vec3& s)
+{
+	float x2 = r.x + r.x, y2 = r.y + r.y, z2 = r.z + r.z;
+	float xx = r.x * x2, yy = r.y * y2, zz = r.z * z2;
+	float xy = r.x * y2, xz = r.x * z2, yz = r.y * z2;
+	float wx = r.w * x2, wy = r.w * y2, wz = r.w * z2;
+	return Mat4(
+		Vec4(1.0f - (yy + zz), xy + wz, xz - wy, 0.0f) * s.x,
+		Vec4(xy - wz, 1.0f - (xx + zz), yz + wx, 0.0f) * s.y,
+		Vec4(xz + wy, yz - wx, 1.0f - (xx + yy), 0.0f) * s.z,
+		Vec4(t, 1.0f));
+}
+
+Mat4 Mat4::Perspective(float fovY, float aspect, float nearPlane, float farPlane)
+{
+	float focal = 1.0f / std::tan(fovY * 0.5f);
+	float depth = 1.0f / (nearPlane - farPlane);
+	return Mat4(
+		Vec4(focal / aspect, 0.0f, 0.0f, 0.0f),
+		Vec4(0.0f, focal, 0.0f, 0.0f),
+		Vec4(0.0f, 0.0f, (farPlane + nearPlane) * depth, -1.0f),
+		Vec4(0.0f, 0.0f, 2.0f * farPlane * nearPlane * depth, 0.0f));
+}
+
+Mat4 Mat4::Orthographic(float left, float right, float bottom, float top, float nearPlane, float farPlane)
+{
+	float width = 1.0f / (right - left);
+	float height = 1.0f / (top - bottom);
+	float depth = 1.0f / (farPlane - nearPlane);
+	return Mat4(
+		Vec4(2.0f * width, 0.0f, 0.0f, 0.0f),
+		Vec4(0.0f, 2.0f * height, 0.0f, 0.0f),
+		Vec4(0.0f, 0.0f, -2.0f * depth, 0.0f),
+		Vec4(-(right + left) * width, -(top + bottom) * height, -(farPlane + nearPlane) * depth, 1.0f));
+}
+
+Mat4 Mat4::LookAt(const Vec3& eye, const Vec3& center, const Vec3& up)
+{
+#if VECTORMATH_SSE
+	// the basis as rows, transposed into columns; w of each is 0
+	__m128 position = VectorMathSSE::Load(eye);
+	__m128 forward = VectorMathSSE::Normalize(_mm_sub_ps(VectorMathSSE::Load(center), position));
+	__m128 side = VectorMathSSE::Normalize(VectorMathSSE::Cross(forward, VectorMathSSE::Load(up)));
+	__m128 trueUp = VectorMathSSE::Cross(side, forward);
+	__m128 back = _mm_sub_ps(_mm_setzero_ps(), forward);
+	__m128 last = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(side, trueUp, back, last);
+	// -(basis . eye) for each axis, then w = 1
+	__m128 columns[4] = { side, trueUp, back, _mm_setzero_ps() };
+	__m128 translation = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), VectorMathSSE::Transform(columns, position));
+	Mat4 m;
+	_mm_store_ps(&m[0].x, side);
+	_mm_store_ps(&m[1].x, trueUp);
+	_mm_store_ps(&m[2].x, back);
+	_mm_store_ps(&m[3].x, translation);
+	return m;
+#else
+	Vec3 forward = Normalize(center - eye);
+	Vec3 side = Normalize(Cross(forward, up));
+	Vec3 trueUp = Cross(side, forward);
+	return Mat4(
+		Vec4(side.x, trueUp.x, -forward.x, 0.0f),
+		Vec4(side.y, trueUp.y, -forward.y, 0.0f),
+		Vec4(side.z, trueUp.z, -forward.z, 0.0f),
+		Vec4(-Dot(side, eye), -Dot(trueUp, eye), Dot(forward, eye), 1.0f));
+#endif
+}
+
+// blockwise: with M = [A B; C D] in 2x2 blocks the inverse only needs 2x2 products,
+// adjugates and determinants, which fit a register each. the inverse of the transpose
+// is the transpose of the inverse, so it doesn't matter that the blocks are read out of
+// columns rather than rows
+Mat4 Inverse(const Mat4& m)
+{
+#if VECTORMATH_SSE
+	__m128 c0 = VectorMathSSE::Load(m[0]), c1 = VectorMathSSE::Load(m[1]);
+	__m128 c2 = VectorMathSSE::Load(m[2]), c3 = VectorMathSSE::Load(m[3]);
+
+	__m128 a = _mm_movelh_ps(c0, c1);
+	__m128 b = _mm_movehl_ps(c1, c0);
+	__m128 c = _mm_movelh_ps(c2, c3);
+	__m128 d = _mm_movehl_ps(c3, c2);
+
+	// |A| |B| |C| |D|
+	__m128 determinants = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+	__m128 detA = _mm_shuffle_ps(determinants, determinants, _MM_SHUFFLE(0, 0, 0, 0));
+	__m128 detB = _mm_shuffle_ps(determinants, determinants, _MM_SHUFFLE(1, 1, 1, 1));
+	__m128 detC = _mm_shuffle_ps(determinants, determinants, _MM_SHUFFLE(2, 2, 2, 2));
+	__m128 detD = _mm_shuffle_ps(determinants, determinants, _MM_SHUFFLE(3, 3, 3, 3));
+
+	__m128 dc = AdjugateMul2x2(d, c);
+	__m128 ab = AdjugateMul2x2(a, b);
+	// adjugates of the result's blocks, before the 1 / |M|
+	__m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), Mul2x2(b, dc));
+	__m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), Mul2x2(c, ab));
+	__m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), MulAdjugate2x2(d, ab));
+	__m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), MulAdjugate2x2(a, dc));
+
+	// |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+	__m128 trace = VectorMathSSE::HorizontalSum(_mm_mul_ps(ab, _mm_shuffle_ps(dc, dc, _MM_SHUFFLE(3, 1, 2, 0))));
+	__m128 determinant = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+	__m128 reciprocal = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), determinant);
+	x = _mm_mul_ps(x, reciprocal);
+	y = _mm_mul_ps(y, reciprocal);
+	z = _mm_mul_ps(z, reciprocal);
+	w = _mm_mul_ps(w, reciprocal);
+
+	// undo the adjugate shuffle and put the blocks back into columns in one go
+	return Mat4(
+		VectorMathSSE::Store<Vec4>(_mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3))),
+		VectorMathSSE::Store<Vec4>(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2))),
+		VectorMathSSE::Store<Vec4>(_mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3))),
+		VectorMathSSE::Store<Vec4>(_mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2))));
+#else
+	// cofactors from the 2x2 minors of the top and bottom two rows
+	float s[6], c[6];
+	s[0] = m[0].x * m[1].y - m[1].x * m[0].y;
+	s[1] = m[0].x * m[1].z - m[1].x * m[0].z;
+	s[2] = m[0].x * m[1].w - m[1].x * m[0].w;
+	s[3] = m[0].y * m[1].z - m[1].y * m[0].z;
+	s[4] = m[0].y * m[1].w - m[1].y * m[0].w;
+	s[5] = m[0].z * m[1].w - m[1].z * m[0].w;
+	c[0] = m[2].x * m[3].y - m[3].x * m[2].y;
+	c[1] = m[2].x * m[3].z - m[3].x * m[2].z;
+	c[2] = m[2].x * m[3].w - m[3].x * m[2].w;
+	c[3] = m[2].y * m[3].z - m[3].y * m[2].z;
+	c[4] = m[2].y * m[3].w - m[3].y * m[2].w;
+	c[5] = m[2].z * m[3].w - m[3].z * m[2].w;
+
+	float inverse = 1.0f / (s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0]);
+	Mat4 r;
+	r[0].x = (m[1].y * c[5] - m[1].z * c[4] + m[1].w * c[3]) * inverse;
+	r[0].y = (-m[0].y * c[5] + m[0].z * c[4] - m[0].w * c[3]) * inverse;
+	r[0].z = (m[3].y * s[5] - m[3].z * s[4] + m[3].w * s[3]) * inverse;
+	r[0].w = (-m[2].y * s[5] + m[2].z * s[4] - m[2].w * s[3]) * inverse;
+	r[1].x = (-m[1].x * c[5] + m[1].z * c[2] - m[1].w * c[1]) * inverse;
+	r[1].y = (m[0].x * c[5] - m[0].z * c[2] + m[0].w * c[1]) * inverse;
+	r[1].z = (-m[3].x * s[5] + m[3].z * s[2] - m[3].w * s[1]) * inverse;
+	r[1].w = (m[2].x * s[5] - m[2].z * s[2] + m[2].w * s[1]) * inverse;
+	r[2].x = (m[1].x * c[4] - m[1].y * c[2] + m[1].w * c[0]) * inverse;
+	r[2].y = (-m[0].x * c[4] + m[0].y * c[2] - m[0].w * c[0]) * inverse;
+	r[2].z = (m[3].x * s[4] - m[3].y * s[2] + m[3].w * s[0]) * inverse;
+	r[2].w = (-m[2].x * s[4] + m[2].y * s[2] - m[2].w * s[0]) * inverse;
+	r[3].x = (-m[1].x * c[3] + m[1].y * c[1] - m[1].z * c[0]) * inverse;
+	r[3].y = (m[0].x * c[3] - m[0].y * c[1] + m[0].z * c[0]) * inverse;
+	r[3].z = (-m[3].x * s[3] + m[3].y * s[1] - m[3].z * s[0]) * inverse;
+	r[3].w = (m[2].x * s[3] - m[2].y * s[1] + m[2].z * s[0]) * inverse;
+	return r;
+#endif
+}
+
+void TransformPoints(const Mat4& m, const PointArrays& points, const PointArrays& out, size_t count)
+{
+	ForEachBatch(count, [&](size_t i, auto lanes)
+	{
+		typedef decltype(lanes) Lanes;
+		Lanes x = Lanes::Load(points.x + i), y = Lanes::Load(points.y + i), z = Lanes::Load(points.z + i);
+		for (int row = 0; row < 3; ++row)
+		{
+			Lanes result = Lanes(m[0][row]) * x + Lanes(m[1][row]) * y + Lanes(m[2][row]) * z + Lanes(m[3][row]);
+			result.store((row == 0 ? out.x : row == 1 ? out.y : out.z) + i);
+		}
+	});
+}
+
+void TransformBoxes(const Mat4& m, const BoxArrays& boxes, const BoxArrays& out, size_t count)
+{
+	float absolute[3][3];
+	for (int column = 0; column < 3; ++column)
+	{
+		for (int row = 0; row < 3; ++row)
+			absolute[column][row] = std::fabs(m[column][row]);
+	}
+
+	ForEachBatch(count, [&](size_t i, auto lanes)
+	{
+		typedef decltype(lanes) Lanes;
+		Lanes half(0.5f);
+		Lanes minX = Lanes::Load(boxes.minX + i), minY = Lanes::Load(boxes.minY + i), minZ = Lanes::Load(boxes.minZ + i);
+		Lanes maxX = Lanes::Load(boxes.maxX + i), maxY = Lanes::Load(boxes.maxY + i), maxZ = Lanes::Load(boxes.maxZ + i);
+		Lanes centerX = (minX + maxX) * half, centerY = (minY + maxY) * half, centerZ = (minZ + maxZ) * half;
+		Lanes extentX = (maxX - minX) * half, extentY = (maxY - minY) * half, extentZ = (maxZ - minZ) * half;
+
+		float* mins[3] = { out.minX + i, out.minY + i, out.minZ + i };
+		float* maxs[3] = { out.maxX + i, out.maxY + i, out.maxZ + i };
+		for (int row = 0; row < 3; ++row)
+		{
+			Lanes center = Lanes(m[0][row]) * centerX + Lanes(m[1][row]) * centerY + Lanes(m[2][row]) * centerZ + Lanes(m[3][row]);
+			Lanes extent = Lanes(absolute[0][row]) * extentX + Lanes(absolute[1][row]) * extentY + Lanes(absolute[2][row]) * extentZ;
+			(center - extent).store(mins[row]);
+			(center + extent).store(maxs[row]);
+		}
+	});
+}
+
+void TransformPlanes(const Mat4& m, const PlaneArrays& planes, const PlaneArrays& out, size_t count)
+{
+	// a plane is a row vector: p' = p * inverse(m), i.e. transpose(inverse(m)) * p
+	Mat4 inverse = Inverse(m);
+
+	ForEachBatch(count, [&](size_t i, auto lanes)
+	{
+		typedef decltype(lanes) Lanes;
+		Lanes a = Lanes::Load(planes.a + i), b = Lanes::Load(planes.b + i);
+		Lanes c = Lanes::Load(planes.c + i), d = Lanes::Load(planes.d + i);
+		float* outputs[4] = { out.a + i, out.b + i, out.c + i, out.d + i };
+		for (int column = 0; column < 4; ++column)
+		{
+			const Vec4& k = inverse[column];
+			(Lanes(k.x) * a + Lanes(k.y) * b + Lanes(k.z) * c + Lanes(k.w) * d).store(outputs[column]);
+		}
+	});
+}
@@ -0,0 +1,487 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+
+// SSE2 is always there on x64; SSE4.1 and AVX2 only when the compiler was told to use them
+#if defined(__AVX2__)
+#define VECTORMATH_AVX2 1
+#endif
+#if defined(__SSE4_1__) || defined(__AVX__)
+#define VECTORMATH_SSE41 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VECTORMATH_SSE 1
+#endif
+
+#if VECTORMATH_AVX2
+#include <immintrin.h>
+#elif VECTORMATH_SSE41
+#include <smmintrin.h>
+#elif VECTORMATH_SSE
+#include <emmintrin.h>
+#endif
+
+// vectors, quaternions and matrices for the engine, each one SSE register (or four) wide so
+// every operation is a handful of instructions. matrices are column-major with column
+// vectors, like GLSL and glUniformMatrix4fv without transpose; projections are OpenGL's
+// right-handed, -1..1 depth. without SSE everything falls back to plain scalar code.
+// the batched functions at the end work on structure of arrays, 8 elements per
+// instruction with AVX2
+// ---------------------------------------------------------------------------------------
+
+struct alignas(16) Vec3
+{
+	float x, y, z;
+	// pads Vec3 out to a register, always 0
+	float w;
+
+	Vec3() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+	Vec3(float x, float y, float z) : x(x), y(y), z(z), w(0.0f) {}
+	explicit Vec3(float s) : x(s), y(s), z(s), w(0.0f) {}
+
+	float& operator[](int i) { return (&x)[i]; }
+	float operator[](int i) const { return (&x)[i]; }
+};
+
+struct alignas(16) Vec4
+{
+	float x, y, z, w;
+
+	Vec4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+	Vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+	Vec4(const Vec3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+	explicit Vec4(float s) : x(s), y(s), z(s), w(s) {}
+
+	Vec3 xyz() const;
+
+	float& operator[](int i) { return (&x)[i]; }
+	float operator[](int i) const { return (&x)[i]; }
+};
+
+// unit quaternion for rotations, x y z vector part and w scalar part
+struct alignas(16) Quat
+{
+	float x, y, z, w;
+
+	Quat() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
+	Quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+	// counter-clockwise looking down the axis, which has to be unit length
+	static Quat AxisAngle(const Vec3& axis, float radians);
+};
+
+struct alignas(16) Mat4
+{
+	Vec4 columns[4];
+
+	// identity
+	Mat4();
+	Mat4(const Vec4& c0, const Vec4& c1, const Vec4& c2, const Vec4& c3);
+
+	static Mat4 Translation(const Vec3& t);
+	static Mat4 Scale(const Vec3& s);
+	static Mat4 Rotation(const Quat& q);
+	// scale, then rotate, then translate
+	static Mat4 TRS(const Vec3& t, const Quat& r, const Vec3& s);
+
+	static Mat4 Perspective(float fovY, float aspect, float nearPlane, float farPlane);
+	static Mat4 Orthographic(float left, float right, float bottom, float top, float nearPlane, float farPlane);
+	// view matrix looking from eye towards center, up roughly up
+	static Mat4 LookAt(const Vec3& eye, const Vec3& center, const Vec3& up);
+
+	// 16 floats, for glUniformMatrix4fv
+	const float* data() const { return &columns[0].x; }
+
+	Vec4& operator[](int column) { return columns[column]; }
+	const Vec4& operator[](int column) const { return columns[column]; }
+};
+
+#if VECTORMATH_SSE
+namespace VectorMathSSE
+{
+	inline __m128 Load(const Vec3& v) { return _mm_load_ps(&v.x); }
+	inline __m128 Load(const Vec4& v) { return _mm_load_ps(&v.x); }
+	inline __m128 Load(const Quat& q) { return _mm_load_ps(&q.x); }
+
+	template<typename T>
+	inline T Store(__m128 value)
+	{
+		T result;
+		_mm_store_ps(&result.x, value);
+		return result;
+	}
+
+	// the sum of all four lanes in every lane
+	inline __m128 HorizontalSum(__m128 v)
+	{
+		__m128 swapped = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 sums = _mm_add_ps(v, swapped);
+		swapped = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(1, 0, 3, 2));
+		return _mm_add_ps(sums, swapped);
+	}
+
+	inline float Dot4(__m128 a, __m128 b)
+	{
+#if VECTORMATH_SSE41
+		return _mm_cvtss_f32(_mm_dp_ps(a, b, 0xF1));
+#else
+		return _mm_cvtss_f32(HorizontalSum(_mm_mul_ps(a, b)));
+#endif
+	}
+
+	inline __m128 Cross(__m128 a, __m128 b)
+	{
+		__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+		return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+	}
+
+	inline __m128 Normalize(__m128 v)
+	{
+		return _mm_div_ps(v, _mm_sqrt_ps(HorizontalSum(_mm_mul_ps(v, v))));
+	}
+
+	// matrix (four column registers) times a column vector
+	inline __m128 Transform(const __m128* columns, __m128 v)
+	{
+		__m128 result = _mm_mul_ps(columns[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+		result = _mm_add_ps(result, _mm_mul_ps(columns[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+		result = _mm_add_ps(result, _mm_mul_ps(columns[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+		return _mm_add_ps(result, _mm_mul_ps(columns[3], _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+	}
+}
+#endif
+
+inline Vec3 Vec4::xyz() const
+{
+#if VECTORMATH_SSE
+	// one masked copy rather than three scalar writes the next 16 byte load would stall on
+	return VectorMathSSE::Store<Vec3>(_mm_and_ps(VectorMathSSE::Load(*this), _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0))));
+#else
+	return Vec3(x, y, z);
+#endif
+}
+
+// ----- Vec3 -----
+
+inline Vec3 operator+(const Vec3& a, const Vec3& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec3>(_mm_add_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+#endif
+}
+
+inline Vec3 operator-(const Vec3& a, const Vec3& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec3>(_mm_sub_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+#endif
+}
+
+inline Vec3 operator-(const Vec3& v)
+{
+	return Vec3() - v;
+}
+
+// component-wise
+inline Vec3 operator*(const Vec3& a, const Vec3& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec3>(_mm_mul_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec3(a.x * b.x, a.y * b.y, a.z * b.z);
+#endif
+}
+
+inline Vec3 operator*(const Vec3& v, float s)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec3>(_mm_mul_ps(VectorMathSSE::Load(v), _mm_set1_ps(s)));
+#else
+	return Vec3(v.x * s, v.y * s, v.z * s);
+#endif
+}
+
+inline Vec3 operator*(float s, const Vec3& v) { return v * s; }
+inline Vec3 operator/(const Vec3& v, float s) { return v * (1.0f / s); }
+inline Vec3& operator+=(Vec3& a, const Vec3& b) { return a = a + b; }
+inline Vec3& operator-=(Vec3& a, const Vec3& b) { return a = a - b; }
+inline Vec3& operator*=(Vec3& v, float s) { return v = v * s; }
+
+inline float Dot(const Vec3& a, const Vec3& b)
+{
+#if VECTORMATH_SSE
+	// w is 0 on both sides
+	return VectorMathSSE::Dot4(VectorMathSSE::Load(a), VectorMathSSE::Load(b));
+#else
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+#endif
+}
+
+inline Vec3 Cross(const Vec3& a, const Vec3& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec3>(VectorMathSSE::Cross(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+#endif
+}
+
+inline float LengthSquared(const Vec3& v) { return Dot(v, v); }
+inline float Length(const Vec3& v) { return std::sqrt(Dot(v, v)); }
+
+// zero length vectors come back as NaNs
+inline Vec3 Normalize(const Vec3& v) { return v * (1.0f / Length(v)); }
+
+inline Vec3 Min(const Vec3& a, const Vec3& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec3>(_mm_min_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec3(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z);
+#endif
+}
+
+inline Vec3 Max(const Vec3& a, const Vec3& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec3>(_mm_max_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec3(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z);
+#endif
+}
+
+inline Vec3 Lerp(const Vec3& a, const Vec3& b, float t) { return a + (b - a) * t; }
+
+// ----- Vec4 -----
+
+inline Vec4 operator+(const Vec4& a, const Vec4& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec4>(_mm_add_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+#endif
+}
+
+inline Vec4 operator-(const Vec4& a, const Vec4& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec4>(_mm_sub_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+#endif
+}
+
+inline Vec4 operator-(const Vec4& v)
+{
+	return Vec4() - v;
+}
+
+inline Vec4 operator*(const Vec4& a, const Vec4& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec4>(_mm_mul_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w);
+#endif
+}
+
+inline Vec4 operator*(const Vec4& v, float s)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec4>(_mm_mul_ps(VectorMathSSE::Load(v), _mm_set1_ps(s)));
+#else
+	return Vec4(v.x * s, v.y * s, v.z * s, v.w * s);
+#endif
+}
+
+inline Vec4 operator*(float s, const Vec4& v) { return v * s; }
+inline Vec4 operator/(const Vec4& v, float s) { return v * (1.0f / s); }
+inline Vec4& operator+=(Vec4& a, const Vec4& b) { return a = a + b; }
+inline Vec4& operator-=(Vec4& a, const Vec4& b) { return a = a - b; }
+inline Vec4& operator*=(Vec4& v, float s) { return v = v * s; }
+
+inline float Dot(const Vec4& a, const Vec4& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Dot4(VectorMathSSE::Load(a), VectorMathSSE::Load(b));
+#else
+	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+#endif
+}
+
+inline float LengthSquared(const Vec4& v) { return Dot(v, v); }
+inline float Length(const Vec4& v) { return std::sqrt(Dot(v, v)); }
+inline Vec4 Normalize(const Vec4& v) { return v * (1.0f / Length(v)); }
+
+inline Vec4 Min(const Vec4& a, const Vec4& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec4>(_mm_min_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec4(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z, a.w < b.w ? a.w : b.w);
+#endif
+}
+
+inline Vec4 Max(const Vec4& a, const Vec4& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Store<Vec4>(_mm_max_ps(VectorMathSSE::Load(a), VectorMathSSE::Load(b)));
+#else
+	return Vec4(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z, a.w > b.w ? a.w : b.w);
+#endif
+}
+
+inline Vec4 Lerp(const Vec4& a, const Vec4& b, float t) { return a + (b - a) * t; }
+
+// ----- Quat -----
+
+// a * b rotates by b first, then by a
+inline Quat operator*(const Quat& a, const Quat& b)
+{
+	return Quat(
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+inline Quat Conjugate(const Quat& q) { return Quat(-q.x, -q.y, -q.z, q.w); }
+
+inline float Dot(const Quat& a, const Quat& b)
+{
+#if VECTORMATH_SSE
+	return VectorMathSSE::Dot4(VectorMathSSE::Load(a), VectorMathSSE::Load(b));
+#else
+	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+#endif
+}
+
+inline Quat Normalize(const Quat& q)
+{
+	float s = 1.0f / std::sqrt(Dot(q, q));
+	return Quat(q.x * s, q.y * s, q.z * s, q.w * s);
+}
+
+// v + 2w(u x v) + 2u x (u x v), u the vector part
+inline Vec3 Rotate(const Quat& q, const Vec3& v)
+{
+	Vec3 u(q.x, q.y, q.z);
+	Vec3 t = Cross(u, v) * 2.0f;
+	return v + t * q.w + Cross(u, t);
+}
+
+// shortest path, falls back to a normalized lerp when the two are nearly the same
+Quat Slerp(const Quat& a, const Quat& b, float t);
+
+// ----- Mat4 -----
+
+inline Mat4::Mat4()
+	: columns{ Vec4(1.0f, 0.0f, 0.0f, 0.0f), Vec4(0.0f, 1.0f, 0.0f, 0.0f), Vec4(0.0f, 0.0f, 1.0f, 0.0f), Vec4(0.0f, 0.0f, 0.0f, 1.0f) }
+{
+}
+
+inline Mat4::Mat4(const Vec4& c0, const Vec4& c1, const Vec4& c2, const Vec4& c3)
+	: columns{ c0, c1, c2, c3 }
+{
+}
+
+inline Vec4 operator*(const Mat4& m, const Vec4& v)
+{
+#if VECTORMATH_SSE
+	__m128 columns[4] = { VectorMathSSE::Load(m[0]), VectorMathSSE::Load(m[1]), VectorMathSSE::Load(m[2]), VectorMathSSE::Load(m[3]) };
+	return VectorMathSSE::Store<Vec4>(VectorMathSSE::Transform(columns, VectorMathSSE::Load(v)));
+#else
+	return m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3] * v.w;
+#endif
+}
+
+inline Mat4 operator*(const Mat4& a, const Mat4& b)
+{
+	Mat4 result;
+#if VECTORMATH_SSE
+	__m128 columns[4] = { VectorMathSSE::Load(a[0]), VectorMathSSE::Load(a[1]), VectorMathSSE::Load(a[2]), VectorMathSSE::Load(a[3]) };
+	for (int i = 0; i < 4; ++i)
+		_mm_store_ps(&result[i].x, VectorMathSSE::Transform(columns, VectorMathSSE::Load(b[i])));
+#else
+	for (int i = 0; i < 4; ++i)
+		result[i] = a * b[i];
+#endif
+	return result;
+}
+
+inline Mat4& operator*=(Mat4& a, const Mat4& b) { return a = a * b; }
+
+// w = 1
+inline Vec3 TransformPoint(const Mat4& m, const Vec3& p)
+{
+	return (m * Vec4(p, 1.0f)).xyz();
+}
+
+// w = 0, no translation
+inline Vec3 TransformVector(const Mat4& m, const Vec3& v)
+{
+	return (m * Vec4(v, 0.0f)).xyz();
+}
+
+inline Mat4 Transpose(const Mat4& m)
+{
+#if VECTORMATH_SSE
+	__m128 c0 = VectorMathSSE::Load(m[0]), c1 = VectorMathSSE::Load(m[1]);
+	__m128 c2 = VectorMathSSE::Load(m[2]), c3 = VectorMathSSE::Load(m[3]);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	return Mat4(VectorMathSSE::Store<Vec4>(c0), VectorMathSSE::Store<Vec4>(c1),
+		VectorMathSSE::Store<Vec4>(c2), VectorMathSSE::Store<Vec4>(c3));
+#else
+	return Mat4(Vec4(m[0].x, m[1].x, m[2].x, m[3].x), Vec4(m[0].y, m[1].y, m[2].y, m[3].y),
+		Vec4(m[0].z, m[1].z, m[2].z, m[3].z), Vec4(m[0].w, m[1].w, m[2].w, m[3].w));
+#endif
+}
+
+// general inverse; singular matrices come back as infinities and NaNs
+Mat4 Inverse(const Mat4& m);
+
+// ----- batches -----
+
+// structure of arrays views: element i is (x[i], y[i], z[i]) and so on.
+// the output may be the input itself
+struct PointArrays
+{
+	float* x;
+	float* y;
+	float* z;
+};
+
+struct BoxArrays
+{
+	float* minX;
+	float* minY;
+	float* minZ;
+	float* maxX;
+	float* maxY;
+	float* maxZ;
+};
+
+// a * x + b * y + c * z + d = 0, positive on the side the normal points to
+struct PlaneArrays
+{
+	float* a;
+	float* b;
+	float* c;
+	float* d;
+};
+
+void TransformPoints(const Mat4& m, const PointArrays& points, const PointArrays& out, size_t count);
+
+// the axis-aligned box around each transformed box, from its transformed center and the
+// extents pushed through the absolute matrix
+void TransformBoxes(const Mat4& m, const BoxArrays& boxes, const BoxArrays& out, size_t count);
+
+// planes follow the points m moves; the normals aren't renormalized
+void TransformPlanes(const Mat4& m, const PlaneArrays& planes, const PlaneArrays& out, size_t count);
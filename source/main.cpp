@@ -1,6 +1,113 @@
 #include "RenderSystem.h"
-int main(void)
+#include "Benchmarks.h"
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
 {
-	OpenGLPractice();
+	RenderSettings settings;
+	for (int i = 1; i < argc; ++i)
+	{
+		// --headless [frames]: render offscreen without a display and print frame timings
+		if (std::strcmp(argv[i], "--headless") == 0)
+		{
+			settings.headless = true;
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				settings.benchmarkFrames = std::atoi(argv[++i]);
+		}
+		// --sprites count: draw that many instanced sprites on top of the quad
+		else if (std::strcmp(argv[i], "--sprites") == 0)
+		{
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				settings.spriteCount = std::atoi(argv[++i]);
+		}
+		// --meshes count: scatter that many static meshes behind the quad, culled and drawn on the GPU
+		else if (std::strcmp(argv[i], "--meshes") == 0)
+		{
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				settings.meshCount = std::atoi(argv[++i]);
+		}
+		// --bench-jobs [maxWorkers]: job system scaling from 1 to maxWorkers workers
+		else if (std::strcmp(argv[i], "--bench-jobs") == 0)
+		{
+			unsigned int maxWorkers = 0;
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				maxWorkers = (unsigned int)std::atoi(argv[++i]);
+			Benchmarks::JobSystemScaling(maxWorkers);
+			return 0;
+		}
+		// --bench-bc [images...]: block compression speed and quality, assets/textures by default
+		else if (std::strcmp(argv[i], "--bench-bc") == 0)
+		{
+			std::vector<std::string> images(argv + i + 1, argv + argc);
+			Benchmarks::BlockCompression(images);
+			return 0;
+		}
+		// --bench-pack [pack]: decompress every file in the asset pack, ./assets.pack by default
+		else if (std::strcmp(argv[i], "--bench-pack") == 0)
+		{
+			Benchmarks::PackStreaming(i + 1 < argc ? argv[i + 1] : "./assets.pack");
+			return 0;
+		}
+		// --bench-io [file]: random reads through the async file system, ./assets.pack by default
+		else if (std::strcmp(argv[i], "--bench-io") == 0)
+		{
+			Benchmarks::AsyncReads(i + 1 < argc ? argv[i + 1] : "./assets.pack");
+			return 0;
+		}
+		// --bench-ecs [count]: entity iteration over EntityWorld, a million entities by default
+		else if (std::strcmp(argv[i], "--bench-ecs") == 0)
+		{
+			unsigned int count = 1000000;
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				count = (unsigned int)std::atoi(argv[++i]);
+			Benchmarks::EntityIteration(count);
+			return 0;
+		}
+		// --bench-transforms [count]: hierarchy world matrix update, 200k nodes by default
+		else if (std::strcmp(argv[i], "--bench-transforms") == 0)
+		{
+			unsigned int count = 200000;
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				count = (unsigned int)std::atoi(argv[++i]);
+			Benchmarks::TransformUpdate(count);
+			return 0;
+		}
+		// --bench-math: VectorMath against linmath.h
+		else if (std::strcmp(argv[i], "--bench-math") == 0)
+		{
+			Benchmarks::VectorMathSpeed();
+			return 0;
+		}
+		// --bench-cull [count]: frustum culling, 500k objects by default
+		else if (std::strcmp(argv[i], "--bench-cull") == 0)
+		{
+			unsigned int count = 500000;
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				count = (unsigned int)std::atoi(argv[++i]);
+			Benchmarks::FrustumCulling(count);
+			return 0;
+		}
+		// --bench-bvh [count]: bounding volume hierarchy queries, 500k boxes by default
+		else if (std::strcmp(argv[i], "--bench-bvh") == 0)
+		{
+			unsigned int count = 500000;
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				count = (unsigned int)std::atoi(argv[++i]);
+			Benchmarks::BoundingVolumes(count);
+			return 0;
+		}
+		// --bench-occlusion [count]: occlusion culling props in a grid of rooms, 100k by default
+		else if (std::strcmp(argv[i], "--bench-occlusion") == 0)
+		{
+			unsigned int count = 100000;
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				count = (unsigned int)std::atoi(argv[++i]);
+			Benchmarks::OcclusionCulling(count);
+			return 0;
+		}
+	}
+
+	OpenGLPractice(settings);
 	return 0;
 }
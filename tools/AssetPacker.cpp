@@ -0,0 +1,107 @@
+// assetpack: bundles loose asset files into one pack the engine maps at startup
+//
+//   assetpack [-o output] [--chunk KiB | --store] paths...
+//
+// directories are added recursively. names in the pack are the paths as given,
+// normalized, so run it from the directory the engine runs in:
+//
+//   assetpack -o assets.pack assets cache/textures
+//
+// files are compressed in independent 128 KiB chunks (--chunk picks another size, 64-256
+// is the sensible range) so the engine can decompress one file on every core at once.
+// --store keeps everything raw, which lets the engine use files straight from the mapping
+#include "AssetPack.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	void AddPath(const std::string& path, std::vector<std::string>& files)
+	{
+		std::error_code error;
+		if (!std::filesystem::is_directory(path, error))
+		{
+			files.push_back(path);
+			return;
+		}
+
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(path, error))
+		{
+			if (entry.is_regular_file())
+				files.push_back(entry.path().generic_string());
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string output = "assets.pack";
+	uint32_t chunkBytes = AssetPack::DEFAULT_CHUNK_BYTES;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else if (std::strcmp(argv[i], "--store") == 0)
+			chunkBytes = 0;
+		else if (std::strcmp(argv[i], "--chunk") == 0 && i + 1 < argc)
+		{
+			int kib = std::atoi(argv[++i]);
+			if (kib < 4 || kib > 16 * 1024)
+			{
+				std::cout << "ERROR::ASSETPACK::BAD_CHUNK_SIZE " << argv[i] << " (4 to 16384 KiB)" << std::endl;
+				return 1;
+			}
+			chunkBytes = (uint32_t)kib * 1024;
+		}
+		else
+			AddPath(argv[i], files);
+	}
+
+	if (files.empty())
+	{
+		std::cout << "usage: assetpack [-o output] [--chunk KiB | --store] paths..." << std::endl;
+		return 1;
+	}
+
+	// the output may sit inside one of the directories being packed
+	std::string outputName = AssetPack::NormalizeName(output);
+	files.erase(std::remove_if(files.begin(), files.end(), [&](const std::string& file)
+	{
+		std::string name = AssetPack::NormalizeName(file);
+		return name == outputName || name == outputName + ".tmp";
+	}), files.end());
+
+	JobSystem jobs;
+	auto start = std::chrono::steady_clock::now();
+	if (!AssetPack::Write(output, files, chunkBytes, &jobs))
+	{
+		std::cout << "ERROR::ASSETPACK::WRITE_FAILED " << output << std::endl;
+		return 1;
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	AssetPack pack;
+	if (!pack.open(output))
+	{
+		std::cout << "ERROR::ASSETPACK::VERIFY_FAILED " << output << std::endl;
+		return 1;
+	}
+	size_t totalBytes = 0;
+	size_t compressedFiles = 0;
+	for (size_t i = 0; i < pack.fileCount(); ++i)
+	{
+		totalBytes += pack.size(i);
+		compressedFiles += pack.compressed(i) ? 1 : 0;
+	}
+	std::cout << output << ": " << pack.fileCount() << " files (" << compressedFiles << " compressed), "
+		<< totalBytes / 1024 << " KiB -> " << pack.mappedBytes() / 1024 << " KiB in " << (int)ms << " ms" << std::endl;
+	return 0;
+}
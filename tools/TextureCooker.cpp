@@ -0,0 +1,174 @@
+// texcook: converts source images into KTX2 files with a full mip chain, so the
+// engine can upload them without decoding or generating mipmaps at load time
+//
+//   texcook [--box | --kaiser] [--linear] [--format rgba8|bc1|bc3|bc4|bc5|bc7]
+//           [--quality fast|normal|high] [-o outputDir] images...
+//
+// defaults: kaiser filter, sRGB color, RGBA8, normal quality, output in
+// ./cache/textures/<name>.ktx2. bc4 and bc5 hold data rather than color and are always linear
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "MipChain.h"
+#include "TextureFile.h"
+#include "BlockCompression.h"
+#include "JobSystem.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct CookSettings
+	{
+		MipFilter filter = MipFilter::Kaiser;
+		bool srgb = true;
+		TextureFormat format = TextureFormat::RGBA8;
+		CompressionQuality quality = CompressionQuality::Normal;
+		std::string outputDir = "./cache/textures";
+	};
+
+	bool ParseFormat(const char* name, TextureFormat& format)
+	{
+		const char* NAMES[] = { "rgba8", "bc1", "bc3", "bc4", "bc5", "bc7" };
+		const TextureFormat FORMATS[] = { TextureFormat::RGBA8, TextureFormat::BC1, TextureFormat::BC3,
+			TextureFormat::BC4, TextureFormat::BC5, TextureFormat::BC7 };
+		for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); ++i)
+		{
+			if (std::strcmp(name, NAMES[i]) == 0)
+			{
+				format = FORMATS[i];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ParseQuality(const char* name, CompressionQuality& quality)
+	{
+		if (std::strcmp(name, "fast") == 0)
+			quality = CompressionQuality::Fast;
+		else if (std::strcmp(name, "normal") == 0)
+			quality = CompressionQuality::Normal;
+		else if (std::strcmp(name, "high") == 0)
+			quality = CompressionQuality::High;
+		else
+			return false;
+		return true;
+	}
+
+	bool Cook(JobSystem& jobs, const std::string& input, const CookSettings& settings, std::string& output, std::string& summary)
+	{
+		output = (std::filesystem::path(settings.outputDir) / std::filesystem::path(input).stem()).string() + ".ktx2";
+
+		auto start = std::chrono::steady_clock::now();
+		int width = 0, height = 0, channels = 0;
+		unsigned char* pixels = stbi_load(input.c_str(), &width, &height, &channels, 4);
+		if (!pixels)
+		{
+			summary = stbi_failure_reason() ? stbi_failure_reason() : "unknown error";
+			return false;
+		}
+
+		bool srgb = settings.srgb && settings.format != TextureFormat::BC4 && settings.format != TextureFormat::BC5;
+		std::vector<MipLevel> levels;
+		BuildMipChain(pixels, width, height, srgb, settings.filter, levels);
+		stbi_image_free(pixels);
+
+		// levels are compressed in place; the block rows of each one spread over the workers
+		if (settings.format != TextureFormat::RGBA8)
+		{
+			std::vector<uint8_t> blocks;
+			for (MipLevel& level : levels)
+			{
+				CompressImage(&jobs, settings.format, settings.quality, level.pixels.data(), level.width, level.height, blocks);
+				level.pixels.swap(blocks);
+			}
+		}
+
+		if (!KTX2::Write(output, levels, settings.format, srgb))
+		{
+			summary = "couldn't write output";
+			return false;
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		summary = std::to_string(width) + "x" + std::to_string(height) + ", " + std::to_string(levels.size()) +
+			" levels, " + std::to_string((int)ms) + " ms";
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	CookSettings settings;
+	std::vector<std::string> inputs;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--box") == 0)
+			settings.filter = MipFilter::Box;
+		else if (std::strcmp(argv[i], "--kaiser") == 0)
+			settings.filter = MipFilter::Kaiser;
+		else if (std::strcmp(argv[i], "--linear") == 0)
+			settings.srgb = false;
+		else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+		{
+			if (!ParseFormat(argv[++i], settings.format))
+			{
+				std::cout << "ERROR::TEXCOOK::UNKNOWN_FORMAT " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (std::strcmp(argv[i], "--quality") == 0 && i + 1 < argc)
+		{
+			if (!ParseQuality(argv[++i], settings.quality))
+			{
+				std::cout << "ERROR::TEXCOOK::UNKNOWN_QUALITY " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			settings.outputDir = argv[++i];
+		else
+			inputs.push_back(argv[i]);
+	}
+
+	if (inputs.empty())
+	{
+		std::cout << "usage: texcook [--box | --kaiser] [--linear] [--format rgba8|bc1|bc3|bc4|bc5|bc7]"
+			" [--quality fast|normal|high] [-o outputDir] images..." << std::endl;
+		return 1;
+	}
+
+	// one image per job, the mip chain of a single image is cheap next to decoding it.
+	// block compression is not, so Cook also splits each level across the workers
+	JobSystem jobs;
+	std::mutex printLock;
+	std::atomic<int> failures(0);
+	jobs.parallelFor((unsigned int)inputs.size(), 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			std::string output;
+			std::string summary;
+			bool cooked = Cook(jobs, inputs[i], settings, output, summary);
+
+			std::lock_guard<std::mutex> guard(printLock);
+			if (cooked)
+			{
+				std::cout << inputs[i] << " -> " << output << " (" << summary << ")" << std::endl;
+			}
+			else
+			{
+				std::cout << "ERROR::TEXCOOK::FAILED " << inputs[i] << ": " << summary << std::endl;
+				++failures;
+			}
+		}
+	});
+
+	return failures.load() == 0 ? 0 : 1;
+}